@@ -0,0 +1,45 @@
+#include "BenchRunner.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+/*
+ * Counts every heap allocation of the process, so that the benchmarks can
+ * report allocations per iteration next to the time per iteration
+ */
+static std::atomic<int64_t> allocationCount(0);
+
+int64_t getAllocationCount() {
+	return allocationCount.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* memory = malloc(size != 0 ? size : 1);
+	if(memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	free(memory);
+}
+
+BENCHMARK_MAIN();
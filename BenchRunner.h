@@ -0,0 +1,19 @@
+#ifndef BENCHRUNNER_H
+#define BENCHRUNNER_H
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+
+int64_t getAllocationCount();
+
+/*
+ * Reports the heap allocations since allocationsBefore as allocations per
+ * iteration. Take allocationsBefore right before the benchmark loop, so the
+ * setup of the benchmark is not counted.
+ */
+inline void reportAllocations(benchmark::State& state, int64_t allocationsBefore) {
+	state.counters["allocs_per_op"] = benchmark::Counter(getAllocationCount() - allocationsBefore,
+														benchmark::Counter::kAvgIterations);
+}
+
+#endif /* BENCHRUNNER_H */
@@ -0,0 +1,62 @@
+#include "DoIPServer.h"
+#include "DoIPSession.h"
+
+#include<iostream>
+#include<thread>
+
+using namespace std;
+
+static const unsigned short LOGICAL_ADDRESS = 0x28;
+
+/**
+ * Serves one tester connection. The coroutine is suspended while it waits
+ * for the tester, all sessions run on the event loop thread of the server.
+ * @param session       connection of the tester
+ */
+DoIPTask<> serveTester(std::shared_ptr<DoIPSession> session) {
+    cout << "Session opened" << endl;
+
+    while(std::optional<SessionRequest> request = co_await session->nextDiagnostic()) {
+        const unsigned char* data = request->data.data();
+        size_t length = request->data.size();
+
+        if(length > 2 && data[0] == 0x22) {
+            unsigned char responseData[] = { 0x62, data[1], data[2], 0x01, 0x02, 0x03, 0x04};
+            co_await session->send(request->targetAddress, responseData, sizeof(responseData));
+        } else if(length > 0) {
+            unsigned char responseData[] = { 0x7F, data[0], 0x11};
+            co_await session->send(request->targetAddress, responseData, sizeof(responseData));
+        }
+    }
+
+    cout << "Session closed" << endl;
+}
+
+int main() {
+    DoIPServer server;
+    server.setVIN("FOOBAR");
+    server.setLogicalGatewayAddress(LOGICAL_ADDRESS);
+    server.setGID(0);
+    server.setFAR(0);
+    server.setEID(0);
+    server.setGeneralInactivityTime(50000);
+
+    DoIPSessionServer sessions(server, serveTester);
+
+    server.setupUdpSocket();
+    server.setupTcpSocket();
+    if(!server.setupEventLoop()) {
+        return 1;
+    }
+
+    thread udpReceiver([&server]() {
+        while(true) {
+            server.receiveUdpMessage();
+        }
+    });
+    udpReceiver.detach();
+
+    server.scheduleVehicleAnnouncements();
+    server.runEventLoop();
+    return 0;
+}
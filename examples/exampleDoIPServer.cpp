@@ -1,4 +1,5 @@
 #include "DoIPServer.h"
+#include "DoIPMetrics.h"
 
 #include<iostream>
 #include<iomanip>
@@ -8,62 +9,51 @@ using namespace std;
 
 static const unsigned short LOGICAL_ADDRESS = 0x28;
 
+DiagnosticRoutingTable routingTable;
 DoIPServer server;
-unique_ptr<DoIPConnection> connection(nullptr);
 std::vector<std::thread> doipReceiver;
 bool serverActive = false;
 
 /**
- * Is called when the doip library receives a diagnostic message.
- * @param address   logical address of the ecu
- * @param data      message which was received
- * @param length    length of the message
+ * ECU behind the gateway which answers ReadDataByIdentifier requests
  */
-void ReceiveFromLibrary(unsigned short address, unsigned char* data, int length) {
-    cout << "DoIP Message received from 0x" << hex << address << ": ";
-    for(int i = 0; i < length; i++) {
-        cout << hex << setw(2) << (int)data[i] << " ";
+class ExampleEcu : public EcuHandler {
+
+public:
+    /**
+     * Is called when the doip library receives a diagnostic message for this ECU.
+     * The message points into the receive buffer and is only valid during this call.
+     * @param message       user data and addresses of the message
+     * @param route         route back to the tester which sent the message
+     */
+    void handleDiagnosticMessage(const DiagnosticMessageView& message, const TesterRoute& route) override {
+        const unsigned char* data = message.data();
+        int length = message.size();
+
+        cout << "DoIP Message received from 0x" << hex << message.getSourceAddress() << ": ";
+        for(int i = 0; i < length; i++) {
+            cout << hex << setw(2) << (int)data[i] << " ";
+        }
+        cout << endl;
+
+        if(length > 2 && data[0] == 0x22)  {
+            cout << "-> Send diagnostic message positive response" << endl;
+            unsigned char responseData[] = { 0x62, data[1], data[2], 0x01, 0x02, 0x03, 0x04};
+            route.sendResponse(LOGICAL_ADDRESS, responseData, sizeof(responseData));
+        } else if(length > 0) {
+            cout << "-> Send diagnostic message negative response" << endl;
+            unsigned char responseData[] = { 0x7F, data[0], 0x11};
+            route.sendResponse(LOGICAL_ADDRESS, responseData, sizeof(responseData));
+        }
     }
-    cout << endl;
-
-    if(length > 2 && data[0] == 0x22)  {
-        cout << "-> Send diagnostic message positive response" << endl;
-        unsigned char responseData[] = { 0x62, data[1], data[2], 0x01, 0x02, 0x03, 0x04};
-        connection->sendDiagnosticPayload(LOGICAL_ADDRESS, responseData, sizeof(responseData));
-    } else {
-        cout << "-> Send diagnostic message negative response" << endl;
-        unsigned char responseData[] = { 0x7F, data[0], 0x11};
-        connection->sendDiagnosticPayload(LOGICAL_ADDRESS, responseData, sizeof(responseData));
-    }
-
-
-}
+};
 
 /**
- * Will be called when the doip library receives a diagnostic message.
- * The library notifies the application about the message.
- * Checks if there is a ecu with the logical address
- * @param targetAddress     logical address to the ecu
- * @return                  If a positive or negative ACK should be send to the client
+ * Is called when the library closed the connection of a tester
+ * @param connection    connection which was closed
  */
-bool DiagnosticMessageReceived(unsigned short targetAddress) {
-    (void)targetAddress;
-    unsigned char ackCode;
-
-    cout << "Received Diagnostic message" << endl;
-
-    //send positiv ack
-    ackCode = 0x00;
-    cout << "-> Send positive diagnostic message ack" << endl;
-    connection->sendDiagnosticAck(LOGICAL_ADDRESS, true, ackCode);
-
-    return true;
-}
-
-/**
- * Closes the connection of the server by ending the listener threads
- */
-void CloseConnection() {
+void CloseConnection(DoIPConnection& connection) {
+    (void)connection;
     cout << "Connection closed" << endl;
     //serverActive = false;
 }
@@ -79,20 +69,23 @@ void listenUdp() {
 }
 
 /*
- * Check permantly if tcp message was received
+ * Serves all tester connections with the event loop of the server
  */
 void listenTcp() {
 
     server.setupTcpSocket();
+    server.setConnectionCallback(nullptr, nullptr, CloseConnection);
+    server.setRoutingTable(&routingTable);
+    server.setGeneralInactivityTime(50000);
+
+    //DOIP_IO_URING=1 drives the tester connections with io_uring instead of epoll
+    const char* ioUring = getenv("DOIP_IO_URING");
+    if(ioUring != nullptr && string(ioUring) == "1") {
+        server.setTransportBackend(IOURINGBACKEND);
+    }
 
-    while(true) {
-        connection = server.waitForTcpConnection();
-        connection->setCallback(ReceiveFromLibrary, DiagnosticMessageReceived, CloseConnection);
-        connection->setGeneralInactivityTime(50000);
-
-         while(connection->isSocketActive()) {
-             connection->receiveTcpMessage();
-         }
+    if(server.setupEventLoop()) {
+        server.runEventLoop();
     }
 }
 
@@ -104,6 +97,9 @@ void ConfigureDoipServer() {
     server.setFAR(0);
     server.setEID(0);
 
+    //messages to other target addresses are answered with a negative ack
+    routingTable.addEcu(LOGICAL_ADDRESS, std::make_shared<ExampleEcu>());
+
     // doipserver->setA_DoIP_Announce_Num(tempNum);
     // doipserver->setA_DoIP_Announce_Interval(tempInterval);
 
@@ -112,13 +108,16 @@ void ConfigureDoipServer() {
 int main() {
     ConfigureDoipServer();
 
+    //read the metrics with: socat - UNIX-CONNECT:/tmp/doip-metrics.sock
+    DoIPMetrics::instance().startTextEndpoint("/tmp/doip-metrics.sock");
+
     server.setupUdpSocket();
 
     serverActive = true;
     doipReceiver.push_back(thread(&listenUdp));
     doipReceiver.push_back(thread(&listenTcp));
 
-    server.sendVehicleAnnouncement();
+    server.scheduleVehicleAnnouncements();
 
     doipReceiver.at(0).join();
     doipReceiver.at(1).join();
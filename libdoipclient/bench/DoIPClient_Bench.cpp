@@ -0,0 +1,63 @@
+#include "BenchRunner.h"
+#include "DoIPClient_h.h"
+#include "DoIPLogger.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+
+/*
+* Receives diagnostic responses of the given size which a loopback server sends as fast as it can
+*/
+static void BM_ReceiveDiagnosticResponse(benchmark::State& state) {
+	DoIPLogger::instance().setLevel(LogLevel::WARNING);
+	size_t userDataLength = state.range(0);
+
+	int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(listenSocket, (struct sockaddr*)&address, sizeof(address));
+	listen(listenSocket, 1);
+	socklen_t addressLength = sizeof(address);
+	getsockname(listenSocket, (struct sockaddr*)&address, &addressLength);
+
+	std::atomic<bool> sending(true);
+	std::thread server([listenSocket, userDataLength, &sending]() {
+		int connection = accept(listenSocket, nullptr, nullptr);
+		std::vector<unsigned char> userData(userDataLength, 0x55);
+		std::vector<unsigned char> message(_GenericHeaderLength + _DiagnosticMessageMinimumLength + userDataLength);
+		unsigned char testerAddress[2] = {0x0E, 0x00};
+		encodeDiagnosticMessage(message.data(), 0x0001, testerAddress, userData.data(), userData.size());
+		while(sending && send(connection, message.data(), message.size(), MSG_NOSIGNAL) > 0) {
+		}
+		close(connection);
+	});
+
+	DoIPClient client;
+	client.startTcpConnection("127.0.0.1", ntohs(address.sin_port));
+	size_t received = 0;
+	client.setDiagnosticMessageCallback([&received](unsigned short, unsigned char* data, int length) {
+		benchmark::DoNotOptimize(data[length - 1]);
+		received++;
+	});
+
+	//one read may return many messages, they count for the following iterations
+	size_t expected = 0;
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		expected++;
+		while(received < expected) {
+			client.receiveMessage();
+		}
+	}
+	reportAllocations(state, allocations);
+	state.SetBytesProcessed(state.iterations() * userDataLength);
+
+	sending = false;
+	client.closeTcpConnection();
+	server.join();
+	close(listenSocket);
+}
+BENCHMARK(BM_ReceiveDiagnosticResponse)->RangeMultiplier(16)->Range(64, 1 << 20)->UseRealTime();
@@ -0,0 +1,162 @@
+#ifndef DOIPASYNCCLIENT_H
+#define DOIPASYNCCLIENT_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "DoIPClient_h.h"
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+const uint32_t _DiagnosticAckTimeoutMs = 2000;      //A_DoIP_Diagnostic_Message
+const uint32_t _DefaultResponseTimeoutMs = 1000;    //P2 client
+const uint32_t _DefaultPendingTimeoutMs = 5000;     //P2* client
+const int _RoutingActivationTimeoutMs = 2000;
+const unsigned _ClientUringBuffers = 16;     //receive buffers of _ClientReceiveChunkSize for the io_uring receive thread
+
+const unsigned char _NegativeResponseServiceId = 0x7F;
+const unsigned char _ResponsePendingCode = 0x78;
+
+/*
+ * How a diagnostic request ended
+ */
+enum DiagnosticRequestStatus {
+    RESPONSERECEIVED,       //the ecu sent its final response
+    REQUESTREJECTED,        //the gateway answered with a negative diagnostic message ack
+    ACKTIMEOUT,             //the gateway did not acknowledge the request in time
+    RESPONSETIMEOUT,        //the ecu did not respond within P2 or P2* after a response pending
+    CONNECTIONCLOSED,       //the connection was closed before the request was completed
+    SENDFAILED,             //the request could not be sent
+};
+
+/**
+ * Result of an asynchronous diagnostic request
+ */
+struct DiagnosticResponse {
+    DiagnosticRequestStatus status = CONNECTIONCLOSED;
+    unsigned short sourceAddress = 0;       //logical address of the responding ecu
+    unsigned char ackCode = 0;              //code of the diagnostic message ack
+    int pendingResponses = 0;               //number of response pending messages before the final response
+    std::vector<unsigned char> data;        //final UDS response
+};
+
+using DiagnosticCompletion = std::function<void(const DiagnosticResponse& response)>;
+
+class DoIPAsyncClient;
+
+#ifdef __cpp_impl_coroutine
+/**
+ * Awaitable diagnostic request, see DoIPAsyncClient::request(). The
+ * awaiting coroutine continues on the receive thread of the client.
+ */
+class DiagnosticRequestAwaiter {
+
+public:
+    DiagnosticRequestAwaiter(DoIPAsyncClient& client, unsigned short targetAddress, const unsigned char* data, int length):
+        client(client), targetAddress(targetAddress), data(data), length(length) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> awaiting);
+    DiagnosticResponse await_resume() { return std::move(response); }
+
+private:
+    DoIPAsyncClient& client;
+    unsigned short targetAddress;
+    const unsigned char* data;
+    int length;
+    DiagnosticResponse response;
+};
+#endif
+
+/**
+ * Diagnostic client which sends requests without waiting for their responses.
+ * Every request is completed through a future or a completion callback. Any
+ * number of requests can be in flight on one connection, requests to the same
+ * ecu are answered in order, so acks and responses are correlated by the
+ * address of the ecu. Response pending messages (NRC 0x78) extend the timeout
+ * of a request to P2*. One receive thread reads all messages and expires the
+ * timeouts, completion callbacks are invoked on this thread and must not block.
+ * The receive thread can wait with io_uring instead of poll(), then the data
+ * is received by a multishot request into buffers of the ring.
+ */
+class DoIPAsyncClient {
+
+public:
+    DoIPAsyncClient();
+    ~DoIPAsyncClient();
+
+    DoIPAsyncClient(const DoIPAsyncClient&) = delete;
+    DoIPAsyncClient& operator=(const DoIPAsyncClient&) = delete;
+
+    bool connect(const char* address, unsigned short sourceAddress, int port = _serverPortNr);
+    void close();
+    bool isConnected() const { return running; };
+
+    std::future<DiagnosticResponse> sendDiagnosticRequest(unsigned short targetAddress, const unsigned char* data, int length);
+    void sendDiagnosticRequest(unsigned short targetAddress, const unsigned char* data, int length, DiagnosticCompletion completion);
+#ifdef __cpp_impl_coroutine
+    //co_await client.request(...) suspends the coroutine until the request is completed
+    DiagnosticRequestAwaiter request(unsigned short targetAddress, const unsigned char* data, int length) {
+        return DiagnosticRequestAwaiter(*this, targetAddress, data, length);
+    }
+#endif
+
+    void setResponseTimeouts(uint32_t responseTimeoutMs, uint32_t pendingTimeoutMs);
+    //takes effect with the next connect(), poll() is used if io_uring is not supported
+    void setUseIoUring(bool enabled) { useIoUring = enabled; };
+    size_t getPendingRequestCount();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct PendingRequest {
+        DiagnosticResponse response;
+        DiagnosticCompletion completion;
+        Clock::time_point deadline;
+        bool acknowledged = false;
+    };
+
+    DoIPClient client;
+    std::thread receiver;
+    std::atomic<bool> running;
+    int wakeupFd = -1;
+    bool useIoUring = false;
+
+    std::mutex sendMutex;       //keeps the order of the pending requests equal to the send order
+    std::mutex requestMutex;
+    std::unordered_map<unsigned short, std::deque<PendingRequest>> pendingRequests;
+    Clock::time_point nextDeadline = Clock::time_point::max();
+
+    uint32_t responseTimeoutMs = _DefaultResponseTimeoutMs;
+    uint32_t pendingTimeoutMs = _DefaultPendingTimeoutMs;
+
+    void receiveMessages();
+    bool receiveMessagesUring();
+    int millisecondsUntilNextDeadline();
+    void completeExpiredRequests();
+    void handleDiagnosticAck(unsigned short sourceAddress, bool ackType, unsigned char ackCode);
+    void handleDiagnosticMessage(unsigned short sourceAddress, unsigned char* data, int length);
+    void expireRequests(std::vector<PendingRequest>& completed);
+    void completeAll(DiagnosticRequestStatus status);
+    void updateNextDeadline();
+    void wakeupReceiver();
+};
+
+#ifdef __cpp_impl_coroutine
+inline void DiagnosticRequestAwaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    //the completion may resume the coroutine on the receive thread before this call returns,
+    //so the awaiter must not be touched afterwards
+    client.sendDiagnosticRequest(targetAddress, data, length, [this, awaiting](const DiagnosticResponse& completed) {
+        response = completed;
+        awaiting.resume();
+    });
+}
+#endif
+
+#endif /* DOIPASYNCCLIENT_H */
@@ -2,47 +2,67 @@
 #ifndef DOIPCLIENT_H
 #define DOIPCLIENT_H
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <iostream>
 #include <unistd.h>
 #include <cstddef>
 #include <stdlib.h>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <mutex>
 
 #include "DiagnosticMessageHandler.h"
 #include "DoIPGenericHeaderHandler.h"
+#include "DoIPFrameDecoder.h"
+#include "ScatterGatherSend.h"
 
 const int _serverPortNr=13400;
 const int _maxDataSize=64;
+const size_t _ClientReceiveChunkSize=65536;
+const int _RoutingActivationRequestLength=15;
+const int _RoutingActivationSuccessCode=0x10;
+
+using DiagnosticAckCallback = std::function<void(unsigned short sourceAddress, bool ackType, unsigned char ackCode)>;
 
 
 class DoIPClient{
     
 public:
     void startTcpConnection();   
+    void startTcpConnection(const char* address, int port = _serverPortNr);
     void startUdpConnection();
     void sendRoutingActivationRequest();
     void sendVehicleIdentificationRequest(const char* address);
-    void receiveRoutingActivationResponse();
+    int receiveRoutingActivationResponse();
     void receiveUdpMessage();
-    void receiveMessage();
+    int receiveMessage();
+    int processReceivedData(unsigned char* data, size_t length);
     void sendDiagnosticMessage(unsigned char* targetAddress, unsigned char* userData, int userDataLength);
+    int sendDiagnosticMessage(unsigned char* targetAddress, const struct iovec* userData, int count);
     void sendAliveCheckResponse();
     void setSourceAddress(unsigned char* address);
+    void setDiagnosticMessageCallback(DiagnosticCallback dc) { diag_callback = dc; };
+    void setDiagnosticViewCallback(DiagnosticViewCallback dvc) { diag_view_callback = dvc; };
+    void setDiagnosticAckCallback(DiagnosticAckCallback dac) { diag_ack_callback = dac; };
     void displayVIResponseInformation();
     void closeTcpConnection();
     void closeUdpConnection();
     void reconnectServer();
+    void setMaxPayloadLength(unsigned long length) { frameDecoder.setMaxPayloadLength(length); };
+    void setBufferPool(BufferPool& pool);
 
     int getSockFd();
     int getConnected();
     
 private:
     unsigned char _receivedData[_maxDataSize];
-    int _sockFd, _sockFd_udp, _connected;
+    int _sockFd = -1, _sockFd_udp = -1, _connected = -1;
     int broadcast = 1;
     struct sockaddr_in _serverAddr, _clientAddr; 
-    unsigned char sourceAddress [2];
+    unsigned char sourceAddress [2] = {0x0E, 0x00};
+    int routingActivationCode = -1;
     
     unsigned char VINResult [17];
     unsigned char LogicalAddressResult [2];
@@ -50,9 +70,21 @@ private:
     unsigned char GIDResult [6];
     unsigned char FurtherActionReqResult;
     
-    const std::pair<int, unsigned char*>* buildRoutingActivationRequest();
-    const std::pair<int, unsigned char*>* buildVehicleIdentificationRequest();
+    //a message is written with several calls, the alive check response of the
+    //receive thread must not be written between them
+    std::mutex sendMutex;
+    std::vector<struct iovec> sendVectorList;
+    BufferPool* bufferPool = &BufferPool::defaultPool();
+    DoIPFrameDecoder frameDecoder;
+    std::vector<unsigned char> receiveChunk = std::vector<unsigned char>(_ClientReceiveChunkSize);
+    DiagnosticCallback diag_callback;
+    DiagnosticViewCallback diag_view_callback;
+    DiagnosticAckCallback diag_ack_callback;
+
+    int buildRoutingActivationRequest(unsigned char* rareq);
+    int buildVehicleIdentificationRequest(unsigned char* rareq);
     void parseVIResponseInformation(unsigned char* data);
+    bool processReceivedFrame(const DoIPFrame& frame);
     
     int emptyMessageCounter = 0;
 };
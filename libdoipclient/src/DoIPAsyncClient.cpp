@@ -0,0 +1,431 @@
+#include "DoIPAsyncClient.h"
+#include "DoIPLogger.h"
+#include "IoUring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <memory>
+
+DoIPAsyncClient::DoIPAsyncClient(): running(false) {
+    client.setDiagnosticAckCallback(std::bind(&DoIPAsyncClient::handleDiagnosticAck, this,
+                                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    client.setDiagnosticMessageCallback(std::bind(&DoIPAsyncClient::handleDiagnosticMessage, this,
+                                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+DoIPAsyncClient::~DoIPAsyncClient() {
+    close();
+}
+
+/**
+ * Connects to the server, activates routing and starts the receive thread
+ * @param address           IPv4 address of the server
+ * @param sourceAddress     logical address of this tester
+ * @param port              TCP port of the server
+ * @return                  true if routing was activated
+ */
+bool DoIPAsyncClient::connect(const char* address, unsigned short sourceAddress, int port) {
+    if(running) {
+        return false;
+    }
+    //releases the thread and socket of a connection which was closed by the server
+    close();
+
+    unsigned char testerAddress[2] = { (unsigned char)(sourceAddress >> 8), (unsigned char)(sourceAddress & 0xFF) };
+    client.setSourceAddress(testerAddress);
+    client.startTcpConnection(address, port);
+
+    struct timeval timeout = { _RoutingActivationTimeoutMs / 1000, (_RoutingActivationTimeoutMs % 1000) * 1000 };
+    setsockopt(client.getSockFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    client.sendRoutingActivationRequest();
+    int responseCode = client.receiveRoutingActivationResponse();
+    if(responseCode != _RoutingActivationSuccessCode) {
+        DOIP_LOG_ERROR("Routing activation failed with code %d", responseCode);
+        client.closeTcpConnection();
+        return false;
+    }
+
+    //the receive thread waits in poll(), so the socket itself needs no timeout anymore
+    timeout = { 0, 0 };
+    setsockopt(client.getSockFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    running = true;
+    receiver = std::thread(&DoIPAsyncClient::receiveMessages, this);
+    return true;
+}
+
+/**
+ * Closes the connection, requests which are still pending are completed with
+ * CONNECTIONCLOSED. May be called from a completion callback, but not from
+ * several threads at the same time.
+ */
+void DoIPAsyncClient::close() {
+    running = false;
+    if(receiver.joinable() && receiver.get_id() != std::this_thread::get_id()) {
+        wakeupReceiver();
+        receiver.join();
+    }
+
+    std::lock_guard<std::mutex> sendLock(sendMutex);
+    if(wakeupFd < 0) {
+        return;
+    }
+    client.closeTcpConnection();
+    ::close(wakeupFd);
+    wakeupFd = -1;
+    completeAll(CONNECTIONCLOSED);
+}
+
+/**
+ * Sends a diagnostic request without waiting for the response
+ * @param targetAddress     logical address of the ecu
+ * @param data              UDS request
+ * @param length            length of the request
+ * @return                  future which becomes ready when the request is completed
+ */
+std::future<DiagnosticResponse> DoIPAsyncClient::sendDiagnosticRequest(unsigned short targetAddress,
+                                                                    const unsigned char* data, int length) {
+    std::shared_ptr<std::promise<DiagnosticResponse>> promise = std::make_shared<std::promise<DiagnosticResponse>>();
+    std::future<DiagnosticResponse> future = promise->get_future();
+    sendDiagnosticRequest(targetAddress, data, length, [promise](const DiagnosticResponse& response) {
+        promise->set_value(response);
+    });
+    return future;
+}
+
+/**
+ * Sends a diagnostic request without waiting for the response
+ * @param targetAddress     logical address of the ecu
+ * @param data              UDS request
+ * @param length            length of the request
+ * @param completion        is called once with the result, on the receive thread
+ *                          or on the calling thread if the request could not be sent
+ */
+void DoIPAsyncClient::sendDiagnosticRequest(unsigned short targetAddress, const unsigned char* data, int length,
+                                            DiagnosticCompletion completion) {
+    std::unique_lock<std::mutex> sendLock(sendMutex);
+    PendingRequest request;
+    request.response.sourceAddress = targetAddress;
+    request.completion = completion;
+
+    if(!running) {
+        sendLock.unlock();
+        request.response.status = CONNECTIONCLOSED;
+        completion(request.response);
+        return;
+    }
+
+    bool earlierDeadline = false;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        request.deadline = Clock::now() + std::chrono::milliseconds(_DiagnosticAckTimeoutMs);
+        earlierDeadline = request.deadline < nextDeadline;
+        pendingRequests[targetAddress].push_back(std::move(request));
+        if(earlierDeadline) {
+            nextDeadline = pendingRequests[targetAddress].back().deadline;
+        }
+    }
+    if(earlierDeadline) {
+        wakeupReceiver();
+    }
+
+    unsigned char ecuAddress[2] = { (unsigned char)(targetAddress >> 8), (unsigned char)(targetAddress & 0xFF) };
+    struct iovec userData = { const_cast<unsigned char*>(data), (size_t)length };
+    if(client.sendDiagnosticMessage(ecuAddress, &userData, 1) == (int)(_GenericHeaderLength + _DiagnosticMessageMinimumLength + length)) {
+        return;
+    }
+
+    //the request was registered last, so it is still at the end of the queue unless it expired meanwhile
+    PendingRequest failed;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        std::deque<PendingRequest>& queue = pendingRequests[targetAddress];
+        if(queue.empty() || queue.back().acknowledged) {
+            return;
+        }
+        failed = std::move(queue.back());
+        queue.pop_back();
+    }
+    sendLock.unlock();
+    failed.response.status = SENDFAILED;
+    failed.completion(failed.response);
+}
+
+/**
+ * Sets the time an ecu has for its response after the ack (P2) and after a
+ * response pending message (P2*). Applies to requests which are sent afterwards.
+ */
+void DoIPAsyncClient::setResponseTimeouts(uint32_t responseTimeout, uint32_t pendingTimeout) {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    responseTimeoutMs = responseTimeout;
+    pendingTimeoutMs = pendingTimeout;
+}
+
+/**
+ * Returns the number of requests which are not completed yet
+ */
+size_t DoIPAsyncClient::getPendingRequestCount() {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    size_t count = 0;
+    for(auto& entry : pendingRequests) {
+        count += entry.second.size();
+    }
+    return count;
+}
+
+/*
+ * Receive thread: reads messages until the connection is closed and
+ * completes requests whose timeout expired
+ */
+void DoIPAsyncClient::receiveMessages() {
+    if(useIoUring && IoUring::isSupported() && receiveMessagesUring()) {
+        running = false;
+        completeAll(CONNECTIONCLOSED);
+        return;
+    }
+
+    struct pollfd pollList[2];
+    pollList[0].fd = client.getSockFd();
+    pollList[0].events = POLLIN;
+    pollList[1].fd = wakeupFd;
+    pollList[1].events = POLLIN;
+
+    while(running) {
+        int result = poll(pollList, 2, millisecondsUntilNextDeadline());
+        if(result < 0 && errno != EINTR) {
+            break;
+        }
+
+        if(result > 0 && pollList[1].revents != 0) {
+            uint64_t wakeups;
+            ssize_t ignored = read(wakeupFd, &wakeups, sizeof(wakeups));
+            (void)ignored;
+        }
+
+        if(result > 0 && pollList[0].revents != 0) {
+            int readBytes = client.receiveMessage();
+            if(readBytes == 0 || (readBytes < 0 && errno != EAGAIN && errno != EINTR)) {
+                DOIP_LOG_WARNING("Connection to the server was closed");
+                break;
+            }
+        }
+
+        completeExpiredRequests();
+    }
+
+    running = false;
+    completeAll(CONNECTIONCLOSED);
+}
+
+/*
+ * Receive loop of the io_uring receive thread. One multishot receive reads
+ * the socket and a multishot poll watches the wakeup descriptor, the wait
+ * for their completions is limited by the next deadline.
+ * @return      false if the ring could not be set up, poll() is used then
+ */
+bool DoIPAsyncClient::receiveMessagesUring() {
+    const uint64_t receiveRequest = 1;
+    const uint64_t wakeupRequest = 2;
+    const uint16_t bufferGroup = 0;
+
+    IoUring ring;
+    if(!ring.setup(8, 4 * _ClientUringBuffers) || !ring.setupBufferRing(bufferGroup, _ClientUringBuffers, _ClientReceiveChunkSize)) {
+        return false;
+    }
+    IoUring::prepareMultishotReceive(ring.getSubmission(), client.getSockFd(), bufferGroup, receiveRequest);
+    IoUring::prepareMultishotPoll(ring.getSubmission(), wakeupFd, POLLIN, wakeupRequest);
+
+    bool closed = false;
+    while(running && !closed) {
+        if(ring.submitAndWait(1, millisecondsUntilNextDeadline()) < 0) {
+            break;
+        }
+
+        struct io_uring_cqe* completion;
+        while((completion = ring.peekCompletion()) != nullptr) {
+            struct io_uring_cqe seen = *completion;
+            ring.completionSeen();
+            bool more = seen.flags & IORING_CQE_F_MORE;
+
+            if(seen.user_data == wakeupRequest) {
+                uint64_t wakeups;
+                ssize_t ignored = read(wakeupFd, &wakeups, sizeof(wakeups));
+                (void)ignored;
+                if(!more) {
+                    IoUring::prepareMultishotPoll(ring.getSubmission(), wakeupFd, POLLIN, wakeupRequest);
+                }
+                continue;
+            }
+
+            if(seen.res <= 0 && seen.res != -ENOBUFS) {
+                DOIP_LOG_WARNING("Connection to the server was closed");
+                closed = true;
+                continue;
+            }
+            if(seen.res > 0) {
+                uint16_t bufferId = seen.flags >> IORING_CQE_BUFFER_SHIFT;
+                client.processReceivedData(ring.getBuffer(bufferId), seen.res);
+                ring.recycleBuffer(bufferId);
+            }
+            //the kernel ends a multishot receive e.g. when it ran out of buffers
+            if(!more) {
+                IoUring::prepareMultishotReceive(ring.getSubmission(), client.getSockFd(), bufferGroup, receiveRequest);
+            }
+        }
+
+        completeExpiredRequests();
+    }
+    return true;
+}
+
+/*
+ * Returns how long the receive thread may wait till the next request expires, -1 if none is pending
+ */
+int DoIPAsyncClient::millisecondsUntilNextDeadline() {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    if(nextDeadline == Clock::time_point::max()) {
+        return -1;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(nextDeadline - Clock::now());
+    return std::max(0, (int)remaining.count() + 1);
+}
+
+void DoIPAsyncClient::completeExpiredRequests() {
+    std::vector<PendingRequest> completed;
+    expireRequests(completed);
+    for(PendingRequest& request : completed) {
+        request.completion(request.response);
+    }
+}
+
+/*
+ * Acks refer to the oldest request to the ecu which was not acknowledged yet
+ */
+void DoIPAsyncClient::handleDiagnosticAck(unsigned short sourceAddress, bool ackType, unsigned char ackCode) {
+    PendingRequest rejected;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        std::deque<PendingRequest>& queue = pendingRequests[sourceAddress];
+        auto request = std::find_if(queue.begin(), queue.end(), [](const PendingRequest& pending) { return !pending.acknowledged; });
+        if(request == queue.end()) {
+            DOIP_LOG_WARNING("Unexpected diagnostic message ack from 0x%04X", sourceAddress);
+            return;
+        }
+
+        request->response.ackCode = ackCode;
+        if(ackType) {
+            request->acknowledged = true;
+            request->deadline = Clock::now() + std::chrono::milliseconds(responseTimeoutMs);
+            updateNextDeadline();
+            return;
+        }
+
+        rejected = std::move(*request);
+        queue.erase(request);
+        updateNextDeadline();
+    }
+    rejected.response.status = REQUESTREJECTED;
+    rejected.completion(rejected.response);
+}
+
+/*
+ * Responses refer to the oldest acknowledged request to the ecu
+ */
+void DoIPAsyncClient::handleDiagnosticMessage(unsigned short sourceAddress, unsigned char* data, int length) {
+    PendingRequest answered;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        std::deque<PendingRequest>& queue = pendingRequests[sourceAddress];
+        if(queue.empty()) {
+            DOIP_LOG_WARNING("Unexpected diagnostic message from 0x%04X", sourceAddress);
+            return;
+        }
+
+        //the response may overtake the ack, the response implies that the request was accepted
+        PendingRequest& request = queue.front();
+        if(length >= 3 && data[0] == _NegativeResponseServiceId && data[2] == _ResponsePendingCode) {
+            request.acknowledged = true;
+            request.response.pendingResponses++;
+            request.deadline = Clock::now() + std::chrono::milliseconds(pendingTimeoutMs);
+            updateNextDeadline();
+            return;
+        }
+
+        answered = std::move(request);
+        queue.pop_front();
+        updateNextDeadline();
+    }
+    answered.response.status = RESPONSERECEIVED;
+    answered.response.data.assign(data, data + length);
+    answered.completion(answered.response);
+}
+
+/*
+ * Removes all requests whose deadline passed
+ */
+void DoIPAsyncClient::expireRequests(std::vector<PendingRequest>& completed) {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    Clock::time_point now = Clock::now();
+    if(nextDeadline > now) {
+        return;
+    }
+
+    for(auto& entry : pendingRequests) {
+        std::deque<PendingRequest>& queue = entry.second;
+        for(auto request = queue.begin(); request != queue.end();) {
+            if(request->deadline > now) {
+                ++request;
+                continue;
+            }
+            request->response.status = request->acknowledged ? RESPONSETIMEOUT : ACKTIMEOUT;
+            completed.push_back(std::move(*request));
+            request = queue.erase(request);
+        }
+    }
+    updateNextDeadline();
+}
+
+/*
+ * Completes every pending request with the given status
+ */
+void DoIPAsyncClient::completeAll(DiagnosticRequestStatus status) {
+    std::vector<PendingRequest> completed;
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        for(auto& entry : pendingRequests) {
+            for(PendingRequest& request : entry.second) {
+                completed.push_back(std::move(request));
+            }
+        }
+        pendingRequests.clear();
+        nextDeadline = Clock::time_point::max();
+    }
+
+    for(PendingRequest& request : completed) {
+        request.response.status = status;
+        request.completion(request.response);
+    }
+}
+
+/*
+ * Recomputes the earliest deadline, requestMutex has to be locked
+ */
+void DoIPAsyncClient::updateNextDeadline() {
+    nextDeadline = Clock::time_point::max();
+    for(auto& entry : pendingRequests) {
+        for(PendingRequest& request : entry.second) {
+            nextDeadline = std::min(nextDeadline, request.deadline);
+        }
+    }
+}
+
+void DoIPAsyncClient::wakeupReceiver() {
+    if(wakeupFd < 0) {
+        return;
+    }
+    uint64_t wakeup = 1;
+    ssize_t ignored = write(wakeupFd, &wakeup, sizeof(wakeup));
+    (void)ignored;
+}
@@ -1,29 +1,45 @@
 #include "DoIPClient_h.h"
+#include "DoIPLogger.h"
 
 /*
  *Set up the connection between client and server
  */
 void DoIPClient::startTcpConnection() {
+    startTcpConnection("127.0.0.1");
+}
+
+/*
+ * Set up the connection to a server, retries until the server accepts the connection
+ * @param address   IPv4 address of the server
+ * @param port      TCP port of the server
+ */
+void DoIPClient::startTcpConnection(const char* address, int port) {
 
-    const char* ipAddr = "127.0.0.1";
     bool connectedFlag = false;
     _sockFd = socket(AF_INET,SOCK_STREAM,0);   
     
     if(_sockFd>=0)
     {
-        std::cout << "Client TCP-Socket created successfully" << std::endl;
+        DOIP_LOG_DEBUG("Client TCP-Socket created successfully");
 
         _serverAddr.sin_family = AF_INET;
-        _serverAddr.sin_port = htons(_serverPortNr);
-        inet_aton(ipAddr,&(_serverAddr.sin_addr)); 
+        _serverAddr.sin_port = htons(port);
+        if(inet_aton(address,&(_serverAddr.sin_addr)) == 0)
+        {
+            DOIP_LOG_ERROR("Invalid server address %s", address);
+            return;
+        }
         
         while(!connectedFlag)
         {
             _connected = connect(_sockFd,(struct sockaddr *) &_serverAddr,sizeof(_serverAddr));
             if(_connected!=-1)
             {
+                //requests are sent right away instead of being collected by Nagle's algorithm
+                int noDelay = 1;
+                setsockopt(_sockFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
                 connectedFlag = true;
-                std::cout << "Connection to server established" << std::endl;
+                DOIP_LOG_INFO("Connection to server established");
             }
         }  
     }   
@@ -35,7 +51,7 @@ void DoIPClient::startUdpConnection(){
     
     if(_sockFd_udp >= 0)
     {
-        std::cout << "Client-UDP-Socket created successfully" << std::endl;
+        DOIP_LOG_DEBUG("Client-UDP-Socket created successfully");
         
         _serverAddr.sin_family = AF_INET;
         _serverAddr.sin_port = htons(_serverPortNr);
@@ -51,14 +67,25 @@ void DoIPClient::startUdpConnection(){
 }
 
 /*
- * closes the client-socket
+ * closes the client-socket, it must not be called while another thread receives
  */
 void DoIPClient::closeTcpConnection(){  
-    close(_sockFd); 
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if(_sockFd >= 0) {
+            close(_sockFd);
+            _sockFd = -1;
+        }
+    }
+    frameDecoder.reset();
+    routingActivationCode = -1;
 }
 
 void DoIPClient::closeUdpConnection(){
-    close(_sockFd_udp);
+    if(_sockFd_udp >= 0) {
+        close(_sockFd_udp);
+        _sockFd_udp = -1;
+    }
 }
 
 void DoIPClient::reconnectServer(){
@@ -68,12 +95,12 @@ void DoIPClient::reconnectServer(){
 
 /*
  *Build the Routing-Activation-Request for server
+ * @param rareq     buffer with space for _RoutingActivationRequestLength bytes
+ * @return          length of the request
  */
-const std::pair<int,unsigned char*>* DoIPClient::buildRoutingActivationRequest() {
+int DoIPClient::buildRoutingActivationRequest(unsigned char* rareq) {
     
-   std::pair <int,unsigned char*>* rareqWithLength= new std::pair<int,unsigned char*>();
-   int rareqLength=15;
-   unsigned char * rareq= new unsigned char[rareqLength];
+   int rareqLength=_RoutingActivationRequestLength;
   
    //Generic Header
    rareq[0]=0x02;  //Protocol Version
@@ -86,18 +113,15 @@ const std::pair<int,unsigned char*>* DoIPClient::buildRoutingActivationRequest()
    rareq[7]=0x07;
    
    //Payload-Type specific message-content
-   rareq[8]=0x0E;  //Source Address
-   rareq[9]=0x00;
+   rareq[8]=sourceAddress[0];  //Source Address
+   rareq[9]=sourceAddress[1];
    rareq[10]=0x00; //Activation-Type
    rareq[11]=0x00; //Reserved ISO(default)
    rareq[12]=0x00;
    rareq[13]=0x00;
    rareq[14]=0x00;
-   
-   rareqWithLength->first=rareqLength;
-   rareqWithLength->second=rareq;
   
-   return rareqWithLength;
+   return rareqLength;
 }
 
 /*
@@ -105,8 +129,10 @@ const std::pair<int,unsigned char*>* DoIPClient::buildRoutingActivationRequest()
  */
 void DoIPClient::sendRoutingActivationRequest() {
         
-    const std::pair <int,unsigned char*>* rareqWithLength=buildRoutingActivationRequest();
-    write(_sockFd,rareqWithLength->second,rareqWithLength->first);    
+    unsigned char rareq[_RoutingActivationRequestLength];
+    int rareqLength=buildRoutingActivationRequest(rareq);
+    std::lock_guard<std::mutex> lock(sendMutex);
+    write(_sockFd,rareq,rareqLength);    
 }
 
 /**
@@ -116,29 +142,86 @@ void DoIPClient::sendRoutingActivationRequest() {
  * @param userDataLength    length of userData
  */
 void DoIPClient::sendDiagnosticMessage(unsigned char* targetAddress, unsigned char* userData, int userDataLength) {
-    unsigned short sourceAddress = 0x0E00;
-    unsigned char* message = createDiagnosticMessage(sourceAddress, targetAddress, userData, userDataLength);
+    struct iovec payload = { userData, (size_t)userDataLength };
+    sendDiagnosticMessage(targetAddress, &payload, 1);
+}
+
+/*
+ * Sends a diagnostic message whose user data is scattered over several buffers.
+ * Only the header is built in a local buffer, the user data is not copied.
+ * @param targetAddress     logical address of the receiving ecu
+ * @param userData          buffers which form the user data in order
+ * @param count             number of buffers
+ * @return                  number of bytes written, or -1 if the message could not be
+ *                          sent completely. The connection is shut down after a partial
+ *                          message, because the server cannot resynchronize on the stream.
+ *                          The receiving thread then sees the end of the stream, the socket
+ *                          is released by closeTcpConnection().
+ */
+int DoIPClient::sendDiagnosticMessage(unsigned char* targetAddress, const struct iovec* userData, int count) {
+    unsigned short testerAddress = (unsigned short)((sourceAddress[0] << 8) | sourceAddress[1]);
+
+    int userDataLength = 0;
+    for(int i = 0; i < count; i++) {
+        userDataLength += userData[i].iov_len;
+    }
+
+    unsigned char header[_GenericHeaderLength + _DiagnosticMessageMinimumLength];
+    int headerLength = encodeDiagnosticMessageHeader(header, testerAddress, targetAddress, userDataLength);
+
+    std::lock_guard<std::mutex> lock(sendMutex);
+
+    //the vector list only grows, so sending does not allocate once it fits the largest message
+    if(sendVectorList.size() < (size_t)count + 1) {
+        sendVectorList.resize(count + 1);
+    }
+    sendVectorList[0].iov_base = header;
+    sendVectorList[0].iov_len = headerLength;
+    std::copy(userData, userData + count, sendVectorList.begin() + 1);
 
-    write(_sockFd, message, _GenericHeaderLength + _DiagnosticMessageMinimumLength + userDataLength);
+    ssize_t sentBytes = sendVectors(_sockFd, sendVectorList.data(), count + 1);
+    if(sentBytes != headerLength + userDataLength) {
+        if(sentBytes > 0) {
+            DOIP_LOG_ERROR("Diagnostic message was sent partially (%zd of %d bytes). Close Connection",
+                           sentBytes, headerLength + userDataLength);
+            //closing here would release the descriptor and the decoder under a receiving thread
+            shutdown(_sockFd, SHUT_RDWR);
+        }
+        return -1;
+    }
+    return sentBytes;
 }
 
 /**
- * Sends a alive check response containing the clients source address to the server
+ * Sends a alive check response containing the clients source address to the server.
+ * It may be called on a receive thread while another thread sends a request.
  */
 void DoIPClient::sendAliveCheckResponse() {
-    int responseLength = 2;
-    unsigned char* message = createGenericHeader(PayloadType::ALIVECHECKRESPONSE, responseLength);
+    const int responseLength = 2;
+    unsigned char message[_GenericHeaderLength + responseLength];
+    encodeGenericHeader(message, PayloadType::ALIVECHECKRESPONSE, responseLength);
     message[8] = sourceAddress[0];
     message[9] = sourceAddress[1];
+    std::lock_guard<std::mutex> lock(sendMutex);
     write(_sockFd, message, _GenericHeaderLength + responseLength);
 }
 
 /*
- * Receive a message from server
+ * Receive a message from server. Reads up to _ClientReceiveChunkSize bytes at
+ * once, the remainder of a large payload is received directly into its buffer.
+ * @return      number of received bytes, 0 if the server closed the connection
+ *              or -1 if an error occurred
  */
-void DoIPClient::receiveMessage() {
+int DoIPClient::receiveMessage() {
     
-    int readedBytes = recv(_sockFd,_receivedData,_maxDataSize, 0);
+    size_t windowLength = 0;
+    unsigned char* window = frameDecoder.getPayloadWindow(windowLength);
+    if(window == nullptr || windowLength < receiveChunk.size()) {
+        window = receiveChunk.data();
+        windowLength = receiveChunk.size();
+    }
+
+    int readedBytes = recv(_sockFd, window, windowLength, 0);
     
     if(!readedBytes) //if server is disconnected from client; client gets empty messages
     {
@@ -146,42 +229,119 @@ void DoIPClient::receiveMessage() {
         
         if(emptyMessageCounter == 5)
         {
-            std::cout << "Received to many empty messages. Reconnect TCP connection" << std::endl;
+            DOIP_LOG_WARNING("Received to many empty messages. Reconnect TCP connection");
             emptyMessageCounter = 0;
             reconnectServer();
         }
-        return;
+        return 0;
+    }
+
+    if(readedBytes < 0) {
+        return -1;
     }
 	
-    printf("Client received: ");
-    for(int i = 0; i < readedBytes; i++)
-    {
-        printf("0x%02X ", _receivedData[i]);
-    }    
-    printf("\n ");	
-    
-    GenericHeaderAction action = parseGenericHeader(_receivedData, readedBytes);
-
-    if(action.type == PayloadType::DIAGNOSTICPOSITIVEACK || action.type == PayloadType::DIAGNOSTICNEGATIVEACK) {
-        switch(action.type) {
-            case PayloadType::DIAGNOSTICPOSITIVEACK: {
-                std::cout << "Client received diagnostic message positive ack with code: ";
-                printf("0x%02X ", _receivedData[12]);
-                break;
+    return processReceivedData(window, readedBytes);
+}
+
+/**
+ * Processes data which was received from the server by another transport,
+ * e.g. a multishot io_uring receive
+ * @param data      received bytes, they are only used during the call
+ * @param length    number of received bytes
+ * @return          number of processed bytes
+ */
+int DoIPClient::processReceivedData(unsigned char* data, size_t length) {
+    DOIP_LOG_HEX("Client received", data, length);
+
+    //a message may be split over several reads or several messages may arrive at once
+    frameDecoder.feed(data, length, [this](const DoIPFrame& frame) {
+        return processReceivedFrame(frame);
+    });
+    return length;
+}
+
+/**
+ * Sets the pool which provides the buffers for messages which span several reads.
+ * A partially received message is discarded.
+ */
+void DoIPClient::setBufferPool(BufferPool& pool) {
+    unsigned long maxPayloadLength = frameDecoder.getMaxPayloadLength();
+    bufferPool = &pool;
+    frameDecoder = DoIPFrameDecoder(pool);
+    frameDecoder.setMaxPayloadLength(maxPayloadLength);
+}
+
+/*
+ * Receives messages until the server answered the routing activation request
+ * @return      routing activation response code
+ *              or -1 if the connection was closed before
+ */
+int DoIPClient::receiveRoutingActivationResponse() {
+    routingActivationCode = -1;
+    while(routingActivationCode < 0) {
+        if(receiveMessage() <= 0) {
+            return -1;
+        }
+    }
+    return routingActivationCode;
+}
+
+/*
+ * Reacts on a completely received message from the server
+ * @return      false if the remaining data of the stream should be discarded
+ */
+bool DoIPClient::processReceivedFrame(const DoIPFrame& frame) {
+    switch(frame.action.type) {
+        case PayloadType::ROUTINGACTIVATIONRESPONSE: {
+            routingActivationCode = frame.payload[4];
+            DOIP_LOG_INFO("Client received routing activation response with code: 0x%02X", frame.payload[4]);
+            break;
+        }
+        case PayloadType::ALIVECHECKREQUEST: {
+            sendAliveCheckResponse();
+            break;
+        }
+        case PayloadType::DIAGNOSTICMESSAGE: {
+            //the user data is passed on where it was received, without copying
+            unsigned short ecuAddress = (unsigned short)((frame.payload[0] << 8) | frame.payload[1]);
+            unsigned char* userData = frame.payload + _DiagnosticMessageMinimumLength;
+            int userDataLength = frame.action.payloadLength - _DiagnosticMessageMinimumLength;
+            if(diag_view_callback) {
+                unsigned short testerAddress = (unsigned short)((frame.payload[2] << 8) | frame.payload[3]);
+                DiagnosticMessageView view(ecuAddress, testerAddress, userData, userDataLength, *bufferPool);
+                diag_view_callback(view);
             }
-            case PayloadType::DIAGNOSTICNEGATIVEACK: {
-                std::cout << "Client received diagnostic message negative ack with code: ";
-                printf("0x%02X ", _receivedData[12]);
-                break;
+            if(diag_callback) {
+                diag_callback(ecuAddress, userData, userDataLength);
             }
-            default: {
-                std::cerr << "not handled payload type occured in receiveMessage()" << std::endl;
-                break;
+            break;
+        }
+        case PayloadType::DIAGNOSTICPOSITIVEACK:
+        case PayloadType::DIAGNOSTICNEGATIVEACK: {
+            bool ackType = frame.action.type == PayloadType::DIAGNOSTICPOSITIVEACK;
+            DOIP_LOG_INFO("Client received diagnostic message %s ack with code: 0x%02X",
+                            ackType ? "positive" : "negative", frame.payload[4]);
+            if(diag_ack_callback) {
+                unsigned short ecuAddress = (unsigned short)((frame.payload[0] << 8) | frame.payload[1]);
+                diag_ack_callback(ecuAddress, ackType, frame.payload[4]);
             }
+            break;
+        }
+        case PayloadType::NEGATIVEACK: {
+            //the message was rejected while decoding, e.g. because it exceeds the maximum payload length
+            DOIP_LOG_WARNING("Client discarded a message of %lu bytes with payload type 0x%04X, code: 0x%02X",
+                                frame.action.payloadLength, frame.action.payloadTypeCode, frame.action.value);
+            break;
+        }
+        case PayloadType::GENERICNACK: {
+            DOIP_LOG_WARNING("Client received generic header negative ack with code: 0x%02X", frame.payload[0]);
+            break;
+        }
+        default: {
+            break;
         }
-        std::cout << std::endl;
     }
- 
+    return true;
 }
 
 void DoIPClient::receiveUdpMessage() {
@@ -198,11 +358,9 @@ void DoIPClient::receiveUdpMessage() {
     
 }
 
-const std::pair<int,unsigned char*>* DoIPClient::buildVehicleIdentificationRequest(){
+int DoIPClient::buildVehicleIdentificationRequest(unsigned char* rareq){
     
-    std::pair <int,unsigned char*>* rareqWithLength= new std::pair<int,unsigned char*>();
-    int rareqLength= 8;
-    unsigned char * rareq= new unsigned char[rareqLength];
+    int rareqLength= _GenericHeaderLength;
 
     //Generic Header
     rareq[0]=0x02;  //Protocol Version
@@ -214,10 +372,7 @@ const std::pair<int,unsigned char*>* DoIPClient::buildVehicleIdentificationReque
     rareq[6]=0x00;
     rareq[7]=0x00;
 
-    rareqWithLength->first=rareqLength;
-    rareqWithLength->second=rareq;
-
-    return rareqWithLength;
+    return rareqLength;
     
 }
 
@@ -227,27 +382,28 @@ void DoIPClient::sendVehicleIdentificationRequest(const char* address){
     
     if(setAddressError != 0)
     {
-        std::cout <<"Address set succesfully"<<std::endl;
+        DOIP_LOG_DEBUG("Address set succesfully");
     }
     else
     {
-        std::cout << "Could not set Address. Try again" << std::endl;
+        DOIP_LOG_ERROR("Could not set Address. Try again");
     }
     
     int socketError = setsockopt(_sockFd_udp, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast) );
          
     if(socketError == 0)
     {
-        std::cout << "Broadcast Option set successfully" << std::endl;
+        DOIP_LOG_DEBUG("Broadcast Option set successfully");
     }
       
-    const std::pair <int,unsigned char*>* rareqWithLength=buildVehicleIdentificationRequest();
+    unsigned char rareq[_GenericHeaderLength];
+    int rareqLength=buildVehicleIdentificationRequest(rareq);
     
-    int sendError = sendto(_sockFd_udp, rareqWithLength->second,rareqWithLength->first, 0, (struct sockaddr *) &_serverAddr, sizeof(_serverAddr));
+    int sendError = sendto(_sockFd_udp, rareq, rareqLength, 0, (struct sockaddr *) &_serverAddr, sizeof(_serverAddr));
     
     if(sendError > 0)
     {
-        std::cout << "Sending Vehicle Identification Request" << std::endl;
+        DOIP_LOG_INFO("Sending Vehicle Identification Request");
     }
 }
 
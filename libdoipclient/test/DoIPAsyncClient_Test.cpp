@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+#include "DoIPAsyncClient.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+
+/*
+* Minimal DoIP gateway on a loopback port which activates routing and then
+* answers the diagnostic requests as the test describes
+*/
+class FakeGateway {
+	public:
+		FakeGateway() {
+			listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+			struct sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			bind(listenSocket, (struct sockaddr*)&address, sizeof(address));
+			listen(listenSocket, 1);
+			socklen_t length = sizeof(address);
+			getsockname(listenSocket, (struct sockaddr*)&address, &length);
+			port = ntohs(address.sin_port);
+		}
+
+		~FakeGateway() {
+			if(server.joinable()) {
+				server.join();
+			}
+			if(connection >= 0) {
+				close(connection);
+			}
+			close(listenSocket);
+		}
+
+		//accepts the tester and activates routing, then runs the script on the connection
+		void run(std::function<void(FakeGateway&)> script) {
+			server = std::thread([this, script]() {
+				connection = accept(listenSocket, nullptr, nullptr);
+				unsigned char request[_RoutingActivationRequestLength];
+				receive(request, sizeof(request));
+				unsigned char response[] = {0x02, 0xFD, 0x00, 0x06, 0x00, 0x00, 0x00, 0x09,
+											request[8], request[9], 0x00, 0x28, 0x10, 0x00, 0x00, 0x00, 0x00};
+				send(connection, response, sizeof(response), 0);
+				script(*this);
+			});
+		}
+
+		//receives a diagnostic request and returns its target address and user data
+		std::vector<unsigned char> receiveRequest(unsigned short& targetAddress) {
+			unsigned char header[_GenericHeaderLength + _DiagnosticMessageMinimumLength];
+			receive(header, sizeof(header));
+			targetAddress = (unsigned short)((header[10] << 8) | header[11]);
+			int length = ((header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]) - _DiagnosticMessageMinimumLength;
+			std::vector<unsigned char> data(length);
+			receive(data.data(), length);
+			return data;
+		}
+
+		void sendAck(unsigned short ecuAddress, bool ackType, unsigned char ackCode = 0x00) {
+			unsigned char message[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+			int length = encodeDiagnosticACK(message, ackType, ecuAddress, testerAddress, ackCode);
+			send(connection, message, length, 0);
+		}
+
+		void sendResponse(unsigned short ecuAddress, std::vector<unsigned char> data) {
+			std::vector<unsigned char> message(_GenericHeaderLength + _DiagnosticMessageMinimumLength + data.size());
+			int length = encodeDiagnosticMessage(message.data(), ecuAddress, testerAddress, data.data(), data.size());
+			send(connection, message.data(), length, 0);
+		}
+
+		void sendAliveCheckRequest() {
+			unsigned char message[_GenericHeaderLength];
+			int length = encodeGenericHeader(message, PayloadType::ALIVECHECKREQUEST, 0);
+			send(connection, message, length, 0);
+		}
+
+		//receives any message, returns its payload type or 0 if the stream is corrupted
+		uint16_t receiveMessage(std::vector<unsigned char>& payload) {
+			unsigned char header[_GenericHeaderLength] = {};
+			receive(header, sizeof(header));
+			if(header[0] != 0x02 || header[1] != 0xFD) {
+				return 0;
+			}
+			payload.resize((header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]);
+			receive(payload.data(), payload.size());
+			return (uint16_t)((header[2] << 8) | header[3]);
+		}
+
+		void closeConnection() {
+			shutdown(connection, SHUT_RDWR);
+		}
+
+		int port = 0;
+
+	private:
+		int listenSocket = -1;
+		int connection = -1;
+		unsigned char testerAddress[2] = {0x0E, 0x00};
+		std::thread server;
+
+		void receive(unsigned char* buffer, size_t length) {
+			size_t offset = 0;
+			while(offset < length) {
+				ssize_t result = recv(connection, buffer + offset, length - offset, 0);
+				if(result <= 0) {
+					return;
+				}
+				offset += result;
+			}
+		}
+};
+
+class DoIPAsyncClientTest : public ::testing::Test {
+	public:
+		FakeGateway gateway;
+		DoIPAsyncClient client;
+
+		void connect(std::function<void(FakeGateway&)> script) {
+			gateway.run(script);
+			ASSERT_TRUE(client.connect("127.0.0.1", 0x0E00, gateway.port));
+		}
+};
+
+/*
+* Checks if responses are assigned to the requests by the ecu address, even if the ecus answer in another order
+*/
+TEST_F(DoIPAsyncClientTest, CorrelatesResponsesByEcuAddress) {
+	connect([](FakeGateway& gateway) {
+		unsigned short firstEcu, secondEcu;
+		gateway.receiveRequest(firstEcu);
+		gateway.receiveRequest(secondEcu);
+		gateway.sendAck(firstEcu, true);
+		gateway.sendAck(secondEcu, true);
+		gateway.sendResponse(secondEcu, {0x62, 0xF1, 0x90, 0x02});
+		gateway.sendResponse(firstEcu, {0x62, 0xF1, 0x90, 0x01});
+	});
+
+	unsigned char request[] = {0x22, 0xF1, 0x90};
+	std::future<DiagnosticResponse> first = client.sendDiagnosticRequest(0x0001, request, sizeof(request));
+	std::future<DiagnosticResponse> second = client.sendDiagnosticRequest(0x0002, request, sizeof(request));
+
+	DiagnosticResponse firstResponse = first.get();
+	DiagnosticResponse secondResponse = second.get();
+	ASSERT_EQ(firstResponse.status, RESPONSERECEIVED);
+	ASSERT_EQ(firstResponse.sourceAddress, 0x0001);
+	ASSERT_EQ(firstResponse.data, std::vector<unsigned char>({0x62, 0xF1, 0x90, 0x01}));
+	ASSERT_EQ(secondResponse.status, RESPONSERECEIVED);
+	ASSERT_EQ(secondResponse.data, std::vector<unsigned char>({0x62, 0xF1, 0x90, 0x02}));
+	ASSERT_EQ(client.getPendingRequestCount(), 0u);
+}
+
+/*
+* Checks if requests to the same ecu are completed in order through callbacks
+*/
+TEST_F(DoIPAsyncClientTest, PipelinesRequestsToOneEcu) {
+	connect([](FakeGateway& gateway) {
+		for(unsigned char i = 0; i < 10; i++) {
+			unsigned short ecu;
+			std::vector<unsigned char> data = gateway.receiveRequest(ecu);
+			gateway.sendAck(ecu, true);
+			gateway.sendResponse(ecu, {0x62, data[1], data[2]});
+		}
+	});
+
+	std::promise<void> done;
+	std::vector<unsigned char> order;
+	for(unsigned char i = 0; i < 10; i++) {
+		unsigned char request[] = {0x22, 0xF1, i};
+		client.sendDiagnosticRequest(0x0001, request, sizeof(request), [&order, &done](const DiagnosticResponse& response) {
+			order.push_back(response.data[2]);
+			if(order.size() == 10) {
+				done.set_value();
+			}
+		});
+	}
+
+	ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(2)), std::future_status::ready);
+	ASSERT_EQ(order, std::vector<unsigned char>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+/*
+* Checks if response pending messages extend the timeout until the final response
+*/
+TEST_F(DoIPAsyncClientTest, ResponsePendingExtendsTimeout) {
+	client.setResponseTimeouts(50, 1000);
+	connect([](FakeGateway& gateway) {
+		unsigned short ecu;
+		gateway.receiveRequest(ecu);
+		gateway.sendAck(ecu, true);
+		gateway.sendResponse(ecu, {0x7F, 0x31, 0x78});
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+		gateway.sendResponse(ecu, {0x7F, 0x31, 0x78});
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+		gateway.sendResponse(ecu, {0x71, 0x01, 0xFF, 0x00});
+	});
+
+	unsigned char request[] = {0x31, 0x01, 0xFF, 0x00};
+	DiagnosticResponse response = client.sendDiagnosticRequest(0x0001, request, sizeof(request)).get();
+	ASSERT_EQ(response.status, RESPONSERECEIVED);
+	ASSERT_EQ(response.pendingResponses, 2);
+	ASSERT_EQ(response.data, std::vector<unsigned char>({0x71, 0x01, 0xFF, 0x00}));
+}
+
+/*
+* Checks if a request which is not answered within P2 times out
+*/
+TEST_F(DoIPAsyncClientTest, MissingResponseTimesOut) {
+	client.setResponseTimeouts(50, 1000);
+	connect([](FakeGateway& gateway) {
+		unsigned short ecu;
+		gateway.receiveRequest(ecu);
+		gateway.sendAck(ecu, true);
+	});
+
+	unsigned char request[] = {0x22, 0xF1, 0x90};
+	std::future<DiagnosticResponse> future = client.sendDiagnosticRequest(0x0001, request, sizeof(request));
+	ASSERT_EQ(future.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+	ASSERT_EQ(future.get().status, RESPONSETIMEOUT);
+}
+
+/*
+* Checks if a negative diagnostic message ack completes the request with its code
+*/
+TEST_F(DoIPAsyncClientTest, NegativeAckRejectsRequest) {
+	connect([](FakeGateway& gateway) {
+		unsigned short ecu;
+		gateway.receiveRequest(ecu);
+		gateway.sendAck(ecu, false, 0x03);
+	});
+
+	unsigned char request[] = {0x22, 0xF1, 0x90};
+	DiagnosticResponse response = client.sendDiagnosticRequest(0x0099, request, sizeof(request)).get();
+	ASSERT_EQ(response.status, REQUESTREJECTED);
+	ASSERT_EQ(response.ackCode, 0x03);
+}
+
+/*
+* Checks if the alive check response of the receive thread is not written into
+* a request which another thread is still sending
+*/
+TEST_F(DoIPAsyncClientTest, AliveCheckResponseDoesNotSplitRequest) {
+	std::vector<unsigned char> request(32 * 1024 * 1024, 0x55);
+	std::vector<uint16_t> types;
+	bool intact = false;
+	connect([&request, &types, &intact](FakeGateway& gateway) {
+		//the gateway does not read, so the request fills the socket buffers and its send blocks
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		gateway.sendAliveCheckRequest();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		for(int i = 0; i < 2; i++) {
+			std::vector<unsigned char> payload;
+			uint16_t type = gateway.receiveMessage(payload);
+			types.push_back(type);
+			if(type == 0x8001) {
+				intact = payload.size() == _DiagnosticMessageMinimumLength + request.size() &&
+					std::all_of(payload.begin() + _DiagnosticMessageMinimumLength, payload.end(),
+						[](unsigned char value) { return value == 0x55; });
+			}
+			if(type == 0) {
+				break;
+			}
+		}
+		gateway.sendAck(0x0001, true);
+		gateway.sendResponse(0x0001, {0x6E, 0xF1, 0x90});
+	});
+
+	DiagnosticResponse response = client.sendDiagnosticRequest(0x0001, request.data(), request.size()).get();
+	ASSERT_EQ(response.status, RESPONSERECEIVED);
+	ASSERT_EQ(types, std::vector<uint16_t>({0x8001, 0x0008}));
+	ASSERT_TRUE(intact) << "the request was corrupted";
+}
+
+/*
+* Checks if pending requests are completed when the gateway closes the connection
+*/
+TEST_F(DoIPAsyncClientTest, ClosedConnectionCompletesPendingRequests) {
+	connect([](FakeGateway& gateway) {
+		unsigned short ecu;
+		gateway.receiveRequest(ecu);
+		gateway.closeConnection();
+	});
+
+	unsigned char request[] = {0x22, 0xF1, 0x90};
+	std::future<DiagnosticResponse> future = client.sendDiagnosticRequest(0x0001, request, sizeof(request));
+	ASSERT_EQ(future.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+	ASSERT_EQ(future.get().status, CONNECTIONCLOSED);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_FALSE(client.isConnected());
+	ASSERT_EQ(client.sendDiagnosticRequest(0x0001, request, sizeof(request)).get().status, CONNECTIONCLOSED);
+}
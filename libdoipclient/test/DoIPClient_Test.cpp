@@ -1,11 +1,150 @@
 #include "DoIPClient_h.h"
 #include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
 
 class DoIPClient_Test : public ::testing::Test{
    
     protected:
         void SetUp() override {
+            listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listenSocket, (struct sockaddr*)&address, sizeof(address));
+            listen(listenSocket, 1);
+            socklen_t length = sizeof(address);
+            getsockname(listenSocket, (struct sockaddr*)&address, &length);
+            port = ntohs(address.sin_port);
+        }
+
+        void TearDown() override {
+            if(server.joinable()) {
+                server.join();
+            }
+            close(listenSocket);
+        }
+
+        //accepts the client and sends the messages
+        void serve(std::vector<std::vector<unsigned char>> messages) {
+            server = std::thread([this, messages]() {
+                int connection = accept(listenSocket, nullptr, nullptr);
+                for(const std::vector<unsigned char>& message : messages) {
+                    send(connection, message.data(), message.size(), MSG_NOSIGNAL);
+                }
+                close(connection);
+            });
+            client1.startTcpConnection("127.0.0.1", port);
+        }
+
+        std::vector<unsigned char> diagnosticMessage(std::vector<unsigned char> userData) {
+            unsigned char testerAddress[2] = {0x0E, 0x00};
+            std::vector<unsigned char> message(_GenericHeaderLength + _DiagnosticMessageMinimumLength + userData.size());
+            encodeDiagnosticMessage(message.data(), 0x0001, testerAddress, userData.data(), userData.size());
+            return message;
+        }
+
+        //receives until the server closed the connection
+        void receiveAll() {
+            while(client1.receiveMessage() > 0) {
+            }
+            client1.closeTcpConnection();
         }
     
     DoIPClient client1;   
-};
\ No newline at end of file
+    int listenSocket = -1;
+    int port = 0;
+    std::thread server;
+};
+
+/*
+* Checks if a response which is much larger than one read is passed on completely
+*/
+TEST_F(DoIPClient_Test, ReceivesLargeDiagnosticMessage) {
+    std::vector<unsigned char> userData(3 * 1024 * 1024);
+    for(size_t i = 0; i < userData.size(); i++) {
+        userData[i] = (unsigned char)(i * 31);
+    }
+    std::vector<std::vector<unsigned char>> received;
+    client1.setDiagnosticMessageCallback([&received](unsigned short sourceAddress, unsigned char* data, int length) {
+        ASSERT_EQ(sourceAddress, 0x0001);
+        received.push_back(std::vector<unsigned char>(data, data + length));
+    });
+
+    serve({diagnosticMessage({0x62, 0xF1, 0x90}), diagnosticMessage(userData), diagnosticMessage({0x7F, 0x22, 0x31})});
+    receiveAll();
+
+    ASSERT_EQ(received.size(), 3u);
+    ASSERT_EQ(received[0], std::vector<unsigned char>({0x62, 0xF1, 0x90}));
+    ASSERT_TRUE(received[1] == userData) << "large message was not received intact";
+    ASSERT_EQ(received[2], std::vector<unsigned char>({0x7F, 0x22, 0x31}));
+}
+
+/*
+* Checks if a message above the maximum payload length is skipped and the following message is still decoded
+*/
+TEST_F(DoIPClient_Test, SkipsMessageAboveMaximumPayloadLength) {
+    client1.setMaxPayloadLength(1024);
+    std::vector<unsigned short> viewAddresses;
+    std::vector<std::vector<unsigned char>> received;
+    client1.setDiagnosticViewCallback([&viewAddresses, &received](const DiagnosticMessageView& view) {
+        viewAddresses.push_back(view.getTargetAddress());
+        received.push_back(std::vector<unsigned char>(view.data(), view.data() + view.size()));
+    });
+
+    serve({diagnosticMessage(std::vector<unsigned char>(200000, 0x55)), diagnosticMessage({0x50, 0x03})});
+    receiveAll();
+
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(received[0], std::vector<unsigned char>({0x50, 0x03}));
+    ASSERT_EQ(viewAddresses[0], 0x0E00);
+}
+
+/*
+* Checks if the connection is closed when a message could only be sent partially,
+* so the server does not receive a corrupted stream
+*/
+TEST_F(DoIPClient_Test, ClosesConnectionAfterPartialMessage) {
+    std::atomic<bool> sent(false);
+    size_t receivedBytes = 0;
+    server = std::thread([this, &sent, &receivedBytes]() {
+        int connection = accept(listenSocket, nullptr, nullptr);
+        while(!sent) {
+            std::this_thread::yield();
+        }
+        unsigned char buffer[65536];
+        ssize_t result;
+        while((result = recv(connection, buffer, sizeof(buffer), 0)) > 0) {
+            receivedBytes += result;
+        }
+        close(connection);
+    });
+    client1.startTcpConnection("127.0.0.1", port);
+
+    //the server does not read, so the send times out when the socket buffers are full
+    struct timeval timeout = {0, 50000};
+    setsockopt(client1.getSockFd(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<unsigned char> userData(16 * 1024 * 1024, 0x55);
+    unsigned char targetAddress[2] = {0x00, 0x01};
+    struct iovec vector = {userData.data(), userData.size()};
+    ASSERT_EQ(client1.sendDiagnosticMessage(targetAddress, &vector, 1), -1);
+    sent = true;
+    server.join();
+
+    ASSERT_GT(receivedBytes, 0u);
+    ASSERT_LT(receivedBytes, userData.size()) << "message was sent completely";
+
+    //the socket is released once, a second close must not close a descriptor which was reused meanwhile
+    client1.closeTcpConnection();
+    ASSERT_EQ(client1.getSockFd(), -1);
+    int reused = dup(listenSocket);
+    client1.closeTcpConnection();
+    ASSERT_NE(fcntl(reused, F_GETFD), -1) << "an unrelated descriptor was closed";
+    close(reused);
+}
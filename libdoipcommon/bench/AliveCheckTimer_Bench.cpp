@@ -0,0 +1,59 @@
+#include "BenchRunner.h"
+#include "AliveCheckTimer.h"
+#include <memory>
+#include <vector>
+
+/*
+* Creates timers on a private wheel, so the shared timer service never expires them
+*/
+static std::vector<std::unique_ptr<AliveCheckTimer>> createTimers(TimerWheel& wheel, size_t count) {
+	std::vector<std::unique_ptr<AliveCheckTimer>> timers;
+	for(size_t i = 0; i < count; i++) {
+		timers.emplace_back(new AliveCheckTimer());
+		timers.back()->setTimer(300);
+		timers.back()->setTimerWheel(wheel);
+	}
+	return timers;
+}
+
+/*
+* Starts and stops the given number of connection timers, as for connections which are opened and closed
+*/
+static void BM_AliveCheckTimerStart(benchmark::State& state) {
+	TimerWheel wheel;
+	std::vector<std::unique_ptr<AliveCheckTimer>> timers = createTimers(wheel, state.range(0));
+
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		for(auto& timer : timers) {
+			timer->startTimer();
+		}
+		for(auto& timer : timers) {
+			timer->stopTimer();
+		}
+	}
+	reportAllocations(state, allocations);
+	state.SetItemsProcessed(state.iterations() * timers.size());
+}
+BENCHMARK(BM_AliveCheckTimerStart)->RangeMultiplier(10)->Range(1, 100000);
+
+/*
+* Resets the given number of running timers, as for every message received on a connection
+*/
+static void BM_AliveCheckTimerReset(benchmark::State& state) {
+	TimerWheel wheel;
+	std::vector<std::unique_ptr<AliveCheckTimer>> timers = createTimers(wheel, state.range(0));
+	for(auto& timer : timers) {
+		timer->startTimer();
+	}
+
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		for(auto& timer : timers) {
+			timer->resetTimer();
+		}
+	}
+	reportAllocations(state, allocations);
+	state.SetItemsProcessed(state.iterations() * timers.size());
+}
+BENCHMARK(BM_AliveCheckTimerReset)->RangeMultiplier(10)->Range(1, 100000);
@@ -0,0 +1,108 @@
+#include "BenchRunner.h"
+#include "DiagnosticMessageHandler.h"
+#include <vector>
+
+/*
+* Builds the payload of a diagnostic message from tester 0x0E00 to ECU 0x0001
+*/
+static std::vector<unsigned char> createPayload(size_t userDataLength) {
+	std::vector<unsigned char> payload(_DiagnosticMessageMinimumLength + userDataLength, 0x55);
+	payload[0] = 0x0E;
+	payload[1] = 0x00;
+	payload[2] = 0x00;
+	payload[3] = 0x01;
+	return payload;
+}
+
+/*
+* Parses a diagnostic message and copies the user data for the callback
+*/
+static void BM_ParseDiagnosticMessage(benchmark::State& state) {
+	std::vector<unsigned char> payload = createPayload(state.range(0));
+	unsigned char sourceAddress[2] = {0x0E, 0x00};
+	BufferPool pool;
+	DiagnosticCallback callback = [](unsigned short targetAddress, unsigned char* data, int length) {
+		benchmark::DoNotOptimize(targetAddress);
+		benchmark::DoNotOptimize(data[length - 1]);
+	};
+
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(parseDiagnosticMessage(callback, sourceAddress, payload.data(), payload.size(), pool));
+	}
+	reportAllocations(state, allocations);
+	state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_ParseDiagnosticMessage)->RangeMultiplier(8)->Range(8, 32 << 10);
+
+/*
+* Parses a diagnostic message and passes a view of the user data to the callback
+*/
+static void BM_ParseDiagnosticMessageView(benchmark::State& state) {
+	std::vector<unsigned char> payload = createPayload(state.range(0));
+	unsigned char sourceAddress[2] = {0x0E, 0x00};
+	BufferPool pool;
+	DiagnosticViewCallback callback = [](const DiagnosticMessageView& view) {
+		benchmark::DoNotOptimize(view.data()[view.size() - 1]);
+	};
+
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(parseDiagnosticMessage(callback, sourceAddress, payload.data(), payload.size(), pool));
+	}
+	reportAllocations(state, allocations);
+	state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_ParseDiagnosticMessageView)->RangeMultiplier(8)->Range(8, 32 << 10);
+
+static void BM_CreateDiagnosticACK(benchmark::State& state) {
+	unsigned char targetAddress[2] = {0x0E, 0x00};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		unsigned char* message = createDiagnosticACK(false, 0x0001, targetAddress, _ValidDiagnosticMessageCode);
+		benchmark::DoNotOptimize(message);
+		delete[] message;
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CreateDiagnosticACK);
+
+static void BM_EncodeDiagnosticACK(benchmark::State& state) {
+	unsigned char targetAddress[2] = {0x0E, 0x00};
+	unsigned char message[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeDiagnosticACK(message, false, 0x0001, targetAddress, _ValidDiagnosticMessageCode));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_EncodeDiagnosticACK);
+
+static void BM_CreateDiagnosticMessage(benchmark::State& state) {
+	unsigned char targetAddress[2] = {0x0E, 0x00};
+	std::vector<unsigned char> userData(state.range(0), 0x55);
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		unsigned char* message = createDiagnosticMessage(0x0001, targetAddress, userData.data(), userData.size());
+		benchmark::DoNotOptimize(message);
+		delete[] message;
+	}
+	reportAllocations(state, allocations);
+	state.SetBytesProcessed(state.iterations() * userData.size());
+}
+BENCHMARK(BM_CreateDiagnosticMessage)->RangeMultiplier(8)->Range(8, 32 << 10);
+
+static void BM_EncodeDiagnosticMessage(benchmark::State& state) {
+	unsigned char targetAddress[2] = {0x0E, 0x00};
+	std::vector<unsigned char> userData(state.range(0), 0x55);
+	std::vector<unsigned char> message(_GenericHeaderLength + _DiagnosticMessageMinimumLength + userData.size());
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeDiagnosticMessage(message.data(), 0x0001, targetAddress, userData.data(), userData.size()));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+	state.SetBytesProcessed(state.iterations() * userData.size());
+}
+BENCHMARK(BM_EncodeDiagnosticMessage)->RangeMultiplier(8)->Range(8, 32 << 10);
@@ -0,0 +1,52 @@
+#include "BenchRunner.h"
+#include "DoIPGenericHeaderHandler.h"
+
+/*
+* Parses the header of a diagnostic message with 2 bytes of user data
+*/
+static void BM_ParseGenericHeader(benchmark::State& state) {
+	unsigned char message[] = {0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x06, 0x0E, 0x00, 0x00, 0x01, 0x22, 0xF1};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		GenericHeaderAction action = parseGenericHeader(message, sizeof(message));
+		benchmark::DoNotOptimize(action);
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_ParseGenericHeader);
+
+/*
+* Parses a header with a wrong synchronization pattern, the path taken for garbage input
+*/
+static void BM_ParseGenericHeaderInvalidPattern(benchmark::State& state) {
+	unsigned char message[] = {0x02, 0x33, 0x80, 0x01, 0x00, 0x00, 0x00, 0x06, 0x0E, 0x00, 0x00, 0x01, 0x22, 0xF1};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		GenericHeaderAction action = parseGenericHeader(message, sizeof(message));
+		benchmark::DoNotOptimize(action);
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_ParseGenericHeaderInvalidPattern);
+
+static void BM_CreateGenericHeader(benchmark::State& state) {
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		unsigned char* header = createGenericHeader(PayloadType::DIAGNOSTICMESSAGE, 6);
+		benchmark::DoNotOptimize(header);
+		delete[] header;
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CreateGenericHeader);
+
+static void BM_EncodeGenericHeader(benchmark::State& state) {
+	unsigned char header[_GenericHeaderLength];
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeGenericHeader(header, PayloadType::DIAGNOSTICMESSAGE, 6));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_EncodeGenericHeader);
@@ -0,0 +1,53 @@
+#include "BenchRunner.h"
+#include "DoIPMetrics.h"
+
+/*
+* Counts an incoming message, as for every message a connection receives
+*/
+static void BM_MetricsRecordMessage(benchmark::State& state) {
+	DoIPMetrics& metrics = DoIPMetrics::instance();
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		metrics.recordMessageIn(PayloadType::DIAGNOSTICMESSAGE, 14);
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_MetricsRecordMessage)->ThreadRange(1, 4);
+
+/*
+* Records the callback latency of a few targets, as for every diagnostic message
+*/
+static void BM_MetricsRecordLatency(benchmark::State& state) {
+	DoIPMetrics& metrics = DoIPMetrics::instance();
+	unsigned short target = 0;
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		metrics.recordCallbackLatency(0x0010 + (target++ & 7), 25000);
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_MetricsRecordLatency)->ThreadRange(1, 4);
+
+/*
+* Measures a callback with the timer, including both clock reads
+*/
+static void BM_MetricsCallbackTimer(benchmark::State& state) {
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		CallbackLatencyTimer timer(0x0010);
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_MetricsCallbackTimer);
+
+/*
+* Sums the shards of all threads, as for every request on the text endpoint
+*/
+static void BM_MetricsSnapshot(benchmark::State& state) {
+	DoIPMetrics::instance().recordCallbackLatency(0x0010, 25000);
+	for(auto _ : state) {
+		MetricsSnapshot snapshot = DoIPMetrics::instance().snapshot();
+		benchmark::DoNotOptimize(snapshot);
+	}
+}
+BENCHMARK(BM_MetricsSnapshot);
@@ -0,0 +1,32 @@
+#include "BenchRunner.h"
+#include "DoIPTracer.h"
+
+/*
+* Opens and closes a span while tracing is disabled, the cost on every message stage
+*/
+static void BM_TraceSpanDisabled(benchmark::State& state) {
+	DoIPTracer::instance().disable();
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		TraceSpan span("DiagnosticCallback", "target", 0x0028);
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_TraceSpanDisabled);
+
+/*
+* Opens and closes a span while tracing is enabled, including both clock reads
+*/
+static void BM_TraceSpanEnabled(benchmark::State& state) {
+	DoIPTracer::instance().enable();
+	DoIPTracer::instance().record("warm up", 1, 2);
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		TraceSpan span("DiagnosticCallback", "target", 0x0028);
+	}
+	reportAllocations(state, allocations);
+	DoIPTracer::instance().disable();
+	DoIPTracer::instance().clear();
+}
+BENCHMARK(BM_TraceSpanEnabled);
@@ -1,32 +1,38 @@
 #ifndef ALIVECHECKTIMER_H
 #define ALIVECHECKTIMER_H
 
-#include <thread>
 #include <ctime>
 #include <cstdlib>
-#include <vector>
+#include <atomic>
 #include <functional>
+#include "TimerWheel.h"
 
 using CloseConnectionCallback = std::function<void()>;
 
 class AliveCheckTimer {
 public:
+    AliveCheckTimer();
+
     void setTimer(uint16_t seconds);
+    void setTimerMilliseconds(uint32_t milliseconds);
+    void setTimerWheel(TimerWheel& wheel);
     void startTimer();
     void resetTimer();
+    void stopTimer();
     
-    bool disabled = false;
-    bool active = false;
-    bool timeout = false;
+    std::atomic<bool> disabled;
+    std::atomic<bool> active;
+    std::atomic<bool> timeout;
     CloseConnectionCallback cb;
     
     ~AliveCheckTimer();
     
 private:
-    std::vector<std::thread> timerThreads;
+    TimerWheel* timerWheel;
+    TimerEntry timerEntry;
+    uint32_t maxMilliseconds = 0;
+
     void waitForResponse();
-    clock_t startTime;
-    uint16_t maxSeconds;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,111 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+const size_t _DefaultSlabSize = 64 * 1024;
+const size_t _HugePageSize = 2 * 1024 * 1024;
+
+class BufferPool;
+
+/**
+ * Statistics of one size class of a BufferPool
+ */
+struct BufferPoolStatistics {
+    size_t blockSize;           //capacity of each buffer of this class
+    size_t totalBlocks;         //buffers allocated from the system
+    size_t blocksInUse;         //buffers currently handed out
+    size_t peakBlocksInUse;     //maximum of blocksInUse since creation
+    uint64_t acquisitions;      //number of acquire() calls served by this class
+    size_t slabs;               //number of slabs allocated for this class
+    size_t hugePageSlabs;       //slabs which are backed by huge pages
+};
+
+/**
+ * Move-only handle to a buffer of a BufferPool. The buffer is returned to
+ * its pool when the handle is destroyed. A handle must not outlive its pool.
+ */
+class PooledBuffer {
+
+public:
+    PooledBuffer() = default;
+    PooledBuffer(PooledBuffer&& other);
+    PooledBuffer& operator=(PooledBuffer&& other);
+    ~PooledBuffer();
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    unsigned char* data() const { return buffer; };
+    size_t size() const { return length; };
+    size_t capacity() const { return blockSize; };
+    explicit operator bool() const { return buffer != nullptr; };
+
+    void reset();
+
+private:
+    friend class BufferPool;
+
+    PooledBuffer(BufferPool* pool, int sizeClass, unsigned char* buffer, size_t length, size_t blockSize):
+        pool(pool), sizeClass(sizeClass), buffer(buffer), length(length), blockSize(blockSize) { };
+
+    BufferPool* pool = nullptr;
+    int sizeClass = -1;             //-1 marks a buffer which is larger than every size class
+    unsigned char* buffer = nullptr;
+    size_t length = 0;
+    size_t blockSize = 0;
+};
+
+/**
+ * Pool of receive buffers which are carved out of large slabs. Every
+ * request is served by the smallest size class which fits, requests larger
+ * than the largest class are allocated from the heap. Slabs are kept until
+ * the pool is destroyed, so steady-state operation does not allocate.
+ * All methods are thread-safe.
+ */
+class BufferPool {
+
+public:
+    BufferPool(bool useHugePages = false);
+    BufferPool(const std::vector<size_t>& blockSizes, size_t slabSize = _DefaultSlabSize, bool useHugePages = false);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    static BufferPool& defaultPool();
+
+    PooledBuffer acquire(size_t length);
+
+    std::vector<BufferPoolStatistics> getStatistics();
+    uint64_t getOversizeAllocations();
+
+private:
+    friend class PooledBuffer;
+
+    struct Slab {
+        void* memory;
+        size_t size;
+    };
+
+    struct SizeClass {
+        BufferPoolStatistics statistics;
+        std::vector<unsigned char*> freeBlocks;
+    };
+
+    std::mutex poolMutex;
+    std::vector<SizeClass> sizeClasses;
+    std::vector<Slab> slabs;
+    size_t slabSize;
+    bool useHugePages;
+    uint64_t oversizeAllocations = 0;
+
+    void setupSizeClasses(const std::vector<size_t>& blockSizes);
+    bool allocateSlab(SizeClass& sizeClass);
+    void release(int sizeClass, unsigned char* buffer);
+};
+
+#endif /* BUFFERPOOL_H */
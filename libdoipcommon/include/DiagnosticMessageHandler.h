@@ -2,21 +2,61 @@
 #define DIAGNOSTICMESSAGEHANDLER_H
 
 #include "DoIPGenericHeaderHandler.h"
+#include "BufferPool.h"
 #include <functional>
 
 using DiagnosticCallback = std::function<void(unsigned short, unsigned char*, int)>;
 using DiagnosticMessageNotification = std::function<bool(unsigned short)>;
 
+/**
+ * Non-owning view of the user data of a received diagnostic message.
+ * The data points directly into the receive buffer and is only valid until
+ * the callback returns. Applications which need the bytes afterwards have to
+ * call retain(), which copies them into a buffer of the receive pool.
+ */
+class DiagnosticMessageView {
+
+public:
+    DiagnosticMessageView(unsigned short sourceAddress, unsigned short targetAddress,
+                            const unsigned char* data, int length, BufferPool& pool):
+        sourceAddress(sourceAddress), targetAddress(targetAddress), userData(data), length(length), pool(&pool) { };
+
+    DiagnosticMessageView(const DiagnosticMessageView&) = delete;
+    DiagnosticMessageView& operator=(const DiagnosticMessageView&) = delete;
+
+    unsigned short getSourceAddress() const { return sourceAddress; };
+    unsigned short getTargetAddress() const { return targetAddress; };
+    const unsigned char* data() const { return userData; };
+    int size() const { return length; };
+
+    PooledBuffer retain() const;
+
+private:
+    unsigned short sourceAddress;
+    unsigned short targetAddress;
+    const unsigned char* userData;
+    int length;
+    BufferPool* pool;
+};
+
+using DiagnosticViewCallback = std::function<void(const DiagnosticMessageView&)>;
+
 const int _DiagnosticPositiveACKLength = 5;
 const int _DiagnosticMessageMinimumLength = 4;
 
 const unsigned char _ValidDiagnosticMessageCode = 0x00;
 const unsigned char _InvalidSourceAddressCode = 0x02;
 const unsigned char _UnknownTargetAddressCode = 0x03;
+const unsigned char _OutOfMemoryCode = 0x05;
 
 unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char sourceAddress [2], unsigned char* data, int diagMessageLength);
+unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char sourceAddress [2], unsigned char* data, int diagMessageLength, BufferPool& pool);
+unsigned char parseDiagnosticMessage(DiagnosticViewCallback callback, unsigned char sourceAddress [2], unsigned char* data, int diagMessageLength, BufferPool& pool);
 unsigned char* createDiagnosticACK(bool ackType, unsigned short sourceAddress, unsigned char targetAddress [2], unsigned char responseCode);
 unsigned char* createDiagnosticMessage(unsigned short sourceAddress, unsigned char targetAddress [2], unsigned char* userData, int userDataLength);
+int encodeDiagnosticACK(unsigned char* buffer, bool ackType, unsigned short sourceAddress, unsigned char targetAddress [2], unsigned char responseCode);
+int encodeDiagnosticMessageHeader(unsigned char* buffer, unsigned short sourceAddress, unsigned char targetAddress [2], int userDataLength);
+int encodeDiagnosticMessage(unsigned char* buffer, unsigned short sourceAddress, unsigned char targetAddress [2], unsigned char* userData, int userDataLength);
 
 
 #endif /* DIAGNOSTICMESSAGEHANDLER_H */
@@ -0,0 +1,172 @@
+#ifndef DOIPCAPTURE_H
+#define DOIPCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint16_t _CaptureDoIPPort = 13400;
+const size_t _MaxReassemblyBytes = 4 * 1024 * 1024;    //out of order data per stream before a gap is skipped
+
+enum CaptureProtocol {
+    CAPTURETCP,
+    CAPTUREUDP
+};
+
+/**
+ * TCP segment or UDP datagram from or to the DoIP port. The payload points
+ * into the mapped capture file and stays valid as long as the reader.
+ */
+struct CapturedPacket {
+    uint64_t timestamp = 0;             //nanoseconds since the epoch
+    CaptureProtocol protocol = CAPTURETCP;
+    unsigned char source[16] = {};      //IPv4 addresses use the first 4 bytes
+    unsigned char destination[16] = {};
+    uint16_t sourcePort = 0;
+    uint16_t destinationPort = 0;
+    uint32_t sequence = 0;              //TCP only
+    uint8_t tcpFlags = 0;
+    unsigned char* payload = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * Reads the packets of a pcap or pcapng file without libpcap. Supported are
+ * Ethernet (also with VLAN tags), Linux cooked capture v1 and v2, BSD
+ * loopback and raw IP link types with IPv4 and IPv6. Only TCP and UDP
+ * packets from or to the DoIP port are returned, fragmented IP packets are
+ * skipped. The file is mapped copy-on-write, so payloads can be decoded in place.
+ */
+class CaptureReader {
+
+public:
+    CaptureReader() = default;
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool open(const std::string& path, uint16_t port = _CaptureDoIPPort);
+    bool next(CapturedPacket& packet);
+    void rewind();
+
+    uint64_t getPacketCount() const { return packetCount; };
+    uint64_t getSkippedPackets() const { return skippedPackets; };
+
+private:
+    enum CaptureFormat {
+        FORMATPCAP,
+        FORMATPCAPNG
+    };
+
+    //pcapng allows several interfaces with their own link type and time resolution
+    struct CaptureInterface {
+        uint32_t linkType;
+        uint64_t ticksPerSecond;
+    };
+
+    unsigned char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t firstRecord = 0;
+    uint16_t port = _CaptureDoIPPort;
+    CaptureFormat format = FORMATPCAP;
+    bool swapped = false;           //the file was written with the other byte order
+    std::vector<CaptureInterface> interfaces;
+
+    uint64_t lastTimestamp = 0;     //simple packet blocks have no timestamp of their own
+    uint64_t packetCount = 0;
+    uint64_t skippedPackets = 0;
+
+    uint16_t read16(const unsigned char* position) const;
+    uint32_t read32(const unsigned char* position) const;
+    bool nextPcapRecord(unsigned char*& frame, size_t& length, uint64_t& timestamp, uint32_t& linkType);
+    bool nextPcapngBlock(unsigned char*& frame, size_t& length, uint64_t& timestamp, uint32_t& linkType);
+    bool readSectionHeader(const unsigned char* block);
+    void readInterface(const unsigned char* body, size_t length);
+    bool decodeLinkLayer(uint32_t linkType, unsigned char* frame, size_t length, CapturedPacket& packet);
+    bool decodeNetworkLayer(uint16_t etherType, unsigned char* frame, size_t length, CapturedPacket& packet);
+    bool decodeTransportLayer(uint8_t protocol, unsigned char* segment, size_t length, CapturedPacket& packet);
+};
+
+/**
+ * Contiguous data of one direction of a DoIP connection, or the data of one datagram
+ */
+struct CaptureChunk {
+    uint64_t timestamp;
+    uint64_t connectionId;      //counts the TCP connections of the capture, UDP datagrams use 0
+    CaptureProtocol protocol;
+    bool toServer;              //sent to the DoIP port
+    bool gap;                   //data before this chunk is missing in the capture
+    bool closed;                //the connection ended, the chunk has no data
+    unsigned char* data;
+    size_t length;
+};
+
+using CaptureChunkCallback = std::function<void(const CaptureChunk& chunk)>;
+
+/**
+ * Puts the TCP segments of a capture back into stream order per connection
+ * and direction. Retransmitted bytes are dropped, segments which arrive
+ * early are kept until the missing data arrives. Data which the capture
+ * lost is reported as gap, the consumer then has to resynchronize, e.g. by
+ * resetting its frame decoder. UDP datagrams are passed on as they are.
+ */
+class CaptureReassembler {
+
+public:
+    explicit CaptureReassembler(uint16_t port = _CaptureDoIPPort): port(port) { };
+
+    void add(const CapturedPacket& packet, const CaptureChunkCallback& callback);
+    void finish(const CaptureChunkCallback& callback);
+
+    uint64_t getConnectionCount() const { return nextConnectionId - 1; };
+    uint64_t getRetransmittedBytes() const { return retransmittedBytes; };
+    uint64_t getMissingBytes() const { return missingBytes; };
+
+private:
+    struct Segment {
+        uint64_t timestamp;
+        unsigned char* data;
+        size_t length;
+    };
+
+    struct Stream {
+        bool toServer = false;
+        bool synchronized = false;      //the first sequence number is known
+        bool gap = false;
+        bool finished = false;          //FIN was received
+        uint32_t firstSequence = 0;
+        uint32_t nextPosition = 0;      //relative to firstSequence
+        std::map<uint32_t, Segment> pending;    //early segments by their position
+        size_t pendingBytes = 0;
+    };
+
+    //both directions of a connection share the connection id
+    struct Connection {
+        std::string key;
+        uint64_t connectionId;
+        uint64_t lastTimestamp;
+        Stream streams[2];              //to the server and to the tester
+    };
+
+    uint16_t port;
+    std::unordered_map<std::string, Connection> connections;
+    uint64_t nextConnectionId = 1;
+    uint64_t retransmittedBytes = 0;
+    uint64_t missingBytes = 0;
+
+    Connection& findConnection(const CapturedPacket& packet, bool toServer, const CaptureChunkCallback& callback);
+    void addSegment(Connection& connection, Stream& stream, const CapturedPacket& packet, const CaptureChunkCallback& callback);
+    void deliver(Connection& connection, Stream& stream, uint64_t timestamp, unsigned char* data, size_t length,
+                 const CaptureChunkCallback& callback);
+    void deliverPending(Connection& connection, Stream& stream, uint64_t timestamp, const CaptureChunkCallback& callback);
+    void skipGap(Connection& connection, Stream& stream, const CaptureChunkCallback& callback);
+    void close(Connection& connection, uint64_t timestamp, const CaptureChunkCallback& callback);
+};
+
+#endif /* DOIPCAPTURE_H */
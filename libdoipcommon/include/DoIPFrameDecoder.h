@@ -0,0 +1,65 @@
+#ifndef DOIPFRAMEDECODER_H
+#define DOIPFRAMEDECODER_H
+
+#include <stddef.h>
+#include <functional>
+#include "DoIPGenericHeaderHandler.h"
+#include "BufferPool.h"
+
+const unsigned char _MessageTooLargeCode = 0x02;
+const unsigned long _DefaultMaxPayloadLength = 0xFFFFFF;
+
+/**
+ * A complete DoIP message or a validation error found by the decoder.
+ * For errors action.type is NEGATIVEACK, action.value holds the NACK code
+ * and payload is nullptr. A NACK sent by the peer is a GENERICNACK frame.
+ * The pointers are only valid during the callback.
+ */
+struct DoIPFrame {
+    GenericHeaderAction action;
+    unsigned char* header;
+    unsigned char* payload;
+};
+
+/**
+ * Called for every decoded frame
+ * @return      false to stop decoding the current chunk, e.g. when the connection was closed
+ */
+using FrameCallback = std::function<bool(const DoIPFrame& frame)>;
+
+/**
+ * Incremental decoder which splits a TCP byte stream into DoIP frames.
+ * Chunks of any size can be fed, partially received messages are kept
+ * until the rest arrives. Frames which are completely contained in a chunk
+ * are passed on without copying, only messages which span several chunks
+ * are collected in a pooled buffer. Large payloads can be received directly
+ * into that buffer through getPayloadWindow().
+ */
+class DoIPFrameDecoder {
+
+public:
+    DoIPFrameDecoder(BufferPool& pool = BufferPool::defaultPool()): pool(&pool) { };
+
+    size_t feed(unsigned char* data, size_t length, FrameCallback callback);
+    unsigned char* getPayloadWindow(size_t& length);
+    void reset();
+
+    void setMaxPayloadLength(unsigned long length) { maxPayloadLength = length; };
+    unsigned long getMaxPayloadLength() const { return maxPayloadLength; };
+    bool isFailed() const { return failed; };
+    bool hasPartialFrame() const { return headerFill > 0 || (bool)payload || skipRemaining > 0; };
+
+private:
+    BufferPool* pool;
+    unsigned long maxPayloadLength = _DefaultMaxPayloadLength;
+
+    unsigned char header[_GenericHeaderLength] = {};
+    size_t headerFill = 0;
+    GenericHeaderAction action = {};
+    PooledBuffer payload;
+    unsigned long payloadFill = 0;
+    unsigned long skipRemaining = 0;
+    bool failed = false;
+};
+
+#endif /* DOIPFRAMEDECODER_H */
@@ -1,6 +1,7 @@
 #ifndef DOIPGENERICHEADERHANDLER_H
 #define DOIPGENERICHEADERHANDLER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 const int _GenericHeaderLength = 8;
@@ -10,6 +11,10 @@ const unsigned char _IncorrectPatternFormatCode = 0x00;
 const unsigned char _UnknownPayloadTypeCode = 0x01;
 const unsigned char _InvalidPayloadLengthCode = 0x04;
 
+/*
+ * NEGATIVEACK is reported by the parser for a header it rejects, value holds
+ * the NACK code to send. A generic header NACK received from the peer is GENERICNACK.
+ */
 enum PayloadType {
     NEGATIVEACK,
     ROUTINGACTIVATIONREQUEST,
@@ -20,16 +25,69 @@ enum PayloadType {
     DIAGNOSTICPOSITIVEACK,
     DIAGNOSTICNEGATIVEACK,
     ALIVECHECKRESPONSE,
+    ALIVECHECKREQUEST,
+    VEHICLEIDENTREQUESTEID,
+    VEHICLEIDENTREQUESTVIN,
+    ENTITYSTATUSREQUEST,
+    ENTITYSTATUSRESPONSE,
+    POWERMODEREQUEST,
+    POWERMODERESPONSE,
+    GENERICNACK,
+    OEMSPECIFIC,
+};
+
+const int _PayloadTypeCount = PayloadType::OEMSPECIFIC + 1;
+
+/*
+ * Checks at compile time that a table which is indexed by PayloadType has
+ * one entry per payload type, listed in the order of the enum
+ */
+template<typename Entry, size_t Count>
+constexpr bool isPayloadTypeTable(const Entry (&entries)[Count], size_t index = 0) {
+    return Count == (size_t)_PayloadTypeCount &&
+           (index == Count || (entries[index].type == static_cast<PayloadType>(index) && isPayloadTypeTable(entries, index + 1)));
+}
+
+/*
+ * How the payload length of a payload type is validated
+ */
+enum PayloadLengthCheck {
+    EXACTLENGTH,        //payload length equals first
+    MINIMUMLENGTH,      //payload length is at least first
+    LENGTHRANGE,        //payload length is between first and second
+    EITHERLENGTH,       //payload length equals first or second
+};
+
+/*
+ * Describes a payload type: its code in the generic header, the
+ * corresponding enum value and the rule for its payload length
+ */
+struct PayloadTypeDefinition {
+    uint16_t code;
+    PayloadType type;
+    PayloadLengthCheck lengthCheck;
+    uint32_t first;
+    uint32_t second;
 };
 
 struct GenericHeaderAction {
     PayloadType type;
     unsigned char value;
     unsigned long payloadLength;
+    uint16_t payloadTypeCode;
 };
 
 GenericHeaderAction parseGenericHeader(unsigned char* data, int dataLenght);
 unsigned char* createGenericHeader(PayloadType type, uint32_t length);
+int encodeGenericHeader(unsigned char* buffer, PayloadType type, uint32_t length);
+int encodeGenericHeader(unsigned char* buffer, uint16_t payloadTypeCode, uint32_t length);
+int encodeNegativeAck(unsigned char* buffer, unsigned char nackCode);
+
+const PayloadTypeDefinition* findPayloadType(uint16_t code);
+uint16_t getPayloadTypeCode(PayloadType type);
+bool registerPayloadType(uint16_t code, PayloadLengthCheck lengthCheck, uint32_t first, uint32_t second = 0);
+bool unregisterPayloadType(uint16_t code);
+bool isValidPayloadLength(const PayloadTypeDefinition& definition, uint32_t payloadLength);
 
 
 #endif /* DOIPGENERICHEADERHANDLER_H */
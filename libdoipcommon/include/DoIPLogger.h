@@ -0,0 +1,248 @@
+#ifndef DOIPLOGGER_H
+#define DOIPLOGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * Log levels for DOIP_LOG_LEVEL. Messages below the configured level are
+ * removed by the preprocessor, their arguments are not evaluated.
+ */
+#define DOIP_LOG_LEVEL_TRACE    0
+#define DOIP_LOG_LEVEL_DEBUG    1
+#define DOIP_LOG_LEVEL_INFO     2
+#define DOIP_LOG_LEVEL_WARNING  3
+#define DOIP_LOG_LEVEL_ERROR    4
+#define DOIP_LOG_LEVEL_OFF      5
+
+#ifndef DOIP_LOG_LEVEL
+#define DOIP_LOG_LEVEL DOIP_LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel {
+    TRACE = DOIP_LOG_LEVEL_TRACE,
+    DEBUG = DOIP_LOG_LEVEL_DEBUG,
+    INFO = DOIP_LOG_LEVEL_INFO,
+    WARNING = DOIP_LOG_LEVEL_WARNING,
+    ERROR = DOIP_LOG_LEVEL_ERROR,
+    OFF = DOIP_LOG_LEVEL_OFF
+};
+
+/**
+ * Receives every formatted line on the logging thread
+ */
+using LogSink = std::function<void(LogLevel level, const char* line)>;
+
+const size_t _LogQueueCapacity = 1024;      //must be a power of two
+const size_t _LogRecordStorage = 192;
+const size_t _LogStringLength = 64;
+const size_t _LogHexDumpLength = 64;
+const size_t _LogLineLength = 512;
+
+/**
+ * Copy of a string argument, so the caller's buffer may be reused right away.
+ * Longer strings are truncated.
+ */
+struct LogString {
+    char text[_LogStringLength];
+};
+
+/*
+ * Converts the arguments of a log call into values which are safe to keep
+ * until the logging thread formats them. Strings are copied, everything else
+ * is kept by value.
+ */
+template<typename T>
+struct LogArgument {
+    typedef T type;
+    static T capture(T value) { return value; };
+    static T forward(const T& value) { return value; };
+};
+
+template<>
+struct LogArgument<const char*> {
+    typedef LogString type;
+    static LogString capture(const char* value) {
+        LogString copy;
+        strncpy(copy.text, value != nullptr ? value : "(null)", _LogStringLength - 1);
+        copy.text[_LogStringLength - 1] = '\0';
+        return copy;
+    };
+    static const char* forward(const LogString& value) { return value.text; };
+};
+
+template<>
+struct LogArgument<char*>: LogArgument<const char*> { };
+
+template<size_t... I> struct LogIndices { };
+template<size_t N, size_t... I> struct MakeLogIndices: MakeLogIndices<N - 1, N - 1, I...> { };
+template<size_t... I> struct MakeLogIndices<0, I...> { typedef LogIndices<I...> type; };
+
+/*
+ * Format string and captured arguments of one log call. It is placed into
+ * the storage of a queue slot and formatted by the logging thread.
+ */
+template<typename... Args>
+struct LogMessage {
+    const char* format;
+    std::tuple<typename LogArgument<Args>::type...> arguments;
+
+    LogMessage(const char* format, Args... args): format(format), arguments(LogArgument<Args>::capture(args)...) { };
+
+    static void write(const void* storage, char* line, size_t length) {
+        const LogMessage* message = static_cast<const LogMessage*>(storage);
+        message->print(line, length, typename MakeLogIndices<sizeof...(Args)>::type());
+    };
+
+    template<size_t... I>
+    void print(char* line, size_t length, LogIndices<I...>) const {
+        snprintf(line, length, format, LogArgument<Args>::forward(std::get<I>(arguments))...);
+    };
+
+    void print(char* line, size_t length, LogIndices<>) const {
+        snprintf(line, length, "%s", format);
+    };
+};
+
+/**
+ * Asynchronous logger. Log calls only capture their arguments into a slot of
+ * a bounded lock-free queue, formatting and writing happens on a background
+ * thread. When the queue is full, messages are dropped and counted instead
+ * of blocking the caller. Use the DOIP_LOG_* macros instead of calling log()
+ * directly, so that disabled levels cost nothing.
+ */
+class DoIPLogger {
+
+public:
+    static DoIPLogger& instance();
+
+    DoIPLogger(const DoIPLogger&) = delete;
+    DoIPLogger& operator=(const DoIPLogger&) = delete;
+
+    template<typename... Args>
+    void log(LogLevel level, const char* format, Args... args) {
+        typedef LogMessage<typename std::decay<Args>::type...> Message;
+        static_assert(sizeof(Message) <= _LogRecordStorage, "too many arguments for one log message");
+        static_assert(std::is_trivially_destructible<Message>::value, "log arguments have to be trivially destructible");
+
+        if(!isEnabled(level)) {
+            return;
+        }
+
+        Record* record = claimRecord();
+        if(record == nullptr) {
+            return;
+        }
+        new (record->storage) Message(format, args...);
+        record->formatter = &Message::write;
+        publishRecord(record, level);
+    };
+
+    void logHex(LogLevel level, const char* prefix, const unsigned char* data, size_t length);
+
+    bool isEnabled(LogLevel level) const { return level >= minimumLevel.load(std::memory_order_relaxed); };
+    void setLevel(LogLevel level) { minimumLevel = level; };
+    void setSink(LogSink sink);
+    void flush();
+
+    uint64_t getDroppedMessages() const { return droppedMessages; };
+
+private:
+    using RecordFormatter = void (*)(const void* storage, char* line, size_t length);
+
+    struct Record {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        RecordFormatter formatter;
+        alignas(std::max_align_t) unsigned char storage[_LogRecordStorage];
+    };
+
+    struct HexDump {
+        const char* prefix;
+        size_t length;
+        unsigned char data[_LogHexDumpLength];
+
+        static void write(const void* storage, char* line, size_t length);
+    };
+
+    DoIPLogger();
+
+    Record records[_LogQueueCapacity];
+    std::atomic<size_t> enqueuePosition;
+    std::atomic<size_t> dequeuePosition;
+    std::atomic<uint64_t> droppedMessages;
+    std::atomic<LogLevel> minimumLevel;
+
+    std::mutex sinkMutex;
+    LogSink sink;
+
+    std::mutex wakeupMutex;
+    std::condition_variable wakeupCondition;
+    std::atomic<bool> consumerSleeping;
+    std::thread consumer;
+
+    Record* claimRecord();
+    void publishRecord(Record* record, LogLevel level);
+    void consumeRecords();
+    size_t writeAvailableRecords();
+
+    static void writeToConsole(LogLevel level, const char* line);
+};
+
+/*
+ * Checks the format string against the arguments at compile time
+ */
+static inline void checkLogFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static inline void checkLogFormat(const char* format, ...) { (void)format; }
+
+#define DOIP_LOG(level, ...) \
+    do { \
+        if(false) checkLogFormat(__VA_ARGS__); \
+        DoIPLogger::instance().log(level, __VA_ARGS__); \
+    } while(0)
+
+#if DOIP_LOG_LEVEL <= DOIP_LOG_LEVEL_TRACE
+#define DOIP_LOG_TRACE(...) DOIP_LOG(LogLevel::TRACE, __VA_ARGS__)
+#define DOIP_LOG_HEX(prefix, data, length) DoIPLogger::instance().logHex(LogLevel::TRACE, "" prefix, data, length)
+#else
+#define DOIP_LOG_TRACE(...) do { } while(0)
+#define DOIP_LOG_HEX(prefix, data, length) do { } while(0)
+#endif
+
+#if DOIP_LOG_LEVEL <= DOIP_LOG_LEVEL_DEBUG
+#define DOIP_LOG_DEBUG(...) DOIP_LOG(LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define DOIP_LOG_DEBUG(...) do { } while(0)
+#endif
+
+#if DOIP_LOG_LEVEL <= DOIP_LOG_LEVEL_INFO
+#define DOIP_LOG_INFO(...) DOIP_LOG(LogLevel::INFO, __VA_ARGS__)
+#else
+#define DOIP_LOG_INFO(...) do { } while(0)
+#endif
+
+#if DOIP_LOG_LEVEL <= DOIP_LOG_LEVEL_WARNING
+#define DOIP_LOG_WARNING(...) DOIP_LOG(LogLevel::WARNING, __VA_ARGS__)
+#else
+#define DOIP_LOG_WARNING(...) do { } while(0)
+#endif
+
+#if DOIP_LOG_LEVEL <= DOIP_LOG_LEVEL_ERROR
+#define DOIP_LOG_ERROR(...) DOIP_LOG(LogLevel::ERROR, __VA_ARGS__)
+#else
+#define DOIP_LOG_ERROR(...) do { } while(0)
+#endif
+
+#endif /* DOIPLOGGER_H */
@@ -0,0 +1,195 @@
+#ifndef DOIPMETRICS_H
+#define DOIPMETRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DoIPGenericHeaderHandler.h"
+
+const int _LatencySubBucketBits = 3;                        //8 buckets per power of two, 12.5 % resolution
+const int _LatencySubBuckets = 1 << _LatencySubBucketBits;
+const int _LatencyMaxBit = 40;                              //longer latencies than 2^40 ns (18 minutes) are clamped
+const int _LatencyBucketCount = (_LatencyMaxBit - _LatencySubBucketBits + 1) * _LatencySubBuckets;
+const int _MetricsTargetSlots = 128;                        //target addresses with an own latency histogram per thread
+const int _MetricsCodeCount = 256;
+
+/**
+ * Counter which is only written by the thread owning it, so an increment
+ * is a plain load and store instead of a locked read-modify-write
+ */
+struct MetricsCounter {
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); };
+    uint64_t get() const { return value.load(std::memory_order_relaxed); };
+};
+
+/**
+ * Log-linear latency histogram in the style of HdrHistogram. Every power of
+ * two is split into _LatencySubBuckets buckets, so the relative error of a
+ * percentile is bounded while the histogram has a fixed size.
+ * Only the owning thread records, every thread may read.
+ */
+class LatencyHistogram {
+
+public:
+    void record(uint64_t nanoseconds);
+
+    static size_t bucketIndex(uint64_t nanoseconds);
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    friend struct LatencySnapshot;
+
+    MetricsCounter buckets[_LatencyBucketCount];
+    MetricsCounter count;
+    MetricsCounter sum;
+    MetricsCounter maximum;
+};
+
+/**
+ * Merged copy of latency histograms
+ */
+struct LatencySnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(_LatencyBucketCount);
+
+    void merge(const LatencyHistogram& histogram);
+    uint64_t percentile(double percent) const;
+    double mean() const { return count > 0 ? (double)sum / count : 0.0; };
+};
+
+/**
+ * Sum of the metrics of all threads at one point in time
+ */
+struct MetricsSnapshot {
+    uint64_t messagesIn[_PayloadTypeCount] = {};
+    uint64_t bytesIn[_PayloadTypeCount] = {};
+    uint64_t messagesOut[_PayloadTypeCount] = {};
+    uint64_t bytesOut[_PayloadTypeCount] = {};
+    uint64_t genericNacks[_MetricsCodeCount] = {};          //by generic header nack code
+    uint64_t diagnosticNacks[_MetricsCodeCount] = {};       //by diagnostic message nack code
+    uint64_t routingActivations[_MetricsCodeCount] = {};    //by routing activation response code
+    uint64_t aliveCheckTimeouts = 0;
+
+    std::map<unsigned short, LatencySnapshot> callbackLatency;     //by target address
+    LatencySnapshot otherCallbackLatency;                          //targets which found no free slot
+
+    std::string toText() const;
+};
+
+/**
+ * Metrics of the library. Every thread records into its own shard, so
+ * recording costs a few nanoseconds and never locks or shares a cache line
+ * with other threads. snapshot() sums all shards. The shard of a thread
+ * which exits is kept and handed to the next new thread, so no counts are
+ * lost. Optionally the metrics are served as text on a unix socket.
+ */
+class DoIPMetrics {
+
+public:
+    static DoIPMetrics& instance();
+
+    DoIPMetrics(const DoIPMetrics&) = delete;
+    DoIPMetrics& operator=(const DoIPMetrics&) = delete;
+
+    void recordMessageIn(PayloadType type, size_t bytes) {
+        Shard& current = shard();
+        current.messagesIn[type].add(1);
+        current.bytesIn[type].add(bytes);
+    };
+    void recordMessageOut(PayloadType type, size_t bytes) {
+        Shard& current = shard();
+        current.messagesOut[type].add(1);
+        current.bytesOut[type].add(bytes);
+    };
+    void recordEncodedMessageOut(const unsigned char* message, size_t bytes);
+    void recordGenericNack(unsigned char code) { shard().genericNacks[code].add(1); };
+    void recordDiagnosticNack(unsigned char code) { shard().diagnosticNacks[code].add(1); };
+    void recordRoutingActivation(unsigned char responseCode) { shard().routingActivations[responseCode].add(1); };
+    void recordAliveCheckTimeout() { shard().aliveCheckTimeouts.add(1); };
+    void recordCallbackLatency(unsigned short targetAddress, uint64_t nanoseconds);
+
+    MetricsSnapshot snapshot();
+
+    bool startTextEndpoint(const std::string& socketPath);
+    void stopTextEndpoint();
+
+private:
+    struct TargetSlot {
+        std::atomic<int32_t> address{-1};                   //-1 marks a free slot
+        std::atomic<LatencyHistogram*> histogram{nullptr};
+    };
+
+    struct Shard {
+        MetricsCounter messagesIn[_PayloadTypeCount];
+        MetricsCounter bytesIn[_PayloadTypeCount];
+        MetricsCounter messagesOut[_PayloadTypeCount];
+        MetricsCounter bytesOut[_PayloadTypeCount];
+        MetricsCounter genericNacks[_MetricsCodeCount];
+        MetricsCounter diagnosticNacks[_MetricsCodeCount];
+        MetricsCounter routingActivations[_MetricsCodeCount];
+        MetricsCounter aliveCheckTimeouts;
+        TargetSlot targets[_MetricsTargetSlots];
+        LatencyHistogram otherTargets;
+        bool inUse = false;
+    };
+
+    DoIPMetrics() = default;
+
+    static thread_local Shard* currentShard;
+
+    std::mutex shardMutex;
+    std::vector<Shard*> shards;
+
+    std::mutex endpointMutex;
+    std::thread endpointThread;
+    int endpointSocket = -1;
+    int endpointWakeup = -1;
+    std::string endpointPath;
+
+    Shard& shard() {
+        if(currentShard == nullptr) {
+            currentShard = acquireShard();
+        }
+        return *currentShard;
+    };
+    Shard* acquireShard();
+    void releaseShard(Shard* shard);
+    LatencyHistogram& targetHistogram(Shard& shard, unsigned short targetAddress);
+    void serveTextEndpoint();
+
+    friend struct MetricsShardRelease;
+};
+
+/**
+ * Measures the time of an application callback for a target address and
+ * records it when the timer goes out of scope
+ */
+class CallbackLatencyTimer {
+
+public:
+    explicit CallbackLatencyTimer(unsigned short targetAddress):
+        targetAddress(targetAddress), start(std::chrono::steady_clock::now()) { };
+    ~CallbackLatencyTimer() {
+        DoIPMetrics::instance().recordCallbackLatency(targetAddress,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    CallbackLatencyTimer(const CallbackLatencyTimer&) = delete;
+    CallbackLatencyTimer& operator=(const CallbackLatencyTimer&) = delete;
+
+private:
+    unsigned short targetAddress;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif /* DOIPMETRICS_H */
@@ -0,0 +1,231 @@
+#ifndef DOIPTASK_H
+#define DOIPTASK_H
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "The coroutine API of libdoip requires C++20 (-std=c++20)"
+#endif
+
+#include <stddef.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+
+const size_t _FrameSizeGranularity = 64;
+const size_t _FrameSizeClasses = 32;            //frames up to 2 KiB are recycled
+const size_t _MaxFreeFramesPerClass = 4096;     //per thread, more frames go back to the heap
+
+/**
+ * Allocator for coroutine frames. Frames of the same size are recycled
+ * through per-thread free lists, so starting a session or a request does
+ * not call malloc in steady state. A frame may be freed by another thread
+ * than the one which allocated it, it then joins the free list of that thread.
+ */
+class CoroutineFrameAllocator {
+
+public:
+    static void* allocate(size_t size) {
+        size_t sizeClass = (size + _FrameSizeGranularity - 1) / _FrameSizeGranularity;
+        if(sizeClass < _FrameSizeClasses) {
+            FreeList& list = freeLists()[sizeClass];
+            if(list.head != nullptr) {
+                FreeFrame* frame = list.head;
+                list.head = frame->next;
+                list.count--;
+                return frame;
+            }
+            return ::operator new(sizeClass * _FrameSizeGranularity);
+        }
+        return ::operator new(size);
+    }
+
+    static void deallocate(void* pointer, size_t size) {
+        size_t sizeClass = (size + _FrameSizeGranularity - 1) / _FrameSizeGranularity;
+        if(sizeClass < _FrameSizeClasses) {
+            FreeList& list = freeLists()[sizeClass];
+            if(list.count < _MaxFreeFramesPerClass) {
+                FreeFrame* frame = static_cast<FreeFrame*>(pointer);
+                frame->next = list.head;
+                list.head = frame;
+                list.count++;
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+
+    struct FreeList {
+        FreeFrame* head = nullptr;
+        size_t count = 0;
+    };
+
+    //the lists give their frames back to the heap when the thread exits
+    struct ThreadFreeLists {
+        FreeList lists[_FrameSizeClasses];
+
+        ~ThreadFreeLists() {
+            for(FreeList& list : lists) {
+                while(list.head != nullptr) {
+                    FreeFrame* frame = list.head;
+                    list.head = frame->next;
+                    ::operator delete(frame);
+                }
+            }
+        }
+    };
+
+    static FreeList* freeLists() {
+        static thread_local ThreadFreeLists threadLists;
+        return threadLists.lists;
+    }
+};
+
+template<typename T>
+class DoIPTask;
+
+/*
+ * Parts of the promise which do not depend on the result type
+ */
+struct DoIPTaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    bool detached = false;
+
+    static void* operator new(size_t size) { return CoroutineFrameAllocator::allocate(size); }
+    static void operator delete(void* pointer, size_t size) { CoroutineFrameAllocator::deallocate(pointer, size); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    //resumes the awaiting coroutine, a detached task releases its own frame
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            DoIPTaskPromiseBase& promise = handle.promise();
+            if(promise.continuation) {
+                return promise.continuation;
+            }
+            if(promise.detached) {
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept { }
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T>
+struct DoIPTaskPromise : DoIPTaskPromiseBase {
+    std::optional<T> value;
+
+    DoIPTask<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+
+    T result() {
+        if(exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct DoIPTaskPromise<void> : DoIPTaskPromiseBase {
+    DoIPTask<void> get_return_object();
+    void return_void() { }
+
+    void result() {
+        if(exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+/**
+ * Lazily started coroutine which returns a T. A task runs when it is
+ * awaited, the awaiting coroutine continues when the task finished. A task
+ * which is not awaited by another coroutine is started with detach() and
+ * releases itself when it finished, e.g. the coroutine of a tester session.
+ */
+template<typename T = void>
+class [[nodiscard]] DoIPTask {
+
+public:
+    using promise_type = DoIPTaskPromise<T>;
+
+    DoIPTask() = default;
+    explicit DoIPTask(std::coroutine_handle<promise_type> handle): handle(handle) { }
+    DoIPTask(DoIPTask&& other) noexcept: handle(std::exchange(other.handle, nullptr)) { }
+    DoIPTask& operator=(DoIPTask&& other) noexcept {
+        if(this != &other) {
+            release();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~DoIPTask() { release(); }
+
+    DoIPTask(const DoIPTask&) = delete;
+    DoIPTask& operator=(const DoIPTask&) = delete;
+
+    bool isDone() const { return !handle || handle.done(); }
+
+    /**
+     * Runs the task until its first suspension and hands the frame over to
+     * the task itself, it is destroyed when the coroutine finished
+     */
+    void detach() {
+        if(!handle) {
+            return;
+        }
+        std::coroutine_handle<promise_type> started = std::exchange(handle, nullptr);
+        started.promise().detached = true;
+        started.resume();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{handle};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    void release() {
+        if(handle) {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+};
+
+template<typename T>
+inline DoIPTask<T> DoIPTaskPromise<T>::get_return_object() {
+    return DoIPTask<T>(std::coroutine_handle<DoIPTaskPromise<T>>::from_promise(*this));
+}
+
+inline DoIPTask<void> DoIPTaskPromise<void>::get_return_object() {
+    return DoIPTask<void>(std::coroutine_handle<DoIPTaskPromise<void>>::from_promise(*this));
+}
+
+#endif /* DOIPTASK_H */
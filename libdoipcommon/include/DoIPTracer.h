@@ -0,0 +1,105 @@
+#ifndef DOIPTRACER_H
+#define DOIPTRACER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct msghdr;
+
+const size_t _TraceBufferCapacity = 16384;      //spans per thread, older spans are overwritten
+
+/**
+ * Opt-in tracing of the stages a DoIP message passes, e.g. socket read,
+ * header parsing, the application callbacks and the response write. Every
+ * thread writes its spans into an own ring buffer without locking, the spans
+ * of all threads can be written as Chrome trace event JSON, which
+ * chrome://tracing and Perfetto display. While tracing is disabled a span
+ * costs one relaxed load.
+ */
+class DoIPTracer {
+
+public:
+    static DoIPTracer& instance();
+
+    DoIPTracer(const DoIPTracer&) = delete;
+    DoIPTracer& operator=(const DoIPTracer&) = delete;
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); };
+    static uint64_t now();
+
+    void enable(bool kernelTimestamps = false);
+    void disable();
+    bool usesKernelTimestamps() const { return kernelTimestamps.load(std::memory_order_relaxed); };
+    static bool enableKernelTimestamps(int socket);
+    static bool getKernelReceiveTime(const struct msghdr& message, uint64_t& timestamp);
+
+    void record(const char* name, uint64_t start, uint64_t end, const char* argument = nullptr, uint32_t value = 0);
+    void clear();
+
+    std::string toChromeTrace();
+    bool writeChromeTrace(const std::string& path);
+
+private:
+    //name and argument have to be string literals, only the pointers are stored
+    struct Span {
+        const char* name;
+        const char* argument;
+        uint64_t start;
+        uint64_t duration;
+        uint32_t threadId;
+        uint32_t value;
+    };
+
+    struct Buffer {
+        Span spans[_TraceBufferCapacity];
+        std::atomic<uint64_t> written{0};
+        std::atomic<uint64_t> cleared{0};
+        bool inUse = false;
+    };
+
+    DoIPTracer() = default;
+
+    static std::atomic<bool> enabled;
+    static thread_local Buffer* currentBuffer;
+    static thread_local uint32_t currentThreadId;
+
+    std::atomic<bool> kernelTimestamps{false};
+    std::mutex bufferMutex;
+    std::vector<Buffer*> buffers;
+
+    Buffer* acquireBuffer();
+    void releaseBuffer(Buffer* buffer);
+
+    friend struct TraceBufferRelease;
+};
+
+/**
+ * Records the time between its construction and destruction as span,
+ * if tracing was enabled when it was constructed
+ */
+class TraceSpan {
+
+public:
+    explicit TraceSpan(const char* name, const char* argument = nullptr, uint32_t value = 0):
+        name(name), argument(argument), value(value), start(DoIPTracer::isEnabled() ? DoIPTracer::now() : 0) { };
+    ~TraceSpan() {
+        if(start != 0) {
+            DoIPTracer::instance().record(name, start, DoIPTracer::now(), argument, value);
+        }
+    };
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const char* argument;
+    uint32_t value;
+    uint64_t start;
+};
+
+#endif /* DOIPTRACER_H */
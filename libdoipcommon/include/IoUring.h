@@ -0,0 +1,81 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+const unsigned _DefaultUringEntries = 256;
+const unsigned _DefaultUringCompletionEntries = 4096;     //multishot requests post many completions per submission
+
+/**
+ * Minimal io_uring ring on the raw system calls, without liburing. The
+ * submission and completion queues are used by one thread: requests are
+ * collected with getSubmission() and passed to the kernel together with the
+ * wait for completions, so one system call serves a whole loop iteration.
+ */
+class IoUring {
+
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    static bool isSupported();
+
+    bool setup(unsigned entries = _DefaultUringEntries, unsigned completionEntries = _DefaultUringCompletionEntries);
+    bool isReady() const { return ringFd >= 0; };
+    int getFd() const { return ringFd; };
+
+    struct io_uring_sqe* getSubmission();
+    int submit();
+    int submitAndWait(unsigned waitCount, int timeoutMs);
+
+    struct io_uring_cqe* peekCompletion();
+    void completionSeen();
+
+    static void prepareMultishotPoll(struct io_uring_sqe* submission, int fd, uint32_t events, uint64_t userData);
+    static void prepareMultishotReceive(struct io_uring_sqe* submission, int fd, uint16_t group, uint64_t userData);
+
+    bool setupBufferRing(uint16_t group, unsigned count, unsigned bufferSize);
+    unsigned char* getBuffer(uint16_t bufferId) { return bufferMemory + (size_t)bufferId * bufferSize; };
+    unsigned getBufferSize() const { return bufferSize; };
+    void recycleBuffer(uint16_t bufferId);
+
+private:
+    int ringFd = -1;
+
+    //submission queue
+    void* submissionRing = nullptr;
+    size_t submissionRingSize = 0;
+    unsigned* submissionHead = nullptr;
+    unsigned* submissionTail = nullptr;
+    unsigned submissionMask = 0;
+    unsigned* submissionArray = nullptr;
+    struct io_uring_sqe* submissions = nullptr;
+    size_t submissionsSize = 0;
+    unsigned localTail = 0;         //tail including the requests which were not passed to the kernel yet
+
+    //completion queue, shares the mapping with the submission queue
+    void* completionRing = nullptr;
+    size_t completionRingSize = 0;
+    unsigned* completionHead = nullptr;
+    unsigned* completionTail = nullptr;
+    unsigned completionMask = 0;
+    struct io_uring_cqe* completions = nullptr;
+
+    //ring of buffers the kernel picks for multishot receives
+    struct io_uring_buf_ring* bufferRing = nullptr;
+    size_t bufferRingSize = 0;
+    unsigned char* bufferMemory = nullptr;
+    unsigned bufferCount = 0;
+    unsigned bufferSize = 0;
+    unsigned short bufferTail = 0;
+
+    int enter(unsigned submitCount, unsigned waitCount, unsigned flags, const struct io_uring_getevents_arg* argument);
+    unsigned pendingSubmissions();
+};
+
+#endif /* IOURING_H */
@@ -0,0 +1,18 @@
+#ifndef SCATTERGATHERSEND_H
+#define SCATTERGATHERSEND_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+const int _DefaultSendTimeoutMs = 1000;
+
+/**
+ * Sends the bytes of the vectors in order. A result smaller than the total
+ * length means that the socket stayed full for timeoutMs or failed after a
+ * part was sent. The peer then received a partial message and the vectors
+ * describe the unsent bytes: the caller has to send them later, e.g. from a
+ * send queue, or close the connection, otherwise the stream is corrupted.
+ */
+ssize_t sendVectors(int socket, struct iovec* vectors, int count, int timeoutMs = _DefaultSendTimeoutMs);
+
+#endif /* SCATTERGATHERSEND_H */
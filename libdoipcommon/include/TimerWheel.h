@@ -0,0 +1,121 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+using TimerCallback = std::function<void()>;
+using TimerWakeupCallback = std::function<void()>;
+using TimerClock = std::function<uint64_t()>;     //monotonic time in milliseconds
+
+const uint32_t _DefaultTimerTickMs = 10;
+const uint32_t _DefaultTimerSlots = 512;
+
+class TimerWheel;
+
+struct TimerLink {
+    TimerLink* prev = nullptr;
+    TimerLink* next = nullptr;
+};
+
+/**
+ * Intrusive timer which is owned by the user of a TimerWheel, so arming and
+ * cancelling never allocates. The destructor cancels an armed timer.
+ */
+class TimerEntry : private TimerLink {
+
+public:
+    TimerEntry() = default;
+    explicit TimerEntry(TimerCallback callback): callback(callback) { };
+    ~TimerEntry();
+
+    TimerEntry(const TimerEntry&) = delete;
+    TimerEntry& operator=(const TimerEntry&) = delete;
+
+    bool isArmed() const { return armed; };
+
+    TimerCallback callback;
+
+private:
+    friend class TimerWheel;
+
+    TimerWheel* wheel = nullptr;    //wheel the timer was last armed on
+    bool armed = false;
+    uint64_t expiryTick = 0;
+};
+
+/**
+ * Hashed timing wheel driven by the monotonic clock, or by the given clock
+ * e.g. in tests. Arming, re-arming and
+ * cancelling a timer is O(1). The wheel does not own a thread, it expires
+ * timers when advance() is called by its driver (an event loop or the
+ * shared TimerService). Callbacks are invoked on the driver thread while
+ * the wheel is locked, so they may arm and cancel timers but must not block.
+ */
+class TimerWheel {
+
+public:
+    TimerWheel(uint32_t tickMs = _DefaultTimerTickMs, uint32_t slotCount = _DefaultTimerSlots, TimerClock clock = nullptr);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    void arm(TimerEntry& entry, uint32_t delayMs);
+    void cancel(TimerEntry& entry);
+
+    int advance();
+    int millisecondsUntilNextExpiry();
+
+    void setWakeupCallback(TimerWakeupCallback callback);
+    size_t getArmedCount() const { return armedCount; };
+    uint32_t getTickMs() const { return tickMs; };
+
+private:
+    std::recursive_mutex wheelMutex;
+    std::vector<TimerLink> slots;
+    uint32_t tickMs;
+    size_t armedCount = 0;
+
+    TimerClock clock;
+    uint64_t origin;
+    uint64_t currentTick = 0;
+    uint64_t scheduledWakeupTick = UINT64_MAX;
+    TimerWakeupCallback wakeupCallback;
+
+    uint64_t now() const;
+    uint64_t elapsedTicks() const;
+    void unlink(TimerEntry& entry);
+    int expireSlot(TimerLink& slot, uint64_t tick);
+};
+
+/**
+ * Shared timer service which drives one TimerWheel with a single thread for
+ * all timers that are not driven by an event loop. The thread is started
+ * when the first timer is armed and sleeps until the next timer is due, so
+ * idle timers cost no CPU time.
+ */
+class TimerService {
+
+public:
+    static TimerService& instance();
+
+    TimerWheel& getTimerWheel() { return timerWheel; };
+
+private:
+    TimerService();
+
+    TimerWheel timerWheel;
+    std::mutex serviceMutex;
+    std::condition_variable serviceCondition;
+    bool wakeupPending = false;
+    std::once_flag threadStarted;
+
+    void run();
+};
+
+#endif /* TIMERWHEEL_H */
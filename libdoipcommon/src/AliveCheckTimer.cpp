@@ -1,26 +1,35 @@
 #include "AliveCheckTimer.h"
 
+/**
+ * Creates a timer which is driven by the shared timer service
+ */
+AliveCheckTimer::AliveCheckTimer():
+    disabled(false), active(false), timeout(false), timerWheel(&TimerService::instance().getTimerWheel()) {
+    timerEntry.callback = std::bind(&AliveCheckTimer::waitForResponse, this);
+}
+
 /**
  * Initialize and starts the alive check timer
  */
 void AliveCheckTimer::startTimer() {
     if(disabled == false) {
+        timeout = false;
         resetTimer();
-        timerThreads.push_back(std::thread(&AliveCheckTimer::waitForResponse, this));
     }
 }
 
 /**
- * Checks if a timeout occured
+ * Is called by the timer wheel when no response was received in time
  */
 void AliveCheckTimer::waitForResponse() {
-    while(!disabled) {
-        double secondsPassed = (clock() - startTime) / CLOCKS_PER_SEC;
-        if(secondsPassed >= maxSeconds) {
-            disabled = true;
-            timeout = true;
-            cb();
-        }
+    if(disabled) {
+        return;
+    }
+
+    disabled = true;
+    timeout = true;
+    if(cb) {
+        cb();
     }
 }
 
@@ -28,8 +37,18 @@ void AliveCheckTimer::waitForResponse() {
  * Resets the timer to the current time
  */
 void AliveCheckTimer::resetTimer() {
-    startTime = clock();
-    active = true;
+    if(disabled == false) {
+        active = true;
+        timerWheel->arm(timerEntry, maxMilliseconds);
+    }
+}
+
+/**
+ * Stops the timer without calling the timeout callback
+ */
+void AliveCheckTimer::stopTimer() {
+    active = false;
+    timerWheel->cancel(timerEntry);
 }
 
 /**
@@ -37,12 +56,31 @@ void AliveCheckTimer::resetTimer() {
  * @param seconds   seconds till timeout
  */
 void AliveCheckTimer::setTimer(uint16_t seconds) {
-    maxSeconds = seconds;
+    maxMilliseconds = (uint32_t)seconds * 1000;
+}
+
+/**
+ * Sets the maximum milliseconds to wait till a timeout occurs
+ * @param milliseconds  milliseconds till timeout
+ */
+void AliveCheckTimer::setTimerMilliseconds(uint32_t milliseconds) {
+    maxMilliseconds = milliseconds;
+}
+
+/**
+ * Sets the timer wheel which drives this timer, e.g. the wheel of an event loop.
+ * A running timer is moved to the new wheel.
+ * @param wheel     wheel which expires this timer
+ */
+void AliveCheckTimer::setTimerWheel(TimerWheel& wheel) {
+    timerWheel->cancel(timerEntry);
+    timerWheel = &wheel;
+    if(active && !disabled) {
+        timerWheel->arm(timerEntry, maxMilliseconds);
+    }
 }
 
 AliveCheckTimer::~AliveCheckTimer() {
     disabled = true;
-    if(timerThreads.size() > 0) {
-        timerThreads.at(0).join();
-    }
+    timerWheel->cancel(timerEntry);
 }
@@ -0,0 +1,207 @@
+#include "BufferPool.h"
+
+#include <sys/mman.h>
+#include <algorithm>
+
+static const size_t defaultBlockSizes[] = { 64, 256, 1024, 4096, 16384, 65536 };
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other):
+    pool(other.pool), sizeClass(other.sizeClass), buffer(other.buffer),
+    length(other.length), blockSize(other.blockSize) {
+    other.buffer = nullptr;
+    other.length = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) {
+    if(this != &other) {
+        reset();
+        pool = other.pool;
+        sizeClass = other.sizeClass;
+        buffer = other.buffer;
+        length = other.length;
+        blockSize = other.blockSize;
+        other.buffer = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer() {
+    reset();
+}
+
+/**
+ * Returns the buffer to its pool, afterwards the handle is empty
+ */
+void PooledBuffer::reset() {
+    if(buffer != nullptr) {
+        pool->release(sizeClass, buffer);
+        buffer = nullptr;
+        length = 0;
+    }
+}
+
+/**
+ * Creates a pool with the default size classes from 64 bytes to 64 KiB
+ * @param useHugePages  back the slabs with huge pages if the system provides them
+ */
+BufferPool::BufferPool(bool useHugePages): slabSize(_DefaultSlabSize), useHugePages(useHugePages) {
+    setupSizeClasses(std::vector<size_t>(defaultBlockSizes,
+                        defaultBlockSizes + sizeof(defaultBlockSizes) / sizeof(defaultBlockSizes[0])));
+}
+
+/**
+ * Creates a pool with custom size classes
+ * @param blockSizes    capacity of the buffers of each size class
+ * @param slabSize      number of bytes which are allocated at once for a size class
+ * @param useHugePages  back the slabs with huge pages if the system provides them
+ */
+BufferPool::BufferPool(const std::vector<size_t>& blockSizes, size_t slabSize, bool useHugePages):
+    slabSize(slabSize), useHugePages(useHugePages) {
+    setupSizeClasses(blockSizes);
+}
+
+BufferPool::~BufferPool() {
+    for(Slab& slab : slabs) {
+        munmap(slab.memory, slab.size);
+    }
+}
+
+/**
+ * Returns the pool which is used when no other pool was configured.
+ * The pool is never destroyed, so buffers in static objects stay valid.
+ */
+BufferPool& BufferPool::defaultPool() {
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+/**
+ * Hands out a buffer with at least length bytes
+ * @param length    number of bytes which are needed
+ * @return          handle which returns the buffer to the pool on destruction
+ */
+PooledBuffer BufferPool::acquire(size_t length) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    for(size_t i = 0; i < sizeClasses.size(); i++) {
+        SizeClass& sizeClass = sizeClasses[i];
+        if(sizeClass.statistics.blockSize < length) {
+            continue;
+        }
+
+        if(sizeClass.freeBlocks.empty() && !allocateSlab(sizeClass)) {
+            break;
+        }
+
+        unsigned char* buffer = sizeClass.freeBlocks.back();
+        sizeClass.freeBlocks.pop_back();
+
+        BufferPoolStatistics& statistics = sizeClass.statistics;
+        statistics.acquisitions++;
+        statistics.blocksInUse++;
+        statistics.peakBlocksInUse = std::max(statistics.peakBlocksInUse, statistics.blocksInUse);
+
+        return PooledBuffer(this, (int)i, buffer, length, statistics.blockSize);
+    }
+
+    //larger than every size class or out of memory for slabs
+    oversizeAllocations++;
+    return PooledBuffer(this, -1, new unsigned char[length], length, length);
+}
+
+/**
+ * Returns a snapshot of the statistics of every size class
+ */
+std::vector<BufferPoolStatistics> BufferPool::getStatistics() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    std::vector<BufferPoolStatistics> statistics;
+    for(SizeClass& sizeClass : sizeClasses) {
+        statistics.push_back(sizeClass.statistics);
+    }
+    return statistics;
+}
+
+/**
+ * Returns how many requests did not fit in a size class and were allocated from the heap
+ */
+uint64_t BufferPool::getOversizeAllocations() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return oversizeAllocations;
+}
+
+void BufferPool::setupSizeClasses(const std::vector<size_t>& blockSizes) {
+    std::vector<size_t> sortedSizes(blockSizes);
+    std::sort(sortedSizes.begin(), sortedSizes.end());
+
+    for(size_t blockSize : sortedSizes) {
+        if(blockSize == 0) {
+            continue;
+        }
+        SizeClass sizeClass;
+        sizeClass.statistics = BufferPoolStatistics();
+        sizeClass.statistics.blockSize = blockSize;
+        sizeClasses.push_back(sizeClass);
+    }
+}
+
+/**
+ * Allocates a new slab for the size class and splits it into free blocks
+ * @return      true if the slab could be allocated
+ */
+bool BufferPool::allocateSlab(SizeClass& sizeClass) {
+    size_t blockSize = sizeClass.statistics.blockSize;
+    size_t bytes = std::max(slabSize, blockSize);
+    bytes -= bytes % blockSize;
+
+    void* memory = MAP_FAILED;
+    size_t mappedBytes = bytes;
+    bool hugePages = false;
+    if(useHugePages) {
+        mappedBytes = (bytes + _HugePageSize - 1) / _HugePageSize * _HugePageSize;
+        memory = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(memory != MAP_FAILED) {
+            bytes = mappedBytes - mappedBytes % blockSize;
+            hugePages = true;
+        }
+    }
+
+    //no huge pages reserved on this system, fall back to normal pages
+    if(memory == MAP_FAILED) {
+        mappedBytes = bytes;
+        memory = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    Slab slab = { memory, mappedBytes };
+    slabs.push_back(slab);
+
+    size_t blocks = bytes / blockSize;
+    sizeClass.freeBlocks.reserve(sizeClass.statistics.totalBlocks + blocks);
+    unsigned char* base = static_cast<unsigned char*>(memory);
+    for(size_t i = blocks; i > 0; i--) {
+        sizeClass.freeBlocks.push_back(base + (i - 1) * blockSize);
+    }
+
+    sizeClass.statistics.totalBlocks += blocks;
+    sizeClass.statistics.slabs++;
+    if(hugePages) {
+        sizeClass.statistics.hugePageSlabs++;
+    }
+    return true;
+}
+
+void BufferPool::release(int sizeClass, unsigned char* buffer) {
+    if(sizeClass < 0) {
+        delete[] buffer;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    sizeClasses[sizeClass].freeBlocks.push_back(buffer);
+    sizeClasses[sizeClass].statistics.blocksInUse--;
+}
@@ -1,5 +1,5 @@
 #include "DiagnosticMessageHandler.h"
-#include <iostream>
+#include "DoIPLogger.h"
 #include <cstring>
 
 /**
@@ -11,7 +11,21 @@
  */
 unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char sourceAddress [2],
                                     unsigned char* data, int diagMessageLength) {
-    std::cout << "parse Diagnostic Message" << std::endl;
+    return parseDiagnosticMessage(callback, sourceAddress, data, diagMessageLength, BufferPool::defaultPool());
+}
+
+/**
+ * Checks if a received Diagnostic Message is valid. The user data passed to
+ * the callback is only valid until the callback returns.
+ * @param cb                    callback which will be called with the user data
+ * @param sourceAddress		currently registered source address on the socket
+ * @param data			message which was received
+ * @param diagMessageLength     length of the diagnostic message
+ * @param pool                  pool which provides the buffer for the user data
+ */
+unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char sourceAddress [2],
+                                    unsigned char* data, int diagMessageLength, BufferPool& pool) {
+    DOIP_LOG_DEBUG("parse Diagnostic Message");
     if(diagMessageLength >= _DiagnosticMessageMinimumLength) {
         //Check if the received SA is registered on the socket
         if(data[0] != sourceAddress[0] || data[1] != sourceAddress[1]) {
@@ -19,20 +33,54 @@ unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char
             return _InvalidSourceAddressCode;
         }
 
-        std::cout << "source address valid" << std::endl;
+        DOIP_LOG_DEBUG("source address valid");
         //Pass the diagnostic message to the target network/transport layer
         unsigned short target_address = 0;
         target_address |= ((unsigned short)data[2]) << 8U;
         target_address |= (unsigned short)data[3];
 
         int cb_message_length = diagMessageLength - _DiagnosticMessageMinimumLength;
-        unsigned char* cb_message = new unsigned char[cb_message_length];
+        PooledBuffer cb_message = pool.acquire(cb_message_length);
+        memcpy(cb_message.data(), data + _DiagnosticMessageMinimumLength, cb_message_length);
+
+        callback(target_address, cb_message.data(), cb_message_length);
 
-        for(int i = _DiagnosticMessageMinimumLength; i < diagMessageLength; i++) {
-            cb_message[i - _DiagnosticMessageMinimumLength] = data[i];
+        //return positive ack code
+        return _ValidDiagnosticMessageCode;
+    }
+    return _UnknownTargetAddressCode;
+}
+
+/**
+ * Checks if a received Diagnostic Message is valid and passes a view of the
+ * user data to the callback without copying it. The view is only valid
+ * until the callback returns.
+ * @param cb                    callback which will be called with the view
+ * @param sourceAddress		currently registered source address on the socket
+ * @param data			message which was received
+ * @param diagMessageLength     length of the diagnostic message
+ * @param pool                  pool which is used if the application retains the user data
+ */
+unsigned char parseDiagnosticMessage(DiagnosticViewCallback callback, unsigned char sourceAddress [2],
+                                    unsigned char* data, int diagMessageLength, BufferPool& pool) {
+    if(diagMessageLength >= _DiagnosticMessageMinimumLength) {
+        //Check if the received SA is registered on the socket
+        if(data[0] != sourceAddress[0] || data[1] != sourceAddress[1]) {
+            //SA of received message is not registered on this TCP_DATA socket
+            return _InvalidSourceAddressCode;
         }
 
-        callback(target_address, cb_message, cb_message_length);
+        unsigned short source_address = 0;
+        source_address |= ((unsigned short)data[0]) << 8U;
+        source_address |= (unsigned short)data[1];
+
+        unsigned short target_address = 0;
+        target_address |= ((unsigned short)data[2]) << 8U;
+        target_address |= (unsigned short)data[3];
+
+        DiagnosticMessageView view(source_address, target_address, data + _DiagnosticMessageMinimumLength,
+                                    diagMessageLength - _DiagnosticMessageMinimumLength, pool);
+        callback(view);
 
         //return positive ack code
         return _ValidDiagnosticMessageCode;
@@ -40,63 +88,124 @@ unsigned char parseDiagnosticMessage(DiagnosticCallback callback, unsigned char
     return _UnknownTargetAddressCode;
 }
 
+/**
+ * Copies the user data into a buffer which stays valid after the callback returned
+ * @return      handle which returns the buffer to the pool on destruction
+ */
+PooledBuffer DiagnosticMessageView::retain() const {
+    PooledBuffer buffer = pool->acquire(length);
+    memcpy(buffer.data(), userData, length);
+    return buffer;
+}
+
 /**
  * Creates a diagnostic message positive/negative acknowledgment message
  * @param type                  defines positive/negative acknowledge type
  * @param sourceAddress		logical address of the receiver of the previous diagnostic message
  * @param targetAddress		logical address of the sender of the previous diagnostic message
  * @param responseCode		positive or negative acknowledge code
- * @return pointer to the created diagnostic message acknowledge
+ * @return pointer to the created diagnostic message acknowledge, release with delete[]
  */
 unsigned char* createDiagnosticACK(bool ackType, unsigned short sourceAddress, 
                                     unsigned char targetAddress [2], unsigned char responseCode) {
     
+    unsigned char* message = new unsigned char[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+    encodeDiagnosticACK(message, ackType, sourceAddress, targetAddress, responseCode);
+    return message;
+}
+
+/**
+ * Creates a complete diagnostic message
+ * @param sourceAddress		logical address of the sender of a diagnostic message
+ * @param targetAddress		logical address of the receiver of a diagnostic message
+ * @param userData		actual diagnostic data
+ * @param userDataLength	length of diagnostic data
+ * @return pointer to the created diagnostic message, release with delete[]
+ */
+unsigned char* createDiagnosticMessage(unsigned short sourceAddress, unsigned char targetAddress [2],
+                                        unsigned char* userData, int userDataLength) {
+    
+    unsigned char* message = new unsigned char[_GenericHeaderLength + _DiagnosticMessageMinimumLength + userDataLength];
+    encodeDiagnosticMessage(message, sourceAddress, targetAddress, userData, userDataLength);
+    return message;
+}
+
+/**
+ * Writes a diagnostic message positive/negative acknowledgment message into a caller provided buffer
+ * @param buffer                buffer with space for _GenericHeaderLength + _DiagnosticPositiveACKLength bytes
+ * @param type                  defines positive/negative acknowledge type
+ * @param sourceAddress		logical address of the receiver of the previous diagnostic message
+ * @param targetAddress		logical address of the sender of the previous diagnostic message
+ * @param responseCode		positive or negative acknowledge code
+ * @return number of written bytes
+ */
+int encodeDiagnosticACK(unsigned char* buffer, bool ackType, unsigned short sourceAddress,
+                        unsigned char targetAddress [2], unsigned char responseCode) {
+    
     PayloadType type;
     if(ackType)
         type = PayloadType::DIAGNOSTICPOSITIVEACK;
     else
         type = PayloadType::DIAGNOSTICNEGATIVEACK;
     
-    unsigned char* message = createGenericHeader(type, _DiagnosticPositiveACKLength);
+    encodeGenericHeader(buffer, type, _DiagnosticPositiveACKLength);
 
     //add source address to the message
-    message[8] = (unsigned char)((sourceAddress >> 8) & 0xFF);
-    message[9] = (unsigned char)(sourceAddress & 0xFF);
+    buffer[8] = (unsigned char)((sourceAddress >> 8) & 0xFF);
+    buffer[9] = (unsigned char)(sourceAddress & 0xFF);
 
     //add target address to the message
-    message[10] = targetAddress[0];
-    message[11] = targetAddress[1];
+    buffer[10] = targetAddress[0];
+    buffer[11] = targetAddress[1];
 
     //add positive or negative acknowledge code to the message
-    message[12] = responseCode;
+    buffer[12] = responseCode;
 
-    return message;
+    return _GenericHeaderLength + _DiagnosticPositiveACKLength;
 }
 
 /**
- * Creates a complete diagnostic message
+ * Writes generic header, source and target address of a diagnostic message
+ * into a caller provided buffer. The user data has to follow these bytes.
+ * @param buffer                buffer with space for _GenericHeaderLength + _DiagnosticMessageMinimumLength bytes
  * @param sourceAddress		logical address of the sender of a diagnostic message
  * @param targetAddress		logical address of the receiver of a diagnostic message
- * @param userData		actual diagnostic data
- * @param userDataLength	length of diagnostic data
+ * @param userDataLength	length of diagnostic data which follows
+ * @return number of written bytes
  */
-unsigned char* createDiagnosticMessage(unsigned short sourceAddress, unsigned char targetAddress [2],
-                                        unsigned char* userData, int userDataLength) {
-    
-    unsigned char* message = createGenericHeader(PayloadType::DIAGNOSTICMESSAGE, _DiagnosticMessageMinimumLength + userDataLength);
+int encodeDiagnosticMessageHeader(unsigned char* buffer, unsigned short sourceAddress,
+                                    unsigned char targetAddress [2], int userDataLength) {
+
+    encodeGenericHeader(buffer, PayloadType::DIAGNOSTICMESSAGE, _DiagnosticMessageMinimumLength + userDataLength);
 
     //add source address to the message
-    message[8] = (unsigned char)((sourceAddress >> 8) & 0xFF);
-    message[9] = (unsigned char)(sourceAddress & 0xFF);
+    buffer[8] = (unsigned char)((sourceAddress >> 8) & 0xFF);
+    buffer[9] = (unsigned char)(sourceAddress & 0xFF);
 
     //add target address to the message
-    message[10] = targetAddress[0];
-    message[11] = targetAddress[1];
+    buffer[10] = targetAddress[0];
+    buffer[11] = targetAddress[1];
+
+    return _GenericHeaderLength + _DiagnosticMessageMinimumLength;
+}
+
+/**
+ * Writes a complete diagnostic message into a caller provided buffer
+ * @param buffer                buffer with space for _GenericHeaderLength +
+ *                              _DiagnosticMessageMinimumLength + userDataLength bytes
+ * @param sourceAddress		logical address of the sender of a diagnostic message
+ * @param targetAddress		logical address of the receiver of a diagnostic message
+ * @param userData		actual diagnostic data
+ * @param userDataLength	length of diagnostic data
+ * @return number of written bytes
+ */
+int encodeDiagnosticMessage(unsigned char* buffer, unsigned short sourceAddress, unsigned char targetAddress [2],
+                            unsigned char* userData, int userDataLength) {
+
+    int headerLength = encodeDiagnosticMessageHeader(buffer, sourceAddress, targetAddress, userDataLength);
 
     //add userdata to the message
-    for(int i = 0; i < userDataLength; i++) {
-        message[12 + i] = userData[i];	
-    }
+    memcpy(buffer + headerLength, userData, userDataLength);
 
-    return message;
+    return headerLength + userDataLength;
 }
@@ -0,0 +1,636 @@
+#include "DoIPCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "DoIPLogger.h"
+
+const uint32_t _PcapMagicMicroseconds = 0xA1B2C3D4;
+const uint32_t _PcapMagicNanoseconds = 0xA1B23C4D;
+const uint32_t _PcapngSectionHeader = 0x0A0D0D0A;
+const uint32_t _PcapngByteOrderMagic = 0x1A2B3C4D;
+const size_t _PcapFileHeaderLength = 24;
+const size_t _PcapRecordHeaderLength = 16;
+
+enum PcapngBlockType {
+    BLOCKINTERFACE = 1,
+    BLOCKPACKET = 2,            //obsolete, still written by old tools
+    BLOCKSIMPLEPACKET = 3,
+    BLOCKENHANCEDPACKET = 6
+};
+
+enum LinkType {
+    LINKNULL = 0,
+    LINKETHERNET = 1,
+    LINKRAWOPENBSD = 12,
+    LINKRAWBSD = 14,
+    LINKRAW = 101,
+    LINKLOOP = 108,
+    LINKLINUXSLL = 113,
+    LINKIPV4 = 228,
+    LINKIPV6 = 229,
+    LINKLINUXSLL2 = 276
+};
+
+const uint16_t _EtherTypeIPv4 = 0x0800;
+const uint16_t _EtherTypeIPv6 = 0x86DD;
+const uint8_t _ProtocolTCP = 6;
+const uint8_t _ProtocolUDP = 17;
+const uint8_t _TcpFin = 0x01;
+const uint8_t _TcpSyn = 0x02;
+const uint8_t _TcpReset = 0x04;
+
+static uint16_t readBigEndian16(const unsigned char* position) {
+    return (uint16_t)(position[0] << 8 | position[1]);
+}
+
+static uint32_t readBigEndian32(const unsigned char* position) {
+    return (uint32_t)position[0] << 24 | (uint32_t)position[1] << 16 | (uint32_t)position[2] << 8 | position[3];
+}
+
+/*
+ * Converts a timestamp in ticks of the capture to nanoseconds without overflowing
+ */
+static uint64_t ticksToNanoseconds(uint64_t ticks, uint64_t ticksPerSecond) {
+    return ticks / ticksPerSecond * 1000000000ULL + (uint64_t)((unsigned __int128)(ticks % ticksPerSecond) * 1000000000ULL / ticksPerSecond);
+}
+
+CaptureReader::~CaptureReader() {
+    if(data != nullptr) {
+        munmap(data, size);
+    }
+}
+
+/**
+ * Maps a capture file and reads its file or section header
+ * @param path      pcap or pcapng file
+ * @param port      TCP and UDP port of the DoIP server
+ * @return          true if the file is a capture this reader understands
+ */
+bool CaptureReader::open(const std::string& path, uint16_t port) {
+    this->port = port;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        DOIP_LOG_ERROR("Could not open capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat status;
+    if(fstat(fd, &status) < 0 || status.st_size < (off_t)_PcapFileHeaderLength) {
+        DOIP_LOG_ERROR("Capture %s is too short", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    //private mapping, so decoders may write into the payloads without changing the file
+    size = status.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        DOIP_LOG_ERROR("Could not map capture %s: %s", path.c_str(), strerror(errno));
+        size = 0;
+        return false;
+    }
+    data = static_cast<unsigned char*>(mapping);
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if(magic == _PcapngSectionHeader) {
+        format = FORMATPCAPNG;
+        firstRecord = 0;
+    } else {
+        format = FORMATPCAP;
+        firstRecord = _PcapFileHeaderLength;
+        swapped = magic == __builtin_bswap32(_PcapMagicMicroseconds) || magic == __builtin_bswap32(_PcapMagicNanoseconds);
+        magic = swapped ? __builtin_bswap32(magic) : magic;
+        if(magic != _PcapMagicMicroseconds && magic != _PcapMagicNanoseconds) {
+            DOIP_LOG_ERROR("%s is neither a pcap nor a pcapng file", path.c_str());
+            return false;
+        }
+        interfaces.clear();
+        interfaces.push_back(CaptureInterface{read32(data + 20), magic == _PcapMagicNanoseconds ? 1000000000ULL : 1000000ULL});
+    }
+    rewind();
+    return true;
+}
+
+/**
+ * Starts reading the capture from its first packet again
+ */
+void CaptureReader::rewind() {
+    offset = firstRecord;
+    lastTimestamp = 0;
+    if(format == FORMATPCAPNG) {
+        interfaces.clear();
+    }
+}
+
+/**
+ * Reads the next TCP segment or UDP datagram from or to the DoIP port
+ * @param packet    filled with the packet
+ * @return          false at the end of the capture or if it is corrupted
+ */
+bool CaptureReader::next(CapturedPacket& packet) {
+    unsigned char* frame;
+    size_t length;
+    uint64_t timestamp;
+    uint32_t linkType;
+
+    while(format == FORMATPCAP ? nextPcapRecord(frame, length, timestamp, linkType)
+                               : nextPcapngBlock(frame, length, timestamp, linkType)) {
+        packetCount++;
+        packet = CapturedPacket();
+        packet.timestamp = timestamp;
+        if(decodeLinkLayer(linkType, frame, length, packet)) {
+            return true;
+        }
+        skippedPackets++;
+    }
+    return false;
+}
+
+uint16_t CaptureReader::read16(const unsigned char* position) const {
+    uint16_t value;
+    memcpy(&value, position, sizeof(value));
+    return swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t CaptureReader::read32(const unsigned char* position) const {
+    uint32_t value;
+    memcpy(&value, position, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+/*
+ * Reads the next record of a pcap file
+ */
+bool CaptureReader::nextPcapRecord(unsigned char*& frame, size_t& length, uint64_t& timestamp, uint32_t& linkType) {
+    if(offset + _PcapRecordHeaderLength > size) {
+        return false;
+    }
+    const unsigned char* header = data + offset;
+    uint32_t capturedLength = read32(header + 8);
+    if(offset + _PcapRecordHeaderLength + capturedLength > size) {
+        DOIP_LOG_WARNING("Capture is truncated after %lu packets", (unsigned long)packetCount);
+        return false;
+    }
+    timestamp = (uint64_t)read32(header) * 1000000000ULL + ticksToNanoseconds(read32(header + 4), interfaces[0].ticksPerSecond);
+    linkType = interfaces[0].linkType;
+    frame = data + offset + _PcapRecordHeaderLength;
+    length = capturedLength;
+    offset += _PcapRecordHeaderLength + capturedLength;
+    return true;
+}
+
+/*
+ * Reads the byte order of a pcapng section, a new section starts with new interfaces
+ */
+bool CaptureReader::readSectionHeader(const unsigned char* block) {
+    uint32_t magic;
+    memcpy(&magic, block + 8, sizeof(magic));
+    if(magic != _PcapngByteOrderMagic && magic != __builtin_bswap32(_PcapngByteOrderMagic)) {
+        DOIP_LOG_ERROR("pcapng section header has an invalid byte order magic");
+        return false;
+    }
+    swapped = magic != _PcapngByteOrderMagic;
+    interfaces.clear();
+    return true;
+}
+
+/*
+ * Reads the link type and timestamp resolution of a pcapng interface description block
+ */
+void CaptureReader::readInterface(const unsigned char* body, size_t length) {
+    CaptureInterface interface{read16(body), 1000000ULL};
+    size_t position = 8;
+    while(position + 4 <= length) {
+        uint16_t code = read16(body + position);
+        uint16_t optionLength = read16(body + position + 2);
+        if(code == 0 || position + 4 + optionLength > length) {
+            break;
+        }
+        if(code == 9 && optionLength >= 1) {
+            //if_tsresol, negative power of 10, or of 2 if the highest bit is set
+            uint8_t resolution = body[position + 4];
+            uint64_t ticksPerSecond = 1;
+            if(resolution & 0x80) {
+                ticksPerSecond <<= std::min(resolution & 0x7F, 63);
+            } else {
+                for(int i = 0; i < std::min((int)resolution, 19); i++) {
+                    ticksPerSecond *= 10;
+                }
+            }
+            interface.ticksPerSecond = ticksPerSecond;
+        }
+        position += 4 + ((optionLength + 3) & ~3u);
+    }
+    interfaces.push_back(interface);
+}
+
+/*
+ * Reads blocks of a pcapng file until the next packet block
+ */
+bool CaptureReader::nextPcapngBlock(unsigned char*& frame, size_t& length, uint64_t& timestamp, uint32_t& linkType) {
+    while(offset + 12 <= size) {
+        unsigned char* block = data + offset;
+        uint32_t type;
+        memcpy(&type, block, sizeof(type));
+        if(type == _PcapngSectionHeader && !readSectionHeader(block)) {
+            return false;
+        }
+        type = read32(block);
+        uint32_t totalLength = read32(block + 4);
+        if(totalLength < 12 || totalLength % 4 != 0 || offset + totalLength > size) {
+            DOIP_LOG_WARNING("Capture is truncated after %lu packets", (unsigned long)packetCount);
+            return false;
+        }
+        offset += totalLength;
+        unsigned char* body = block + 8;
+        size_t bodyLength = totalLength - 12;
+
+        uint32_t interfaceId = 0;
+        uint64_t ticks = 0;
+        uint32_t capturedLength = 0;
+        size_t dataOffset = 0;
+        if(type == BLOCKINTERFACE && bodyLength >= 8) {
+            readInterface(body, bodyLength);
+            continue;
+        } else if(type == BLOCKENHANCEDPACKET && bodyLength >= 20) {
+            interfaceId = read32(body);
+            ticks = (uint64_t)read32(body + 4) << 32 | read32(body + 8);
+            capturedLength = read32(body + 12);
+            dataOffset = 20;
+        } else if(type == BLOCKPACKET && bodyLength >= 20) {
+            interfaceId = read16(body);
+            ticks = (uint64_t)read32(body + 4) << 32 | read32(body + 8);
+            capturedLength = read32(body + 12);
+            dataOffset = 20;
+        } else if(type == BLOCKSIMPLEPACKET && bodyLength >= 4) {
+            capturedLength = std::min<uint32_t>(read32(body), bodyLength - 4);
+            dataOffset = 4;
+        } else {
+            continue;
+        }
+
+        if(interfaceId >= interfaces.size() || dataOffset + capturedLength > bodyLength) {
+            DOIP_LOG_WARNING("Skipping packet block with unknown interface %u or invalid length", interfaceId);
+            packetCount++;
+            skippedPackets++;
+            continue;
+        }
+        if(type != BLOCKSIMPLEPACKET) {
+            lastTimestamp = ticksToNanoseconds(ticks, interfaces[interfaceId].ticksPerSecond);
+        }
+        timestamp = lastTimestamp;
+        linkType = interfaces[interfaceId].linkType;
+        frame = body + dataOffset;
+        length = capturedLength;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Removes the link layer header and finds out the network protocol
+ */
+bool CaptureReader::decodeLinkLayer(uint32_t linkType, unsigned char* frame, size_t length, CapturedPacket& packet) {
+    switch(linkType) {
+        case LINKETHERNET: {
+            if(length < 14) {
+                return false;
+            }
+            size_t headerLength = 14;
+            uint16_t etherType = readBigEndian16(frame + 12);
+            while((etherType == 0x8100 || etherType == 0x88A8 || etherType == 0x9100) && length >= headerLength + 4) {
+                etherType = readBigEndian16(frame + headerLength + 2);
+                headerLength += 4;
+            }
+            return decodeNetworkLayer(etherType, frame + headerLength, length - headerLength, packet);
+        }
+        case LINKNULL:
+        case LINKLOOP: {
+            //address family in the byte order of the capturing host
+            if(length < 4) {
+                return false;
+            }
+            uint32_t family;
+            memcpy(&family, frame, sizeof(family));
+            if(family > 0xFFFF) {
+                family = __builtin_bswap32(family);
+            }
+            uint16_t etherType = family == 2 ? _EtherTypeIPv4 : (family == 10 || family == 24 || family == 28 || family == 30) ? _EtherTypeIPv6 : 0;
+            return decodeNetworkLayer(etherType, frame + 4, length - 4, packet);
+        }
+        case LINKRAW:
+        case LINKRAWOPENBSD:
+        case LINKRAWBSD:
+            if(length < 1) {
+                return false;
+            }
+            return decodeNetworkLayer((frame[0] >> 4) == 6 ? _EtherTypeIPv6 : _EtherTypeIPv4, frame, length, packet);
+        case LINKIPV4:
+            return decodeNetworkLayer(_EtherTypeIPv4, frame, length, packet);
+        case LINKIPV6:
+            return decodeNetworkLayer(_EtherTypeIPv6, frame, length, packet);
+        case LINKLINUXSLL:
+            if(length < 16) {
+                return false;
+            }
+            return decodeNetworkLayer(readBigEndian16(frame + 14), frame + 16, length - 16, packet);
+        case LINKLINUXSLL2:
+            if(length < 20) {
+                return false;
+            }
+            return decodeNetworkLayer(readBigEndian16(frame), frame + 20, length - 20, packet);
+        default:
+            return false;
+    }
+}
+
+/*
+ * Reads the addresses of an IPv4 or IPv6 packet, fragments are not reassembled
+ */
+bool CaptureReader::decodeNetworkLayer(uint16_t etherType, unsigned char* frame, size_t length, CapturedPacket& packet) {
+    if(etherType == _EtherTypeIPv4) {
+        if(length < 20 || (frame[0] >> 4) != 4) {
+            return false;
+        }
+        size_t headerLength = (frame[0] & 0x0F) * 4;
+        uint16_t totalLength = readBigEndian16(frame + 2);
+        if(headerLength < 20 || headerLength > length) {
+            return false;
+        }
+        //ethernet padding follows short packets, segmentation offload captures have no total length
+        if(totalLength >= headerLength && totalLength < length) {
+            length = totalLength;
+        }
+        if(readBigEndian16(frame + 6) & 0x3FFF) {
+            return false;
+        }
+        memcpy(packet.source, frame + 12, 4);
+        memcpy(packet.destination, frame + 16, 4);
+        return decodeTransportLayer(frame[9], frame + headerLength, length - headerLength, packet);
+    }
+
+    if(etherType == _EtherTypeIPv6) {
+        if(length < 40 || (frame[0] >> 4) != 6) {
+            return false;
+        }
+        uint16_t payloadLength = readBigEndian16(frame + 4);
+        if(payloadLength > 0 && 40u + payloadLength < length) {
+            length = 40 + payloadLength;
+        }
+        memcpy(packet.source, frame + 8, 16);
+        memcpy(packet.destination, frame + 24, 16);
+
+        //skip hop-by-hop, routing and destination options headers, fragments are not supported
+        uint8_t nextHeader = frame[6];
+        size_t headerLength = 40;
+        while(nextHeader == 0 || nextHeader == 43 || nextHeader == 60) {
+            if(headerLength + 2 > length) {
+                return false;
+            }
+            nextHeader = frame[headerLength];
+            headerLength += (frame[headerLength + 1] + 1) * 8;
+        }
+        if(headerLength > length) {
+            return false;
+        }
+        return decodeTransportLayer(nextHeader, frame + headerLength, length - headerLength, packet);
+    }
+    return false;
+}
+
+/*
+ * Reads the ports of a TCP or UDP packet and keeps it if it is from or to the DoIP port
+ */
+bool CaptureReader::decodeTransportLayer(uint8_t protocol, unsigned char* segment, size_t length, CapturedPacket& packet) {
+    size_t headerLength;
+    if(protocol == _ProtocolTCP) {
+        if(length < 20) {
+            return false;
+        }
+        headerLength = (segment[12] >> 4) * 4;
+        if(headerLength < 20 || headerLength > length) {
+            return false;
+        }
+        packet.protocol = CAPTURETCP;
+        packet.sequence = readBigEndian32(segment + 4);
+        packet.tcpFlags = segment[13];
+    } else if(protocol == _ProtocolUDP) {
+        if(length < 8) {
+            return false;
+        }
+        uint16_t datagramLength = readBigEndian16(segment + 4);
+        if(datagramLength >= 8 && datagramLength < length) {
+            length = datagramLength;
+        }
+        headerLength = 8;
+        packet.protocol = CAPTUREUDP;
+    } else {
+        return false;
+    }
+
+    packet.sourcePort = readBigEndian16(segment);
+    packet.destinationPort = readBigEndian16(segment + 2);
+    if(packet.sourcePort != port && packet.destinationPort != port) {
+        return false;
+    }
+    packet.payload = segment + headerLength;
+    packet.length = length - headerLength;
+    return true;
+}
+
+/**
+ * Adds a packet of the capture, the data which is in stream order afterwards is passed to the callback
+ * @param packet        packet from CaptureReader, its payload must stay valid until finish()
+ * @param callback      receives the chunks of data and closed connections
+ */
+void CaptureReassembler::add(const CapturedPacket& packet, const CaptureChunkCallback& callback) {
+    bool toServer = packet.destinationPort == port;
+    if(packet.protocol == CAPTUREUDP) {
+        if(packet.length > 0) {
+            callback(CaptureChunk{packet.timestamp, 0, CAPTUREUDP, toServer, false, false, packet.payload, packet.length});
+        }
+        return;
+    }
+
+    Connection& connection = findConnection(packet, toServer, callback);
+    connection.lastTimestamp = packet.timestamp;
+    Stream& stream = connection.streams[toServer ? 0 : 1];
+    addSegment(connection, stream, packet, callback);
+
+    if(packet.tcpFlags & _TcpReset) {
+        close(connection, packet.timestamp, callback);
+        return;
+    }
+    if(packet.tcpFlags & _TcpFin) {
+        stream.finished = true;
+    }
+    Stream& other = connection.streams[toServer ? 1 : 0];
+    if(stream.finished && other.finished && stream.pending.empty() && other.pending.empty()) {
+        close(connection, packet.timestamp, callback);
+    }
+}
+
+/**
+ * Delivers the data which still waits for missing segments and closes all connections
+ * @param callback      receives the chunks of data and closed connections
+ */
+void CaptureReassembler::finish(const CaptureChunkCallback& callback) {
+    while(!connections.empty()) {
+        Connection& connection = connections.begin()->second;
+        close(connection, connection.lastTimestamp, callback);
+    }
+}
+
+/*
+ * Finds the connection of a segment, a SYN which does not fit the known
+ * connection on the same ports starts a new one
+ */
+CaptureReassembler::Connection& CaptureReassembler::findConnection(const CapturedPacket& packet, bool toServer,
+                                                                    const CaptureChunkCallback& callback) {
+    //tester address and port, then server address and port
+    char key[36];
+    memcpy(key, toServer ? packet.source : packet.destination, 16);
+    memcpy(key + 16, toServer ? &packet.sourcePort : &packet.destinationPort, 2);
+    memcpy(key + 18, toServer ? packet.destination : packet.source, 16);
+    memcpy(key + 34, toServer ? &packet.destinationPort : &packet.sourcePort, 2);
+    std::string connectionKey(key, sizeof(key));
+
+    auto it = connections.find(connectionKey);
+    if(it != connections.end() && (packet.tcpFlags & _TcpSyn)) {
+        Stream& stream = it->second.streams[toServer ? 0 : 1];
+        if(stream.synchronized && packet.sequence != stream.firstSequence - 1) {
+            close(it->second, packet.timestamp, callback);
+            it = connections.end();
+        }
+    }
+    if(it == connections.end()) {
+        it = connections.emplace(connectionKey, Connection()).first;
+        it->second.key = connectionKey;
+        it->second.connectionId = nextConnectionId++;
+        it->second.streams[0].toServer = true;
+    }
+    return it->second;
+}
+
+/*
+ * Delivers the data of a segment if it continues the stream, keeps it if it is early
+ */
+void CaptureReassembler::addSegment(Connection& connection, Stream& stream, const CapturedPacket& packet,
+                                    const CaptureChunkCallback& callback) {
+    uint32_t sequence = packet.sequence;
+    if(packet.tcpFlags & _TcpSyn) {
+        sequence++;
+        if(!stream.synchronized) {
+            stream.synchronized = true;
+            stream.firstSequence = sequence;
+            stream.nextPosition = 0;
+        }
+    }
+    if(packet.length == 0) {
+        return;
+    }
+    if(!stream.synchronized) {
+        //the capture started after the handshake, the stream may start inside a message
+        stream.synchronized = true;
+        stream.firstSequence = sequence;
+        stream.nextPosition = 0;
+        stream.gap = true;
+    }
+
+    uint32_t position = sequence - stream.firstSequence;
+    int32_t distance = (int32_t)(position - stream.nextPosition);
+    if(distance > 0) {
+        auto it = stream.pending.find(position);
+        if(it == stream.pending.end() || it->second.length < packet.length) {
+            if(it != stream.pending.end()) {
+                retransmittedBytes += it->second.length;
+                stream.pendingBytes -= it->second.length;
+            }
+            stream.pending[position] = Segment{packet.timestamp, packet.payload, packet.length};
+            stream.pendingBytes += packet.length;
+        } else {
+            retransmittedBytes += packet.length;
+        }
+        if(stream.pendingBytes > _MaxReassemblyBytes) {
+            skipGap(connection, stream, callback);
+        }
+        return;
+    }
+
+    size_t overlap = (size_t)-(int64_t)distance;
+    if(overlap >= packet.length) {
+        retransmittedBytes += packet.length;
+        return;
+    }
+    retransmittedBytes += overlap;
+    deliver(connection, stream, packet.timestamp, packet.payload + overlap, packet.length - overlap, callback);
+    deliverPending(connection, stream, packet.timestamp, callback);
+}
+
+void CaptureReassembler::deliver(Connection& connection, Stream& stream, uint64_t timestamp, unsigned char* data, size_t length,
+                                 const CaptureChunkCallback& callback) {
+    stream.nextPosition += length;
+    bool gap = stream.gap;
+    stream.gap = false;
+    callback(CaptureChunk{timestamp, connection.connectionId, CAPTURETCP, stream.toServer, gap, false, data, length});
+}
+
+/*
+ * Delivers the early segments which continue the stream now
+ */
+void CaptureReassembler::deliverPending(Connection& connection, Stream& stream, uint64_t timestamp, const CaptureChunkCallback& callback) {
+    while(!stream.pending.empty()) {
+        auto it = stream.pending.begin();
+        int32_t distance = (int32_t)(it->first - stream.nextPosition);
+        if(distance > 0) {
+            return;
+        }
+        Segment segment = it->second;
+        stream.pending.erase(it);
+        stream.pendingBytes -= segment.length;
+
+        size_t overlap = (size_t)-(int64_t)distance;
+        if(overlap >= segment.length) {
+            retransmittedBytes += segment.length;
+        } else {
+            retransmittedBytes += overlap;
+            deliver(connection, stream, timestamp, segment.data + overlap, segment.length - overlap, callback);
+        }
+    }
+}
+
+/*
+ * Gives up on data the capture lost and continues with the first early segment
+ */
+void CaptureReassembler::skipGap(Connection& connection, Stream& stream, const CaptureChunkCallback& callback) {
+    if(stream.pending.empty()) {
+        return;
+    }
+    auto it = stream.pending.begin();
+    missingBytes += it->first - stream.nextPosition;
+    stream.nextPosition = it->first;
+    stream.gap = true;
+    deliverPending(connection, stream, it->second.timestamp, callback);
+}
+
+/*
+ * Delivers what is left of both streams and reports the end of the connection
+ */
+void CaptureReassembler::close(Connection& connection, uint64_t timestamp, const CaptureChunkCallback& callback) {
+    for(Stream& stream : connection.streams) {
+        while(!stream.pending.empty()) {
+            skipGap(connection, stream, callback);
+        }
+    }
+    callback(CaptureChunk{timestamp, connection.connectionId, CAPTURETCP, true, false, true, nullptr, 0});
+
+    std::string key = connection.key;
+    connections.erase(key);
+}
@@ -0,0 +1,140 @@
+#include "DoIPFrameDecoder.h"
+#include "DoIPTracer.h"
+
+#include <cstring>
+#include <algorithm>
+
+/**
+ * Decodes a chunk of received bytes and calls the callback for every
+ * complete frame and every validation error. A synchronization pattern
+ * error puts the decoder into the failed state, because the stream can not
+ * be resynchronized afterwards. Payloads of rejected messages are skipped.
+ * @param data      received bytes
+ * @param length    number of received bytes
+ * @param callback  function which is called for every frame
+ * @return          number of consumed bytes, less than length if the
+ *                  callback stopped decoding or the decoder failed
+ */
+size_t DoIPFrameDecoder::feed(unsigned char* data, size_t length, FrameCallback callback) {
+    size_t offset = 0;
+
+    while(offset < length && !failed) {
+        size_t available = length - offset;
+
+        //discard the payload of a rejected message
+        if(skipRemaining > 0) {
+            size_t skipped = std::min((size_t)skipRemaining, available);
+            skipRemaining -= skipped;
+            offset += skipped;
+            continue;
+        }
+
+        //continue a message which spans several chunks
+        if(payload) {
+            size_t copied = std::min((size_t)(action.payloadLength - payloadFill), available);
+            //bytes which were received into the payload window are already in place
+            if(data + offset != payload.data() + payloadFill) {
+                memcpy(payload.data() + payloadFill, data + offset, copied);
+            }
+            payloadFill += copied;
+            offset += copied;
+
+            if(payloadFill == action.payloadLength) {
+                DoIPFrame frame = { action, header, payload.data() };
+                bool proceed = callback(frame);
+                payload.reset();
+                payloadFill = 0;
+                if(!proceed) {
+                    return offset;
+                }
+            }
+            continue;
+        }
+
+        unsigned char* headerData;
+        if(headerFill == 0 && available >= (size_t)_GenericHeaderLength) {
+            //header is contained in the chunk
+            headerData = data + offset;
+            offset += _GenericHeaderLength;
+        } else {
+            size_t copied = std::min(_GenericHeaderLength - headerFill, available);
+            memcpy(header + headerFill, data + offset, copied);
+            headerFill += copied;
+            offset += copied;
+            if(headerFill < (size_t)_GenericHeaderLength) {
+                break;
+            }
+            headerData = header;
+        }
+        headerFill = 0;
+
+        {
+            TraceSpan span("parseGenericHeader");
+            action = parseGenericHeader(headerData, _GenericHeaderLength);
+        }
+        if(action.type != PayloadType::NEGATIVEACK && action.payloadLength > maxPayloadLength) {
+            action.type = PayloadType::NEGATIVEACK;
+            action.value = _MessageTooLargeCode;
+        }
+
+        if(action.type == PayloadType::NEGATIVEACK) {
+            if(action.value == _IncorrectPatternFormatCode) {
+                failed = true;
+            } else {
+                skipRemaining = action.payloadLength;
+            }
+
+            DoIPFrame frame = { action, headerData, nullptr };
+            if(!callback(frame)) {
+                return offset;
+            }
+            continue;
+        }
+
+        //payload is contained in the chunk, pass it on without copying
+        if(action.payloadLength <= length - offset) {
+            DoIPFrame frame = { action, headerData, action.payloadLength > 0 ? data + offset : nullptr };
+            offset += action.payloadLength;
+            if(!callback(frame)) {
+                return offset;
+            }
+            continue;
+        }
+
+        //collect the payload of a message which spans several chunks
+        if(headerData != header) {
+            memcpy(header, headerData, _GenericHeaderLength);
+        }
+        payload = pool->acquire(action.payloadLength);
+        payloadFill = 0;
+    }
+
+    return offset;
+}
+
+/**
+ * Returns the part of the payload buffer of a partially received message
+ * which is still missing. The caller may receive directly into it and then
+ * pass exactly the received bytes to feed(), which skips copying them.
+ * @param length    set to the number of missing payload bytes
+ * @return          start of the missing bytes or nullptr if no payload is collected
+ */
+unsigned char* DoIPFrameDecoder::getPayloadWindow(size_t& length) {
+    if(!payload || failed) {
+        length = 0;
+        return nullptr;
+    }
+    length = action.payloadLength - payloadFill;
+    return payload.data() + payloadFill;
+}
+
+/**
+ * Discards a partially received message and leaves the failed state
+ */
+void DoIPFrameDecoder::reset() {
+    headerFill = 0;
+    payload.reset();
+    payloadFill = 0;
+    skipRemaining = 0;
+    failed = false;
+}
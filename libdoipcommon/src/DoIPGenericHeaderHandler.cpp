@@ -1,9 +1,184 @@
 #include "DoIPGenericHeaderHandler.h"
-#include <iostream>
-#include <iomanip>
+#include "DoIPLogger.h"
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 
+/*
+ * Payload types of ISO 13400-2 with their length rules
+ */
+static constexpr PayloadTypeDefinition payloadTypeDefinitions[] = {
+    { 0x0000, PayloadType::GENERICNACK,                 EXACTLENGTH,    1,  0 },
+    { 0x0001, PayloadType::VEHICLEIDENTREQUEST,         EXACTLENGTH,    0,  0 },
+    { 0x0002, PayloadType::VEHICLEIDENTREQUESTEID,      EXACTLENGTH,    6,  0 },
+    { 0x0003, PayloadType::VEHICLEIDENTREQUESTVIN,      EXACTLENGTH,    17, 0 },
+    { 0x0004, PayloadType::VEHICLEIDENTRESPONSE,        EITHERLENGTH,   32, 33 },
+    { 0x0005, PayloadType::ROUTINGACTIVATIONREQUEST,    EITHERLENGTH,   7,  11 },
+    { 0x0006, PayloadType::ROUTINGACTIVATIONRESPONSE,   EITHERLENGTH,   9,  13 },
+    { 0x0007, PayloadType::ALIVECHECKREQUEST,           EXACTLENGTH,    0,  0 },
+    { 0x0008, PayloadType::ALIVECHECKRESPONSE,          EXACTLENGTH,    2,  0 },
+    { 0x4001, PayloadType::ENTITYSTATUSREQUEST,         EXACTLENGTH,    0,  0 },
+    { 0x4002, PayloadType::ENTITYSTATUSRESPONSE,        EITHERLENGTH,   3,  7 },
+    { 0x4003, PayloadType::POWERMODEREQUEST,            EXACTLENGTH,    0,  0 },
+    { 0x4004, PayloadType::POWERMODERESPONSE,           EXACTLENGTH,    1,  0 },
+    { 0x8001, PayloadType::DIAGNOSTICMESSAGE,           MINIMUMLENGTH,  5,  0 },
+    { 0x8002, PayloadType::DIAGNOSTICPOSITIVEACK,       MINIMUMLENGTH,  5,  0 },
+    { 0x8003, PayloadType::DIAGNOSTICNEGATIVEACK,       MINIMUMLENGTH,  5,  0 },
+};
+
+/*
+ * Payload type codes indexed by PayloadType, OEM specific types have no fixed code
+ */
+struct PayloadTypeCode {
+    PayloadType type;
+    uint16_t code;
+};
+
+static constexpr PayloadTypeCode payloadTypeCodes[] = {
+    { PayloadType::NEGATIVEACK,                 0x0000 },
+    { PayloadType::ROUTINGACTIVATIONREQUEST,    0x0005 },
+    { PayloadType::ROUTINGACTIVATIONRESPONSE,   0x0006 },
+    { PayloadType::VEHICLEIDENTREQUEST,         0x0001 },
+    { PayloadType::VEHICLEIDENTRESPONSE,        0x0004 },
+    { PayloadType::DIAGNOSTICMESSAGE,           0x8001 },
+    { PayloadType::DIAGNOSTICPOSITIVEACK,       0x8002 },
+    { PayloadType::DIAGNOSTICNEGATIVEACK,       0x8003 },
+    { PayloadType::ALIVECHECKRESPONSE,          0x0008 },
+    { PayloadType::ALIVECHECKREQUEST,           0x0007 },
+    { PayloadType::VEHICLEIDENTREQUESTEID,      0x0002 },
+    { PayloadType::VEHICLEIDENTREQUESTVIN,      0x0003 },
+    { PayloadType::ENTITYSTATUSREQUEST,         0x4001 },
+    { PayloadType::ENTITYSTATUSRESPONSE,        0x4002 },
+    { PayloadType::POWERMODEREQUEST,            0x4003 },
+    { PayloadType::POWERMODERESPONSE,           0x4004 },
+    { PayloadType::GENERICNACK,                 0x0000 },
+    { PayloadType::OEMSPECIFIC,                 0xFFFF },
+};
+static_assert(isPayloadTypeTable(payloadTypeCodes), "every payload type needs a code, in the order of the enum");
+
+/*
+ * Second level of the payload type index, one page covers all codes with the same high byte
+ */
+struct PayloadTypePage {
+    PayloadTypeDefinition definitions[256];
+    std::atomic<bool> known[256];
+};
+
+static std::mutex registrationMutex;
+
+static bool insertPayloadType(std::atomic<PayloadTypePage*>* pages, const PayloadTypeDefinition& definition) {
+    std::atomic<PayloadTypePage*>& slot = pages[definition.code >> 8];
+    PayloadTypePage* page = slot.load(std::memory_order_acquire);
+    if(page == nullptr) {
+        page = new PayloadTypePage();
+        for(int i = 0; i < 256; i++) {
+            page->known[i].store(false, std::memory_order_relaxed);
+        }
+        slot.store(page, std::memory_order_release);
+    }
+
+    uint8_t index = definition.code & 0xFF;
+    if(page->known[index].load(std::memory_order_acquire)) {
+        return false;
+    }
+    page->definitions[index] = definition;
+    page->known[index].store(true, std::memory_order_release);
+    return true;
+}
+
+/*
+ * First level of the payload type index, pages are only allocated for
+ * high bytes which are in use. The pages are never released.
+ */
+static std::atomic<PayloadTypePage*>* getPayloadTypePages() {
+    static std::atomic<PayloadTypePage*> pages[256];
+    static bool initialized = []() {
+        std::lock_guard<std::mutex> lock(registrationMutex);
+        for(const PayloadTypeDefinition& definition : payloadTypeDefinitions) {
+            insertPayloadType(pages, definition);
+        }
+        return true;
+    }();
+    (void)initialized;
+    return pages;
+}
+
+/**
+ * Looks up a payload type in constant time
+ * @param code      payload type field of a generic header
+ * @return          definition of the payload type or nullptr if it is unknown
+ */
+const PayloadTypeDefinition* findPayloadType(uint16_t code) {
+    PayloadTypePage* page = getPayloadTypePages()[code >> 8].load(std::memory_order_acquire);
+    if(page == nullptr || !page->known[code & 0xFF].load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return &page->definitions[code & 0xFF];
+}
+
+/**
+ * Returns the code which is written into the generic header for a payload type
+ */
+uint16_t getPayloadTypeCode(PayloadType type) {
+    return payloadTypeCodes[type].code;
+}
+
+/**
+ * Registers an OEM specific payload type, messages of this type are reported
+ * as PayloadType::OEMSPECIFIC with their code instead of being rejected
+ * @param code          payload type code, ISO 13400-2 reserves 0xF000 to 0xFFFF for OEMs
+ * @param lengthCheck   rule for the payload length
+ * @param first         length or minimum length, depending on the rule
+ * @param second        maximum or alternative length, depending on the rule
+ * @return              false if the code is already in use
+ */
+bool registerPayloadType(uint16_t code, PayloadLengthCheck lengthCheck, uint32_t first, uint32_t second) {
+    std::atomic<PayloadTypePage*>* pages = getPayloadTypePages();
+    PayloadTypeDefinition definition = { code, PayloadType::OEMSPECIFIC, lengthCheck, first, second };
+
+    std::lock_guard<std::mutex> lock(registrationMutex);
+    return insertPayloadType(pages, definition);
+}
+
+/**
+ * Removes a registered OEM specific payload type, messages of this type are
+ * rejected again. The code must not be registered again while messages of
+ * this type may still be parsed, their definition would be overwritten.
+ * @param code          payload type code which was registered
+ * @return              false if the code is not a registered OEM payload type
+ */
+bool unregisterPayloadType(uint16_t code) {
+    std::atomic<PayloadTypePage*>* pages = getPayloadTypePages();
+
+    std::lock_guard<std::mutex> lock(registrationMutex);
+    PayloadTypePage* page = pages[code >> 8].load(std::memory_order_acquire);
+    uint8_t index = code & 0xFF;
+    if(page == nullptr || !page->known[index].load(std::memory_order_acquire) ||
+            page->definitions[index].type != PayloadType::OEMSPECIFIC) {
+        return false;
+    }
+    page->known[index].store(false, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Checks the payload length of a message against the rule of its payload type
+ */
+bool isValidPayloadLength(const PayloadTypeDefinition& definition, uint32_t payloadLength) {
+    switch(definition.lengthCheck) {
+        case EXACTLENGTH:
+            return payloadLength == definition.first;
+        case MINIMUMLENGTH:
+            return payloadLength >= definition.first;
+        case LENGTHRANGE:
+            return payloadLength >= definition.first && payloadLength <= definition.second;
+        case EITHERLENGTH:
+            return payloadLength == definition.first || payloadLength == definition.second;
+    }
+    return false;
+}
+
 /**
  * Checks if the received Generic Header is valid
  * @param data          message which was received
@@ -13,7 +188,7 @@ using namespace std;
  */
 GenericHeaderAction parseGenericHeader(unsigned char* data, int dataLenght) {
     
-    GenericHeaderAction action;
+    GenericHeaderAction action = {};
     
     //Only check header if received data is greater or equals the set header length
     if(dataLenght >= _GenericHeaderLength) {
@@ -34,27 +209,11 @@ GenericHeaderAction parseGenericHeader(unsigned char* data, int dataLenght) {
         payloadLength |= (unsigned int)(data[7] <<  0);
 
         action.payloadLength = payloadLength;
+        action.payloadTypeCode = (uint16_t)((data[2] << 8) | data[3]);
 
         //Check Payload Type
-        PayloadType messagePayloadType;
-        if(data[2] == 0x00 && data[3] == 0x05) {	//Value of RoutingActivationRequest = 0x0005
-            messagePayloadType = PayloadType::ROUTINGACTIVATIONREQUEST;
-        }
-        else if(data[2] == 0x00 && data[3] == 0x04){
-            messagePayloadType = PayloadType::VEHICLEIDENTRESPONSE;
-        }
-        else if(data[2] == 0x00 && data[3] == 0x01) {   //Value of Vehicle Identification Request = 0x0001
-            messagePayloadType = PayloadType::VEHICLEIDENTREQUEST;
-        }
-        else if(data[2] == 0x80 && data[3] == 0x01) {   //Value of Diagnose Message = 0x8001
-            messagePayloadType = PayloadType::DIAGNOSTICMESSAGE;
-        } 
-        else if(data[2] == 0x80 && data[3] == 0x02) {   //Value of Diagnostic Message positive ack = 0x8002
-            messagePayloadType = PayloadType::DIAGNOSTICPOSITIVEACK;
-        } 
-        else if(data[2] == 0x80 && data[3] == 0x03) {   //Value of Diagnostic Message negative ack = 0x8003
-            messagePayloadType = PayloadType::DIAGNOSTICNEGATIVEACK;
-        } else {
+        const PayloadTypeDefinition* definition = findPayloadType(action.payloadTypeCode);
+        if(definition == nullptr) {
             //Unknown Payload Type --> Send Generic DoIP Header NACK
             action.type = PayloadType::NEGATIVEACK;
             action.value = _UnknownPayloadTypeCode;
@@ -62,74 +221,13 @@ GenericHeaderAction parseGenericHeader(unsigned char* data, int dataLenght) {
         }
 
         //Check Payload Type specific length
-        switch(messagePayloadType) {
-            case PayloadType::ROUTINGACTIVATIONREQUEST: {
-                if(payloadLength != 7 && payloadLength != 11) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                    return action;
-                }
-                break;
-            }
-
-            case PayloadType::ALIVECHECKRESPONSE: {
-                if(payloadLength != 2) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                    return action;
-                }
-                break;
-            }
-            
-            case PayloadType::VEHICLEIDENTREQUEST: {
-                if(payloadLength != 0) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                    return action;
-                }
-                break;
-            }
-
-            case PayloadType::VEHICLEIDENTRESPONSE:{
-                if(payloadLength != 32 && payloadLength != 33) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                    return action;
-                }
-                break;
-            }
-
-            case PayloadType::DIAGNOSTICMESSAGE: {
-                if(payloadLength <= 4) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                    return action;
-                }
-                break;	
-            }
-
-            case PayloadType::DIAGNOSTICPOSITIVEACK: {
-                if(payloadLength < 5) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                }
-                break;
-            }
-
-            case PayloadType::DIAGNOSTICNEGATIVEACK: {
-                if(payloadLength < 5) {
-                    action.type = PayloadType::NEGATIVEACK;
-                    action.value = _InvalidPayloadLengthCode;
-                }
-                break;
-            }
-
-            default: {
-                std::cerr << "not handled payload type occured in parseGenericHeader()" << std::endl;
-                break;	
-            }
+        if(!isValidPayloadLength(*definition, payloadLength)) {
+            action.type = PayloadType::NEGATIVEACK;
+            action.value = _InvalidPayloadLengthCode;
+            return action;
         }
-        action.type = messagePayloadType;
+
+        action.type = definition->type;
     }
     
     return action;
@@ -139,65 +237,59 @@ GenericHeaderAction parseGenericHeader(unsigned char* data, int dataLenght) {
  * Creates a generic header
  * @param type      payload type which will be filled in the header
  * @param length    length of the payload type specific message
- * @return          header array
+ * @return          header array with space for the payload,
+ *                  which has to be released with delete[]
  */
 unsigned char* createGenericHeader(PayloadType type, uint32_t length) {
-    unsigned char *header = new unsigned char[8 + length];
-    header[0] = 0x02;
-    header[1] = 0xFD;
-    switch(type) {
-        case PayloadType::ROUTINGACTIVATIONRESPONSE: {
-            header[2] = 0x00;
-            header[3] = 0x06;
-            break;
-        }
-			
-        case PayloadType::NEGATIVEACK: {
-            header[2] = 0x00;
-            header[3] = 0x00;
-            break;
-        }
-
-        case PayloadType::VEHICLEIDENTRESPONSE:{
-            header[2] = 0x00;
-            header[3] = 0x04;
-            break;
-        }
-
-        case PayloadType::DIAGNOSTICMESSAGE: {
-            header[2] = 0x80;
-            header[3] = 0x01;
-            break;
-        }
-
-        case PayloadType::DIAGNOSTICPOSITIVEACK: {
-            header[2] = 0x80;
-            header[3] = 0x02;
-            break;
-        }
-
-        case PayloadType::DIAGNOSTICNEGATIVEACK: {
-            header[2] = 0x80;
-            header[3] = 0x03;
-            break;
-        }
-        
-        case PayloadType::ALIVECHECKRESPONSE: {
-            header[2] = 0x00;
-            header[3] = 0x08;
-            break;
-        }
+    unsigned char *header = new unsigned char[_GenericHeaderLength + length];
+    encodeGenericHeader(header, type, length);
+    return header;
+}
 
-        default: {
-            std::cerr << "not handled payload type occured in createGenericHeader()" << std::endl;
-            break;
-        }
+/**
+ * Writes a generic header into a caller provided buffer
+ * @param buffer    buffer with space for at least _GenericHeaderLength bytes
+ * @param type      payload type which will be filled in the header
+ * @param length    length of the payload type specific message
+ * @return          number of written bytes
+ */
+int encodeGenericHeader(unsigned char* buffer, PayloadType type, uint32_t length) {
+    if(type == PayloadType::OEMSPECIFIC) {
+        DOIP_LOG_WARNING("OEM specific payload types have to be encoded with their code");
     }
-    
+    return encodeGenericHeader(buffer, getPayloadTypeCode(type), length);
+}
+
+/**
+ * Writes a generic header with the code of the payload type into a caller provided buffer,
+ * e.g. for OEM specific payload types
+ * @param buffer            buffer with space for at least _GenericHeaderLength bytes
+ * @param payloadTypeCode   payload type field of the header
+ * @param length            length of the payload type specific message
+ * @return                  number of written bytes
+ */
+int encodeGenericHeader(unsigned char* buffer, uint16_t payloadTypeCode, uint32_t length) {
+    unsigned char* header = buffer;
+    header[0] = 0x02;
+    header[1] = 0xFD;
+    header[2] = (payloadTypeCode >> 8) & 0xFF;
+    header[3] = payloadTypeCode & 0xFF;
     header[4] = (length >> 24) & 0xFF;
     header[5] = (length >> 16) & 0xFF;
     header[6] = (length >> 8) & 0xFF;
     header[7] = length & 0xFF;
     
-    return header;
+    return _GenericHeaderLength;
+}
+
+/**
+ * Writes a generic header negative acknowledge into a caller provided buffer
+ * @param buffer    buffer with space for at least _GenericHeaderLength + _NACKLength bytes
+ * @param nackCode  NACK code which will be included in the message
+ * @return          number of written bytes
+ */
+int encodeNegativeAck(unsigned char* buffer, unsigned char nackCode) {
+    encodeGenericHeader(buffer, PayloadType::GENERICNACK, _NACKLength);
+    buffer[8] = nackCode;
+    return _GenericHeaderLength + _NACKLength;
 }
@@ -0,0 +1,201 @@
+#include "DoIPLogger.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+static const char* levelNames[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "OFF" };
+
+/**
+ * Returns the logger of the process. It is never destroyed, so objects with
+ * static storage duration can still log while the process exits.
+ */
+DoIPLogger& DoIPLogger::instance() {
+    static DoIPLogger* logger = new DoIPLogger();
+    return *logger;
+}
+
+DoIPLogger::DoIPLogger():
+    enqueuePosition(0), dequeuePosition(0), droppedMessages(0),
+    minimumLevel(static_cast<LogLevel>(DOIP_LOG_LEVEL)), sink(&DoIPLogger::writeToConsole), consumerSleeping(false) {
+
+    for(size_t i = 0; i < _LogQueueCapacity; i++) {
+        records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    consumer = std::thread(&DoIPLogger::consumeRecords, this);
+    consumer.detach();
+
+    //write the remaining messages when the process exits normally
+    atexit([]() { DoIPLogger::instance().flush(); });
+}
+
+/**
+ * Logs a hex dump of a buffer. At most _LogHexDumpLength bytes are copied,
+ * the line reports the complete length.
+ * @param level     level of the message
+ * @param prefix    string literal which is written before the bytes
+ * @param data      bytes which are dumped
+ * @param length    number of bytes
+ */
+void DoIPLogger::logHex(LogLevel level, const char* prefix, const unsigned char* data, size_t length) {
+    if(!isEnabled(level)) {
+        return;
+    }
+
+    Record* record = claimRecord();
+    if(record == nullptr) {
+        return;
+    }
+
+    HexDump* dump = new (record->storage) HexDump;
+    dump->prefix = prefix;
+    dump->length = length;
+    memcpy(dump->data, data, std::min(length, _LogHexDumpLength));
+    record->formatter = &HexDump::write;
+    publishRecord(record, level);
+}
+
+void DoIPLogger::HexDump::write(const void* storage, char* line, size_t length) {
+    const HexDump* dump = static_cast<const HexDump*>(storage);
+
+    int written = snprintf(line, length, "%s:", dump->prefix);
+    size_t dumped = std::min(dump->length, _LogHexDumpLength);
+    for(size_t i = 0; i < dumped && written > 0 && (size_t)written < length; i++) {
+        written += snprintf(line + written, length - written, " %02X", dump->data[i]);
+    }
+    if(dumped < dump->length && written > 0 && (size_t)written < length) {
+        snprintf(line + written, length - written, " ... (%zu bytes)", dump->length);
+    }
+}
+
+/**
+ * Replaces the function which writes the formatted lines, by default they
+ * are written to stdout and warnings and errors to stderr
+ */
+void DoIPLogger::setSink(LogSink newSink) {
+    std::lock_guard<std::mutex> lock(sinkMutex);
+    sink = newSink ? newSink : LogSink(&DoIPLogger::writeToConsole);
+}
+
+/**
+ * Blocks until every message which was logged before the call is written
+ */
+void DoIPLogger::flush() {
+    size_t target = enqueuePosition.load(std::memory_order_acquire);
+    while(dequeuePosition.load(std::memory_order_acquire) < target) {
+        {
+            std::lock_guard<std::mutex> lock(wakeupMutex);
+            wakeupCondition.notify_one();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+/**
+ * Reserves the next free slot of the queue for a producer
+ * @return      the slot or nullptr if the queue is full
+ */
+DoIPLogger::Record* DoIPLogger::claimRecord() {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+
+    while(true) {
+        Record* record = &records[position & (_LogQueueCapacity - 1)];
+        size_t sequence = record->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if(difference == 0) {
+            if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return record;
+            }
+        } else if(difference < 0) {
+            //the logging thread did not keep up
+            droppedMessages.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Hands a filled slot over to the logging thread
+ */
+void DoIPLogger::publishRecord(Record* record, LogLevel level) {
+    record->level = level;
+    record->time = std::chrono::system_clock::now();
+
+    size_t position = record->sequence.load(std::memory_order_relaxed);
+    record->sequence.store(position + 1, std::memory_order_release);
+
+    if(consumerSleeping.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(wakeupMutex);
+        wakeupCondition.notify_one();
+    }
+}
+
+void DoIPLogger::consumeRecords() {
+    while(true) {
+        if(writeAvailableRecords() > 0) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeupMutex);
+        consumerSleeping.store(true, std::memory_order_release);
+
+        //a producer may have published a record before it saw the flag
+        Record* next = &records[dequeuePosition.load(std::memory_order_relaxed) & (_LogQueueCapacity - 1)];
+        if(next->sequence.load(std::memory_order_acquire) != dequeuePosition.load(std::memory_order_relaxed) + 1) {
+            wakeupCondition.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        consumerSleeping.store(false, std::memory_order_release);
+    }
+}
+
+/**
+ * Formats and writes all published records
+ * @return      number of written records
+ */
+size_t DoIPLogger::writeAvailableRecords() {
+    std::lock_guard<std::mutex> lock(sinkMutex);
+    size_t written = 0;
+    char line[_LogLineLength];
+
+    while(true) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        Record* record = &records[position & (_LogQueueCapacity - 1)];
+        if(record->sequence.load(std::memory_order_acquire) != position + 1) {
+            break;
+        }
+
+        time_t seconds = std::chrono::system_clock::to_time_t(record->time);
+        long milliseconds = (long)(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                record->time.time_since_epoch()).count() % 1000);
+        struct tm localTime;
+        localtime_r(&seconds, &localTime);
+        int prefixLength = snprintf(line, sizeof(line), "%02d:%02d:%02d.%03ld %-7s ",
+                                    localTime.tm_hour, localTime.tm_min, localTime.tm_sec, milliseconds,
+                                    levelNames[static_cast<int>(record->level)]);
+        record->formatter(record->storage, line + prefixLength, sizeof(line) - prefixLength);
+
+        LogLevel level = record->level;
+        record->sequence.store(position + _LogQueueCapacity, std::memory_order_release);
+
+        sink(level, line);
+        written++;
+
+        //flush() waits for this position, so it is advanced after the line was written
+        if(position + 1 == enqueuePosition.load(std::memory_order_acquire)) {
+            fflush(stdout);
+        }
+        dequeuePosition.store(position + 1, std::memory_order_release);
+    }
+
+    return written;
+}
+
+void DoIPLogger::writeToConsole(LogLevel level, const char* line) {
+    FILE* stream = level >= LogLevel::WARNING ? stderr : stdout;
+    fputs(line, stream);
+    fputc('\n', stream);
+}
@@ -0,0 +1,397 @@
+#include "DoIPMetrics.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include "DoIPLogger.h"
+
+thread_local DoIPMetrics::Shard* DoIPMetrics::currentShard = nullptr;
+
+/*
+ * Hands the shard of a thread back to the registry when the thread exits
+ */
+struct MetricsShardRelease {
+    DoIPMetrics::Shard* shard = nullptr;
+
+    ~MetricsShardRelease() {
+        if(shard != nullptr) {
+            DoIPMetrics::currentShard = nullptr;
+            DoIPMetrics::instance().releaseShard(shard);
+        }
+    }
+};
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    buckets[bucketIndex(nanoseconds)].add(1);
+    count.add(1);
+    sum.add(nanoseconds);
+    if(nanoseconds > maximum.get()) {
+        maximum.value.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Returns the bucket of a latency. Values below _LatencySubBuckets have an
+ * exact bucket, above the top bits after the highest set bit select one.
+ */
+size_t LatencyHistogram::bucketIndex(uint64_t nanoseconds) {
+    if(nanoseconds < (uint64_t)_LatencySubBuckets) {
+        return (size_t)nanoseconds;
+    }
+    if(nanoseconds >= (1ULL << _LatencyMaxBit)) {
+        return _LatencyBucketCount - 1;
+    }
+
+    int highestBit = 63 - __builtin_clzll(nanoseconds);
+    int shift = highestBit - _LatencySubBucketBits;
+    size_t subBucket = (size_t)(nanoseconds >> shift) & (_LatencySubBuckets - 1);
+    return (size_t)(shift + 1) * _LatencySubBuckets + subBucket;
+}
+
+/**
+ * Returns the highest latency which is counted in a bucket
+ */
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if(index < (size_t)_LatencySubBuckets) {
+        return index;
+    }
+
+    int shift = (int)(index / _LatencySubBuckets) - 1;
+    uint64_t lowerBound = (uint64_t)(_LatencySubBuckets + index % _LatencySubBuckets) << shift;
+    return lowerBound + (1ULL << shift) - 1;
+}
+
+void LatencySnapshot::merge(const LatencyHistogram& histogram) {
+    for(size_t i = 0; i < buckets.size(); i++) {
+        buckets[i] += histogram.buckets[i].get();
+    }
+    count += histogram.count.get();
+    sum += histogram.sum.get();
+    maximum = std::max(maximum, histogram.maximum.get());
+}
+
+/**
+ * Returns the latency which the given percentage of the recorded latencies
+ * did not exceed, as upper bound of its bucket
+ * @param percent   percentage between 0 and 100
+ * @return          latency in nanoseconds, 0 if nothing was recorded
+ */
+uint64_t LatencySnapshot::percentile(double percent) const {
+    if(count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if(seen >= rank) {
+            return std::min(LatencyHistogram::bucketUpperBound(i), maximum);
+        }
+    }
+    return maximum;
+}
+
+static void appendLine(std::string& text, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendLine(std::string& text, const char* format, ...) {
+    char line[256];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    text += line;
+}
+
+static void appendLatency(std::string& text, const char* target, const LatencySnapshot& latency) {
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+    for(double percent : percentiles) {
+        appendLine(text, "doip_callback_latency_ns{target=\"%s\",quantile=\"%g\"} %llu\n",
+                   target, percent / 100.0, (unsigned long long)latency.percentile(percent));
+    }
+    appendLine(text, "doip_callback_latency_ns_max{target=\"%s\"} %llu\n", target, (unsigned long long)latency.maximum);
+    appendLine(text, "doip_callback_latency_ns_sum{target=\"%s\"} %llu\n", target, (unsigned long long)latency.sum);
+    appendLine(text, "doip_callback_latency_ns_count{target=\"%s\"} %llu\n", target, (unsigned long long)latency.count);
+}
+
+/**
+ * Formats the metrics in the Prometheus text format, counters which are
+ * zero are left out
+ */
+std::string MetricsSnapshot::toText() const {
+    std::string text;
+
+    for(int type = 0; type < _PayloadTypeCount; type++) {
+        unsigned int code = getPayloadTypeCode(static_cast<PayloadType>(type));
+        if(messagesIn[type] > 0) {
+            appendLine(text, "doip_messages_in_total{payload_type=\"0x%04X\"} %llu\n", code, (unsigned long long)messagesIn[type]);
+            appendLine(text, "doip_bytes_in_total{payload_type=\"0x%04X\"} %llu\n", code, (unsigned long long)bytesIn[type]);
+        }
+        if(messagesOut[type] > 0) {
+            appendLine(text, "doip_messages_out_total{payload_type=\"0x%04X\"} %llu\n", code, (unsigned long long)messagesOut[type]);
+            appendLine(text, "doip_bytes_out_total{payload_type=\"0x%04X\"} %llu\n", code, (unsigned long long)bytesOut[type]);
+        }
+    }
+
+    for(int code = 0; code < _MetricsCodeCount; code++) {
+        if(genericNacks[code] > 0) {
+            appendLine(text, "doip_generic_nacks_total{code=\"0x%02X\"} %llu\n", code, (unsigned long long)genericNacks[code]);
+        }
+    }
+    for(int code = 0; code < _MetricsCodeCount; code++) {
+        if(diagnosticNacks[code] > 0) {
+            appendLine(text, "doip_diagnostic_nacks_total{code=\"0x%02X\"} %llu\n", code, (unsigned long long)diagnosticNacks[code]);
+        }
+    }
+    for(int code = 0; code < _MetricsCodeCount; code++) {
+        if(routingActivations[code] > 0) {
+            appendLine(text, "doip_routing_activations_total{result=\"0x%02X\"} %llu\n", code, (unsigned long long)routingActivations[code]);
+        }
+    }
+    appendLine(text, "doip_alive_check_timeouts_total %llu\n", (unsigned long long)aliveCheckTimeouts);
+
+    for(const auto& target : callbackLatency) {
+        char address[8];
+        snprintf(address, sizeof(address), "0x%04X", target.first);
+        appendLatency(text, address, target.second);
+    }
+    if(otherCallbackLatency.count > 0) {
+        appendLatency(text, "other", otherCallbackLatency);
+    }
+
+    return text;
+}
+
+/**
+ * Returns the metrics of the process. They are never destroyed, so threads
+ * which exit after main() can still hand back their shard.
+ */
+DoIPMetrics& DoIPMetrics::instance() {
+    static DoIPMetrics* metrics = new DoIPMetrics();
+    return *metrics;
+}
+
+/*
+ * Returns a shard of an exited thread or a new one for the calling thread
+ */
+DoIPMetrics::Shard* DoIPMetrics::acquireShard() {
+    static thread_local MetricsShardRelease release;
+
+    Shard* acquired = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shardMutex);
+        for(Shard* candidate : shards) {
+            if(!candidate->inUse) {
+                acquired = candidate;
+                break;
+            }
+        }
+        if(acquired == nullptr) {
+            acquired = new Shard();
+            shards.push_back(acquired);
+        }
+        acquired->inUse = true;
+    }
+
+    release.shard = acquired;
+    return acquired;
+}
+
+void DoIPMetrics::releaseShard(Shard* shard) {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    shard->inUse = false;
+}
+
+/**
+ * Records an outgoing message by the payload type in its generic header
+ * @param message   encoded message, at least the generic header
+ * @param bytes     length of the complete message
+ */
+void DoIPMetrics::recordEncodedMessageOut(const unsigned char* message, size_t bytes) {
+    const PayloadTypeDefinition* definition = findPayloadType((uint16_t)(message[2] << 8 | message[3]));
+    recordMessageOut(definition != nullptr ? definition->type : PayloadType::OEMSPECIFIC, bytes);
+}
+
+/*
+ * Finds the histogram of a target address in the shard of the calling
+ * thread. Only this thread adds targets: the histogram is published before
+ * the address, so snapshot() never sees an address without histogram.
+ */
+LatencyHistogram& DoIPMetrics::targetHistogram(Shard& shard, unsigned short targetAddress) {
+    size_t slot = (targetAddress * 0x9E37u >> 4) % _MetricsTargetSlots;
+
+    for(int probe = 0; probe < _MetricsTargetSlots; probe++) {
+        TargetSlot& target = shard.targets[slot];
+        int32_t address = target.address.load(std::memory_order_relaxed);
+        if(address == targetAddress) {
+            return *target.histogram.load(std::memory_order_relaxed);
+        }
+        if(address == -1) {
+            target.histogram.store(new LatencyHistogram(), std::memory_order_relaxed);
+            target.address.store(targetAddress, std::memory_order_release);
+            return *target.histogram.load(std::memory_order_relaxed);
+        }
+        slot = (slot + 1) % _MetricsTargetSlots;
+    }
+    return shard.otherTargets;
+}
+
+/**
+ * Records how long the application needed to handle a diagnostic message
+ * @param targetAddress     target address of the message
+ * @param nanoseconds       duration of the callback
+ */
+void DoIPMetrics::recordCallbackLatency(unsigned short targetAddress, uint64_t nanoseconds) {
+    Shard& current = shard();
+    targetHistogram(current, targetAddress).record(nanoseconds);
+}
+
+/**
+ * Sums the metrics of all threads. Counters are read one by one while they
+ * are recorded, so the sums of different counters may be off by the
+ * messages in flight.
+ */
+MetricsSnapshot DoIPMetrics::snapshot() {
+    MetricsSnapshot result;
+    std::lock_guard<std::mutex> lock(shardMutex);
+
+    for(const Shard* shard : shards) {
+        for(int type = 0; type < _PayloadTypeCount; type++) {
+            result.messagesIn[type] += shard->messagesIn[type].get();
+            result.bytesIn[type] += shard->bytesIn[type].get();
+            result.messagesOut[type] += shard->messagesOut[type].get();
+            result.bytesOut[type] += shard->bytesOut[type].get();
+        }
+        for(int code = 0; code < _MetricsCodeCount; code++) {
+            result.genericNacks[code] += shard->genericNacks[code].get();
+            result.diagnosticNacks[code] += shard->diagnosticNacks[code].get();
+            result.routingActivations[code] += shard->routingActivations[code].get();
+        }
+        result.aliveCheckTimeouts += shard->aliveCheckTimeouts.get();
+
+        for(const TargetSlot& target : shard->targets) {
+            int32_t address = target.address.load(std::memory_order_acquire);
+            if(address != -1) {
+                result.callbackLatency[(unsigned short)address].merge(*target.histogram.load(std::memory_order_relaxed));
+            }
+        }
+        result.otherCallbackLatency.merge(shard->otherTargets);
+    }
+    return result;
+}
+
+/**
+ * Serves the metrics as text on a unix socket, every client which connects
+ * gets a snapshot and the socket is closed, e.g. socat - UNIX-CONNECT:path
+ * @param socketPath    path of the socket, an existing file is replaced
+ * @return              true if the endpoint is running
+ */
+bool DoIPMetrics::startTextEndpoint(const std::string& socketPath) {
+    std::lock_guard<std::mutex> lock(endpointMutex);
+    if(endpointSocket != -1) {
+        return false;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(address.sun_path)) {
+        DOIP_LOG_ERROR("Metrics socket path is too long: %s", socketPath.c_str());
+        return false;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0) {
+        DOIP_LOG_ERROR("Failed to create metrics socket: %s", strerror(errno));
+        return false;
+    }
+    unlink(socketPath.c_str());
+    if(bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 8) < 0) {
+        DOIP_LOG_ERROR("Failed to bind metrics socket %s: %s", socketPath.c_str(), strerror(errno));
+        close(listener);
+        return false;
+    }
+
+    endpointSocket = listener;
+    endpointWakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    endpointPath = socketPath;
+    endpointThread = std::thread(&DoIPMetrics::serveTextEndpoint, this);
+    DOIP_LOG_INFO("Serving metrics on %s", socketPath.c_str());
+    return true;
+}
+
+/**
+ * Stops serving the metrics and removes the socket file
+ */
+void DoIPMetrics::stopTextEndpoint() {
+    std::lock_guard<std::mutex> lock(endpointMutex);
+    if(endpointSocket == -1) {
+        return;
+    }
+
+    uint64_t wake = 1;
+    if(write(endpointWakeup, &wake, sizeof(wake)) < 0) {
+        DOIP_LOG_WARNING("Failed to wake the metrics endpoint: %s", strerror(errno));
+    }
+    endpointThread.join();
+
+    close(endpointSocket);
+    close(endpointWakeup);
+    unlink(endpointPath.c_str());
+    endpointSocket = -1;
+    endpointWakeup = -1;
+}
+
+/*
+ * Accepts clients on the metrics socket until stopTextEndpoint() is called
+ */
+void DoIPMetrics::serveTextEndpoint() {
+    struct pollfd descriptors[2];
+    descriptors[0].fd = endpointSocket;
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = endpointWakeup;
+    descriptors[1].events = POLLIN;
+
+    while(true) {
+        if(poll(descriptors, 2, -1) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            DOIP_LOG_ERROR("Metrics endpoint stopped: %s", strerror(errno));
+            return;
+        }
+        if(descriptors[1].revents != 0) {
+            return;
+        }
+
+        int client = accept4(endpointSocket, nullptr, nullptr, SOCK_CLOEXEC);
+        if(client < 0) {
+            continue;
+        }
+
+        std::string text = snapshot().toText();
+        size_t written = 0;
+        while(written < text.size()) {
+            ssize_t result = send(client, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+            if(result < 0 && errno == EINTR) {
+                continue;
+            }
+            if(result <= 0) {
+                break;
+            }
+            written += result;
+        }
+        close(client);
+    }
+}
@@ -0,0 +1,243 @@
+#include "DoIPTracer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/net_tstamp.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include "DoIPLogger.h"
+
+std::atomic<bool> DoIPTracer::enabled(false);
+thread_local DoIPTracer::Buffer* DoIPTracer::currentBuffer = nullptr;
+thread_local uint32_t DoIPTracer::currentThreadId = 0;
+
+/*
+ * Hands the buffer of a thread back when the thread exits, its spans stay
+ * readable until another thread overwrites them
+ */
+struct TraceBufferRelease {
+    DoIPTracer::Buffer* buffer = nullptr;
+
+    ~TraceBufferRelease() {
+        if(buffer != nullptr) {
+            DoIPTracer::currentBuffer = nullptr;
+            DoIPTracer::instance().releaseBuffer(buffer);
+        }
+    }
+};
+
+/**
+ * Returns the tracer of the process. It is never destroyed, so threads which
+ * exit after main() can still hand back their buffer.
+ */
+DoIPTracer& DoIPTracer::instance() {
+    static DoIPTracer* tracer = new DoIPTracer();
+    return *tracer;
+}
+
+/**
+ * Returns the monotonic time in nanoseconds, never 0
+ */
+uint64_t DoIPTracer::now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/**
+ * Starts recording spans
+ * @param kernelTimestamps  true if connections which are opened afterwards
+ *                          should record how long received data waited in
+ *                          the socket, from the SO_TIMESTAMPING receive time
+ */
+void DoIPTracer::enable(bool kernelTimestamps) {
+    this->kernelTimestamps.store(kernelTimestamps, std::memory_order_relaxed);
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Stops recording spans, the recorded spans are kept
+ */
+void DoIPTracer::disable() {
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * Lets the kernel timestamp the data it receives on a socket in software
+ * @return      true if the socket delivers receive timestamps
+ */
+bool DoIPTracer::enableKernelTimestamps(int socket) {
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if(setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        DOIP_LOG_WARNING("Failed to enable receive timestamps: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the SO_TIMESTAMPING receive time from the control messages of a
+ * received message and converts it from the realtime to the monotonic clock
+ * @param message       message filled by recvmsg()
+ * @param timestamp     receive time on the clock of now()
+ * @return              true if the message carried a receive time
+ */
+bool DoIPTracer::getKernelReceiveTime(const struct msghdr& message, uint64_t& timestamp) {
+    for(struct cmsghdr* control = CMSG_FIRSTHDR(&message); control != nullptr;
+            control = CMSG_NXTHDR(const_cast<struct msghdr*>(&message), control)) {
+        if(control->cmsg_level != SOL_SOCKET || control->cmsg_type != SO_TIMESTAMPING) {
+            continue;
+        }
+
+        //the first of the three timestamps is the software timestamp
+        struct timespec received;
+        memcpy(&received, CMSG_DATA(control), sizeof(received));
+        if(received.tv_sec == 0 && received.tv_nsec == 0) {
+            return false;
+        }
+
+        struct timespec realtime;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        uint64_t monotonic = now();
+        int64_t age = ((int64_t)realtime.tv_sec - received.tv_sec) * 1000000000LL + (realtime.tv_nsec - received.tv_nsec);
+        timestamp = monotonic - std::max<int64_t>(age, 0);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Records a span in the buffer of the calling thread
+ * @param name          name of the stage, a string literal
+ * @param start         start time from now()
+ * @param end           end time from now()
+ * @param argument      name of the value which is shown with the span, a string literal or nullptr
+ * @param value         e.g. target address or socket
+ */
+void DoIPTracer::record(const char* name, uint64_t start, uint64_t end, const char* argument, uint32_t value) {
+    if(currentBuffer == nullptr) {
+        currentBuffer = acquireBuffer();
+    }
+
+    Buffer& buffer = *currentBuffer;
+    uint64_t position = buffer.written.load(std::memory_order_relaxed);
+    Span& span = buffer.spans[position % _TraceBufferCapacity];
+    span.name = name;
+    span.argument = argument;
+    span.start = start;
+    span.duration = end > start ? end - start : 0;
+    span.threadId = currentThreadId;
+    span.value = value;
+    buffer.written.store(position + 1, std::memory_order_release);
+}
+
+/*
+ * Returns a buffer of an exited thread or a new one for the calling thread
+ */
+DoIPTracer::Buffer* DoIPTracer::acquireBuffer() {
+    static thread_local TraceBufferRelease release;
+
+    currentThreadId = (uint32_t)syscall(SYS_gettid);
+
+    Buffer* acquired = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        for(Buffer* candidate : buffers) {
+            if(!candidate->inUse) {
+                acquired = candidate;
+                break;
+            }
+        }
+        if(acquired == nullptr) {
+            acquired = new Buffer();
+            buffers.push_back(acquired);
+        }
+        acquired->inUse = true;
+    }
+
+    release.buffer = acquired;
+    return acquired;
+}
+
+void DoIPTracer::releaseBuffer(Buffer* buffer) {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    buffer->inUse = false;
+}
+
+/**
+ * Discards the recorded spans of all threads
+ */
+void DoIPTracer::clear() {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    for(Buffer* buffer : buffers) {
+        buffer->cleared.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Formats the recorded spans as Chrome trace event JSON. Threads keep
+ * recording meanwhile, spans which they overwrote during the copy are left out.
+ */
+std::string DoIPTracer::toChromeTrace() {
+    std::vector<Span> spans;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        for(Buffer* buffer : buffers) {
+            uint64_t end = buffer->written.load(std::memory_order_acquire);
+            uint64_t begin = std::max(buffer->cleared.load(std::memory_order_relaxed),
+                                      end > _TraceBufferCapacity ? end - _TraceBufferCapacity : 0);
+            std::vector<Span> copied;
+            for(uint64_t position = begin; position < end; position++) {
+                copied.push_back(buffer->spans[position % _TraceBufferCapacity]);
+            }
+
+            //a span is valid if the writer did not start to overwrite its slot during the copy
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t overwritten = buffer->written.load(std::memory_order_relaxed) + 1;
+            uint64_t firstValid = overwritten > _TraceBufferCapacity ? overwritten - _TraceBufferCapacity : 0;
+            size_t skipped = firstValid > begin ? std::min<uint64_t>(firstValid - begin, copied.size()) : 0;
+            spans.insert(spans.end(), copied.begin() + skipped, copied.end());
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const Span& first, const Span& second) { return first.start < second.start; });
+
+    std::string trace = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    int processId = getpid();
+    char event[256];
+    for(size_t i = 0; i < spans.size(); i++) {
+        const Span& span = spans[i];
+        int length = snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"cat\":\"doip\",\"ph\":\"X\",\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":%d,\"tid\":%u",
+                              i > 0 ? "," : "", span.name,
+                              (unsigned long long)(span.start / 1000), (unsigned long long)(span.start % 1000),
+                              (unsigned long long)(span.duration / 1000), (unsigned long long)(span.duration % 1000),
+                              processId, span.threadId);
+        if(span.argument != nullptr && length > 0 && (size_t)length < sizeof(event)) {
+            length += snprintf(event + length, sizeof(event) - length, ",\"args\":{\"%s\":\"0x%04X\"}", span.argument, span.value);
+        }
+        trace += event;
+        trace += "}";
+    }
+    trace += "]}\n";
+    return trace;
+}
+
+/**
+ * Writes the recorded spans as Chrome trace event JSON into a file
+ * @return      true if the file was written
+ */
+bool DoIPTracer::writeChromeTrace(const std::string& path) {
+    std::string trace = toChromeTrace();
+
+    FILE* file = fopen(path.c_str(), "w");
+    if(file == nullptr) {
+        DOIP_LOG_ERROR("Failed to open trace file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    bool written = fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,279 @@
+#include "IoUring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include "DoIPLogger.h"
+
+IoUring::~IoUring() {
+    if(bufferRing != nullptr) {
+        munmap(bufferRing, bufferRingSize);
+    }
+    delete[] bufferMemory;
+    if(submissions != nullptr) {
+        munmap(submissions, submissionsSize);
+    }
+    if(completionRing != nullptr && completionRing != submissionRing) {
+        munmap(completionRing, completionRingSize);
+    }
+    if(submissionRing != nullptr) {
+        munmap(submissionRing, submissionRingSize);
+    }
+    if(ringFd >= 0) {
+        close(ringFd);
+    }
+}
+
+/**
+ * Checks once if the kernel provides io_uring with the features this
+ * library uses, it may be missing or disabled, e.g. by a seccomp filter
+ */
+bool IoUring::isSupported() {
+    static const bool supported = []() {
+        IoUring probe;
+        return probe.setup(4, 8) && probe.setupBufferRing(0, 1, 64);
+    }();
+    return supported;
+}
+
+/**
+ * Creates the ring and maps its queues
+ * @param entries               size of the submission queue
+ * @param completionEntries     size of the completion queue
+ * @return                      true if the ring is ready
+ */
+bool IoUring::setup(unsigned entries, unsigned completionEntries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = completionEntries;
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd < 0) {
+        DOIP_LOG_WARNING("io_uring is not available: %s", strerror(errno));
+        return false;
+    }
+
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+    }
+
+    submissionRing = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if(submissionRing == MAP_FAILED) {
+        submissionRing = nullptr;
+        DOIP_LOG_ERROR("Failed to map the io_uring submission queue: %s", strerror(errno));
+        return false;
+    }
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        completionRing = submissionRing;
+    } else {
+        completionRing = mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(completionRing == MAP_FAILED) {
+            completionRing = nullptr;
+            DOIP_LOG_ERROR("Failed to map the io_uring completion queue: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    submissionsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* entriesMapping = mmap(nullptr, submissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(entriesMapping == MAP_FAILED) {
+        DOIP_LOG_ERROR("Failed to map the io_uring submission entries: %s", strerror(errno));
+        return false;
+    }
+    submissions = static_cast<struct io_uring_sqe*>(entriesMapping);
+
+    unsigned char* submissionBase = static_cast<unsigned char*>(submissionRing);
+    submissionHead = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.head);
+    submissionTail = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.tail);
+    submissionMask = *reinterpret_cast<unsigned*>(submissionBase + params.sq_off.ring_mask);
+    submissionArray = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.array);
+
+    unsigned char* completionBase = static_cast<unsigned char*>(completionRing);
+    completionHead = reinterpret_cast<unsigned*>(completionBase + params.cq_off.head);
+    completionTail = reinterpret_cast<unsigned*>(completionBase + params.cq_off.tail);
+    completionMask = *reinterpret_cast<unsigned*>(completionBase + params.cq_off.ring_mask);
+    completions = reinterpret_cast<struct io_uring_cqe*>(completionBase + params.cq_off.cqes);
+
+    //every slot of the array points to the entry with the same index
+    for(unsigned i = 0; i <= submissionMask; i++) {
+        submissionArray[i] = i;
+    }
+    localTail = *submissionTail;
+    return true;
+}
+
+/**
+ * Returns a cleared submission entry which is passed to the kernel with the
+ * next submit(), or nullptr if the submission queue is full
+ */
+struct io_uring_sqe* IoUring::getSubmission() {
+    unsigned head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+    if(localTail - head > submissionMask) {
+        return nullptr;
+    }
+
+    struct io_uring_sqe* submission = &submissions[localTail & submissionMask];
+    memset(submission, 0, sizeof(*submission));
+    localTail++;
+    return submission;
+}
+
+/*
+ * Publishes the collected entries to the kernel
+ * @return      number of entries which were not submitted before
+ */
+unsigned IoUring::pendingSubmissions() {
+    unsigned pending = localTail - *submissionTail;
+    __atomic_store_n(submissionTail, localTail, __ATOMIC_RELEASE);
+    return pending;
+}
+
+int IoUring::enter(unsigned submitCount, unsigned waitCount, unsigned flags, const struct io_uring_getevents_arg* argument) {
+    size_t argumentSize = argument != nullptr ? sizeof(*argument) : _NSIG / 8;
+    int result = syscall(__NR_io_uring_enter, ringFd, submitCount, waitCount, flags, argument, argumentSize);
+    if(result < 0 && (errno == EINTR || errno == ETIME)) {
+        return 0;
+    }
+    return result;
+}
+
+/**
+ * Passes the collected entries to the kernel without waiting
+ * @return      number of submitted entries or -1 if error occurred
+ */
+int IoUring::submit() {
+    unsigned pending = pendingSubmissions();
+    if(pending == 0) {
+        return 0;
+    }
+    return enter(pending, 0, 0, nullptr);
+}
+
+/**
+ * Passes the collected entries to the kernel and waits for completions
+ * in the same system call
+ * @param waitCount     number of completions to wait for
+ * @param timeoutMs     maximum time to wait, -1 waits without limit
+ * @return              number of submitted entries or -1 if error occurred
+ */
+int IoUring::submitAndWait(unsigned waitCount, int timeoutMs) {
+    unsigned pending = pendingSubmissions();
+    if(waitCount == 0) {
+        return pending > 0 ? enter(pending, 0, 0, nullptr) : 0;
+    }
+
+    if(timeoutMs < 0) {
+        return enter(pending, waitCount, IORING_ENTER_GETEVENTS, nullptr);
+    }
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+    struct io_uring_getevents_arg argument;
+    memset(&argument, 0, sizeof(argument));
+    argument.sigmask_sz = _NSIG / 8;
+    argument.ts = (uint64_t)(uintptr_t)&timeout;
+    return enter(pending, waitCount, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument);
+}
+
+/**
+ * Returns the oldest completion which was not seen yet, or nullptr
+ */
+struct io_uring_cqe* IoUring::peekCompletion() {
+    unsigned head = *completionHead;
+    if(head == __atomic_load_n(completionTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &completions[head & completionMask];
+}
+
+/**
+ * Hands the completion returned by peekCompletion() back to the kernel
+ */
+void IoUring::completionSeen() {
+    __atomic_store_n(completionHead, *completionHead + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Fills a submission entry with a level-triggered poll which posts a
+ * completion every time the descriptor is ready, until it is cancelled
+ * @param events    poll events of interest (POLLIN, POLLOUT, ...)
+ */
+void IoUring::prepareMultishotPoll(struct io_uring_sqe* submission, int fd, uint32_t events, uint64_t userData) {
+    submission->opcode = IORING_OP_POLL_ADD;
+    submission->fd = fd;
+    submission->len = IORING_POLL_ADD_MULTI;
+    submission->poll32_events = events;
+    submission->user_data = userData;
+}
+
+/**
+ * Fills a submission entry with a receive which posts a completion for every
+ * received chunk, each in a buffer of the buffer ring with the given group.
+ * The buffer id is in the upper bits of the completion flags.
+ */
+void IoUring::prepareMultishotReceive(struct io_uring_sqe* submission, int fd, uint16_t group, uint64_t userData) {
+    submission->opcode = IORING_OP_RECV;
+    submission->fd = fd;
+    submission->ioprio = IORING_RECV_MULTISHOT;
+    submission->flags = IOSQE_BUFFER_SELECT;
+    submission->buf_group = group;
+    submission->user_data = userData;
+}
+
+/**
+ * Registers a ring of receive buffers, multishot receives of the group take
+ * a buffer for every completion. The buffers belong to the caller again
+ * until they are returned with recycleBuffer().
+ * @param group         buffer group id used in the receive requests
+ * @param count         number of buffers, a power of two
+ * @param bufferSize    size of every buffer
+ * @return              true if the buffers were registered
+ */
+bool IoUring::setupBufferRing(uint16_t group, unsigned count, unsigned bufferSize) {
+    bufferRingSize = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    bufferRing = static_cast<struct io_uring_buf_ring*>(ring);
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        DOIP_LOG_WARNING("Failed to register io_uring receive buffers: %s", strerror(errno));
+        return false;
+    }
+
+    this->bufferCount = count;
+    this->bufferSize = bufferSize;
+    bufferMemory = new unsigned char[(size_t)count * bufferSize];
+    for(unsigned i = 0; i < count; i++) {
+        recycleBuffer(i);
+    }
+    return true;
+}
+
+/**
+ * Returns a buffer which was taken by a receive to the kernel
+ */
+void IoUring::recycleBuffer(uint16_t bufferId) {
+    struct io_uring_buf* buffers = reinterpret_cast<struct io_uring_buf*>(bufferRing);
+    struct io_uring_buf& buffer = buffers[bufferTail & (bufferCount - 1)];
+    buffer.addr = (uint64_t)(uintptr_t)getBuffer(bufferId);
+    buffer.len = bufferSize;
+    buffer.bid = bufferId;
+    bufferTail++;
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
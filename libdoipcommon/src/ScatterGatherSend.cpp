@@ -0,0 +1,69 @@
+#include "ScatterGatherSend.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+
+/**
+ * Sends all bytes described by the vectors with as few system calls as
+ * possible. Partial writes are continued at the first unsent byte, a
+ * non-blocking socket is polled until it is writable again.
+ * @param socket        connected socket
+ * @param vectors       buffers which are sent in order, they are modified
+ *                      to describe the unsent bytes on return
+ * @param count         number of vectors
+ * @param timeoutMs     maximum time to wait for a full socket to become writable
+ * @return              number of bytes sent, or -1 if nothing could be sent
+ */
+ssize_t sendVectors(int socket, struct iovec* vectors, int count, int timeoutMs) {
+    ssize_t sentBytes = 0;
+
+    while(count > 0) {
+        //skip buffers which are completely sent or empty
+        if(vectors->iov_len == 0) {
+            vectors++;
+            count--;
+            continue;
+        }
+
+        struct msghdr message = {};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count < IOV_MAX ? count : IOV_MAX;
+
+        ssize_t result = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if(result > 0) {
+            sentBytes += result;
+
+            //advance the vectors behind the sent bytes
+            size_t remaining = result;
+            while(remaining > 0 && remaining >= vectors->iov_len) {
+                remaining -= vectors->iov_len;
+                vectors->iov_len = 0;
+                vectors++;
+                count--;
+            }
+            if(remaining > 0) {
+                vectors->iov_base = static_cast<char*>(vectors->iov_base) + remaining;
+                vectors->iov_len -= remaining;
+            }
+            continue;
+        }
+
+        if(result < 0 && errno == EINTR) {
+            continue;
+        }
+
+        //non-blocking socket, wait till it is writable again
+        if(result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd writable = { socket, POLLOUT, 0 };
+            if(poll(&writable, 1, timeoutMs) > 0) {
+                continue;
+            }
+        }
+
+        return sentBytes > 0 ? sentBytes : -1;
+    }
+
+    return sentBytes;
+}
@@ -0,0 +1,275 @@
+#include "TimerWheel.h"
+
+#include <thread>
+
+/**
+ * Cancels the timer, waits for a currently running callback of this timer
+ */
+TimerEntry::~TimerEntry() {
+    if(wheel != nullptr) {
+        wheel->cancel(*this);
+    }
+}
+
+/**
+ * Creates an empty timing wheel
+ * @param tickMs        resolution of the wheel in milliseconds
+ * @param slotCount     number of slots, timers further away than
+ *                      tickMs * slotCount share slots with closer timers
+ * @param clock         source of the time in milliseconds, the monotonic clock if empty
+ */
+TimerWheel::TimerWheel(uint32_t tickMs, uint32_t slotCount, TimerClock clock):
+    slots(slotCount > 0 ? slotCount : 1), tickMs(tickMs > 0 ? tickMs : 1), clock(clock), origin(0) {
+
+    origin = now();
+
+    for(TimerLink& slot : slots) {
+        slot.prev = &slot;
+        slot.next = &slot;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+    for(TimerLink& slot : slots) {
+        while(slot.next != &slot) {
+            TimerEntry& entry = static_cast<TimerEntry&>(*slot.next);
+            unlink(entry);
+            entry.armed = false;
+            entry.wheel = nullptr;
+        }
+    }
+}
+
+/**
+ * Arms the timer or re-arms it if it is already armed
+ * @param entry     timer which will be armed
+ * @param delayMs   time in milliseconds till the callback of the timer is called
+ */
+void TimerWheel::arm(TimerEntry& entry, uint32_t delayMs) {
+    if(entry.wheel != nullptr && entry.wheel != this) {
+        entry.wheel->cancel(entry);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+    if(entry.armed) {
+        unlink(entry);
+        armedCount--;
+    }
+
+    uint64_t delayTicks = (delayMs + tickMs - 1) / tickMs;
+    if(delayTicks == 0) {
+        delayTicks = 1;
+    }
+
+    uint64_t now = elapsedTicks();
+    entry.expiryTick = (now > currentTick ? now : currentTick) + delayTicks;
+    entry.wheel = this;
+    entry.armed = true;
+    armedCount++;
+
+    //link at the tail of the slot
+    TimerLink& slot = slots[entry.expiryTick % slots.size()];
+    entry.prev = slot.prev;
+    entry.next = &slot;
+    slot.prev->next = &entry;
+    slot.prev = &entry;
+
+    //the driver sleeps longer than this timer needs, wake it up
+    if(entry.expiryTick < scheduledWakeupTick) {
+        scheduledWakeupTick = entry.expiryTick;
+        if(wakeupCallback) {
+            wakeupCallback();
+        }
+    }
+}
+
+/**
+ * Cancels an armed timer. Does nothing if the timer is not armed.
+ * @param entry     timer which will be cancelled
+ */
+void TimerWheel::cancel(TimerEntry& entry) {
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+    if(entry.wheel == this && entry.armed) {
+        unlink(entry);
+        entry.armed = false;
+        armedCount--;
+    }
+}
+
+/**
+ * Expires all timers which are due since the last call and calls their callbacks
+ * @return      number of expired timers
+ */
+int TimerWheel::advance() {
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+
+    uint64_t targetTick = elapsedTicks();
+    int expiredTimers = 0;
+
+    //the driver was late by at least one revolution, every slot is due once
+    if(armedCount > 0 && targetTick - currentTick >= slots.size()) {
+        currentTick = targetTick;
+        for(TimerLink& slot : slots) {
+            expiredTimers += expireSlot(slot, targetTick);
+        }
+    }
+
+    while(currentTick < targetTick) {
+        if(armedCount == 0) {
+            currentTick = targetTick;
+            break;
+        }
+        currentTick++;
+        expiredTimers += expireSlot(slots[currentTick % slots.size()], currentTick);
+    }
+
+    return expiredTimers;
+}
+
+/**
+ * Calculates how long the driver may sleep till the next timer might expire
+ * @return      time in milliseconds, or -1 if no timer is armed
+ */
+int TimerWheel::millisecondsUntilNextExpiry() {
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+
+    if(armedCount == 0) {
+        scheduledWakeupTick = UINT64_MAX;
+        return -1;
+    }
+
+    //find the next slot which holds a timer, the timer itself may be due in a later revolution
+    uint64_t nextTick = currentTick + slots.size();
+    for(uint64_t tick = currentTick + 1; tick <= currentTick + slots.size(); tick++) {
+        TimerLink& slot = slots[tick % slots.size()];
+        if(slot.next != &slot) {
+            nextTick = tick;
+            break;
+        }
+    }
+    scheduledWakeupTick = nextTick;
+
+    uint64_t due = origin + nextTick * tickMs;
+    uint64_t current = now();
+    if(due <= current) {
+        return 0;
+    }
+    return (int)(due - current);
+}
+
+/**
+ * Sets a function which is called when a timer is armed which expires
+ * before the driver of the wheel would wake up. It is called with the
+ * wheel locked and must only notify the driver.
+ * @param callback  function which wakes up the driver
+ */
+void TimerWheel::setWakeupCallback(TimerWakeupCallback callback) {
+    std::lock_guard<std::recursive_mutex> lock(wheelMutex);
+    wakeupCallback = callback;
+}
+
+uint64_t TimerWheel::now() const {
+    if(clock) {
+        return clock();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t TimerWheel::elapsedTicks() const {
+    return (now() - origin) / tickMs;
+}
+
+void TimerWheel::unlink(TimerEntry& entry) {
+    entry.prev->next = entry.next;
+    entry.next->prev = entry.prev;
+    entry.prev = nullptr;
+    entry.next = nullptr;
+}
+
+/**
+ * Calls the callbacks of all timers in the slot which are due at tick
+ * @return      number of expired timers
+ */
+int TimerWheel::expireSlot(TimerLink& slot, uint64_t tick) {
+    //move due timers to a local list first, callbacks may arm timers into this slot
+    TimerLink expired;
+    expired.prev = &expired;
+    expired.next = &expired;
+
+    TimerLink* link = slot.next;
+    while(link != &slot) {
+        TimerLink* next = link->next;
+        TimerEntry& entry = static_cast<TimerEntry&>(*link);
+        if(entry.expiryTick <= tick) {
+            unlink(entry);
+            entry.prev = expired.prev;
+            entry.next = &expired;
+            expired.prev->next = &entry;
+            expired.prev = &entry;
+        }
+        link = next;
+    }
+
+    int expiredTimers = 0;
+    while(expired.next != &expired) {
+        //callbacks may cancel other timers of the expired list
+        TimerEntry& entry = static_cast<TimerEntry&>(*expired.next);
+        unlink(entry);
+        entry.armed = false;
+        armedCount--;
+        expiredTimers++;
+
+        if(entry.callback) {
+            entry.callback();
+        }
+    }
+
+    return expiredTimers;
+}
+
+/**
+ * Returns the timer service which is shared by all timers that are not
+ * driven by an event loop. The service is never destroyed, so timers in
+ * static objects stay valid till the end of the program.
+ */
+TimerService& TimerService::instance() {
+    static TimerService* service = new TimerService();
+    return *service;
+}
+
+/*
+ * The thread is started by the first armed timer, programs which only use
+ * event loops or disabled timers never start it
+ */
+TimerService::TimerService() {
+    timerWheel.setWakeupCallback([this]() {
+        std::call_once(threadStarted, [this]() {
+            std::thread(&TimerService::run, this).detach();
+        });
+        {
+            std::lock_guard<std::mutex> lock(serviceMutex);
+            wakeupPending = true;
+        }
+        serviceCondition.notify_one();
+    });
+}
+
+/**
+ * Sleeps till the next timer is due and expires it
+ */
+void TimerService::run() {
+    while(true) {
+        timerWheel.advance();
+        int waitMs = timerWheel.millisecondsUntilNextExpiry();
+
+        std::unique_lock<std::mutex> lock(serviceMutex);
+        if(waitMs < 0) {
+            serviceCondition.wait(lock, [this]() { return wakeupPending; });
+        } else {
+            serviceCondition.wait_for(lock, std::chrono::milliseconds(waitMs), [this]() { return wakeupPending; });
+        }
+        wakeupPending = false;
+    }
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "BufferPool.h"
+
+class BufferPoolTest : public ::testing::Test {
+	public:
+		BufferPool pool{std::vector<size_t>{64, 1024}, 4096};
+};
+
+/*
+* Checks if a request is served by the smallest fitting size class
+*/
+TEST_F(BufferPoolTest, SmallestFittingSizeClass) {
+	PooledBuffer buffer = pool.acquire(100);
+	ASSERT_TRUE((bool)buffer);
+	ASSERT_EQ(buffer.size(), 100u);
+	ASSERT_EQ(buffer.capacity(), 1024u);
+
+	std::vector<BufferPoolStatistics> statistics = pool.getStatistics();
+	ASSERT_EQ(statistics.size(), 2u);
+	ASSERT_EQ(statistics[0].blocksInUse, 0u);
+	ASSERT_EQ(statistics[1].blocksInUse, 1u);
+	ASSERT_EQ(statistics[1].totalBlocks, 4u);
+}
+
+/*
+* Checks if released buffers are reused instead of allocating new slabs
+*/
+TEST_F(BufferPoolTest, ReleasedBufferIsReused) {
+	unsigned char* first;
+	{
+		PooledBuffer buffer = pool.acquire(10);
+		first = buffer.data();
+	}
+
+	PooledBuffer buffer = pool.acquire(20);
+	ASSERT_EQ(buffer.data(), first);
+
+	std::vector<BufferPoolStatistics> statistics = pool.getStatistics();
+	ASSERT_EQ(statistics[0].slabs, 1u);
+	ASSERT_EQ(statistics[0].acquisitions, 2u);
+	ASSERT_EQ(statistics[0].peakBlocksInUse, 1u);
+}
+
+/*
+* Checks if moving a handle transfers the ownership of the buffer
+*/
+TEST_F(BufferPoolTest, MoveTransfersOwnership) {
+	PooledBuffer buffer = pool.acquire(10);
+	PooledBuffer moved(std::move(buffer));
+	ASSERT_FALSE((bool)buffer);
+	ASSERT_TRUE((bool)moved);
+
+	moved.reset();
+	ASSERT_EQ(pool.getStatistics()[0].blocksInUse, 0u);
+}
+
+/*
+* Checks if requests larger than every size class are served from the heap
+*/
+TEST_F(BufferPoolTest, OversizeRequest) {
+	PooledBuffer buffer = pool.acquire(5000);
+	ASSERT_TRUE((bool)buffer);
+	ASSERT_EQ(buffer.size(), 5000u);
+	ASSERT_EQ(pool.getOversizeAllocations(), 1u);
+}
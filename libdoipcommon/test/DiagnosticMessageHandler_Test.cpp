@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include "DiagnosticMessageHandler.h"
+
+class DiagnosticMessageTest : public ::testing::Test {
+	public:
+		unsigned char targetAddress[2] = {0x0E, 0x00};
+		unsigned char userData[3] = {0x22, 0xF1, 0x90};
+};
+
+/*
+* Checks if a diagnostic positive ack is written correctly into the buffer
+*/
+TEST_F(DiagnosticMessageTest, EncodePositiveACK) {
+	unsigned char buffer[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+	int length = encodeDiagnosticACK(buffer, true, 0x0028, targetAddress, 0x00);
+
+	unsigned char expected[] = {0x02, 0xFD, 0x80, 0x02, 0x00, 0x00, 0x00, 0x05, 0x00, 0x28, 0x0E, 0x00, 0x00};
+	ASSERT_EQ(length, (int)sizeof(expected));
+	for(int i = 0; i < length; i++) {
+		ASSERT_EQ(buffer[i], expected[i]) << "wrong byte at position " << i;
+	}
+}
+
+/*
+* Checks if a diagnostic negative ack uses the negative ack payload type
+*/
+TEST_F(DiagnosticMessageTest, EncodeNegativeACK) {
+	unsigned char buffer[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+	encodeDiagnosticACK(buffer, false, 0x0028, targetAddress, _UnknownTargetAddressCode);
+
+	GenericHeaderAction action = parseGenericHeader(buffer, sizeof(buffer));
+	ASSERT_EQ(action.type, PayloadType::DIAGNOSTICNEGATIVEACK);
+	ASSERT_EQ(buffer[12], _UnknownTargetAddressCode);
+}
+
+/*
+* Checks if an encoded diagnostic message is parsed as valid diagnostic message
+*/
+TEST_F(DiagnosticMessageTest, EncodeDiagnosticMessage) {
+	unsigned char buffer[_GenericHeaderLength + _DiagnosticMessageMinimumLength + sizeof(userData)];
+	int length = encodeDiagnosticMessage(buffer, 0x0028, targetAddress, userData, sizeof(userData));
+	ASSERT_EQ(length, (int)sizeof(buffer));
+
+	GenericHeaderAction action = parseGenericHeader(buffer, length);
+	ASSERT_EQ(action.type, PayloadType::DIAGNOSTICMESSAGE);
+	ASSERT_EQ(action.payloadLength, _DiagnosticMessageMinimumLength + sizeof(userData));
+	ASSERT_EQ(buffer[8], 0x00);
+	ASSERT_EQ(buffer[9], 0x28);
+	ASSERT_EQ(buffer[12], 0x22);
+	ASSERT_EQ(buffer[14], 0x90);
+}
+
+/*
+* Checks if the allocating create function produces the same message as the encoder
+*/
+TEST_F(DiagnosticMessageTest, CreateMatchesEncode) {
+	unsigned char buffer[_GenericHeaderLength + _DiagnosticMessageMinimumLength + sizeof(userData)];
+	int length = encodeDiagnosticMessage(buffer, 0x0028, targetAddress, userData, sizeof(userData));
+
+	unsigned char* message = createDiagnosticMessage(0x0028, targetAddress, userData, sizeof(userData));
+	for(int i = 0; i < length; i++) {
+		ASSERT_EQ(message[i], buffer[i]) << "wrong byte at position " << i;
+	}
+	delete[] message;
+}
+
+/*
+* Checks if the view callback gets the user data without a copy
+*/
+TEST_F(DiagnosticMessageTest, ViewPointsIntoReceiveBuffer) {
+	unsigned char payload[] = {0x0E, 0x00, 0x00, 0x28, 0x22, 0xF1, 0x90};
+	const unsigned char* viewData = nullptr;
+	int viewLength = 0;
+	unsigned short viewTarget = 0;
+
+	unsigned char result = parseDiagnosticMessage([&](const DiagnosticMessageView& view) {
+		viewData = view.data();
+		viewLength = view.size();
+		viewTarget = view.getTargetAddress();
+	}, targetAddress, payload, sizeof(payload), BufferPool::defaultPool());
+
+	ASSERT_EQ(result, _ValidDiagnosticMessageCode);
+	ASSERT_EQ(viewData, payload + _DiagnosticMessageMinimumLength);
+	ASSERT_EQ(viewLength, 3);
+	ASSERT_EQ(viewTarget, 0x0028);
+}
+
+/*
+* Checks if retained user data stays valid after the receive buffer was overwritten
+*/
+TEST_F(DiagnosticMessageTest, RetainCopiesUserData) {
+	unsigned char payload[] = {0x0E, 0x00, 0x00, 0x28, 0x22, 0xF1, 0x90};
+	PooledBuffer retained;
+
+	parseDiagnosticMessage([&](const DiagnosticMessageView& view) {
+		retained = view.retain();
+	}, targetAddress, payload, sizeof(payload), BufferPool::defaultPool());
+	memset(payload, 0, sizeof(payload));
+
+	ASSERT_TRUE((bool)retained);
+	ASSERT_EQ(retained.size(), 3u);
+	for(int i = 0; i < 3; i++) {
+		ASSERT_EQ(retained.data()[i], userData[i]);
+	}
+}
+
+/*
+* Checks if the view callback is not called for an unregistered source address
+*/
+TEST_F(DiagnosticMessageTest, ViewRejectsInvalidSourceAddress) {
+	unsigned char payload[] = {0x0E, 0x01, 0x00, 0x28, 0x22};
+	bool called = false;
+
+	unsigned char result = parseDiagnosticMessage([&](const DiagnosticMessageView&) {
+		called = true;
+	}, targetAddress, payload, sizeof(payload), BufferPool::defaultPool());
+
+	ASSERT_EQ(result, _InvalidSourceAddressCode);
+	ASSERT_FALSE(called);
+}
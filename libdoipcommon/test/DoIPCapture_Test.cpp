@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+#include "DoIPCapture.h"
+#include "DoIPFrameDecoder.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+class DoIPCaptureTest : public ::testing::Test {
+	public:
+		std::string path;
+		std::vector<CaptureChunk> chunks;
+		Bytes toServer;
+
+		//diagnostic message from 0x0E00 to 0x0028 with ReadDataByIdentifier 0xF190
+		Bytes diagnosticMessage = {0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x07, 0x0E, 0x00, 0x00, 0x28, 0x22, 0xF1, 0x90};
+
+		static void append16(Bytes& bytes, uint16_t value) {
+			bytes.push_back(value >> 8);
+			bytes.push_back(value & 0xFF);
+		}
+
+		static void append32(Bytes& bytes, uint32_t value) {
+			append16(bytes, value >> 16);
+			append16(bytes, value & 0xFFFF);
+		}
+
+		//appends a value in host byte order, like capture headers are written
+		template<typename T>
+		static void appendHost(Bytes& bytes, T value, bool swap = false) {
+			const unsigned char* raw = reinterpret_cast<const unsigned char*>(&value);
+			for(size_t i = 0; i < sizeof(T); i++) {
+				bytes.push_back(raw[swap ? sizeof(T) - 1 - i : i]);
+			}
+		}
+
+		//ethernet frame with an IPv4 packet from 10.0.0.1 to 10.0.0.2 or back
+		static Bytes ipFrame(bool toServer, uint8_t protocol, const Bytes& transport) {
+			Bytes frame(12, 0x00);
+			append16(frame, 0x0800);
+			frame.push_back(0x45);
+			frame.push_back(0x00);
+			append16(frame, 20 + transport.size());
+			append32(frame, 0x00004000);
+			frame.push_back(64);
+			frame.push_back(protocol);
+			append16(frame, 0);
+			append32(frame, toServer ? 0x0A000001 : 0x0A000002);
+			append32(frame, toServer ? 0x0A000002 : 0x0A000001);
+			frame.insert(frame.end(), transport.begin(), transport.end());
+			return frame;
+		}
+
+		static Bytes tcpFrame(bool toServer, uint32_t sequence, uint8_t flags, const Bytes& payload = Bytes()) {
+			Bytes segment;
+			append16(segment, toServer ? 50000 : 13400);
+			append16(segment, toServer ? 13400 : 50000);
+			append32(segment, sequence);
+			append32(segment, 0);
+			segment.push_back(0x50);
+			segment.push_back(flags);
+			append16(segment, 65535);
+			append32(segment, 0);
+			segment.insert(segment.end(), payload.begin(), payload.end());
+			return ipFrame(toServer, 6, segment);
+		}
+
+		static Bytes udpFrame(uint16_t sourcePort, uint16_t destinationPort, const Bytes& payload) {
+			Bytes datagram;
+			append16(datagram, sourcePort);
+			append16(datagram, destinationPort);
+			append16(datagram, 8 + payload.size());
+			append16(datagram, 0);
+			datagram.insert(datagram.end(), payload.begin(), payload.end());
+			return ipFrame(true, 17, datagram);
+		}
+
+		void writeFile(const Bytes& content) {
+			FILE* file = fopen(path.c_str(), "wb");
+			ASSERT_NE(file, nullptr);
+			ASSERT_EQ(fwrite(content.data(), 1, content.size(), file), content.size());
+			fclose(file);
+		}
+
+		//pcap with microsecond timestamps, optionally in the other byte order
+		void writePcap(const std::vector<Bytes>& frames, bool swap = false) {
+			Bytes file;
+			appendHost<uint32_t>(file, 0xA1B2C3D4, swap);
+			appendHost<uint16_t>(file, 2, swap);
+			appendHost<uint16_t>(file, 4, swap);
+			appendHost<uint32_t>(file, 0, swap);
+			appendHost<uint32_t>(file, 0, swap);
+			appendHost<uint32_t>(file, 65535, swap);
+			appendHost<uint32_t>(file, 1, swap);
+			for(size_t i = 0; i < frames.size(); i++) {
+				appendHost<uint32_t>(file, 100, swap);
+				appendHost<uint32_t>(file, i * 1000, swap);
+				appendHost<uint32_t>(file, frames[i].size(), swap);
+				appendHost<uint32_t>(file, frames[i].size(), swap);
+				file.insert(file.end(), frames[i].begin(), frames[i].end());
+			}
+			writeFile(file);
+		}
+
+		//pcapng with one ethernet interface with nanosecond timestamps
+		void writePcapng(const std::vector<Bytes>& frames, uint64_t timestamp) {
+			Bytes file;
+			appendHost<uint32_t>(file, 0x0A0D0D0A);
+			appendHost<uint32_t>(file, 28);
+			appendHost<uint32_t>(file, 0x1A2B3C4D);
+			appendHost<uint16_t>(file, 1);
+			appendHost<uint16_t>(file, 0);
+			appendHost<uint64_t>(file, UINT64_MAX);
+			appendHost<uint32_t>(file, 28);
+
+			appendHost<uint32_t>(file, 1);
+			appendHost<uint32_t>(file, 32);
+			appendHost<uint16_t>(file, 1);
+			appendHost<uint16_t>(file, 0);
+			appendHost<uint32_t>(file, 65535);
+			appendHost<uint16_t>(file, 9);
+			appendHost<uint16_t>(file, 1);
+			appendHost<uint32_t>(file, 9);
+			appendHost<uint32_t>(file, 0);
+			appendHost<uint32_t>(file, 32);
+
+			for(const Bytes& frame : frames) {
+				size_t padded = (frame.size() + 3) & ~3u;
+				appendHost<uint32_t>(file, 6);
+				appendHost<uint32_t>(file, 32 + padded);
+				appendHost<uint32_t>(file, 0);
+				appendHost<uint32_t>(file, timestamp >> 32);
+				appendHost<uint32_t>(file, timestamp & 0xFFFFFFFF);
+				appendHost<uint32_t>(file, frame.size());
+				appendHost<uint32_t>(file, frame.size());
+				file.insert(file.end(), frame.begin(), frame.end());
+				file.insert(file.end(), padded - frame.size(), 0x00);
+				appendHost<uint32_t>(file, 32 + padded);
+			}
+			writeFile(file);
+		}
+
+		CaptureChunkCallback collect() {
+			return [this](const CaptureChunk& chunk) {
+				chunks.push_back(chunk);
+				if(chunk.toServer && !chunk.closed) {
+					toServer.insert(toServer.end(), chunk.data, chunk.data + chunk.length);
+				}
+			};
+		}
+
+		void reassemble(CaptureReader& reader, CaptureReassembler& reassembler) {
+			ASSERT_TRUE(reader.open(path));
+			CapturedPacket packet;
+			while(reader.next(packet)) {
+				reassembler.add(packet, collect());
+			}
+			reassembler.finish(collect());
+		}
+
+	protected:
+		void SetUp() override {
+			path = "/tmp/doip_capture_test_" + std::to_string(getpid());
+			chunks.clear();
+			toServer.clear();
+		}
+
+		void TearDown() override {
+			remove(path.c_str());
+		}
+};
+
+/*
+* Checks if a message which was sent in two segments is reassembled although
+* the segments were captured in the wrong order and one was retransmitted
+*/
+TEST_F(DoIPCaptureTest, ReassemblesOutOfOrderSegments) {
+	Bytes first(diagnosticMessage.begin(), diagnosticMessage.begin() + 5);
+	Bytes second(diagnosticMessage.begin() + 5, diagnosticMessage.end());
+	writePcap({
+		tcpFrame(true, 1000, 0x02),
+		tcpFrame(false, 5000, 0x12),
+		tcpFrame(true, 1006, 0x18, second),
+		tcpFrame(true, 1001, 0x18, first),
+		tcpFrame(true, 1001, 0x18, first),
+		tcpFrame(true, 1001 + diagnosticMessage.size(), 0x11),
+		tcpFrame(false, 5001, 0x11)
+	});
+
+	CaptureReader reader;
+	CaptureReassembler reassembler;
+	reassemble(reader, reassembler);
+	ASSERT_EQ(reader.getPacketCount(), 7u);
+	ASSERT_EQ(reader.getSkippedPackets(), 0u);
+	ASSERT_EQ(reassembler.getConnectionCount(), 1u);
+	ASSERT_EQ(reassembler.getRetransmittedBytes(), first.size());
+	ASSERT_EQ(reassembler.getMissingBytes(), 0u);
+	ASSERT_EQ(toServer, diagnosticMessage);
+
+	ASSERT_EQ(chunks.size(), 3u);
+	ASSERT_FALSE(chunks[0].gap);
+	ASSERT_EQ(chunks[0].timestamp, 100003000000ULL);
+	ASSERT_EQ(chunks[1].timestamp, chunks[0].timestamp) << "the early segment is delivered with the segment which completes it";
+	ASSERT_TRUE(chunks[2].closed);
+
+	DoIPFrameDecoder decoder;
+	std::vector<PayloadType> types;
+	decoder.feed(toServer.data(), toServer.size(), [&types](const DoIPFrame& frame) {
+		types.push_back(frame.action.type);
+		return true;
+	});
+	ASSERT_EQ(types, std::vector<PayloadType>{DIAGNOSTICMESSAGE});
+}
+
+/*
+* Checks if data which is missing in a capture of the other byte order is
+* skipped and reported as gap, and the capture started within the connection
+*/
+TEST_F(DoIPCaptureTest, ReportsMissingData) {
+	writePcap({
+		tcpFrame(true, 7000, 0x18, diagnosticMessage),
+		tcpFrame(true, 7000 + 2 * diagnosticMessage.size(), 0x18, diagnosticMessage)
+	}, true);
+
+	CaptureReader reader;
+	CaptureReassembler reassembler;
+	reassemble(reader, reassembler);
+	ASSERT_EQ(reassembler.getMissingBytes(), diagnosticMessage.size());
+	ASSERT_EQ(chunks.size(), 3u);
+	ASSERT_TRUE(chunks[0].gap) << "the capture started after the handshake";
+	ASSERT_TRUE(chunks[1].gap);
+	ASSERT_EQ(chunks[1].length, diagnosticMessage.size());
+	ASSERT_TRUE(chunks[2].closed);
+}
+
+/*
+* Checks if datagrams of a pcapng file keep their nanosecond timestamp and
+* packets to other ports are skipped
+*/
+TEST_F(DoIPCaptureTest, ReadsPcapngDatagrams) {
+	Bytes vehicleIdentificationRequest = {0x02, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+	uint64_t timestamp = 1700000000123456789ULL;
+	writePcapng({
+		udpFrame(50001, 13400, vehicleIdentificationRequest),
+		udpFrame(50001, 53, vehicleIdentificationRequest)
+	}, timestamp);
+
+	CaptureReader reader;
+	CaptureReassembler reassembler;
+	reassemble(reader, reassembler);
+	ASSERT_EQ(reader.getPacketCount(), 2u);
+	ASSERT_EQ(reader.getSkippedPackets(), 1u);
+	ASSERT_EQ(reassembler.getConnectionCount(), 0u);
+	ASSERT_EQ(chunks.size(), 1u);
+	ASSERT_EQ(chunks[0].protocol, CAPTUREUDP);
+	ASSERT_EQ(chunks[0].timestamp, timestamp);
+	ASSERT_TRUE(chunks[0].toServer);
+	ASSERT_EQ(Bytes(chunks[0].data, chunks[0].data + chunks[0].length), vehicleIdentificationRequest);
+}
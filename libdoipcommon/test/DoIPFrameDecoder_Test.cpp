@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include "DoIPFrameDecoder.h"
+#include <vector>
+
+class DoIPFrameDecoderTest : public ::testing::Test {
+	public:
+		DoIPFrameDecoder decoder;
+		std::vector<GenericHeaderAction> actions;
+		std::vector<std::vector<unsigned char>> payloads;
+
+		//alive check response with source address 0x0E00
+		unsigned char aliveCheckResponse[10] = {0x02, 0xFD, 0x00, 0x08, 0x00, 0x00, 0x00, 0x02, 0x0E, 0x00};
+
+		FrameCallback collect() {
+			return [this](const DoIPFrame& frame) {
+				actions.push_back(frame.action);
+				if(frame.payload != nullptr) {
+					payloads.push_back(std::vector<unsigned char>(frame.payload, frame.payload + frame.action.payloadLength));
+				} else {
+					payloads.push_back(std::vector<unsigned char>());
+				}
+				return true;
+			};
+		}
+
+	protected:
+		void SetUp() override {
+			actions.clear();
+			payloads.clear();
+		}
+};
+
+/*
+* Checks if a message which is fed byte by byte is decoded once it is complete
+*/
+TEST_F(DoIPFrameDecoderTest, ByteByByte) {
+	for(size_t i = 0; i < sizeof(aliveCheckResponse); i++) {
+		ASSERT_EQ(actions.size(), 0u);
+		ASSERT_EQ(decoder.feed(&aliveCheckResponse[i], 1, collect()), 1u);
+	}
+
+	ASSERT_EQ(actions.size(), 1u);
+	ASSERT_EQ(actions[0].type, PayloadType::ALIVECHECKRESPONSE);
+	ASSERT_EQ(payloads[0], std::vector<unsigned char>({0x0E, 0x00}));
+	ASSERT_FALSE(decoder.hasPartialFrame());
+}
+
+/*
+* Checks if several messages in one chunk are decoded in order
+*/
+TEST_F(DoIPFrameDecoderTest, SeveralMessagesInOneChunk) {
+	std::vector<unsigned char> chunk;
+	for(int i = 0; i < 3; i++) {
+		aliveCheckResponse[9] = (unsigned char)i;
+		chunk.insert(chunk.end(), aliveCheckResponse, aliveCheckResponse + sizeof(aliveCheckResponse));
+	}
+	//first half of a fourth message
+	chunk.insert(chunk.end(), aliveCheckResponse, aliveCheckResponse + 5);
+
+	ASSERT_EQ(decoder.feed(chunk.data(), chunk.size(), collect()), chunk.size());
+	ASSERT_EQ(actions.size(), 3u);
+	for(int i = 0; i < 3; i++) {
+		ASSERT_EQ(payloads[i][1], i);
+	}
+	ASSERT_TRUE(decoder.hasPartialFrame());
+
+	decoder.feed(aliveCheckResponse + 5, sizeof(aliveCheckResponse) - 5, collect());
+	ASSERT_EQ(actions.size(), 4u);
+	ASSERT_FALSE(decoder.hasPartialFrame());
+}
+
+/*
+* Checks if a wrong synchronization pattern puts the decoder into the failed state
+*/
+TEST_F(DoIPFrameDecoderTest, PatternErrorFails) {
+	unsigned char chunk[10] = {0x02, 0xFE, 0x00, 0x08, 0x00, 0x00, 0x00, 0x02, 0x0E, 0x00};
+
+	ASSERT_EQ(decoder.feed(chunk, sizeof(chunk), collect()), 8u);
+	ASSERT_EQ(actions.size(), 1u);
+	ASSERT_EQ(actions[0].type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(actions[0].value, _IncorrectPatternFormatCode);
+	ASSERT_TRUE(decoder.isFailed());
+
+	decoder.reset();
+	ASSERT_FALSE(decoder.isFailed());
+}
+
+/*
+* Checks if a NACK of the peer with code 0x00 is passed on as message and
+* the decoder continues with the next message
+*/
+TEST_F(DoIPFrameDecoderTest, ReceivedNackIsDecoded) {
+	unsigned char nack[9] = {0x02, 0xFD, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00};
+
+	decoder.feed(nack, sizeof(nack), collect());
+	decoder.feed(aliveCheckResponse, sizeof(aliveCheckResponse), collect());
+
+	ASSERT_FALSE(decoder.isFailed());
+	ASSERT_EQ(actions.size(), 2u);
+	ASSERT_EQ(actions[0].type, PayloadType::GENERICNACK);
+	ASSERT_EQ(payloads[0], std::vector<unsigned char>({_IncorrectPatternFormatCode}));
+	ASSERT_EQ(actions[1].type, PayloadType::ALIVECHECKRESPONSE);
+}
+
+/*
+* Checks if the payload of an unknown payload type is skipped
+*/
+TEST_F(DoIPFrameDecoderTest, UnknownTypeIsSkipped) {
+	unsigned char unknown[11] = {0x02, 0xFD, 0x12, 0x34, 0x00, 0x00, 0x00, 0x03, 0x01, 0x02, 0x03};
+
+	decoder.feed(unknown, 9, collect());
+	decoder.feed(unknown + 9, 2, collect());
+	decoder.feed(aliveCheckResponse, sizeof(aliveCheckResponse), collect());
+
+	ASSERT_EQ(actions.size(), 2u);
+	ASSERT_EQ(actions[0].type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(actions[0].value, _UnknownPayloadTypeCode);
+	ASSERT_EQ(actions[1].type, PayloadType::ALIVECHECKRESPONSE);
+}
+
+/*
+* Checks if a payload above the configured maximum is rejected with NACK 0x02
+*/
+TEST_F(DoIPFrameDecoderTest, OversizePayloadIsRejected) {
+	decoder.setMaxPayloadLength(4);
+	unsigned char header[8] = {0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x10};
+	std::vector<unsigned char> chunk(header, header + sizeof(header));
+	chunk.resize(chunk.size() + 0x10, 0xAA);
+
+	decoder.feed(chunk.data(), chunk.size(), collect());
+	ASSERT_EQ(actions.size(), 1u);
+	ASSERT_EQ(actions[0].type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(actions[0].value, _MessageTooLargeCode);
+	ASSERT_FALSE(decoder.isFailed());
+	ASSERT_FALSE(decoder.hasPartialFrame());
+}
+
+/*
+* Checks if decoding stops when the callback returns false
+*/
+TEST_F(DoIPFrameDecoderTest, CallbackStopsDecoding) {
+	std::vector<unsigned char> chunk(aliveCheckResponse, aliveCheckResponse + sizeof(aliveCheckResponse));
+	chunk.insert(chunk.end(), aliveCheckResponse, aliveCheckResponse + sizeof(aliveCheckResponse));
+
+	int frames = 0;
+	size_t consumed = decoder.feed(chunk.data(), chunk.size(), [&frames](const DoIPFrame&) {
+		frames++;
+		return false;
+	});
+	ASSERT_EQ(frames, 1);
+	ASSERT_EQ(consumed, sizeof(aliveCheckResponse));
+}
+
+/*
+* Checks if the rest of a large payload can be received directly into the payload window
+*/
+TEST_F(DoIPFrameDecoderTest, PayloadWindowIsFilledInPlace) {
+	std::vector<unsigned char> message(_GenericHeaderLength + 4 + 1000);
+	unsigned char header[] = {0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x03, 0xEC, 0x00, 0x01, 0x0E, 0x00};
+	std::copy(header, header + sizeof(header), message.begin());
+	for(size_t i = sizeof(header); i < message.size(); i++) {
+		message[i] = (unsigned char)i;
+	}
+
+	size_t windowLength = 1;
+	ASSERT_EQ(decoder.getPayloadWindow(windowLength), nullptr);
+	ASSERT_EQ(windowLength, 0u);
+
+	decoder.feed(message.data(), 100, collect());
+	unsigned char* window = decoder.getPayloadWindow(windowLength);
+	ASSERT_NE(window, nullptr);
+	ASSERT_EQ(windowLength, message.size() - 100);
+
+	//receive the rest in two parts into the window
+	memcpy(window, message.data() + 100, 500);
+	decoder.feed(window, 500, collect());
+	window = decoder.getPayloadWindow(windowLength);
+	ASSERT_EQ(windowLength, message.size() - 600);
+	memcpy(window, message.data() + 600, windowLength);
+	decoder.feed(window, windowLength, collect());
+
+	ASSERT_EQ(actions.size(), 1u);
+	ASSERT_EQ(actions[0].type, PayloadType::DIAGNOSTICMESSAGE);
+	ASSERT_EQ(payloads[0], std::vector<unsigned char>(message.begin() + _GenericHeaderLength, message.end()));
+	ASSERT_EQ(decoder.getPayloadWindow(windowLength), nullptr);
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "DoIPGenericHeaderHandler.h"
 
+const uint16_t _TestOemPayloadType = 0xF042;
+
 class GenericHeaderTest : public ::testing::Test {
 	public:
 		unsigned char* request;
@@ -24,6 +26,12 @@ class GenericHeaderTest : public ::testing::Test {
 			request[13] = 0x00;
 			request[14] = 0x00;
 		}
+
+		void TearDown() override {
+			//registered payload types are global, they must not leak into other tests
+			unregisterPayloadType(_TestOemPayloadType);
+			delete[] request;
+		}
 };
 
 /*
@@ -107,4 +115,86 @@ TEST_F(GenericHeaderTest, WrongRoutingActivationLength) {
 TEST_F(GenericHeaderTest, ValidGenericHeader) {
 	GenericHeaderAction action = parseGenericHeader(request, 15);
 	ASSERT_NE(action.type, PayloadType::NEGATIVEACK);
-}
\ No newline at end of file
+}
+
+/*
+* Checks if an encoded generic header NACK contains the NACK code and is parsed correctly
+*/
+TEST_F(GenericHeaderTest, EncodeNegativeAck) {
+	unsigned char buffer[_GenericHeaderLength + _NACKLength];
+	int length = encodeNegativeAck(buffer, _InvalidPayloadLengthCode);
+	ASSERT_EQ(length, _GenericHeaderLength + _NACKLength);
+	ASSERT_EQ(buffer[0], 0x02);
+	ASSERT_EQ(buffer[1], 0xFD);
+	ASSERT_EQ(buffer[2], 0x00);
+	ASSERT_EQ(buffer[3], 0x00);
+	ASSERT_EQ(buffer[7], _NACKLength);
+	ASSERT_EQ(buffer[8], _InvalidPayloadLengthCode);
+}
+
+/*
+* Checks if every payload type of ISO 13400-2 is recognized from an encoded header
+*/
+TEST_F(GenericHeaderTest, EncodedPayloadTypesAreRecognized) {
+	struct { PayloadType type; uint32_t length; } messages[] = {
+		{ PayloadType::VEHICLEIDENTREQUEST, 0 }, { PayloadType::VEHICLEIDENTREQUESTEID, 6 },
+		{ PayloadType::VEHICLEIDENTREQUESTVIN, 17 }, { PayloadType::VEHICLEIDENTRESPONSE, 33 },
+		{ PayloadType::ROUTINGACTIVATIONREQUEST, 11 }, { PayloadType::ROUTINGACTIVATIONRESPONSE, 9 },
+		{ PayloadType::ALIVECHECKREQUEST, 0 }, { PayloadType::ALIVECHECKRESPONSE, 2 },
+		{ PayloadType::ENTITYSTATUSREQUEST, 0 }, { PayloadType::ENTITYSTATUSRESPONSE, 7 },
+		{ PayloadType::POWERMODEREQUEST, 0 }, { PayloadType::POWERMODERESPONSE, 1 },
+		{ PayloadType::DIAGNOSTICMESSAGE, 6 }, { PayloadType::DIAGNOSTICPOSITIVEACK, 5 },
+		{ PayloadType::DIAGNOSTICNEGATIVEACK, 5 },
+	};
+
+	for(auto& message : messages) {
+		unsigned char header[_GenericHeaderLength];
+		encodeGenericHeader(header, message.type, message.length);
+		GenericHeaderAction action = parseGenericHeader(header, _GenericHeaderLength);
+		ASSERT_EQ(action.type, message.type) << "payload type 0x" << std::hex << getPayloadTypeCode(message.type);
+		ASSERT_EQ(action.payloadTypeCode, getPayloadTypeCode(message.type));
+	}
+}
+
+/*
+* Checks if a too short diagnostic message acknowledge is rejected with NACK code (0x04)
+*/
+TEST_F(GenericHeaderTest, WrongDiagnosticAckLength) {
+	request[2] = 0x80;
+	request[3] = 0x02;
+	request[7] = 0x04;
+	GenericHeaderAction action = parseGenericHeader(request, 15);
+	ASSERT_EQ(action.type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(action.value, _InvalidPayloadLengthCode);
+}
+
+/*
+* Checks if a registered OEM specific payload type is accepted with its length rule
+*/
+TEST_F(GenericHeaderTest, RegisteredOemPayloadType) {
+	request[2] = 0xF0;
+	request[3] = 0x42;
+	GenericHeaderAction action = parseGenericHeader(request, 15);
+	ASSERT_EQ(action.type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(action.value, _UnknownPayloadTypeCode);
+
+	ASSERT_TRUE(registerPayloadType(_TestOemPayloadType, PayloadLengthCheck::LENGTHRANGE, 4, 8));
+	ASSERT_FALSE(registerPayloadType(_TestOemPayloadType, PayloadLengthCheck::EXACTLENGTH, 1)) << "code registered twice";
+	ASSERT_FALSE(registerPayloadType(0x8001, PayloadLengthCheck::EXACTLENGTH, 1)) << "standard type overwritten";
+
+	action = parseGenericHeader(request, 15);
+	ASSERT_EQ(action.type, PayloadType::OEMSPECIFIC);
+	ASSERT_EQ(action.payloadTypeCode, _TestOemPayloadType);
+
+	request[7] = 0x09;
+	action = parseGenericHeader(request, 15);
+	ASSERT_EQ(action.type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(action.value, _InvalidPayloadLengthCode);
+
+	ASSERT_FALSE(unregisterPayloadType(0x8001)) << "standard type removed";
+	ASSERT_TRUE(unregisterPayloadType(_TestOemPayloadType));
+	request[7] = 0x07;
+	action = parseGenericHeader(request, 15);
+	ASSERT_EQ(action.type, PayloadType::NEGATIVEACK);
+	ASSERT_EQ(action.value, _UnknownPayloadTypeCode);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "DoIPLogger.h"
+#include <string>
+#include <vector>
+
+class DoIPLoggerTest : public ::testing::Test {
+	public:
+		std::vector<std::string> lines;
+		std::vector<LogLevel> levels;
+
+	protected:
+		void SetUp() override {
+			DoIPLogger::instance().flush();
+			DoIPLogger::instance().setSink([this](LogLevel level, const char* line) {
+				levels.push_back(level);
+				lines.push_back(line);
+			});
+			DoIPLogger::instance().setLevel(LogLevel::TRACE);
+		}
+
+		void TearDown() override {
+			DoIPLogger::instance().flush();
+			DoIPLogger::instance().setSink(nullptr);
+			DoIPLogger::instance().setLevel(static_cast<LogLevel>(DOIP_LOG_LEVEL));
+		}
+
+		bool endsWith(const std::string& line, const std::string& end) {
+			return line.size() >= end.size() && line.compare(line.size() - end.size(), end.size(), end) == 0;
+		}
+};
+
+/*
+* Checks if the arguments are formatted by the logging thread
+*/
+TEST_F(DoIPLoggerTest, FormatsArguments) {
+	DoIPLogger::instance().log(LogLevel::INFO, "value %d of %s at 0x%04X", 42, "test", 0x0E00);
+	DoIPLogger::instance().flush();
+
+	ASSERT_EQ(lines.size(), 1u);
+	ASSERT_EQ(levels[0], LogLevel::INFO);
+	ASSERT_TRUE(endsWith(lines[0], "INFO    value 42 of test at 0x0E00")) << lines[0];
+}
+
+/*
+* Checks if string arguments are copied when the message is logged
+*/
+TEST_F(DoIPLoggerTest, CopiesStrings) {
+	char text[] = "before";
+	DoIPLogger::instance().log(LogLevel::INFO, "%s", text);
+	strcpy(text, "after!");
+	DoIPLogger::instance().flush();
+
+	ASSERT_EQ(lines.size(), 1u);
+	ASSERT_TRUE(endsWith(lines[0], "before")) << lines[0];
+}
+
+/*
+* Checks if messages below the runtime level are discarded
+*/
+TEST_F(DoIPLoggerTest, FiltersByLevel) {
+	DoIPLogger::instance().setLevel(LogLevel::WARNING);
+	DoIPLogger::instance().log(LogLevel::INFO, "hidden");
+	DoIPLogger::instance().log(LogLevel::ERROR, "shown");
+	DoIPLogger::instance().flush();
+
+	ASSERT_EQ(lines.size(), 1u);
+	ASSERT_TRUE(endsWith(lines[0], "shown"));
+}
+
+/*
+* Checks if a hex dump lists the bytes and the length of long buffers
+*/
+TEST_F(DoIPLoggerTest, HexDump) {
+	unsigned char data[] = {0x02, 0xFD, 0x80, 0x01};
+	DoIPLogger::instance().logHex(LogLevel::TRACE, "Received", data, sizeof(data));
+
+	std::vector<unsigned char> longData(100, 0xAA);
+	DoIPLogger::instance().logHex(LogLevel::TRACE, "Long", longData.data(), longData.size());
+	DoIPLogger::instance().flush();
+
+	ASSERT_EQ(lines.size(), 2u);
+	ASSERT_TRUE(endsWith(lines[0], "Received: 02 FD 80 01")) << lines[0];
+	ASSERT_TRUE(endsWith(lines[1], "... (100 bytes)")) << lines[1];
+}
+
+/*
+* Checks if messages of several threads are all written
+*/
+TEST_F(DoIPLoggerTest, SeveralProducers) {
+	std::vector<std::thread> producers;
+	for(int t = 0; t < 4; t++) {
+		producers.push_back(std::thread([t]() {
+			for(int i = 0; i < 100; i++) {
+				DoIPLogger::instance().log(LogLevel::DEBUG, "thread %d message %d", t, i);
+			}
+		}));
+	}
+	for(std::thread& producer : producers) {
+		producer.join();
+	}
+	DoIPLogger::instance().flush();
+
+	ASSERT_EQ(lines.size() + DoIPLogger::instance().getDroppedMessages(), 400u);
+}
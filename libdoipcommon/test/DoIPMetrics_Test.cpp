@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "DoIPMetrics.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* The metrics of the process are shared by all tests, so the tests compare
+* the difference of two snapshots
+*/
+class DoIPMetricsTest : public ::testing::Test {
+	public:
+		MetricsSnapshot before;
+
+	protected:
+		void SetUp() override {
+			before = DoIPMetrics::instance().snapshot();
+		}
+
+		LatencySnapshot latencySince(unsigned short targetAddress) {
+			MetricsSnapshot after = DoIPMetrics::instance().snapshot();
+			LatencySnapshot latency = after.callbackLatency[targetAddress];
+			const LatencySnapshot& previous = before.callbackLatency[targetAddress];
+			latency.count -= previous.count;
+			latency.sum -= previous.sum;
+			for(size_t i = 0; i < latency.buckets.size(); i++) {
+				latency.buckets[i] -= previous.buckets[i];
+			}
+			return latency;
+		}
+};
+
+/*
+* Checks if the counters of several threads are summed up
+*/
+TEST_F(DoIPMetricsTest, SumsCountersOfAllThreads) {
+	std::vector<std::thread> threads;
+	for(int i = 0; i < 4; i++) {
+		threads.push_back(std::thread([]() {
+			for(int j = 0; j < 1000; j++) {
+				DoIPMetrics::instance().recordMessageIn(PayloadType::DIAGNOSTICMESSAGE, 14);
+				DoIPMetrics::instance().recordGenericNack(0x04);
+			}
+			DoIPMetrics::instance().recordRoutingActivation(0x10);
+			DoIPMetrics::instance().recordAliveCheckTimeout();
+		}));
+	}
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+
+	MetricsSnapshot after = DoIPMetrics::instance().snapshot();
+	ASSERT_EQ(after.messagesIn[PayloadType::DIAGNOSTICMESSAGE] - before.messagesIn[PayloadType::DIAGNOSTICMESSAGE], 4000u);
+	ASSERT_EQ(after.bytesIn[PayloadType::DIAGNOSTICMESSAGE] - before.bytesIn[PayloadType::DIAGNOSTICMESSAGE], 56000u);
+	ASSERT_EQ(after.genericNacks[0x04] - before.genericNacks[0x04], 4000u);
+	ASSERT_EQ(after.routingActivations[0x10] - before.routingActivations[0x10], 4u);
+	ASSERT_EQ(after.aliveCheckTimeouts - before.aliveCheckTimeouts, 4u);
+}
+
+/*
+* Checks if outgoing messages are counted by the payload type in their header
+*/
+TEST_F(DoIPMetricsTest, CountsEncodedMessages) {
+	unsigned char message[_GenericHeaderLength + _NACKLength];
+	int length = encodeNegativeAck(message, 0x02);
+	DoIPMetrics::instance().recordEncodedMessageOut(message, length);
+	DoIPMetrics::instance().recordDiagnosticNack(0x03);
+
+	MetricsSnapshot after = DoIPMetrics::instance().snapshot();
+	ASSERT_EQ(after.messagesOut[PayloadType::GENERICNACK] - before.messagesOut[PayloadType::GENERICNACK], 1u);
+	ASSERT_EQ(after.bytesOut[PayloadType::GENERICNACK] - before.bytesOut[PayloadType::GENERICNACK], (uint64_t)length);
+	ASSERT_EQ(after.diagnosticNacks[0x03] - before.diagnosticNacks[0x03], 1u);
+}
+
+/*
+* Checks if every latency falls into a bucket whose bounds contain it
+*/
+TEST(LatencyHistogramTest, BucketBounds) {
+	uint64_t values[] = {0, 1, 7, 8, 9, 15, 16, 17, 100, 1000, 12345, 1000000, 999999999, (1ULL << 39) + 1};
+	for(uint64_t value : values) {
+		size_t index = LatencyHistogram::bucketIndex(value);
+		ASSERT_LT(index, (size_t)_LatencyBucketCount);
+		ASSERT_GE(LatencyHistogram::bucketUpperBound(index), value) << value;
+		if(index > 0) {
+			ASSERT_LT(LatencyHistogram::bucketUpperBound(index - 1), value) << value;
+		}
+	}
+	ASSERT_EQ(LatencyHistogram::bucketIndex(1ULL << 50), (size_t)_LatencyBucketCount - 1);
+}
+
+/*
+* Checks if percentiles are reported within the resolution of the histogram
+*/
+TEST_F(DoIPMetricsTest, PercentilesPerTarget) {
+	for(uint64_t i = 1; i <= 1000; i++) {
+		DoIPMetrics::instance().recordCallbackLatency(0x0E80, i * 1000);
+	}
+	DoIPMetrics::instance().recordCallbackLatency(0x0E81, 50);
+
+	LatencySnapshot latency = latencySince(0x0E80);
+	ASSERT_EQ(latency.count, 1000u);
+	ASSERT_NEAR((double)latency.percentile(50), 500000.0, 500000.0 / _LatencySubBuckets);
+	ASSERT_NEAR((double)latency.percentile(99), 990000.0, 990000.0 / _LatencySubBuckets);
+	ASSERT_EQ(latency.percentile(100), 1000000u);
+	ASSERT_EQ(latencySince(0x0E81).count, 1u);
+}
+
+/*
+* Checks if the counts of a thread which exited are kept
+*/
+TEST_F(DoIPMetricsTest, KeepsCountsOfExitedThreads) {
+	for(int i = 0; i < 10; i++) {
+		std::thread([]() {
+			DoIPMetrics::instance().recordCallbackLatency(0x0E82, 2000);
+		}).join();
+	}
+
+	ASSERT_EQ(latencySince(0x0E82).count, 10u);
+}
+
+/*
+* Checks if the text endpoint serves the current metrics
+*/
+TEST_F(DoIPMetricsTest, ServesText) {
+	const char* path = "/tmp/doip-metrics-test.sock";
+	ASSERT_TRUE(DoIPMetrics::instance().startTextEndpoint(path));
+	DoIPMetrics::instance().recordCallbackLatency(0x0E83, 3000);
+
+	int client = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	ASSERT_EQ(connect(client, (struct sockaddr*)&address, sizeof(address)), 0);
+
+	std::string text;
+	char buffer[4096];
+	ssize_t result;
+	while((result = read(client, buffer, sizeof(buffer))) > 0) {
+		text.append(buffer, result);
+	}
+	close(client);
+	DoIPMetrics::instance().stopTextEndpoint();
+
+	ASSERT_NE(text.find("doip_callback_latency_ns_count{target=\"0x0E83\"}"), std::string::npos) << text;
+	ASSERT_NE(text.find("doip_alive_check_timeouts_total"), std::string::npos);
+	ASSERT_NE(access(path, F_OK), 0) << "socket file was not removed";
+}
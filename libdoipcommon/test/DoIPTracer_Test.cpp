@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "DoIPTracer.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+
+class DoIPTracerTest : public ::testing::Test {
+	protected:
+		void SetUp() override {
+			DoIPTracer::instance().clear();
+		}
+
+		void TearDown() override {
+			DoIPTracer::instance().disable();
+			DoIPTracer::instance().clear();
+		}
+
+		size_t countOccurrences(const std::string& text, const std::string& pattern) {
+			size_t count = 0;
+			for(size_t position = text.find(pattern); position != std::string::npos; position = text.find(pattern, position + 1)) {
+				count++;
+			}
+			return count;
+		}
+};
+
+/*
+* Checks if no spans are recorded while tracing is disabled
+*/
+TEST_F(DoIPTracerTest, DisabledRecordsNothing) {
+	{
+		TraceSpan span("disabled stage");
+	}
+
+	std::string trace = DoIPTracer::instance().toChromeTrace();
+	ASSERT_EQ(trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}\n");
+}
+
+/*
+* Checks if nested spans of several threads are written as complete events
+*/
+TEST_F(DoIPTracerTest, WritesChromeTraceEvents) {
+	DoIPTracer::instance().enable();
+	std::thread([]() {
+		TraceSpan outer("DiagnosticMessageNotification", "target", 0x0028);
+		TraceSpan inner("response write");
+	}).join();
+	{
+		TraceSpan span("socket read", "socket", 7);
+	}
+
+	std::string trace = DoIPTracer::instance().toChromeTrace();
+	ASSERT_EQ(countOccurrences(trace, "\"ph\":\"X\""), 3u) << trace;
+	ASSERT_NE(trace.find("\"name\":\"DiagnosticMessageNotification\""), std::string::npos);
+	ASSERT_NE(trace.find("\"args\":{\"target\":\"0x0028\"}"), std::string::npos);
+	ASSERT_NE(trace.find("\"name\":\"response write\""), std::string::npos);
+	ASSERT_NE(trace.find("\"args\":{\"socket\":\"0x0007\"}"), std::string::npos);
+}
+
+/*
+* Checks if a full buffer keeps the newest spans
+*/
+TEST_F(DoIPTracerTest, KeepsNewestSpans) {
+	DoIPTracer::instance().enable();
+	for(size_t i = 0; i < _TraceBufferCapacity + 100; i++) {
+		DoIPTracer::instance().record(i < 100 ? "old" : "new", i + 1, i + 2);
+	}
+
+	std::string trace = DoIPTracer::instance().toChromeTrace();
+	//the oldest slot is the one the next span overwrites, it is left out
+	ASSERT_EQ(countOccurrences(trace, "\"name\":\"new\""), _TraceBufferCapacity - 1);
+	ASSERT_EQ(countOccurrences(trace, "\"name\":\"old\""), 0u);
+}
+
+/*
+* Checks if the kernel receive time of a datagram is converted to the trace clock
+*/
+TEST_F(DoIPTracerTest, KernelReceiveTime) {
+	int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	ASSERT_EQ(bind(receiver, (struct sockaddr*)&address, sizeof(address)), 0);
+	getsockname(receiver, (struct sockaddr*)&address, &addressLength);
+	ASSERT_TRUE(DoIPTracer::enableKernelTimestamps(receiver));
+
+	uint64_t sent = DoIPTracer::now();
+	int sender = socket(AF_INET, SOCK_DGRAM, 0);
+	unsigned char data[] = {0x02, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+	ASSERT_EQ(sendto(sender, data, sizeof(data), 0, (struct sockaddr*)&address, sizeof(address)), (ssize_t)sizeof(data));
+
+	unsigned char buffer[64];
+	struct iovec vector = { buffer, sizeof(buffer) };
+	char control[CMSG_SPACE(3 * sizeof(struct timespec))];
+	struct msghdr message = {};
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	ASSERT_EQ(recvmsg(receiver, &message, 0), (ssize_t)sizeof(data));
+
+	uint64_t received = 0;
+	ASSERT_TRUE(DoIPTracer::getKernelReceiveTime(message, received));
+	ASSERT_LE(received, DoIPTracer::now());
+	ASSERT_GE(received + 1000000, sent) << "receive time is more than 1 ms before sending";
+
+	close(sender);
+	close(receiver);
+}
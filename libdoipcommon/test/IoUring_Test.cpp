@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "IoUring.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+class IoUringTest : public ::testing::Test {
+	public:
+		int sockets[2];
+		IoUring ring;
+
+	protected:
+		void SetUp() override {
+			ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+		}
+
+		void TearDown() override {
+			close(sockets[0]);
+			close(sockets[1]);
+		}
+};
+
+/*
+* Checks if one multishot receive delivers every write in a buffer of the ring
+*/
+TEST_F(IoUringTest, MultishotReceive) {
+	//the kernel may not provide io_uring, the event loop uses epoll then
+	if(!IoUring::isSupported()) {
+		return;
+	}
+	ASSERT_TRUE(ring.setup(8, 32));
+	ASSERT_TRUE(ring.setupBufferRing(0, 4, 64));
+	IoUring::prepareMultishotReceive(ring.getSubmission(), sockets[0], 0, 7);
+	ASSERT_EQ(ring.submitAndWait(0, 0), 1);
+
+	std::string received;
+	for(int i = 0; i < 10; i++) {
+		std::string message = "message " + std::to_string(i) + ";";
+		ASSERT_EQ(write(sockets[1], message.data(), message.size()), (ssize_t)message.size());
+
+		ASSERT_GE(ring.submitAndWait(1, 1000), 0);
+		struct io_uring_cqe* completion = ring.peekCompletion();
+		ASSERT_NE(completion, nullptr);
+		ASSERT_EQ(completion->user_data, 7u);
+		ASSERT_GT(completion->res, 0);
+		ASSERT_TRUE(completion->flags & IORING_CQE_F_BUFFER);
+		ASSERT_TRUE(completion->flags & IORING_CQE_F_MORE) << "the receive has to stay armed";
+
+		uint16_t bufferId = completion->flags >> IORING_CQE_BUFFER_SHIFT;
+		received.append(reinterpret_cast<char*>(ring.getBuffer(bufferId)), completion->res);
+		ring.recycleBuffer(bufferId);
+		ring.completionSeen();
+	}
+
+	ASSERT_EQ(received.find("message 0;message 1;"), 0u);
+	ASSERT_NE(received.find("message 9;"), std::string::npos);
+}
+
+/*
+* Checks if a multishot poll reports readiness until it is consumed and the
+* wait returns after the timeout without completions
+*/
+TEST_F(IoUringTest, MultishotPollAndTimeout) {
+	if(!IoUring::isSupported()) {
+		return;
+	}
+	ASSERT_TRUE(ring.setup(8, 32));
+	IoUring::prepareMultishotPoll(ring.getSubmission(), sockets[0], POLLIN, 3);
+	ASSERT_EQ(ring.submitAndWait(1, 20), 1);
+	ASSERT_EQ(ring.peekCompletion(), nullptr);
+
+	ASSERT_EQ(write(sockets[1], "x", 1), 1);
+	ASSERT_GE(ring.submitAndWait(1, 1000), 0);
+	struct io_uring_cqe* completion = ring.peekCompletion();
+	ASSERT_NE(completion, nullptr);
+	ASSERT_EQ(completion->user_data, 3u);
+	ASSERT_TRUE(completion->res & POLLIN);
+	ASSERT_TRUE(completion->flags & IORING_CQE_F_MORE);
+	ring.completionSeen();
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "ScatterGatherSend.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+class ScatterGatherSendTest : public ::testing::Test {
+	public:
+		int sockets[2];
+
+	protected:
+		void SetUp() override {
+			ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+		}
+
+		void TearDown() override {
+			close(sockets[0]);
+			close(sockets[1]);
+		}
+
+		std::vector<unsigned char> receive(size_t length) {
+			std::vector<unsigned char> received(length);
+			size_t offset = 0;
+			while(offset < length) {
+				ssize_t result = read(sockets[1], received.data() + offset, length - offset);
+				if(result <= 0) {
+					break;
+				}
+				offset += result;
+			}
+			received.resize(offset);
+			return received;
+		}
+};
+
+/*
+* Checks if several buffers are sent in order
+*/
+TEST_F(ScatterGatherSendTest, SendsBuffersInOrder) {
+	unsigned char header[] = {0x01, 0x02};
+	unsigned char empty[1];
+	unsigned char payload[] = {0x03, 0x04, 0x05};
+	struct iovec vectors[] = { {header, sizeof(header)}, {empty, 0}, {payload, sizeof(payload)} };
+
+	ASSERT_EQ(sendVectors(sockets[0], vectors, 3), 5);
+	ASSERT_EQ(receive(5), std::vector<unsigned char>({0x01, 0x02, 0x03, 0x04, 0x05}));
+}
+
+/*
+* Checks if partial writes on a full non-blocking socket are continued
+*/
+TEST_F(ScatterGatherSendTest, ContinuesPartialWrites) {
+	int bufferSize = 4096;
+	setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+	fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+
+	std::vector<unsigned char> first(300000), second(300001);
+	for(size_t i = 0; i < first.size(); i++) {
+		first[i] = (unsigned char)i;
+	}
+	for(size_t i = 0; i < second.size(); i++) {
+		second[i] = (unsigned char)(i * 7);
+	}
+	struct iovec vectors[] = { {first.data(), first.size()}, {second.data(), second.size()} };
+
+	std::vector<unsigned char> received;
+	std::thread reader([this, &received, &first, &second]() {
+		received = receive(first.size() + second.size());
+	});
+	ssize_t sent = sendVectors(sockets[0], vectors, 2);
+	reader.join();
+
+	ASSERT_EQ(sent, (ssize_t)(first.size() + second.size()));
+	ASSERT_TRUE(std::equal(first.begin(), first.end(), received.begin()));
+	ASSERT_TRUE(std::equal(second.begin(), second.end(), received.begin() + first.size()));
+}
+
+/*
+* Checks if sending on a closed connection fails without a signal
+*/
+TEST_F(ScatterGatherSendTest, ClosedPeerFails) {
+	close(sockets[1]);
+	sockets[1] = -1;
+
+	unsigned char payload[] = {0x01};
+	struct iovec vector = {payload, sizeof(payload)};
+	ASSERT_EQ(sendVectors(sockets[0], &vector, 1), -1);
+}
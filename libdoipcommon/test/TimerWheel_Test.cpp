@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include "TimerWheel.h"
+#include "AliveCheckTimer.h"
+
+class TimerWheelTest : public ::testing::Test {
+	public:
+		uint64_t currentTime = 1000;
+		TimerWheel wheel{1, 8, [this]() { return currentTime; }};
+		int expired = 0;
+
+	protected:
+		void SetUp() override {
+			expired = 0;
+		}
+
+		void advanceFor(int milliseconds) {
+			currentTime += milliseconds;
+			wheel.advance();
+		}
+};
+
+/*
+* Checks if an armed timer expires once after its delay
+*/
+TEST_F(TimerWheelTest, ArmedTimerExpires) {
+	TimerEntry entry([this]() { expired++; });
+	wheel.arm(entry, 5);
+	ASSERT_TRUE(entry.isArmed());
+	ASSERT_EQ(wheel.getArmedCount(), 1u);
+
+	advanceFor(20);
+	ASSERT_EQ(expired, 1);
+	ASSERT_FALSE(entry.isArmed());
+	ASSERT_EQ(wheel.getArmedCount(), 0u);
+
+	advanceFor(20);
+	ASSERT_EQ(expired, 1) << "timer expired twice";
+}
+
+/*
+* Checks if a cancelled timer does not expire
+*/
+TEST_F(TimerWheelTest, CancelledTimerDoesNotExpire) {
+	TimerEntry entry([this]() { expired++; });
+	wheel.arm(entry, 5);
+	wheel.cancel(entry);
+	ASSERT_FALSE(entry.isArmed());
+
+	advanceFor(20);
+	ASSERT_EQ(expired, 0);
+}
+
+/*
+* Checks if re-arming moves the expiry of a timer
+*/
+TEST_F(TimerWheelTest, RearmedTimerIsPostponed) {
+	TimerEntry entry([this]() { expired++; });
+	wheel.arm(entry, 30);
+	wheel.arm(entry, 200);
+	ASSERT_EQ(wheel.getArmedCount(), 1u);
+
+	advanceFor(50);
+	ASSERT_EQ(expired, 0);
+	ASSERT_TRUE(entry.isArmed());
+}
+
+/*
+* Checks if timers further away than one revolution of the wheel expire at the correct time
+*/
+TEST_F(TimerWheelTest, TimerBeyondOneRevolution) {
+	TimerEntry entry([this]() { expired++; });
+	wheel.arm(entry, 40);
+
+	advanceFor(10);
+	ASSERT_EQ(expired, 0);
+
+	advanceFor(50);
+	ASSERT_EQ(expired, 1);
+}
+
+/*
+* Checks if an empty wheel lets the driver sleep forever
+*/
+TEST_F(TimerWheelTest, EmptyWheelHasNoExpiry) {
+	ASSERT_EQ(wheel.millisecondsUntilNextExpiry(), -1);
+
+	TimerEntry entry;
+	wheel.arm(entry, 5);
+	ASSERT_EQ(wheel.millisecondsUntilNextExpiry(), 5);
+
+	currentTime += 3;
+	ASSERT_EQ(wheel.millisecondsUntilNextExpiry(), 2);
+}
+
+/*
+* Checks if the alive check timer calls its callback once when its wheel
+* passes the timeout, and not after it was reset in time
+*/
+TEST_F(TimerWheelTest, AliveCheckTimeoutCallsCallback) {
+	int called = 0;
+	AliveCheckTimer timer;
+	timer.setTimerWheel(wheel);
+	timer.cb = [&called]() { called++; };
+	timer.setTimerMilliseconds(20);
+	timer.startTimer();
+
+	advanceFor(15);
+	timer.resetTimer();
+	advanceFor(15);
+	ASSERT_EQ(called, 0);
+	ASSERT_FALSE(timer.timeout);
+
+	advanceFor(10);
+	ASSERT_EQ(called, 1);
+	ASSERT_TRUE(timer.timeout);
+
+	advanceFor(40);
+	ASSERT_EQ(called, 1);
+}
@@ -0,0 +1,73 @@
+#include "BenchRunner.h"
+#include "RoutingActivationHandler.h"
+
+/*
+* Parses a routing activation request with the default activation type
+*/
+static void BM_ParseRoutingActivation(benchmark::State& state) {
+	unsigned char payload[] = {0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(parseRoutingActivation(payload));
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_ParseRoutingActivation);
+
+/*
+* Parses a routing activation request against a policy with several rule sets
+*/
+static void BM_ParseRoutingActivationWithPolicy(benchmark::State& state) {
+	AddressAdmissionPolicy policy;
+	policy.supportActivationType(_DefaultActivationType);
+	policy.allowRange(0x0E00, 0x0FFF);
+	policy.allowRange(0x3000, 0x3FFF);
+	policy.block(0x0E80);
+	policy.allowRange(0x0E00, 0x0E0F, _CentralSecurityActivationType);
+	unsigned char payload[] = {0x3A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(parseRoutingActivation(payload, policy));
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_ParseRoutingActivationWithPolicy);
+
+/*
+* Checks source addresses across the whole address space
+*/
+static void BM_CheckSourceAddress(benchmark::State& state) {
+	uint32_t address = 0;
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(checkSourceAddress(address));
+		address = (address + 0x0101) & 0xFFFF;
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CheckSourceAddress);
+
+static void BM_CreateRoutingActivationResponse(benchmark::State& state) {
+	unsigned char clientAddress[2] = {0x0E, 0x00};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		unsigned char* message = createRoutingActivationResponse(0x0001, clientAddress, _SuccessfullyRoutedCode);
+		benchmark::DoNotOptimize(message);
+		delete[] message;
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CreateRoutingActivationResponse);
+
+static void BM_EncodeRoutingActivationResponse(benchmark::State& state) {
+	unsigned char clientAddress[2] = {0x0E, 0x00};
+	unsigned char message[_GenericHeaderLength + _ActivationResponseLength];
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeRoutingActivationResponse(message, 0x0001, clientAddress, _SuccessfullyRoutedCode));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_EncodeRoutingActivationResponse);
@@ -0,0 +1,42 @@
+#include "BenchRunner.h"
+#include "VehicleIdentificationHandler.h"
+#include "EntityStatusHandler.h"
+
+static void BM_CreateVehicleIdentificationResponse(benchmark::State& state) {
+	std::string vin = "WVWZZZ1JZXW000001";
+	unsigned char eid[6] = {0x00, 0x1A, 0x2B, 0x3C, 0x4D, 0x5E};
+	unsigned char gid[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		unsigned char* message = createVehicleIdentificationResponse(vin, 0x0001, eid, gid, 0x00);
+		benchmark::DoNotOptimize(message);
+		delete[] message;
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_CreateVehicleIdentificationResponse);
+
+static void BM_EncodeVehicleIdentificationResponse(benchmark::State& state) {
+	std::string vin = "WVWZZZ1JZXW000001";
+	unsigned char eid[6] = {0x00, 0x1A, 0x2B, 0x3C, 0x4D, 0x5E};
+	unsigned char gid[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
+	unsigned char message[_GenericHeaderLength + _VIResponseLength];
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeVehicleIdentificationResponse(message, vin, 0x0001, eid, gid, 0x00));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_EncodeVehicleIdentificationResponse);
+
+static void BM_EncodeEntityStatusResponse(benchmark::State& state) {
+	unsigned char message[64];
+	int64_t allocations = getAllocationCount();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(encodeEntityStatusResponse(message, _NodeTypeGateway, 255, 3, 4096));
+		benchmark::ClobberMemory();
+	}
+	reportAllocations(state, allocations);
+}
+BENCHMARK(BM_EncodeEntityStatusResponse);
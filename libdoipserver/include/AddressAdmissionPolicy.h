@@ -0,0 +1,57 @@
+#ifndef ADDRESSADMISSIONPOLICY_H
+#define ADDRESSADMISSIONPOLICY_H
+
+#include <stdint.h>
+#include <array>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+const int _AnyActivationType = -1;
+const int _AddressCount = 0x10000;
+
+const unsigned char _DefaultActivationType = 0x00;
+const unsigned char _WwhObdActivationType = 0x01;
+const unsigned char _CentralSecurityActivationType = 0xE0;
+
+const uint16_t _TesterAddressFirst = 0x0E00;
+const uint16_t _TesterAddressLast = 0x0FFF;
+
+/**
+ * Decides which tester source addresses may activate routing with which
+ * activation type. Every rule set is a bitmap over the whole 16 bit address
+ * space, so a lookup costs one bit test regardless of the number of rules.
+ * A policy is built once and then shared read-only, to change the rules at
+ * runtime a new policy is swapped in with setAddressAdmissionPolicy().
+ */
+class AddressAdmissionPolicy {
+
+public:
+    AddressAdmissionPolicy();
+
+    static std::shared_ptr<const AddressAdmissionPolicy> createDefault();
+
+    void supportActivationType(unsigned char activationType);
+    void allowRange(uint16_t first, uint16_t last, int activationType = _AnyActivationType);
+    void blockRange(uint16_t first, uint16_t last, int activationType = _AnyActivationType);
+    void allow(uint16_t address, int activationType = _AnyActivationType) { allowRange(address, address, activationType); };
+    void block(uint16_t address, int activationType = _AnyActivationType) { blockRange(address, address, activationType); };
+
+    bool isActivationTypeSupported(unsigned char activationType) const { return ruleIndex[activationType] >= 0; };
+    bool isAllowed(uint16_t address, unsigned char activationType) const;
+    bool isKnown(uint16_t address) const;
+
+private:
+    typedef std::bitset<_AddressCount> AddressBitmap;
+
+    //index 0 holds the rules for all activation types without own rules
+    std::vector<AddressBitmap> bitmaps;
+    std::array<int, 256> ruleIndex;
+
+    void setRange(uint16_t first, uint16_t last, int activationType, bool allowed);
+};
+
+std::shared_ptr<const AddressAdmissionPolicy> getAddressAdmissionPolicy();
+void setAddressAdmissionPolicy(std::shared_ptr<const AddressAdmissionPolicy> policy);
+
+#endif /* ADDRESSADMISSIONPOLICY_H */
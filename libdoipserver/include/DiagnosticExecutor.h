@@ -0,0 +1,95 @@
+#ifndef DIAGNOSTICEXECUTOR_H
+#define DIAGNOSTICEXECUTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using ExecutorTask = std::function<void()>;
+
+const size_t _DefaultExecutorQueueDepth = 4096;
+const size_t _StrandBatchSize = 16;         //tasks of one strand which run before other strands get a turn
+const size_t _StrandShardCount = 64;
+
+/**
+ * Work-stealing thread pool which runs the diagnostic callbacks of the
+ * server off the I/O thread. Every task is submitted with a key, e.g. the
+ * connection and the target address of a diagnostic message. Tasks with the
+ * same key form a strand: they run one after another in submission order,
+ * while tasks with different keys run in parallel. A strand is queued at the
+ * worker chosen by its key, idle workers steal queued strands from the
+ * others, so one slow ECU handler only delays the messages for that ECU.
+ */
+class DiagnosticExecutor {
+
+public:
+    DiagnosticExecutor(size_t workerCount = 0, size_t queueDepth = _DefaultExecutorQueueDepth);
+    ~DiagnosticExecutor();
+
+    DiagnosticExecutor(const DiagnosticExecutor&) = delete;
+    DiagnosticExecutor& operator=(const DiagnosticExecutor&) = delete;
+
+    static uint64_t makeKey(uint64_t connectionId, unsigned short targetAddress) {
+        return (connectionId << 16) | targetAddress;
+    };
+
+    bool submit(uint64_t key, ExecutorTask task);
+    bool reserve();
+    void submitReserved(uint64_t key, ExecutorTask task);
+    void cancelReservation();
+    void drain();
+
+    size_t getWorkerCount() const { return workers.size(); };
+    size_t getQueueDepth() const { return queueDepth; };
+    size_t getPendingTasks() const { return pendingTasks; };
+    uint64_t getRejectedTasks() const { return rejectedTasks; };
+    uint64_t getStolenStrands() const { return stolenStrands; };
+
+private:
+    struct Strand {
+        uint64_t key;
+        std::deque<ExecutorTask> tasks;
+        bool scheduled = false;     //queued at a worker or running, only then it may be used without the shard lock
+    };
+
+    struct StrandShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Strand*> strands;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Strand*> runQueue;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    StrandShard shards[_StrandShardCount];
+    size_t queueDepth;
+
+    std::atomic<size_t> pendingTasks{0};
+    std::atomic<size_t> queuedStrands{0};
+    std::atomic<uint64_t> rejectedTasks{0};
+    std::atomic<uint64_t> stolenStrands{0};
+    std::atomic<bool> running{true};
+
+    std::mutex sleepMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable drained;
+
+    StrandShard& shardOf(uint64_t key) { return shards[key % _StrandShardCount]; };
+    void enqueue(size_t workerIndex, Strand* strand);
+    Strand* takeStrand(size_t workerIndex);
+    void runStrand(size_t workerIndex, Strand* strand);
+    void work(size_t workerIndex);
+};
+
+#endif /* DIAGNOSTICEXECUTOR_H */
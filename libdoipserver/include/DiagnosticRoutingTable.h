@@ -0,0 +1,92 @@
+#ifndef DIAGNOSTICROUTINGTABLE_H
+#define DIAGNOSTICROUTINGTABLE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "DiagnosticMessageHandler.h"
+
+class DoIPConnection;
+
+/**
+ * Route back to the tester which sent a diagnostic message. It may be kept
+ * after the handler returned to answer later, e.g. after a response pending.
+ */
+class TesterRoute {
+
+public:
+    TesterRoute(std::weak_ptr<DoIPConnection> connection, unsigned short testerAddress, unsigned short ecuAddress):
+        connection(connection), testerAddress(testerAddress), ecuAddress(ecuAddress) { };
+
+    unsigned short getTesterAddress() const { return testerAddress; };
+    unsigned short getEcuAddress() const { return ecuAddress; };     //target address of the request, may be functional
+    bool isConnected() const { return !connection.expired(); };
+
+    int sendResponse(unsigned short sourceAddress, const unsigned char* data, int length) const;
+
+private:
+    std::weak_ptr<DoIPConnection> connection;
+    unsigned short testerAddress;
+    unsigned short ecuAddress;
+};
+
+/**
+ * ECU behind the gateway which receives the diagnostic messages for its
+ * logical address. The message is only valid during the call.
+ */
+class EcuHandler {
+
+public:
+    virtual ~EcuHandler() = default;
+
+    virtual void handleDiagnosticMessage(const DiagnosticMessageView& message, const TesterRoute& route) = 0;
+};
+
+/**
+ * Maps the logical target addresses of diagnostic messages to ECU handlers.
+ * Lookups never lock: they read an immutable snapshot of the routes, which
+ * writers replace as a whole. A replaced snapshot is deleted after every
+ * lookup which might still read it has finished, readers are tracked with
+ * two epoch counters. Changes are expected to be rare, they wait for all
+ * running lookups.
+ */
+class DiagnosticRoutingTable {
+
+public:
+    DiagnosticRoutingTable();
+    ~DiagnosticRoutingTable();
+
+    DiagnosticRoutingTable(const DiagnosticRoutingTable&) = delete;
+    DiagnosticRoutingTable& operator=(const DiagnosticRoutingTable&) = delete;
+
+    void addEcu(unsigned short address, std::shared_ptr<EcuHandler> handler);
+    void addFunctionalRange(unsigned short first, unsigned short last, std::shared_ptr<EcuHandler> handler);
+    bool removeEcu(unsigned short address);
+    void clear();
+
+    std::shared_ptr<EcuHandler> lookup(unsigned short targetAddress) const;
+
+private:
+    struct Route {
+        unsigned short first;
+        unsigned short last;
+        std::shared_ptr<EcuHandler> handler;
+    };
+
+    //physical routes are sorted by address, functional ranges are checked in registration order
+    struct Snapshot {
+        std::vector<Route> physical;
+        std::vector<Route> functional;
+    };
+
+    std::atomic<const Snapshot*> current;
+    mutable std::atomic<uint64_t> epoch{0};
+    mutable std::atomic<long> readers[2];
+    std::mutex writerMutex;
+
+    void publish(Snapshot* next);
+};
+
+#endif /* DIAGNOSTICROUTINGTABLE_H */
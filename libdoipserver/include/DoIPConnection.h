@@ -9,6 +9,11 @@
 #include <string.h>
 #include <net/if.h>
 #include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
 #include "DoIPGenericHeaderHandler.h"
 #include "RoutingActivationHandler.h"
 #include "VehicleIdentificationHandler.h"
@@ -16,22 +21,66 @@
 #include "RoutingActivationHandler.h"
 #include "DiagnosticMessageHandler.h"
 #include "AliveCheckTimer.h"
+#include "BufferPool.h"
+#include "DoIPFrameDecoder.h"
+#include "ScatterGatherSend.h"
 
 using CloseConnectionCallback = std::function<void()>;
+using OemPayloadCallback = std::function<void(uint16_t payloadType, unsigned char* payload, unsigned long length)>;
+using BackpressureCallback = std::function<void(bool throttle)>;
+using SendSubmitCallback = std::function<void()>;
 
 const unsigned long _MaxDataSize = 0xFFFFFF;
+const int _ReceiveChunkSize = 16384;
+const int _SendTimeoutMs = 1000;
+const uint32_t _InitialInactivityTimeMs = 2000;     //T_TCP_Initial_Inactivity
+const uint16_t _DefaultGeneralInactivityTime = 300; //T_TCP_General_Inactivity in seconds
+const uint32_t _AliveCheckResponseTimeMs = 500;     //T_TCP_Alive_Check
+
+const size_t _DefaultSendQueueLimit = 4 * 1024 * 1024;
+const size_t _DefaultSendHighWaterMark = 1024 * 1024;
+const size_t _DefaultSendLowWaterMark = 256 * 1024;
+const int _MaxFlushVectors = 64;
+
+/**
+ * What happens to a message which does not fit into the send queue anymore
+ */
+enum SendOverflowPolicy {
+    OVERFLOWDROP,           //the message is discarded
+    OVERFLOWDISCONNECT,     //the connection is closed
+    OVERFLOWBLOCK           //the sender waits up to _SendTimeoutMs until the tester read enough
+};
+
+/**
+ * Limits of the send queue of a connection. Above the high water mark the
+ * application is told to throttle, below the low water mark to resume. The
+ * overflow policy applies when a message would exceed the limit, a message
+ * to an empty queue is always accepted.
+ */
+struct SendQueueLimits {
+    size_t highWaterMark = _DefaultSendHighWaterMark;
+    size_t lowWaterMark = _DefaultSendLowWaterMark;
+    size_t limit = _DefaultSendQueueLimit;
+    SendOverflowPolicy overflowPolicy = OVERFLOWDROP;
+};
 
 class DoIPConnection {
 
 public:
     DoIPConnection(int tcpSocket, unsigned short logicalGatewayAddress): 
-        tcpSocket(tcpSocket), logicalGatewayAddress(logicalGatewayAddress) { };
+        tcpSocket(tcpSocket), logicalGatewayAddress(logicalGatewayAddress) {
+        generalInactivityTimer.setTimer(_DefaultGeneralInactivityTime);
+    };
     
     int receiveTcpMessage();
+    int receiveAvailableTcpMessages();
+    int processReceivedData(unsigned char* data, size_t length);
     unsigned long receiveFixedNumberOfBytesFromTCP(unsigned long payloadLength, unsigned char *receivedData);
 
     void sendDiagnosticPayload(unsigned short sourceAddress, unsigned char* data, int length);
+    int sendDiagnosticPayload(unsigned short sourceAddress, const struct iovec* payload, int count);
     bool isSocketActive() { return tcpSocket != 0; };
+    int getSocket() const { return tcpSocket; };
 
     void triggerDisconnection();
     
@@ -39,25 +88,91 @@ public:
     int sendNegativeAck(unsigned char ackCode);
 
     void setCallback(DiagnosticCallback dc, DiagnosticMessageNotification dmn, CloseConnectionCallback ccb);                       
+    void setDiagnosticViewCallback(DiagnosticViewCallback dvc) { diag_view_callback = dvc; };
+    void setOemPayloadCallback(OemPayloadCallback opc) { oem_callback = opc; };
     void setGeneralInactivityTime(const uint16_t seconds);   
+    void setInitialInactivityTime(uint32_t milliseconds);
+    void setTimerWheel(TimerWheel& wheel);
+    void setBufferPool(BufferPool& pool) { bufferPool = &pool; frameDecoder = DoIPFrameDecoder(pool); };
+    void setSendQueueLimits(const SendQueueLimits& limits) { sendQueueLimits = limits; };
+    void setBackpressureCallback(BackpressureCallback bpc) { backpressure_callback = bpc; };
+    void setSendSubmitCallback(SendSubmitCallback ssc) { send_submit_callback = ssc; };
+    void setSocketReleasedByOwner() { closesSocket = false; };
+
+    int flushSendQueue();
+    int collectSendVectors(struct iovec* vectors, int maxCount);
+    bool completeSend(int result);
+    size_t getQueuedBytes();
+    uint64_t getDroppedMessages() const { return droppedMessages; };
+
+    int sendAliveCheckRequest();
 
 private:
 
-    int tcpSocket;
+    //closeSocket() may run on an executor thread while the event loop reads the socket
+    std::atomic<int> tcpSocket;
+    //with an owner, e.g. the event loop, the socket number stays reserved until the owner closes it
+    bool closesSocket = true;
 
-    AliveCheckTimer aliveCheckTimer;
+    AliveCheckTimer initialInactivityTimer;
+    AliveCheckTimer generalInactivityTimer;
+    AliveCheckTimer aliveCheckResponseTimer;
     DiagnosticCallback diag_callback;
+    DiagnosticViewCallback diag_view_callback;
     CloseConnectionCallback close_connection;
     DiagnosticMessageNotification notify_application;
+    OemPayloadCallback oem_callback;
 
-    unsigned char* routedClientAddress;
+    unsigned char routedClientAddress[2] = {0x00, 0x00};
     unsigned short logicalGatewayAddress = 0x0000;
+
+    BufferPool* bufferPool = &BufferPool::defaultPool();
+    DoIPFrameDecoder frameDecoder;
+    std::vector<struct iovec> sendVectorList;
+    std::mutex sendMutex;   //responses may be sent from executor threads while the I/O thread sends acks
+
+    //bytes which did not fit into the socket buffer, they are sent when the socket is writable again
+    struct QueuedMessage {
+        PooledBuffer buffer;
+        size_t offset;
+    };
+    std::deque<QueuedMessage> sendQueue;
+    size_t queuedBytes = 0;
+    SendQueueLimits sendQueueLimits;
+    BackpressureCallback backpressure_callback;
+    bool throttled = false;
+    std::atomic<uint64_t> droppedMessages{0};
+
+    //with a send submit callback the queue is written by the transport, e.g. io_uring
+    SendSubmitCallback send_submit_callback;
+    bool sendSubmitted = false;
+    std::condition_variable sendSpace;
         
     void closeSocket();
 
+    bool processReceivedFrame(const DoIPFrame& frame);
+
+    ssize_t receiveTraced(unsigned char* buffer, size_t length);
     int reactOnReceivedTcpMessage(GenericHeaderAction action, unsigned long payloadLength, unsigned char *payload);
+
+    using TcpMessageHandler = int (DoIPConnection::*)(const GenericHeaderAction& action, unsigned char* payload);
+    struct TcpHandlerEntry {
+        PayloadType type;
+        TcpMessageHandler handler;
+    };
+    int handleNegativeAck(const GenericHeaderAction& action, unsigned char* payload);
+    int handleGenericNack(const GenericHeaderAction& action, unsigned char* payload);
+    int handleRoutingActivationRequest(const GenericHeaderAction& action, unsigned char* payload);
+    int handleAliveCheckResponse(const GenericHeaderAction& action, unsigned char* payload);
+    int handleDiagnosticMessage(const GenericHeaderAction& action, unsigned char* payload);
+    int handleOemMessage(const GenericHeaderAction& action, unsigned char* payload);
     
     int sendMessage(unsigned char* message, int messageLenght);
+    int queueMessage(std::unique_lock<std::mutex>& lock, struct iovec* vectors, int count);
+    int queueForSubmission(std::unique_lock<std::mutex>& lock, struct iovec* vectors, int count, size_t length, const unsigned char* header);
+    ssize_t writeSendQueue();
+    void consumeSendQueue(size_t written);
+    bool waitForQueueSpace(std::unique_lock<std::mutex>& lock, size_t length);
     
     void aliveCheckTimeout();
 };
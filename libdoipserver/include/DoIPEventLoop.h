@@ -0,0 +1,137 @@
+#ifndef DOIPEVENTLOOP_H
+#define DOIPEVENTLOOP_H
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "IoUring.h"
+#include "TimerWheel.h"
+
+using EventHandler = std::function<void(uint32_t events)>;
+using LoopTask = std::function<void()>;
+using AcceptHandler = std::function<void(int fd)>;
+using ReceiveHandler = std::function<void(unsigned char* data, size_t length)>;
+using SendCompletion = std::function<void(int result)>;
+
+const int _MaxEventsPerPoll = 64;
+const unsigned _UringReceiveBuffers = 256;          //shared by all receiving sockets, a power of two
+const unsigned _UringReceiveBufferSize = 16384;
+const uint16_t _UringReceiveBufferGroup = 0;
+
+/*
+ * How the event loop waits for the sockets
+ */
+enum EventLoopBackend {
+    EPOLLBACKEND,       //readiness with epoll, the handlers read and write the sockets themselves
+    IOURINGBACKEND      //completions with io_uring, sockets can also be read and written by the loop
+};
+
+/**
+ * Edge-triggered epoll reactor which dispatches socket readiness events to
+ * registered handlers and drives a timer wheel. All handlers, timer callbacks
+ * and posted tasks run on the thread which calls run() or runOnce().
+ *
+ * With the io_uring backend descriptors are watched with level-triggered
+ * multishot polls instead, and stream sockets can be accepted, received and
+ * sent by the ring. All requests of a loop iteration are submitted in the
+ * system call which waits for the next completions.
+ */
+class DoIPEventLoop {
+
+public:
+    DoIPEventLoop();
+    ~DoIPEventLoop();
+
+    DoIPEventLoop(const DoIPEventLoop&) = delete;
+    DoIPEventLoop& operator=(const DoIPEventLoop&) = delete;
+
+    bool setBackend(EventLoopBackend backend);
+    EventLoopBackend getBackend() const { return backend; };
+
+    bool addDescriptor(int fd, uint32_t events, EventHandler handler);
+    bool modifyDescriptor(int fd, uint32_t events);
+    void removeDescriptor(int fd);
+
+    bool acceptConnections(int fd, AcceptHandler handler);
+    bool receiveStream(int fd, ReceiveHandler handler);
+    bool sendStream(int fd, const struct iovec* vectors, int count, SendCompletion completion);
+    void flushSubmissions();
+
+    void post(LoopTask task);
+    void defer(LoopTask task);
+    bool isInLoopThread() const { return loopThread.load() == std::this_thread::get_id(); };
+
+    int runOnce(int timeoutMs);
+    void run();
+    void stop();
+
+    bool isRunning() const { return running; };
+    TimerWheel& getTimerWheel() { return timerWheel; };
+
+private:
+
+    enum RequestKind {
+        POLLREQUEST,
+        ACCEPTREQUEST,
+        RECEIVEREQUEST
+    };
+
+    struct Registration {
+        int fd;
+        EventHandler handler;
+        bool active;
+
+        //only used by the io_uring backend
+        RequestKind kind;
+        uint32_t events;
+        AcceptHandler acceptHandler;
+        ReceiveHandler receiveHandler;
+        bool armed;         //the kernel may still post completions for it
+    };
+
+    //io_uring send which owns its vectors until it completes
+    struct SendRequest {
+        std::vector<struct iovec> vectors;
+        struct msghdr message;
+        SendCompletion completion;
+    };
+
+    int epollFd;
+    int wakeupFd;
+    std::atomic<bool> running;
+    TimerWheel timerWheel;
+    EventLoopBackend backend = EPOLLBACKEND;
+    std::atomic<std::thread::id> loopThread;
+
+    std::unordered_map<int, Registration*> registrations;
+    std::vector<Registration*> retiredRegistrations;
+
+    IoUring ring;
+    std::unordered_set<Registration*> cancelledRegistrations;     //removed, waiting for their last completion
+    std::unordered_set<SendRequest*> pendingSends;
+
+    std::mutex taskMutex;
+    std::vector<LoopTask> pendingTasks;
+    std::vector<LoopTask> deferredTasks;     //only touched by the loop thread
+
+    void wakeup();
+    void runPendingTasks();
+    void releaseRetiredRegistrations();
+
+    int runOnceUring(int timeoutMs);
+    struct io_uring_sqe* nextSubmission();
+    void armRegistration(Registration* registration);
+    void armWakeup();
+    void dispatchCompletion(const struct io_uring_cqe& completion);
+    void dispatchRegistration(Registration* registration, const struct io_uring_cqe& completion);
+};
+
+#endif /* DOIPEVENTLOOP_H */
@@ -9,26 +9,74 @@
 #include <string.h>
 #include <net/if.h>
 #include <unistd.h>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "DoIPGenericHeaderHandler.h"
 #include "RoutingActivationHandler.h"
 #include "VehicleIdentificationHandler.h"
 #include "DoIPGenericHeaderHandler.h"
 #include "RoutingActivationHandler.h"
 #include "DiagnosticMessageHandler.h"
+#include "EntityStatusHandler.h"
 #include "AliveCheckTimer.h"
 #include "DoIPConnection.h"
+#include "DoIPEventLoop.h"
+#include "DiagnosticExecutor.h"
+#include "DiagnosticRoutingTable.h"
+#include "VehicleAnnouncementScheduler.h"
 
 using CloseConnectionCallback = std::function<void()>;
+using ConnectionDiagnosticCallback = std::function<void(DoIPConnection&, unsigned short, unsigned char*, int)>;
+using ConnectionDiagnosticViewCallback = std::function<void(DoIPConnection&, const DiagnosticMessageView&)>;
+using ConnectionDiagnosticNotification = std::function<bool(DoIPConnection&, unsigned short)>;
+using ConnectionClosedCallback = std::function<void(DoIPConnection&)>;
+using ConnectionOpenedCallback = std::function<void(DoIPConnection&)>;
+using ConnectionOemPayloadCallback = std::function<void(DoIPConnection&, uint16_t, unsigned char*, unsigned long)>;
+using ConnectionBackpressureCallback = std::function<void(DoIPConnection&, bool)>;
 
 const int _ServerPort = 13400;
-//const unsigned long _MaxDataSize = 4294967294;
-//const unsigned long _MaxDataSize = 0xFFFFFF;
+const int _AnnouncementPort = 13401;
+const int _UdpBatchSize = 16;           //datagrams which are received and answered with one system call
+const int _MaxUdpMessageLength = 64;    //the longest udp message, a vehicle identification response, has 41 bytes
+const unsigned char _DefaultMaxConnections = 0xFF;  //the entity status reports the limit in one byte
+
+/*
+ * Datagrams of one recvmmsg() call and their responses, which are sent with one sendmmsg() call
+ */
+struct UdpBatch {
+    unsigned char requests[_UdpBatchSize][_MaxUdpMessageLength];
+    unsigned char responses[_UdpBatchSize][_MaxUdpMessageLength];
+    struct sockaddr_in senders[_UdpBatchSize];
+    struct iovec requestVectors[_UdpBatchSize];
+    struct iovec responseVectors[_UdpBatchSize];
+    struct mmsghdr requestHeaders[_UdpBatchSize];
+    struct mmsghdr responseHeaders[_UdpBatchSize];
+    int current = 0;            //datagram which is processed
+    int responseCount = 0;
+};
+
+/*
+ * Encoded vehicle identification response, which is also sent as vehicle
+ * announcement. A frame is never changed after it was published.
+ */
+struct VehicleIdentificationFrame {
+    unsigned char message[_GenericHeaderLength + _VIResponseLength];
+    int length;
+};
 
 class DoIPServer {
 
 public:
-    DoIPServer() = default;
+    DoIPServer() {
+        frameReaders[0] = 0;
+        frameReaders[1] = 0;
+        std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
+        updateVehicleIdentificationFrame();
+    };
+    ~DoIPServer();
     
     void setupTcpSocket();
     std::unique_ptr<DoIPConnection> waitForTcpConnection();
@@ -37,8 +85,38 @@ public:
 
     void closeTcpSocket();
     void closeUdpSocket();
+
+    bool setTransportBackend(EventLoopBackend backend);
+    bool setupEventLoop();
+    void runEventLoop();
+    int pollEvents(int timeoutMs);
+    void stopEventLoop();
+    DoIPEventLoop& getEventLoop() { return eventLoop; };
+    size_t getConnectionCount() const { return connectionCount; };
+    //further connections are closed when they are accepted, the limit is reported in the entity status
+    void setMaxConnections(unsigned char count) { maxConnections = count; };
+
+    void setConnectionCallback(ConnectionDiagnosticCallback dc, ConnectionDiagnosticNotification dmn,
+                                ConnectionClosedCallback ccb);
+    void setConnectionViewCallback(ConnectionDiagnosticViewCallback dvc) { connection_diag_view_callback = dvc; };
+    void setOemPayloadCallback(ConnectionOemPayloadCallback opc) { connection_oem_callback = opc; };
+    //called on the event loop thread before the first message of an accepted connection is processed
+    void setConnectionOpenedCallback(ConnectionOpenedCallback occ) { connection_opened = occ; };
+    void setGeneralInactivityTime(const uint16_t seconds);
+    void setInitialInactivityTime(const uint32_t milliseconds);
+    void setSendQueueLimits(const SendQueueLimits& limits) { sendQueueLimits = limits; };
+    void setBackpressureCallback(ConnectionBackpressureCallback bpc) { connection_backpressure_callback = bpc; };
+    void setBufferPool(BufferPool& pool) { bufferPool = &pool; };
+    //the diagnostic callbacks of connections which are accepted afterwards run on the executor,
+    //it has to be drained before the server or its buffer pool is destroyed
+    void setDiagnosticExecutor(DiagnosticExecutor* executor) { diagnosticExecutor = executor; };
+    //with a routing table the diagnostic messages of connections which are accepted afterwards go to the
+    //ecu handlers instead of the connection callbacks, unknown target addresses get a negative ack
+    void setRoutingTable(DiagnosticRoutingTable* table) { routingTable = table; };
+    BufferPool& getBufferPool() { return *bufferPool; };
     
     int sendVehicleAnnouncement();
+    int scheduleVehicleAnnouncements();
 
     void setEIDdefault();
     void setVIN(std::string VINString);
@@ -48,28 +126,83 @@ public:
     void setFAR(const unsigned int inputFAR);
     void setA_DoIP_Announce_Num(int Num);
     void setA_DoIP_Announce_Interval(int Interval); 
+    void setDiagnosticPowerMode(unsigned char powerMode) { diagnosticPowerMode = powerMode; };
 
 private:
 
-    int server_socket_tcp, server_socket_udp;
-    struct sockaddr_in serverAddress, clientAddress;
-    unsigned char data[_MaxDataSize];
+    int server_socket_tcp = -1, server_socket_udp = -1;
+    struct sockaddr_in serverAddress;
+    UdpBatch udpBatch;
 
     std::string VIN = "00000000000000000";
     unsigned short LogicalGatewayAddress = 0x0000;
-    unsigned char EID [6];
+    unsigned char EID [6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     unsigned char GID [6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     unsigned char FurtherActionReq = 0x00;
-    
-    int A_DoIP_Announce_Num = 3;    //Default Value = 3
-    int A_DoIP_Announce_Interval = 500; //Default Value = 500ms
+    unsigned char diagnosticPowerMode = _PowerModeReady;
     
     int broadcast = 1;
+    int addressMonitorSocket = -1;      //netlink socket which reports new ip addresses
+
+    //the udp thread reads the current frame without locking, readers are tracked with two
+    //epoch counters like in DiagnosticRoutingTable, so a replaced frame is deleted once
+    //no response can copy it anymore
+    std::atomic<const VehicleIdentificationFrame*> vehicleIdentificationFrame{nullptr};
+    std::atomic<uint64_t> frameEpoch{0};
+    std::atomic<long> frameReaders[2];
+    std::mutex vehicleIdentificationMutex;      //guards the identification values while a frame is encoded
+
+    DoIPEventLoop eventLoop;
+    VehicleAnnouncementScheduler announcementScheduler{eventLoop.getTimerWheel(),
+                                                       std::bind(&DoIPServer::broadcastVehicleAnnouncement, this)};
+    BufferPool* bufferPool = &BufferPool::defaultPool();
+    DiagnosticExecutor* diagnosticExecutor = nullptr;
+    DiagnosticRoutingTable* routingTable = nullptr;
+    std::unordered_map<int, std::shared_ptr<DoIPConnection>> connections;     //executor tasks keep a closed connection alive
+    uint64_t nextConnectionId = 0;
+    std::atomic<size_t> connectionCount{0};   //readable from the udp thread
+    std::atomic<unsigned char> maxConnections{_DefaultMaxConnections};
+    ConnectionDiagnosticCallback connection_diag_callback;
+    ConnectionDiagnosticViewCallback connection_diag_view_callback;
+    ConnectionDiagnosticNotification connection_notify_application;
+    ConnectionClosedCallback connection_closed;
+    ConnectionOpenedCallback connection_opened;
+    ConnectionOemPayloadCallback connection_oem_callback;
+    ConnectionBackpressureCallback connection_backpressure_callback;
+    SendQueueLimits sendQueueLimits;
+    uint16_t generalInactivityTime = _DefaultGeneralInactivityTime;
+    uint32_t initialInactivityTime = _InitialInactivityTimeMs;
+
+    void acceptTcpConnections();
+    void watchAddressChanges();
+    void receiveAddressChanges();
+    void addConnection(int tcpSocket);
+    void submitQueuedMessages(const std::shared_ptr<DoIPConnection>& connection, int tcpSocket);
+    void submitDiagnosticMessage(const std::shared_ptr<DoIPConnection>& connection, uint64_t connectionId,
+                                    const DiagnosticMessageView& view);
+    bool acknowledgeDiagnosticMessage(DoIPConnection& connection, unsigned short targetAddress);
+    bool acknowledgeRoutedMessage(DoIPConnection& connection, unsigned short targetAddress);
+    void routeDiagnosticMessage(const std::shared_ptr<DoIPConnection>& connection, const DiagnosticMessageView& view);
+    void releaseConnection(int tcpSocket, DoIPConnection* connection);
     
-    int reactToReceivedUdpMessage(int readedBytes);
+    int reactToReceivedUdpMessage(unsigned char* message, int readedBytes);
+
+    using UdpMessageHandler = int (DoIPServer::*)(const GenericHeaderAction& action, unsigned char* payload);
+    struct UdpHandlerEntry {
+        PayloadType type;
+        UdpMessageHandler handler;
+    };
+    int handleUdpNegativeAck(const GenericHeaderAction& action, unsigned char* payload);
+    int handleVehicleIdentificationRequest(const GenericHeaderAction& action, unsigned char* payload);
+    int handleVehicleIdentificationResponse(const GenericHeaderAction& action, unsigned char* payload);
+    int handleEntityStatusRequest(const GenericHeaderAction& action, unsigned char* payload);
+    int handlePowerModeRequest(const GenericHeaderAction& action, unsigned char* payload);
     
-    int sendUdpMessage(unsigned char* message, int messageLength);
+    int sendUdpMessage(const unsigned char* message, int messageLength);
+    int sendUdpResponses();
+    int broadcastVehicleAnnouncement();
     
+    void updateVehicleIdentificationFrame();
     void setMulticastGroup(const char* address);
 };
 
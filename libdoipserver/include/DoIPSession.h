@@ -0,0 +1,186 @@
+#ifndef DOIPSESSION_H
+#define DOIPSESSION_H
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include "DoIPTask.h"
+#include "DoIPServer.h"
+
+/**
+ * Diagnostic message which a tester sent in a session
+ */
+struct SessionRequest {
+    unsigned short sourceAddress;   //logical address of the tester
+    unsigned short targetAddress;   //logical address of the ecu, responses are sent from it
+    PooledBuffer data;              //user data, in a buffer of the pool of the server
+};
+
+/**
+ * Tester connection as seen by a session coroutine. The coroutine waits for
+ * the next diagnostic message with co_await nextDiagnostic() and answers
+ * with co_await send(). It runs on the event loop thread of the server, so
+ * thousands of sessions share this thread instead of needing one each.
+ * Only one coroutine may wait on a session at a time.
+ */
+class DoIPSession {
+
+public:
+    explicit DoIPSession(DoIPConnection& connection): connection(&connection) { }
+
+    DoIPSession(const DoIPSession&) = delete;
+    DoIPSession& operator=(const DoIPSession&) = delete;
+
+    bool isOpen() const { return connection != nullptr; }
+    DoIPConnection* getConnection() const { return connection; }
+
+    struct DiagnosticAwaiter {
+        DoIPSession& session;
+
+        bool await_ready() const noexcept { return !session.requests.empty() || session.connection == nullptr; }
+        void await_suspend(std::coroutine_handle<> awaiting) noexcept { session.receiver = awaiting; }
+        std::optional<SessionRequest> await_resume() {
+            if(session.requests.empty()) {
+                return std::nullopt;
+            }
+            std::optional<SessionRequest> request(std::move(session.requests.front()));
+            session.requests.pop_front();
+            return request;
+        }
+    };
+
+    struct SendAwaiter {
+        DoIPSession& session;
+        int result;
+
+        bool await_ready() const noexcept { return !session.throttled || session.connection == nullptr; }
+        void await_suspend(std::coroutine_handle<> awaiting) noexcept { session.sender = awaiting; }
+        int await_resume() const noexcept { return result; }
+    };
+
+    /**
+     * Waits for the next diagnostic message of the tester
+     * @return      awaitable which yields the message, or std::nullopt when
+     *              the connection was closed
+     */
+    DiagnosticAwaiter nextDiagnostic() {
+        return DiagnosticAwaiter{*this};
+    }
+
+    /**
+     * Sends a diagnostic message to the tester. The message is queued at
+     * once, awaiting it suspends the coroutine while the send queue of the
+     * connection is above its high water mark.
+     * @param sourceAddress     logical address of the ecu which responds
+     * @return                  awaitable which yields the length of the
+     *                          message, or -1 if it was not sent
+     */
+    SendAwaiter send(unsigned short sourceAddress, const unsigned char* data, int length) {
+        if(connection == nullptr) {
+            return SendAwaiter{*this, -1};
+        }
+        struct iovec payload = { const_cast<unsigned char*>(data), (size_t)length };
+        return SendAwaiter{*this, connection->sendDiagnosticPayload(sourceAddress, &payload, 1)};
+    }
+
+    /**
+     * Closes the connection, waiting coroutines continue as if the tester closed it
+     */
+    void close() {
+        if(connection != nullptr) {
+            connection->triggerDisconnection();
+        }
+    }
+
+private:
+    friend class DoIPSessionServer;
+
+    DoIPConnection* connection;
+    std::deque<SessionRequest> requests;    //received while the coroutine was busy
+    std::coroutine_handle<> receiver;
+    std::coroutine_handle<> sender;
+    bool throttled = false;
+
+    void deliver(const DiagnosticMessageView& view) {
+        requests.push_back(SessionRequest{view.getSourceAddress(), view.getTargetAddress(), view.retain()});
+        resume(receiver);
+    }
+
+    void setThrottled(bool throttle) {
+        throttled = throttle;
+        if(!throttle) {
+            resume(sender);
+        }
+    }
+
+    void closed() {
+        connection = nullptr;
+        requests.clear();
+        resume(receiver);
+        resume(sender);
+    }
+
+    static void resume(std::coroutine_handle<>& waiting) {
+        if(waiting) {
+            std::exchange(waiting, nullptr).resume();
+        }
+    }
+};
+
+using SessionHandler = std::function<DoIPTask<>(std::shared_ptr<DoIPSession> session)>;
+
+/**
+ * Runs a session coroutine for every tester connection of a DoIPServer. It
+ * takes over the connection, view and backpressure callbacks of the server,
+ * which must not use a diagnostic executor or routing table, so all
+ * sessions run on the event loop thread. The connection is closed when its
+ * session coroutine returns.
+ */
+class DoIPSessionServer {
+
+public:
+    DoIPSessionServer(DoIPServer& server, SessionHandler handler): handler(handler) {
+        server.setConnectionOpenedCallback([this](DoIPConnection& connection) {
+            std::shared_ptr<DoIPSession> session = std::make_shared<DoIPSession>(connection);
+            sessions[&connection] = session;
+            runSession(this->handler(session), session).detach();
+        });
+        server.setConnectionViewCallback([this](DoIPConnection& connection, const DiagnosticMessageView& view) {
+            auto it = sessions.find(&connection);
+            if(it != sessions.end()) {
+                it->second->deliver(view);
+            }
+        });
+        server.setBackpressureCallback([this](DoIPConnection& connection, bool throttle) {
+            auto it = sessions.find(&connection);
+            if(it != sessions.end()) {
+                it->second->setThrottled(throttle);
+            }
+        });
+        server.setConnectionCallback(nullptr, nullptr, [this](DoIPConnection& connection) {
+            auto it = sessions.find(&connection);
+            if(it != sessions.end()) {
+                std::shared_ptr<DoIPSession> session = it->second;
+                sessions.erase(it);
+                session->closed();
+            }
+        });
+    }
+
+    DoIPSessionServer(const DoIPSessionServer&) = delete;
+    DoIPSessionServer& operator=(const DoIPSessionServer&) = delete;
+
+    size_t getSessionCount() const { return sessions.size(); }
+
+private:
+    SessionHandler handler;
+    std::unordered_map<DoIPConnection*, std::shared_ptr<DoIPSession>> sessions;
+
+    static DoIPTask<> runSession(DoIPTask<> task, std::shared_ptr<DoIPSession> session) {
+        co_await std::move(task);
+        session->close();
+    }
+};
+
+#endif /* DOIPSESSION_H */
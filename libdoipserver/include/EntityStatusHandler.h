@@ -0,0 +1,20 @@
+#ifndef ENTITYSTATUSHANDLER_H
+#define ENTITYSTATUSHANDLER_H
+
+#include "DoIPGenericHeaderHandler.h"
+
+const int _EntityStatusResponseLength = 7;
+const int _PowerModeResponseLength = 1;
+
+const unsigned char _NodeTypeGateway = 0x00;
+const unsigned char _NodeTypeNode = 0x01;
+
+const unsigned char _PowerModeNotReady = 0x00;
+const unsigned char _PowerModeReady = 0x01;
+const unsigned char _PowerModeNotSupported = 0x02;
+
+int encodeEntityStatusResponse(unsigned char* buffer, unsigned char nodeType, unsigned char maxOpenSockets,
+                                unsigned char currentlyOpenSockets, uint32_t maxDataSize);
+int encodePowerModeResponse(unsigned char* buffer, unsigned char powerMode);
+
+#endif /* ENTITYSTATUSHANDLER_H */
@@ -4,6 +4,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "DoIPGenericHeaderHandler.h"
+#include "AddressAdmissionPolicy.h"
 
 const int _ActivationResponseLength = 9;
 
@@ -12,9 +13,12 @@ const unsigned char _UnsupportedRoutingTypeCode = 0x06;
 const unsigned char _SuccessfullyRoutedCode = 0x10;
 
 unsigned char parseRoutingActivation(unsigned char* data);
+unsigned char parseRoutingActivation(unsigned char* data, const AddressAdmissionPolicy& policy);
 unsigned char* createRoutingActivationResponse(unsigned short sourceAddress, 
                                                 unsigned char clientAddress[2],
                                                 unsigned char responseCode);
+int encodeRoutingActivationResponse(unsigned char* buffer, unsigned short sourceAddress,
+                                    unsigned char clientAddress[2], unsigned char responseCode);
 bool checkSourceAddress(uint32_t address);
 
 
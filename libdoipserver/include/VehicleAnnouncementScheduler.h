@@ -0,0 +1,51 @@
+#ifndef VEHICLEANNOUNCEMENTSCHEDULER_H
+#define VEHICLEANNOUNCEMENTSCHEDULER_H
+
+#include <atomic>
+#include <functional>
+#include "TimerWheel.h"
+
+using AnnouncementSender = std::function<int()>;
+
+const int _DefaultAnnounceNum = 3;
+const int _DefaultAnnounceIntervalMs = 500;
+const int _MaxAnnounceWaitMs = 500;        //A_DoIP_Announce_Wait is chosen randomly up to this value
+
+/**
+ * Sends the vehicle announcements of ISO 13400 as timer events of a timer
+ * wheel, so nobody blocks while waiting for the next announcement. Every
+ * start() waits a random A_DoIP_Announce_Wait, then sends A_DoIP_Announce_Num
+ * announcements in a distance of A_DoIP_Announce_Interval. Starting again
+ * while announcements are pending restarts the sequence.
+ */
+class VehicleAnnouncementScheduler {
+
+public:
+    VehicleAnnouncementScheduler(TimerWheel& wheel, AnnouncementSender sender);
+
+    VehicleAnnouncementScheduler(const VehicleAnnouncementScheduler&) = delete;
+    VehicleAnnouncementScheduler& operator=(const VehicleAnnouncementScheduler&) = delete;
+
+    void start();
+    void start(int waitMs);
+    void stop();
+
+    void setAnnounceNum(int num) { announceNum = num; };
+    void setAnnounceInterval(int intervalMs) { announceIntervalMs = intervalMs; };
+    int getAnnounceNum() const { return announceNum; };
+    int getAnnounceInterval() const { return announceIntervalMs; };
+    int getRemainingAnnouncements() const { return remainingAnnouncements; };
+
+private:
+    TimerWheel& timerWheel;
+    AnnouncementSender sender;
+    TimerEntry timerEntry;
+
+    std::atomic<int> announceNum{_DefaultAnnounceNum};
+    std::atomic<int> announceIntervalMs{_DefaultAnnounceIntervalMs};
+    std::atomic<int> remainingAnnouncements{0};
+
+    void announce();
+};
+
+#endif /* VEHICLEANNOUNCEMENTSCHEDULER_H */
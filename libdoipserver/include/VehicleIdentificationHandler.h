@@ -6,8 +6,12 @@
 
 
 unsigned char* createVehicleIdentificationResponse(std::string VIN,unsigned short LogicalAdress,unsigned char* EID,unsigned char* GID,unsigned char FurtherActionReq);
+int encodeVehicleIdentificationResponse(unsigned char* buffer, const std::string& VIN, unsigned short LogicalAdress,
+                                        unsigned char* EID, unsigned char* GID, unsigned char FurtherActionReq);
 
 const int _VIResponseLength = 32;
+const int _VIResponseVINOffset = 0;     //offsets relative to the payload
+const int _VIResponseEIDOffset = 19;
 
 #endif /* VEHICLEIDENTIFICATIONHANDLER_H */
 
@@ -0,0 +1,131 @@
+#include "AddressAdmissionPolicy.h"
+
+#include <atomic>
+
+/**
+ * Creates a policy which supports no activation type and admits no address
+ */
+AddressAdmissionPolicy::AddressAdmissionPolicy(): bitmaps(1) {
+    ruleIndex.fill(-1);
+}
+
+/**
+ * Creates the policy which is used until another one is set: testers in the
+ * range 0x0E00 to 0x0FFF with the default or the WWH-OBD activation type
+ */
+std::shared_ptr<const AddressAdmissionPolicy> AddressAdmissionPolicy::createDefault() {
+    std::shared_ptr<AddressAdmissionPolicy> policy = std::make_shared<AddressAdmissionPolicy>();
+    policy->supportActivationType(_DefaultActivationType);
+    policy->supportActivationType(_WwhObdActivationType);
+    policy->allowRange(_TesterAddressFirst, _TesterAddressLast);
+    return policy;
+}
+
+/**
+ * Accepts routing activation requests with this activation type, they use
+ * the common rules until rules for the activation type are added
+ */
+void AddressAdmissionPolicy::supportActivationType(unsigned char activationType) {
+    if(ruleIndex[activationType] < 0) {
+        ruleIndex[activationType] = 0;
+    }
+}
+
+/**
+ * Admits all addresses from first to last
+ * @param activationType    activation type the rule applies to or
+ *                          _AnyActivationType for the common rules
+ */
+void AddressAdmissionPolicy::allowRange(uint16_t first, uint16_t last, int activationType) {
+    setRange(first, last, activationType, true);
+}
+
+/**
+ * Rejects all addresses from first to last, e.g. to exclude single testers from an allowed range
+ * @param activationType    activation type the rule applies to or
+ *                          _AnyActivationType for the common rules
+ */
+void AddressAdmissionPolicy::blockRange(uint16_t first, uint16_t last, int activationType) {
+    setRange(first, last, activationType, false);
+}
+
+/**
+ * Checks if a tester may activate routing
+ * @param address           source address of the routing activation request
+ * @param activationType    activation type of the routing activation request
+ * @return                  true if the address is admitted for the activation type
+ */
+bool AddressAdmissionPolicy::isAllowed(uint16_t address, unsigned char activationType) const {
+    int index = ruleIndex[activationType];
+    if(index < 0) {
+        return false;
+    }
+    return bitmaps[index].test(address);
+}
+
+/**
+ * Checks if a tester may activate routing with any activation type
+ * @param address           source address of the routing activation request
+ * @return                  true if the address is admitted by any rule set
+ */
+bool AddressAdmissionPolicy::isKnown(uint16_t address) const {
+    for(const AddressBitmap& bitmap : bitmaps) {
+        if(bitmap.test(address)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The first rule for a specific activation type copies the common rules
+ * which exist at that time, so common rules should be added first.
+ * Such a rule also makes the activation type supported.
+ */
+void AddressAdmissionPolicy::setRange(uint16_t first, uint16_t last, int activationType, bool allowed) {
+    std::vector<AddressBitmap*> targets;
+
+    if(activationType == _AnyActivationType) {
+        //common rules also apply to activation types which copied them before
+        for(AddressBitmap& bitmap : bitmaps) {
+            targets.push_back(&bitmap);
+        }
+    } else {
+        int& index = ruleIndex[activationType & 0xFF];
+        if(index <= 0) {
+            bitmaps.push_back(bitmaps[0]);
+            index = bitmaps.size() - 1;
+        }
+        targets.push_back(&bitmaps[index]);
+    }
+
+    for(AddressBitmap* bitmap : targets) {
+        for(uint32_t address = first; address <= last; address++) {
+            bitmap->set(address, allowed);
+        }
+    }
+}
+
+static std::shared_ptr<const AddressAdmissionPolicy>& currentPolicy() {
+    static std::shared_ptr<const AddressAdmissionPolicy> policy = AddressAdmissionPolicy::createDefault();
+    return policy;
+}
+
+/**
+ * Returns the policy which is consulted for routing activation requests.
+ * The returned policy stays valid even if another one is set meanwhile.
+ */
+std::shared_ptr<const AddressAdmissionPolicy> getAddressAdmissionPolicy() {
+    return std::atomic_load(&currentPolicy());
+}
+
+/**
+ * Replaces the policy for all following routing activation requests,
+ * requests which are processed at the same time still use the old policy
+ */
+void setAddressAdmissionPolicy(std::shared_ptr<const AddressAdmissionPolicy> policy) {
+    if(!policy) {
+        policy = AddressAdmissionPolicy::createDefault();
+    }
+    std::atomic_store(&currentPolicy(), policy);
+}
@@ -0,0 +1,206 @@
+#include "DiagnosticExecutor.h"
+
+#include <algorithm>
+
+/**
+ * Starts the worker threads
+ * @param workerCount   number of workers, 0 uses one worker per cpu core
+ * @param queueDepth    maximum number of tasks which are submitted but not finished
+ */
+DiagnosticExecutor::DiagnosticExecutor(size_t workerCount, size_t queueDepth): queueDepth(queueDepth) {
+    if(workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for(size_t i = 0; i < workerCount; i++) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for(size_t i = 0; i < workerCount; i++) {
+        workers[i]->thread = std::thread(&DiagnosticExecutor::work, this, i);
+    }
+}
+
+/**
+ * Runs all submitted tasks and stops the workers
+ */
+DiagnosticExecutor::~DiagnosticExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    workAvailable.notify_all();
+
+    for(std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+
+    for(StrandShard& shard : shards) {
+        for(auto& entry : shard.strands) {
+            delete entry.second;
+        }
+    }
+}
+
+/**
+ * Queues a task behind all tasks which were submitted with the same key.
+ * Never blocks, so it may be called from the I/O thread.
+ * @param key       ordering key, see makeKey()
+ * @param task      function which is called on a worker thread
+ * @return          false if the queue depth is reached, the task is dropped
+ */
+bool DiagnosticExecutor::submit(uint64_t key, ExecutorTask task) {
+    if(!reserve()) {
+        return false;
+    }
+    submitReserved(key, std::move(task));
+    return true;
+}
+
+/**
+ * Reserves a place in the queue, e.g. before a message is acknowledged whose
+ * task is submitted afterwards. Every successful reservation has to be
+ * followed by submitReserved() or cancelReservation().
+ * @return          false if the queue depth is reached
+ */
+bool DiagnosticExecutor::reserve() {
+    if(pendingTasks.fetch_add(1) >= queueDepth) {
+        pendingTasks.fetch_sub(1);
+        rejectedTasks++;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Queues a task into a place which was reserved with reserve()
+ * @param key       ordering key, see makeKey()
+ * @param task      function which is called on a worker thread
+ */
+void DiagnosticExecutor::submitReserved(uint64_t key, ExecutorTask task) {
+    Strand* ready = nullptr;
+    {
+        StrandShard& shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Strand*& strand = shard.strands[key];
+        if(strand == nullptr) {
+            strand = new Strand;
+            strand->key = key;
+        }
+        strand->tasks.push_back(std::move(task));
+        if(!strand->scheduled) {
+            strand->scheduled = true;
+            ready = strand;
+        }
+    }
+
+    if(ready != nullptr) {
+        //spread the keys over the workers, the multiplier mixes the connection bits into the low bits
+        enqueue((key * 0x9E3779B97F4A7C15ULL >> 32) % workers.size(), ready);
+    }
+}
+
+/**
+ * Returns a place which was reserved with reserve() but is not used
+ */
+void DiagnosticExecutor::cancelReservation() {
+    if(pendingTasks.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        drained.notify_all();
+    }
+}
+
+/**
+ * Blocks until every submitted task has finished. Must not be called by a task.
+ */
+void DiagnosticExecutor::drain() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    drained.wait(lock, [this]() { return pendingTasks == 0; });
+}
+
+void DiagnosticExecutor::enqueue(size_t workerIndex, Strand* strand) {
+    {
+        std::lock_guard<std::mutex> lock(workers[workerIndex]->mutex);
+        workers[workerIndex]->runQueue.push_back(strand);
+        queuedStrands++;
+    }
+
+    //a worker checks queuedStrands with the sleep mutex locked, so the notification cannot get lost
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    workAvailable.notify_one();
+}
+
+/**
+ * Takes the oldest strand of the own queue or steals the newest strand of another worker
+ * @return      strand or nullptr if all queues are empty
+ */
+DiagnosticExecutor::Strand* DiagnosticExecutor::takeStrand(size_t workerIndex) {
+    for(size_t i = 0; i < workers.size(); i++) {
+        Worker& worker = *workers[(workerIndex + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(worker.runQueue.empty()) {
+            continue;
+        }
+
+        Strand* strand;
+        if(i == 0) {
+            strand = worker.runQueue.front();
+            worker.runQueue.pop_front();
+        } else {
+            strand = worker.runQueue.back();
+            worker.runQueue.pop_back();
+            stolenStrands++;
+        }
+        queuedStrands--;
+        return strand;
+    }
+    return nullptr;
+}
+
+/*
+ * Runs up to _StrandBatchSize tasks of a strand. A strand without tasks is
+ * deleted, otherwise it is queued again behind the other strands of the worker.
+ */
+void DiagnosticExecutor::runStrand(size_t workerIndex, Strand* strand) {
+    StrandShard& shard = shardOf(strand->key);
+
+    for(size_t i = 0; i < _StrandBatchSize; i++) {
+        ExecutorTask task;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if(strand->tasks.empty()) {
+                shard.strands.erase(strand->key);
+                delete strand;
+                return;
+            }
+            task = std::move(strand->tasks.front());
+            strand->tasks.pop_front();
+        }
+
+        task();
+
+        if(pendingTasks.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            drained.notify_all();
+        }
+    }
+
+    enqueue(workerIndex, strand);
+}
+
+void DiagnosticExecutor::work(size_t workerIndex) {
+    while(true) {
+        Strand* strand = takeStrand(workerIndex);
+        if(strand != nullptr) {
+            runStrand(workerIndex, strand);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if(queuedStrands == 0 && !running) {
+            return;
+        }
+        workAvailable.wait(lock, [this]() { return queuedStrands > 0 || !running; });
+    }
+}
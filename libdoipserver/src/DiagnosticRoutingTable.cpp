@@ -0,0 +1,143 @@
+#include "DiagnosticRoutingTable.h"
+
+#include <algorithm>
+#include <thread>
+#include "DoIPConnection.h"
+
+/**
+ * Sends the response of an ECU to the tester on the connection the request arrived on
+ * @param sourceAddress     logical address of the responding ECU, which differs from
+ *                          the target address of the request if it was functional
+ * @param data              user data of the response
+ * @param length            length of the user data
+ * @return                  number of bytes written, or -1 if the tester is disconnected
+ */
+int TesterRoute::sendResponse(unsigned short sourceAddress, const unsigned char* data, int length) const {
+    std::shared_ptr<DoIPConnection> tester = connection.lock();
+    if(!tester) {
+        return -1;
+    }
+
+    struct iovec payload = { const_cast<unsigned char*>(data), (size_t)length };
+    return tester->sendDiagnosticPayload(sourceAddress, &payload, 1);
+}
+
+DiagnosticRoutingTable::DiagnosticRoutingTable(): current(new Snapshot) {
+    readers[0] = 0;
+    readers[1] = 0;
+}
+
+/**
+ * No lookup may run while the table is destroyed
+ */
+DiagnosticRoutingTable::~DiagnosticRoutingTable() {
+    delete current.load();
+}
+
+/**
+ * Routes the diagnostic messages for a physical address to a handler,
+ * an existing route for the address is replaced
+ */
+void DiagnosticRoutingTable::addEcu(unsigned short address, std::shared_ptr<EcuHandler> handler) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    Snapshot* next = new Snapshot(*current.load());
+
+    auto position = std::lower_bound(next->physical.begin(), next->physical.end(), address,
+                                     [](const Route& route, unsigned short value) { return route.first < value; });
+    if(position != next->physical.end() && position->first == address) {
+        position->handler = handler;
+    } else {
+        next->physical.insert(position, Route{address, address, handler});
+    }
+    publish(next);
+}
+
+/**
+ * Routes the diagnostic messages for all addresses from first to last, which
+ * have no physical route, to a handler, e.g. the functional addresses of a
+ * group of ECUs. If ranges overlap, the first added range wins.
+ */
+void DiagnosticRoutingTable::addFunctionalRange(unsigned short first, unsigned short last, std::shared_ptr<EcuHandler> handler) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    Snapshot* next = new Snapshot(*current.load());
+    next->functional.push_back(Route{first, last, handler});
+    publish(next);
+}
+
+/**
+ * Removes the physical route of an address, afterwards messages for it are
+ * answered with a negative ack. A running lookup may still return the handler.
+ * @return      true if the address had a route
+ */
+bool DiagnosticRoutingTable::removeEcu(unsigned short address) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    Snapshot* next = new Snapshot(*current.load());
+
+    auto position = std::lower_bound(next->physical.begin(), next->physical.end(), address,
+                                     [](const Route& route, unsigned short value) { return route.first < value; });
+    if(position == next->physical.end() || position->first != address) {
+        delete next;
+        return false;
+    }
+    next->physical.erase(position);
+    publish(next);
+    return true;
+}
+
+/**
+ * Removes all routes
+ */
+void DiagnosticRoutingTable::clear() {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    publish(new Snapshot);
+}
+
+/**
+ * Finds the handler for the target address of a diagnostic message.
+ * A physical route has priority over functional ranges.
+ * @return      handler or nullptr if the target address is unknown
+ */
+std::shared_ptr<EcuHandler> DiagnosticRoutingTable::lookup(unsigned short targetAddress) const {
+    //announce the reader in the current epoch, publish() waits for it before deleting the snapshot
+    std::atomic<long>& counter = readers[epoch.load() & 1];
+    counter++;
+
+    const Snapshot* snapshot = current.load();
+    std::shared_ptr<EcuHandler> handler;
+
+    auto position = std::lower_bound(snapshot->physical.begin(), snapshot->physical.end(), targetAddress,
+                                     [](const Route& route, unsigned short value) { return route.first < value; });
+    if(position != snapshot->physical.end() && position->first == targetAddress) {
+        handler = position->handler;
+    } else {
+        for(const Route& route : snapshot->functional) {
+            if(targetAddress >= route.first && targetAddress <= route.last) {
+                handler = route.handler;
+                break;
+            }
+        }
+    }
+
+    counter--;
+    return handler;
+}
+
+/*
+ * Replaces the snapshot and deletes the old one once no lookup can read it.
+ * Every flip of the epoch sends new readers to the other counter, so waiting
+ * for each counter after a flip finishes although lookups never stop. A
+ * reader which increments a counter after the wait already sees the new
+ * snapshot. The writer mutex has to be locked.
+ */
+void DiagnosticRoutingTable::publish(Snapshot* next) {
+    const Snapshot* previous = current.exchange(next);
+
+    for(int flip = 0; flip < 2; flip++) {
+        uint64_t drainedEpoch = epoch.fetch_add(1);
+        while(readers[drainedEpoch & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    delete previous;
+}
@@ -1,23 +1,95 @@
 #include "DoIPConnection.h"
 
-#include <iostream>
-#include <iomanip>
+#include "DoIPLogger.h"
+#include "DoIPMetrics.h"
+#include "DoIPTracer.h"
+#include <errno.h>
+#include <poll.h>
+#include <algorithm>
+#include <chrono>
 
 /**
  * Closes the connection by closing the sockets
  */
 void DoIPConnection::aliveCheckTimeout() {
-    std::cout << "Alive Check Timeout. Close Connection" << std::endl;
+    DOIP_LOG_INFO("Alive Check Timeout. Close Connection");
+    DoIPMetrics::instance().recordAliveCheckTimeout();
     closeSocket();
-    close_connection();
+}
+
+/**
+ * Sets the timer wheel which drives the timers of this connection.
+ * By default the timers are driven by the shared timer service.
+ * @param wheel     wheel which expires the timers, e.g. of an event loop
+ */
+void DoIPConnection::setTimerWheel(TimerWheel& wheel) {
+    initialInactivityTimer.setTimerWheel(wheel);
+    generalInactivityTimer.setTimerWheel(wheel);
+    aliveCheckResponseTimer.setTimerWheel(wheel);
+}
+
+/**
+ * Starts the initial inactivity timer, which closes the connection if no
+ * routing activation succeeds in time (T_TCP_Initial_Inactivity).
+ * Setting the time to 0 stops the timer.
+ * @param milliseconds  time after which the connection will be closed
+ */
+void DoIPConnection::setInitialInactivityTime(uint32_t milliseconds) {
+    if(milliseconds > 0) {
+        initialInactivityTimer.cb = std::bind(&DoIPConnection::aliveCheckTimeout, this);
+        initialInactivityTimer.setTimerMilliseconds(milliseconds);
+        initialInactivityTimer.startTimer();
+    } else {
+        initialInactivityTimer.stopTimer();
+    }
+}
+
+/**
+ * Sends a alive check request to the client. The connection will be closed
+ * if the client does not respond within T_TCP_Alive_Check.
+ * @return      amount of bytes sended to the client
+ */
+int DoIPConnection::sendAliveCheckRequest() {
+    unsigned char message[_GenericHeaderLength];
+    encodeGenericHeader(message, PayloadType::ALIVECHECKREQUEST, 0);
+    int sendedBytes = sendMessage(message, _GenericHeaderLength);
+
+    if(sendedBytes == _GenericHeaderLength && !aliveCheckResponseTimer.active) {
+        aliveCheckResponseTimer.cb = std::bind(&DoIPConnection::aliveCheckTimeout, this);
+        aliveCheckResponseTimer.setTimerMilliseconds(_AliveCheckResponseTimeMs);
+        aliveCheckResponseTimer.startTimer();
+    }
+    return sendedBytes;
 }
 
 /*
- * Closes the socket for this server
+ * Closes the socket for this server and notifies the application
  */
 void DoIPConnection::closeSocket() {
-    close(tcpSocket);
-    tcpSocket = 0;
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if(tcpSocket == 0) {
+            return;
+        }
+
+        //wakes up a thread which is blocked in recv() on this socket
+        shutdown(tcpSocket, SHUT_RDWR);
+        if(closesSocket) {
+            close(tcpSocket);
+        }
+        tcpSocket = 0;
+
+        //a submitted send still uses the queued buffers, completeSend() releases them
+        if(!sendSubmitted) {
+            sendQueue.clear();
+        }
+        queuedBytes = 0;
+    }
+    sendSpace.notify_all();
+
+    if(close_connection) {
+        close_connection();
+    }
 }
 
 /*
@@ -26,31 +98,32 @@ void DoIPConnection::closeSocket() {
  *              or -1 if error occurred     
  */
 int DoIPConnection::receiveTcpMessage() {
-    std::cout << "Waiting for DoIP Header..." << std::endl;
+    DOIP_LOG_DEBUG("Waiting for DoIP Header...");
     unsigned char genericHeader[_GenericHeaderLength];
     unsigned int readBytes = receiveFixedNumberOfBytesFromTCP(_GenericHeaderLength, genericHeader);
-    if(readBytes == _GenericHeaderLength && !aliveCheckTimer.timeout) {
-        std::cout << "Received DoIP Header." << std::endl;
+    if(readBytes == _GenericHeaderLength && !generalInactivityTimer.timeout) {
+        DOIP_LOG_DEBUG("Received DoIP Header.");
         GenericHeaderAction doipHeaderAction = parseGenericHeader(genericHeader, _GenericHeaderLength);
 
-        unsigned char *payload = nullptr;
+        //the payload buffer returns to the pool when it goes out of scope
+        PooledBuffer payload;
         if(doipHeaderAction.payloadLength > 0) {
-            std::cout << "Waiting for " << doipHeaderAction.payloadLength << " bytes of payload..." << std::endl;
-            payload = new unsigned char[doipHeaderAction.payloadLength];
-            unsigned int receivedPayloadBytes = receiveFixedNumberOfBytesFromTCP(doipHeaderAction.payloadLength, payload);
+            DOIP_LOG_DEBUG("Waiting for %lu bytes of payload...", doipHeaderAction.payloadLength);
+            payload = bufferPool->acquire(doipHeaderAction.payloadLength);
+            unsigned int receivedPayloadBytes = receiveFixedNumberOfBytesFromTCP(doipHeaderAction.payloadLength, payload.data());
             if(receivedPayloadBytes != doipHeaderAction.payloadLength) {
                 closeSocket();
                 return 0;
             }
-            std::cout << "DoIP message completely received" << std::endl;
+            DOIP_LOG_DEBUG("DoIP message completely received");
         }
 
         //if alive check timouts should be possible, reset timer when message received
-        if(aliveCheckTimer.active) {
-            aliveCheckTimer.resetTimer();
+        if(generalInactivityTimer.active) {
+            generalInactivityTimer.resetTimer();
         }
 
-        int sentBytes = reactOnReceivedTcpMessage(doipHeaderAction, doipHeaderAction.payloadLength, payload);
+        int sentBytes = reactOnReceivedTcpMessage(doipHeaderAction, doipHeaderAction.payloadLength, payload.data());
         
         return sentBytes;
     } else {
@@ -61,6 +134,108 @@ int DoIPConnection::receiveTcpMessage() {
       
 }
 
+/*
+ * Reads all data which is currently available on a non-blocking socket and
+ * processes every completely received DoIP message. Incomplete messages are
+ * kept by the frame decoder until the next call, so this method never blocks.
+ * @return      number of processed messages
+ *              or -1 if the connection was closed
+ */
+int DoIPConnection::receiveAvailableTcpMessages() {
+    int processedMessages = 0;
+    unsigned char chunk[_ReceiveChunkSize];
+
+    while(isSocketActive()) {
+        ssize_t readBytes = DoIPTracer::isEnabled() ? receiveTraced(chunk, sizeof(chunk)) : recv(tcpSocket, chunk, sizeof(chunk), 0);
+        if(readBytes > 0) {
+            frameDecoder.feed(chunk, readBytes, [this, &processedMessages](const DoIPFrame& frame) {
+                processedMessages++;
+                return processReceivedFrame(frame);
+            });
+            continue;
+        }
+
+        if(readBytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if(readBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return processedMessages;
+        }
+
+        //client closed the connection or a socket error occurred
+        closeSocket();
+    }
+
+    return -1;
+}
+
+/**
+ * Processes data which a completion based transport received on the socket,
+ * e.g. the io_uring backend of the event loop
+ * @param data      received bytes, they are only used during the call
+ * @param length    number of received bytes, 0 if the client closed the
+ *                  connection or a socket error occurred
+ * @return          number of processed messages
+ *                  or -1 if the connection was closed
+ */
+int DoIPConnection::processReceivedData(unsigned char* data, size_t length) {
+    if(length == 0) {
+        closeSocket();
+        return -1;
+    }
+
+    int processedMessages = 0;
+    frameDecoder.feed(data, length, [this, &processedMessages](const DoIPFrame& frame) {
+        processedMessages++;
+        return processReceivedFrame(frame);
+    });
+    return isSocketActive() ? processedMessages : -1;
+}
+
+/*
+ * Reads from the socket like recv() and records the read as trace span. With
+ * kernel timestamps also the time the data waited in the socket is recorded.
+ */
+ssize_t DoIPConnection::receiveTraced(unsigned char* buffer, size_t length) {
+    struct iovec vector = { buffer, length };
+    char control[CMSG_SPACE(3 * sizeof(struct timespec))];
+    struct msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    uint64_t start = DoIPTracer::now();
+    ssize_t readBytes = recvmsg(tcpSocket, &message, 0);
+    if(readBytes <= 0) {
+        return readBytes;
+    }
+
+    DoIPTracer& tracer = DoIPTracer::instance();
+    uint64_t received;
+    if(DoIPTracer::getKernelReceiveTime(message, received) && received < start) {
+        tracer.record("socket queue", received, start, "socket", tcpSocket);
+    }
+    tracer.record("socket read", start, DoIPTracer::now(), "socket", tcpSocket);
+    return readBytes;
+}
+
+/*
+ * Processes a DoIP message or a validation error from the frame decoder
+ * @param frame     decoded message
+ * @return          true if the connection is still active
+ */
+bool DoIPConnection::processReceivedFrame(const DoIPFrame& frame) {
+    //if alive check timouts should be possible, reset timer when message received
+    if(generalInactivityTimer.active) {
+        generalInactivityTimer.resetTimer();
+    }
+
+    reactOnReceivedTcpMessage(frame.action, frame.action.payloadLength, frame.payload);
+    return isSocketActive();
+}
+
 /**
  * Receive exactly payloadLength bytes from the TCP stream and put them into receivedData.
  * The method blocks until receivedData bytes are received or the socket is closed.
@@ -93,89 +268,470 @@ unsigned long DoIPConnection::receiveFixedNumberOfBytesFromTCP(unsigned long pay
  */
 int DoIPConnection::reactOnReceivedTcpMessage(GenericHeaderAction action, unsigned long payloadLength, unsigned char *payload) {
 
-    std::cout << "processing DoIP message..." << std::endl;
-    int sentBytes;
-    switch(action.type) {
-        case PayloadType::NEGATIVEACK: {
-            //send NACK
-            sentBytes = sendNegativeAck(action.value);
+    //handlers indexed by payload type, types which are not expected from a tester have none
+    static constexpr TcpHandlerEntry handlers[] = {
+        { PayloadType::NEGATIVEACK,                 &DoIPConnection::handleNegativeAck },
+        { PayloadType::ROUTINGACTIVATIONREQUEST,    &DoIPConnection::handleRoutingActivationRequest },
+        { PayloadType::ROUTINGACTIVATIONRESPONSE,   nullptr },
+        { PayloadType::VEHICLEIDENTREQUEST,         nullptr },
+        { PayloadType::VEHICLEIDENTRESPONSE,        nullptr },
+        { PayloadType::DIAGNOSTICMESSAGE,           &DoIPConnection::handleDiagnosticMessage },
+        { PayloadType::DIAGNOSTICPOSITIVEACK,       nullptr },
+        { PayloadType::DIAGNOSTICNEGATIVEACK,       nullptr },
+        { PayloadType::ALIVECHECKRESPONSE,          &DoIPConnection::handleAliveCheckResponse },
+        { PayloadType::ALIVECHECKREQUEST,           nullptr },
+        { PayloadType::VEHICLEIDENTREQUESTEID,      nullptr },
+        { PayloadType::VEHICLEIDENTREQUESTVIN,      nullptr },
+        { PayloadType::ENTITYSTATUSREQUEST,         nullptr },
+        { PayloadType::ENTITYSTATUSRESPONSE,        nullptr },
+        { PayloadType::POWERMODEREQUEST,            nullptr },
+        { PayloadType::POWERMODERESPONSE,           nullptr },
+        { PayloadType::GENERICNACK,                 &DoIPConnection::handleGenericNack },
+        { PayloadType::OEMSPECIFIC,                 &DoIPConnection::handleOemMessage },
+    };
+    static_assert(isPayloadTypeTable(handlers), "every payload type needs a handler slot, in the order of the enum");
+
+    DOIP_LOG_DEBUG("processing DoIP message...");
+    action.payloadLength = payloadLength;
+    if(action.type != PayloadType::NEGATIVEACK) {
+        DoIPMetrics::instance().recordMessageIn(action.type, _GenericHeaderLength + payloadLength);
+    }
+    TcpMessageHandler handler = handlers[action.type].handler;
+    if(handler == nullptr) {
+        DOIP_LOG_WARNING("Received message with unhandled payload type: 0x%04X", action.payloadTypeCode);
+        return -1;
+    }
+    return (this->*handler)(action, payload);
+}
 
-            if(action.value == _IncorrectPatternFormatCode || 
-                    action.value == _InvalidPayloadLengthCode) {
-                closeSocket();
-                return -1;
-            }
+int DoIPConnection::handleNegativeAck(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)payload;
 
-            return sentBytes;
-        }
+    //send NACK
+    int sentBytes = sendNegativeAck(action.value);
 
-        case PayloadType::ROUTINGACTIVATIONREQUEST: {
-            //start routing activation handler with the received message
-            unsigned char result = parseRoutingActivation(payload);
-            unsigned char clientAddress [2] = {payload[0], payload[1]};
+    if(action.value == _IncorrectPatternFormatCode || 
+            action.value == _InvalidPayloadLengthCode) {
+        closeSocket();
+        return -1;
+    }
 
-            unsigned char* message = createRoutingActivationResponse(logicalGatewayAddress, clientAddress, result);
-            sentBytes = sendMessage(message, _GenericHeaderLength + _ActivationResponseLength);
+    return sentBytes;
+}
 
-            if(result == _UnknownSourceAddressCode || result == _UnsupportedRoutingTypeCode) {
-                closeSocket();
-                return -1;
-            } else {
-                //Routing Activation Request was successfull, save address of the client
-                routedClientAddress = new unsigned char[2];
-                routedClientAddress[0] = payload[0];
-                routedClientAddress[1] = payload[1];
-
-                //start alive check timer
-                if(!aliveCheckTimer.active) {
-                    aliveCheckTimer.cb = std::bind(&DoIPConnection::aliveCheckTimeout,this);
-                    aliveCheckTimer.startTimer();
-                }
-            }
+/*
+ * A NACK of the tester is only logged, it must not be answered with another NACK
+ */
+int DoIPConnection::handleGenericNack(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
+    DOIP_LOG_WARNING("Received generic header negative ack with code: 0x%02X", payload[0]);
+    return 0;
+}
 
-            return sentBytes;
-        }
+int DoIPConnection::handleRoutingActivationRequest(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
 
-        case PayloadType::ALIVECHECKRESPONSE: {
-            return 0;
-        }
+    //start routing activation handler with the received message
+    unsigned char result = parseRoutingActivation(payload);
+    unsigned char clientAddress [2] = {payload[0], payload[1]};
 
-        case PayloadType::DIAGNOSTICMESSAGE: {
+    unsigned char message[_GenericHeaderLength + _ActivationResponseLength];
+    int messageLength = encodeRoutingActivationResponse(message, logicalGatewayAddress, clientAddress, result);
+    int sentBytes = sendMessage(message, messageLength);
+    DoIPMetrics::instance().recordRoutingActivation(result);
 
-            unsigned short target_address = 0;
-            target_address |= ((unsigned short)payload[2]) << 8U;
-            target_address |= (unsigned short)payload[3];
-            bool ack = notify_application(target_address);
+    if(result == _UnknownSourceAddressCode || result == _UnsupportedRoutingTypeCode) {
+        closeSocket();
+        return -1;
+    } else {
+        //Routing Activation Request was successfull, save address of the client
+        routedClientAddress[0] = payload[0];
+        routedClientAddress[1] = payload[1];
 
-            if(ack)
-                parseDiagnosticMessage(diag_callback, routedClientAddress, payload, payloadLength);
+        initialInactivityTimer.stopTimer();
 
-            break;
+        //start alive check timer
+        if(!generalInactivityTimer.active) {
+            generalInactivityTimer.cb = std::bind(&DoIPConnection::aliveCheckTimeout,this);
+            generalInactivityTimer.startTimer();
         }
+    }
+
+    return sentBytes;
+}
+
+int DoIPConnection::handleAliveCheckResponse(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
+    (void)payload;
+
+    aliveCheckResponseTimer.stopTimer();
+    return 0;
+}
+
+int DoIPConnection::handleDiagnosticMessage(const GenericHeaderAction& action, unsigned char* payload) {
+
+    unsigned short target_address = 0;
+    target_address |= ((unsigned short)payload[2]) << 8U;
+    target_address |= (unsigned short)payload[3];
+    bool ack;
+    {
+        TraceSpan span("DiagnosticMessageNotification", "target", target_address);
+        ack = notify_application(target_address);
+    }
+    if(!ack) {
+        return -1;
+    }
+
+    //the view callback gets the user data without copying it
+    TraceSpan span("DiagnosticCallback", "target", target_address);
+    if(diag_view_callback)
+        parseDiagnosticMessage(diag_view_callback, routedClientAddress, payload, action.payloadLength, *bufferPool);
+    else
+        parseDiagnosticMessage(diag_callback, routedClientAddress, payload, action.payloadLength, *bufferPool);
 
-        default: {
-            std::cerr << "Received message with unhandled payload type: " << action.type << std::endl;
-            return -1;
-        }
-    }  
     return -1;
 }
 
+int DoIPConnection::handleOemMessage(const GenericHeaderAction& action, unsigned char* payload) {
+    if(oem_callback) {
+        oem_callback(action.payloadTypeCode, payload, action.payloadLength);
+    }
+    return 0;
+}
+
 void DoIPConnection::triggerDisconnection() {
-    std::cout << "Application requested to disconnect Client from Server" << std::endl;
+    DOIP_LOG_INFO("Application requested to disconnect Client from Server");
     closeSocket();
 }
 
 /**
- * Sends a message back to the connected client
+ * Sends a message back to the connected client. What does not fit into the
+ * socket buffer is queued, so the caller never waits for a slow tester unless
+ * the overflow policy says so.
  * @param message           contains generic header and payload specific content
  * @param messageLength     length of the complete message
- * @return                  number of bytes written is returned,
- *                          or -1 if error occurred
+ * @return                  length of the message, or -1 if it was dropped
+ *                          or error occurred
  */
 int DoIPConnection::sendMessage(unsigned char* message, int messageLength) {
-    int result = write(tcpSocket, message, messageLength);
-    return result;
+    struct iovec vector = { message, (size_t)messageLength };
+    std::unique_lock<std::mutex> lock(sendMutex);
+    return queueMessage(lock, &vector, 1);
+}
+
+/*
+ * Writes as much of a message as the socket takes without blocking and
+ * queues the rest behind the already queued messages. The send mutex has
+ * to be locked, it is unlocked before the application is notified.
+ * @return      length of the message, or -1 if it was dropped or the connection is closed
+ */
+int DoIPConnection::queueMessage(std::unique_lock<std::mutex>& lock, struct iovec* vectors, int count) {
+    if(tcpSocket == 0) {
+        return -1;
+    }
+    TraceSpan span("response write", "socket", tcpSocket);
+
+    size_t length = 0;
+    for(int i = 0; i < count; i++) {
+        length += vectors[i].iov_len;
+    }
+    //the vectors are advanced while they are sent, the header is kept for the metrics
+    unsigned char header[4];
+    memcpy(header, vectors[0].iov_base, sizeof(header));
+
+    if(send_submit_callback) {
+        return queueForSubmission(lock, vectors, count, length, header);
+    }
+
+    //the queue keeps the order, new messages may only be written directly if it is empty
+    size_t sentBytes = 0;
+    if(sendQueue.empty()) {
+        ssize_t result = sendVectors(tcpSocket, vectors, count, 0);
+        if(result < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        sentBytes = result > 0 ? result : 0;
+        if(sentBytes == length) {
+            DoIPMetrics::instance().recordEncodedMessageOut(header, length);
+            return length;
+        }
+    }
+
+    //a partially sent message has to be completed, otherwise the tester loses the framing
+    size_t remaining = length - sentBytes;
+    if(sentBytes == 0 && queuedBytes > 0 && queuedBytes + remaining > sendQueueLimits.limit) {
+        if(sendQueueLimits.overflowPolicy == OVERFLOWDISCONNECT) {
+            DOIP_LOG_WARNING("Send queue of the connection is full, closing it");
+            lock.unlock();
+            closeSocket();
+            return -1;
+        }
+        if(sendQueueLimits.overflowPolicy == OVERFLOWDROP || !waitForQueueSpace(lock, remaining)) {
+            droppedMessages++;
+            DOIP_LOG_WARNING("Send queue of the connection is full, dropped a message");
+            return -1;
+        }
+        if(sendQueue.empty()) {
+            //the wait flushed everything, write directly again
+            ssize_t result = sendVectors(tcpSocket, vectors, count, 0);
+            sentBytes = result > 0 ? result : 0;
+            remaining = length - sentBytes;
+            if(remaining == 0) {
+                DoIPMetrics::instance().recordEncodedMessageOut(header, length);
+                return length;
+            }
+        }
+    }
+
+    PooledBuffer buffer = bufferPool->acquire(remaining);
+    size_t offset = 0;
+    for(int i = 0; i < count; i++) {
+        memcpy(buffer.data() + offset, vectors[i].iov_base, vectors[i].iov_len);
+        offset += vectors[i].iov_len;
+    }
+    sendQueue.push_back(QueuedMessage{std::move(buffer), 0});
+    queuedBytes += remaining;
+    DoIPMetrics::instance().recordEncodedMessageOut(header, length);
+
+    bool throttle = !throttled && queuedBytes >= sendQueueLimits.highWaterMark;
+    if(throttle) {
+        throttled = true;
+    }
+    lock.unlock();
+
+    if(throttle && backpressure_callback) {
+        backpressure_callback(true);
+    }
+    return length;
+}
+
+/*
+ * Queues a whole message for a transport which writes the socket itself. The
+ * send submit callback is called if no send is in flight, the transport then
+ * takes the queue with collectSendVectors(). The send mutex has to be locked,
+ * it is unlocked before the callbacks are called.
+ * @return      length of the message, or -1 if it was dropped or the connection is closed
+ */
+int DoIPConnection::queueForSubmission(std::unique_lock<std::mutex>& lock, struct iovec* vectors, int count, size_t length, const unsigned char* header) {
+    if(queuedBytes > 0 && queuedBytes + length > sendQueueLimits.limit) {
+        if(sendQueueLimits.overflowPolicy == OVERFLOWDISCONNECT) {
+            DOIP_LOG_WARNING("Send queue of the connection is full, closing it");
+            lock.unlock();
+            closeSocket();
+            return -1;
+        }
+        if(sendQueueLimits.overflowPolicy == OVERFLOWDROP || !waitForQueueSpace(lock, length)) {
+            droppedMessages++;
+            DOIP_LOG_WARNING("Send queue of the connection is full, dropped a message");
+            return -1;
+        }
+    }
+
+    PooledBuffer buffer = bufferPool->acquire(length);
+    size_t offset = 0;
+    for(int i = 0; i < count; i++) {
+        memcpy(buffer.data() + offset, vectors[i].iov_base, vectors[i].iov_len);
+        offset += vectors[i].iov_len;
+    }
+    sendQueue.push_back(QueuedMessage{std::move(buffer), 0});
+    queuedBytes += length;
+    DoIPMetrics::instance().recordEncodedMessageOut(header, length);
+
+    bool submit = !sendSubmitted;
+    sendSubmitted = true;
+    bool throttle = !throttled && queuedBytes >= sendQueueLimits.highWaterMark;
+    if(throttle) {
+        throttled = true;
+    }
+    lock.unlock();
+
+    if(submit) {
+        send_submit_callback();
+    }
+    if(throttle && backpressure_callback) {
+        backpressure_callback(true);
+    }
+    return length;
+}
+
+/*
+ * Writes queued bytes until the queue is empty or the socket buffer is full.
+ * With edge-triggered events the socket is only reported writable again
+ * after it was full, so the queue must not be left with data while there
+ * is space. The send mutex has to be locked.
+ * @return      number of written bytes, or -1 if the socket failed
+ */
+ssize_t DoIPConnection::writeSendQueue() {
+    struct iovec vectors[_MaxFlushVectors];
+    ssize_t written = 0;
+
+    while(!sendQueue.empty()) {
+        int count = 0;
+        size_t length = 0;
+        for(auto it = sendQueue.begin(); it != sendQueue.end() && count < _MaxFlushVectors; ++it, ++count) {
+            vectors[count].iov_base = it->buffer.data() + it->offset;
+            vectors[count].iov_len = it->buffer.size() - it->offset;
+            length += vectors[count].iov_len;
+        }
+
+        ssize_t result = sendVectors(tcpSocket, vectors, count, 0);
+        if(result < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return written > 0 ? written : -1;
+        }
+
+        consumeSendQueue(result);
+        written += result;
+        if((size_t)result < length) {
+            //the socket buffer is full
+            break;
+        }
+    }
+    return written;
+}
+
+/*
+ * Removes written bytes from the front of the queue. The send mutex has to be locked.
+ */
+void DoIPConnection::consumeSendQueue(size_t written) {
+    queuedBytes -= std::min(written, queuedBytes);
+    while(written > 0 && !sendQueue.empty()) {
+        QueuedMessage& front = sendQueue.front();
+        size_t frontLength = front.buffer.size() - front.offset;
+        if(written < frontLength) {
+            front.offset += written;
+            break;
+        }
+        written -= frontLength;
+        sendQueue.pop_front();
+    }
+}
+
+/*
+ * Waits till the tester read enough, so a message of the given length fits
+ * into the send queue. The send mutex has to be locked.
+ * @return      false if the queue is still too full after _SendTimeoutMs
+ */
+bool DoIPConnection::waitForQueueSpace(std::unique_lock<std::mutex>& lock, size_t length) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_SendTimeoutMs);
+
+    //the transport writes the queue, completeSend() signals the space
+    if(send_submit_callback) {
+        return sendSpace.wait_until(lock, deadline, [this, length]() {
+            return tcpSocket == 0 || queuedBytes == 0 || queuedBytes + length <= sendQueueLimits.limit;
+        }) && tcpSocket != 0;
+    }
+
+    while(queuedBytes > 0 && queuedBytes + length > sendQueueLimits.limit) {
+        int timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd writable = { tcpSocket, POLLOUT, 0 };
+        if(timeoutMs <= 0 || poll(&writable, 1, timeoutMs) <= 0 || writeSendQueue() < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Sends queued messages, the event loop calls it when the socket is writable again
+ * @return      number of written bytes, or -1 if the socket failed
+ */
+int DoIPConnection::flushSendQueue() {
+    std::unique_lock<std::mutex> lock(sendMutex);
+    if(tcpSocket == 0 || sendQueue.empty()) {
+        return 0;
+    }
+
+    ssize_t written;
+    {
+        TraceSpan span("send queue flush", "socket", tcpSocket);
+        written = writeSendQueue();
+    }
+
+    bool resume = throttled && queuedBytes <= sendQueueLimits.lowWaterMark;
+    if(resume) {
+        throttled = false;
+    }
+    lock.unlock();
+
+    if(resume && backpressure_callback) {
+        backpressure_callback(false);
+    }
+    return written;
+}
+
+/**
+ * Returns the queued messages to a transport which writes the socket itself.
+ * They stay queued until completeSend() reports how much was written, no
+ * other send may be in flight meanwhile.
+ * @param vectors       filled with the queued data
+ * @param maxCount      maximum number of vectors
+ * @return              number of vectors, 0 if nothing has to be sent
+ */
+int DoIPConnection::collectSendVectors(struct iovec* vectors, int maxCount) {
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if(tcpSocket == 0 || sendQueue.empty()) {
+        sendSubmitted = false;
+        if(tcpSocket == 0) {
+            sendQueue.clear();
+        }
+        return 0;
+    }
+
+    int count = 0;
+    for(auto it = sendQueue.begin(); it != sendQueue.end() && count < maxCount; ++it, ++count) {
+        vectors[count].iov_base = it->buffer.data() + it->offset;
+        vectors[count].iov_len = it->buffer.size() - it->offset;
+    }
+    sendSubmitted = true;
+    return count;
+}
+
+/**
+ * Removes what a send of the transport wrote from the queue
+ * @param result    number of written bytes or a negative errno
+ * @return          true if messages are still queued, they have to be
+ *                  collected and sent next
+ */
+bool DoIPConnection::completeSend(int result) {
+    std::unique_lock<std::mutex> lock(sendMutex);
+    if(tcpSocket == 0) {
+        sendQueue.clear();
+        sendSubmitted = false;
+        return false;
+    }
+    if(result < 0) {
+        sendSubmitted = false;
+        lock.unlock();
+        DOIP_LOG_WARNING("Sending to the tester failed: %s", strerror(-result));
+        closeSocket();
+        return false;
+    }
+
+    consumeSendQueue(result);
+    bool more = !sendQueue.empty();
+    sendSubmitted = more;
+    bool resume = throttled && queuedBytes <= sendQueueLimits.lowWaterMark;
+    if(resume) {
+        throttled = false;
+    }
+    lock.unlock();
+    sendSpace.notify_all();
+
+    if(resume && backpressure_callback) {
+        backpressure_callback(false);
+    }
+    return more;
+}
+
+/**
+ * Returns the number of bytes which wait for the socket to become writable
+ */
+size_t DoIPConnection::getQueuedBytes() {
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return queuedBytes;
 }
 
 /**
@@ -185,9 +741,9 @@ int DoIPConnection::sendMessage(unsigned char* message, int messageLength) {
  */
 void DoIPConnection::setGeneralInactivityTime(uint16_t seconds) {
     if(seconds > 0) {
-        aliveCheckTimer.setTimer(seconds);
+        generalInactivityTimer.setTimer(seconds);
     } else {
-        aliveCheckTimer.disabled = true;
+        generalInactivityTimer.disabled = true;
     }
 }
 
@@ -198,20 +754,48 @@ void DoIPConnection::setGeneralInactivityTime(uint16_t seconds) {
  * @param length    length of received payload
  */
 void DoIPConnection::sendDiagnosticPayload(unsigned short sourceAddress, unsigned char* data, int length) {
+    struct iovec payload = { data, (size_t)length };
+    sendDiagnosticPayload(sourceAddress, &payload, 1);
+}
 
-    std::cout << "Sending diagnostic data: ";
-    for(int i = 0; i < length; i++) {
-        std::cout << std::hex << std::setw(2) << (unsigned int)data[i] << " ";
+/*
+ * Sends a diagnostic message whose user data is scattered over several buffers.
+ * Only the header is built in a local buffer, the user data is only copied
+ * if the socket buffer is full and the rest of the message has to be queued.
+ * @param sourceAddress     logical address of the ecu which sends the data
+ * @param payload           buffers which form the user data in order
+ * @param count             number of buffers
+ * @return                  length of the message, or -1 if it was dropped
+ *                          or error occurred
+ */
+int DoIPConnection::sendDiagnosticPayload(unsigned short sourceAddress, const struct iovec* payload, int count) {
+
+    int length = 0;
+    for(int i = 0; i < count; i++) {
+        DOIP_LOG_HEX("Sending diagnostic data", static_cast<const unsigned char*>(payload[i].iov_base), payload[i].iov_len);
+        length += payload[i].iov_len;
     }
-    std::cout << std::endl;
-    
-    unsigned char* message = createDiagnosticMessage(sourceAddress, routedClientAddress, data, length);  
-    sendMessage(message, _GenericHeaderLength + _DiagnosticMessageMinimumLength + length);
+
+    unsigned char header[_GenericHeaderLength + _DiagnosticMessageMinimumLength];
+    int headerLength = encodeDiagnosticMessageHeader(header, sourceAddress, routedClientAddress, length);
+
+    std::unique_lock<std::mutex> lock(sendMutex);
+
+    //the vector list only grows, so sending does not allocate once it fits the largest message
+    if(sendVectorList.size() < (size_t)count + 1) {
+        sendVectorList.resize(count + 1);
+    }
+    sendVectorList[0].iov_base = header;
+    sendVectorList[0].iov_len = headerLength;
+    std::copy(payload, payload + count, sendVectorList.begin() + 1);
+
+    return queueMessage(lock, sendVectorList.data(), count + 1);
 }
 
 /*
  * Set the callback function for this doip server instance
- * @dc      Callback which sends the data of a diagnostic message to the application
+ * @dc      Callback which sends the data of a diagnostic message to the application,
+ *          the data is only valid until the callback returns
  * @dmn     Callback which notifies the application of receiving a diagnostic message
  * @ccb     Callback for application function when the library closes the connection
  */
@@ -224,8 +808,12 @@ void DoIPConnection::setCallback(DiagnosticCallback dc, DiagnosticMessageNotific
 void DoIPConnection::sendDiagnosticAck(unsigned short sourceAddress, bool ackType, unsigned char ackCode) {
     unsigned char data_TA [2] = { routedClientAddress[0], routedClientAddress[1] };
     
-    unsigned char* message = createDiagnosticACK(ackType, sourceAddress, data_TA, ackCode);
-    sendMessage(message, _GenericHeaderLength + _DiagnosticPositiveACKLength);
+    unsigned char message[_GenericHeaderLength + _DiagnosticPositiveACKLength];
+    int messageLength = encodeDiagnosticACK(message, ackType, sourceAddress, data_TA, ackCode);
+    sendMessage(message, messageLength);
+    if(!ackType) {
+        DoIPMetrics::instance().recordDiagnosticNack(ackCode);
+    }
 }
 
 /**
@@ -234,8 +822,9 @@ void DoIPConnection::sendDiagnosticAck(unsigned short sourceAddress, bool ackTyp
  * @return              amount of bytes sended to the client
  */
 int DoIPConnection::sendNegativeAck(unsigned char ackCode) {
-    unsigned char* message = createGenericHeader(PayloadType::NEGATIVEACK, _NACKLength);
-    message[8] = ackCode;
-    int sendedBytes = sendMessage(message, _GenericHeaderLength + _NACKLength);
+    unsigned char message[_GenericHeaderLength + _NACKLength];
+    int messageLength = encodeNegativeAck(message, ackCode);
+    int sendedBytes = sendMessage(message, messageLength);
+    DoIPMetrics::instance().recordGenericNack(ackCode);
     return sendedBytes;
 }
@@ -0,0 +1,541 @@
+#include "DoIPEventLoop.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "DoIPLogger.h"
+
+//user_data of io_uring requests which are no registrations, registrations and sends are aligned pointers
+const uint64_t _UringWakeupRequest = 0;
+const uint64_t _UringIgnoredRequest = 2;
+const uint64_t _UringSendRequestTag = 1;
+
+DoIPEventLoop::DoIPEventLoop(): running(false), loopThread(std::thread::id()) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(epollFd < 0 || wakeupFd < 0) {
+        DOIP_LOG_ERROR("Error setting up the event loop");
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;   //nullptr marks the internal wakeup descriptor
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
+
+    //timers armed from other threads may expire before the loop would wake up
+    timerWheel.setWakeupCallback(std::bind(&DoIPEventLoop::wakeup, this));
+}
+
+DoIPEventLoop::~DoIPEventLoop() {
+    for(auto& entry : registrations) {
+        delete entry.second;
+    }
+    for(Registration* registration : cancelledRegistrations) {
+        delete registration;
+    }
+    for(SendRequest* request : pendingSends) {
+        delete request;
+    }
+    releaseRetiredRegistrations();
+    close(wakeupFd);
+    close(epollFd);
+}
+
+/**
+ * Selects how the event loop waits for its descriptors. It has to be called
+ * before any descriptor is registered. The epoll backend stays selected if
+ * the kernel does not support io_uring.
+ * @param backend   EPOLLBACKEND or IOURINGBACKEND
+ * @return          true if the backend is used
+ */
+bool DoIPEventLoop::setBackend(EventLoopBackend backend) {
+    if(backend == this->backend) {
+        return true;
+    }
+    if(!registrations.empty()) {
+        DOIP_LOG_ERROR("The event loop backend can only be changed before descriptors are registered");
+        return false;
+    }
+    if(backend == EPOLLBACKEND) {
+        DOIP_LOG_ERROR("The io_uring backend can not be switched back to epoll");
+        return false;
+    }
+
+    if(!IoUring::isSupported() || !ring.setup() ||
+       !ring.setupBufferRing(_UringReceiveBufferGroup, _UringReceiveBuffers, _UringReceiveBufferSize)) {
+        DOIP_LOG_WARNING("io_uring is not supported, the event loop uses epoll");
+        return false;
+    }
+
+    this->backend = IOURINGBACKEND;
+    armWakeup();
+    return true;
+}
+
+/**
+ * Registers a descriptor in the event loop. The descriptor is always watched
+ * edge-triggered, so the handler has to consume all available data. The
+ * io_uring backend watches level-triggered, which allows the same handlers.
+ * @param fd        descriptor which will be watched
+ * @param events    epoll events of interest (EPOLLIN, EPOLLOUT, ...)
+ * @param handler   function which is called with the occurred events
+ * @return          true if the descriptor was registered
+ */
+bool DoIPEventLoop::addDescriptor(int fd, uint32_t events, EventHandler handler) {
+    //a stale registration remains if the descriptor was closed without removal
+    removeDescriptor(fd);
+
+    Registration* registration = new Registration{fd, handler, true, POLLREQUEST, events & ~EPOLLET, nullptr, nullptr, false};
+
+    if(backend == IOURINGBACKEND) {
+        armRegistration(registration);
+        registrations[fd] = registration;
+        return true;
+    }
+
+    struct epoll_event event;
+    event.events = events | EPOLLET;
+    event.data.ptr = registration;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        delete registration;
+        return false;
+    }
+
+    registrations[fd] = registration;
+    return true;
+}
+
+/**
+ * Changes the events of interest for an already registered descriptor
+ * @param fd        registered descriptor
+ * @param events    new epoll events of interest
+ * @return          true if the events were changed
+ */
+bool DoIPEventLoop::modifyDescriptor(int fd, uint32_t events) {
+    auto it = registrations.find(fd);
+    if(it == registrations.end()) {
+        return false;
+    }
+
+    if(backend == IOURINGBACKEND) {
+        if(it->second->kind != POLLREQUEST) {
+            return false;
+        }
+        EventHandler handler = it->second->handler;
+        return addDescriptor(fd, events, handler);
+    }
+
+    struct epoll_event event;
+    event.events = events | EPOLLET;
+    event.data.ptr = it->second;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+/**
+ * Removes a descriptor from the event loop. Pending events of the current
+ * poll round are discarded, the descriptor itself is not closed.
+ * @param fd    registered descriptor
+ */
+void DoIPEventLoop::removeDescriptor(int fd) {
+    auto it = registrations.find(fd);
+    if(it == registrations.end()) {
+        return;
+    }
+
+    Registration* registration = it->second;
+    registration->active = false;
+    registrations.erase(it);
+
+    if(backend == IOURINGBACKEND) {
+        if(!registration->armed) {
+            retiredRegistrations.push_back(registration);
+            return;
+        }
+
+        //the registration is released with the last completion of its request
+        struct io_uring_sqe* submission = nextSubmission();
+        submission->opcode = IORING_OP_ASYNC_CANCEL;
+        submission->fd = -1;
+        submission->addr = (uint64_t)(uintptr_t)registration;
+        submission->user_data = _UringIgnoredRequest;
+        cancelledRegistrations.insert(registration);
+        return;
+    }
+
+    //fails with EBADF if the descriptor is already closed, which is fine
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    retiredRegistrations.push_back(registration);
+}
+
+/**
+ * Accepts connections on a listening socket with a multishot accept request,
+ * only available with the io_uring backend. The socket is removed with
+ * removeDescriptor().
+ * @param fd        listening socket
+ * @param handler   function which is called with every accepted socket, the
+ *                  sockets are non-blocking
+ * @return          true if the request was submitted
+ */
+bool DoIPEventLoop::acceptConnections(int fd, AcceptHandler handler) {
+    if(backend != IOURINGBACKEND) {
+        return false;
+    }
+    removeDescriptor(fd);
+
+    Registration* registration = new Registration{fd, nullptr, true, ACCEPTREQUEST, 0, handler, nullptr, false};
+    armRegistration(registration);
+    registrations[fd] = registration;
+    return true;
+}
+
+/**
+ * Receives from a stream socket with a multishot receive request into the
+ * buffers of the ring, only available with the io_uring backend. The socket
+ * is removed with removeDescriptor().
+ * @param fd        connected socket
+ * @param handler   function which is called with the received data, the
+ *                  buffer is reused after the call. A length of 0 reports
+ *                  that the peer closed the connection or an error occurred.
+ * @return          true if the request was submitted
+ */
+bool DoIPEventLoop::receiveStream(int fd, ReceiveHandler handler) {
+    if(backend != IOURINGBACKEND) {
+        return false;
+    }
+    removeDescriptor(fd);
+
+    Registration* registration = new Registration{fd, nullptr, true, RECEIVEREQUEST, 0, nullptr, handler, false};
+    armRegistration(registration);
+    registrations[fd] = registration;
+    return true;
+}
+
+/**
+ * Sends the vectors with one sendmsg request, only available with the io_uring
+ * backend. The vectors are copied, the data they point to has to stay valid
+ * until the completion is called.
+ * @param fd            connected socket
+ * @param vectors       data to send
+ * @param count         number of vectors
+ * @param completion    function which is called on the loop thread with the
+ *                      number of sent bytes or a negative errno
+ * @return              true if the request was submitted
+ */
+bool DoIPEventLoop::sendStream(int fd, const struct iovec* vectors, int count, SendCompletion completion) {
+    if(backend != IOURINGBACKEND) {
+        return false;
+    }
+
+    SendRequest* request = new SendRequest();
+    request->vectors.assign(vectors, vectors + count);
+    memset(&request->message, 0, sizeof(request->message));
+    request->message.msg_iov = request->vectors.data();
+    request->message.msg_iovlen = count;
+    request->completion = completion;
+    pendingSends.insert(request);
+
+    struct io_uring_sqe* submission = nextSubmission();
+    submission->opcode = IORING_OP_SENDMSG;
+    submission->fd = fd;
+    submission->addr = (uint64_t)(uintptr_t)&request->message;
+    submission->len = 1;
+    submission->msg_flags = MSG_NOSIGNAL;
+    submission->user_data = (uint64_t)(uintptr_t)request | _UringSendRequestTag;
+    return true;
+}
+
+/**
+ * Passes the collected io_uring requests to the kernel without waiting for
+ * the next loop iteration, e.g. before a socket which they use is closed
+ */
+void DoIPEventLoop::flushSubmissions() {
+    if(backend == IOURINGBACKEND) {
+        ring.submit();
+    }
+}
+
+/**
+ * Queues a task which will be executed on the event loop thread.
+ * This is the only method which may be called from other threads.
+ * @param task  function which will be called by the event loop
+ */
+void DoIPEventLoop::post(LoopTask task) {
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        pendingTasks.push_back(task);
+    }
+
+    wakeup();
+}
+
+/**
+ * Queues a task like post(), but may only be called on the event loop thread.
+ * The task runs at the end of the current iteration without waking up the
+ * loop, e.g. to batch the work of several handlers.
+ * @param task  function which will be called by the event loop
+ */
+void DoIPEventLoop::defer(LoopTask task) {
+    deferredTasks.push_back(task);
+}
+
+/**
+ * Waits for events and dispatches them to the registered handlers, then
+ * expires all due timers
+ * @param timeoutMs     maximum time to wait in milliseconds, -1 waits forever
+ * @return              number of dispatched events or -1 if error occurred
+ */
+int DoIPEventLoop::runOnce(int timeoutMs) {
+    struct epoll_event events[_MaxEventsPerPoll];
+
+    loopThread = std::this_thread::get_id();
+
+    int timerTimeoutMs = timerWheel.millisecondsUntilNextExpiry();
+    if(timerTimeoutMs >= 0 && (timeoutMs < 0 || timerTimeoutMs < timeoutMs)) {
+        timeoutMs = timerTimeoutMs;
+    }
+
+    if(backend == IOURINGBACKEND) {
+        return runOnceUring(timeoutMs);
+    }
+
+    int readyEvents = epoll_wait(epollFd, events, _MaxEventsPerPoll, timeoutMs);
+    if(readyEvents < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for(int i = 0; i < readyEvents; i++) {
+        Registration* registration = static_cast<Registration*>(events[i].data.ptr);
+        if(registration == nullptr) {
+            uint64_t counter;
+            while(read(wakeupFd, &counter, sizeof(counter)) > 0) {}
+            continue;
+        }
+
+        //a previous handler of this round may have removed the descriptor
+        if(registration->active) {
+            registration->handler(events[i].events);
+        }
+    }
+
+    timerWheel.advance();
+    runPendingTasks();
+    releaseRetiredRegistrations();
+
+    return readyEvents;
+}
+
+/**
+ * Dispatches events until stop() is called
+ */
+void DoIPEventLoop::run() {
+    running = true;
+    while(running) {
+        if(runOnce(-1) < 0) {
+            DOIP_LOG_ERROR("Waiting for events failed in DoIPEventLoop::run(): %s", strerror(errno));
+            running = false;
+        }
+    }
+}
+
+/**
+ * Stops a running event loop. May be called from any thread.
+ */
+void DoIPEventLoop::stop() {
+    running = false;
+    wakeup();
+}
+
+/**
+ * Interrupts a blocking wait of the event loop thread
+ */
+void DoIPEventLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t result = write(wakeupFd, &one, sizeof(one));
+    (void)result;
+}
+
+void DoIPEventLoop::runPendingTasks() {
+    std::vector<LoopTask> tasks;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        tasks.swap(pendingTasks);
+    }
+
+    for(LoopTask& task : tasks) {
+        task();
+    }
+
+    //deferred tasks may defer further tasks
+    while(!deferredTasks.empty()) {
+        tasks.clear();
+        tasks.swap(deferredTasks);
+        for(LoopTask& task : tasks) {
+            task();
+        }
+    }
+}
+
+void DoIPEventLoop::releaseRetiredRegistrations() {
+    for(Registration* registration : retiredRegistrations) {
+        delete registration;
+    }
+    retiredRegistrations.clear();
+}
+
+/*
+ * Submits the requests of the last iteration, waits for completions and
+ * dispatches them
+ */
+int DoIPEventLoop::runOnceUring(int timeoutMs) {
+    if(ring.submitAndWait(1, timeoutMs) < 0) {
+        return errno == EINTR || errno == EBUSY ? 0 : -1;
+    }
+
+    int dispatched = 0;
+    struct io_uring_cqe* completion;
+    while((completion = ring.peekCompletion()) != nullptr) {
+        //the handlers may submit requests, which must not overwrite the completion
+        struct io_uring_cqe seen = *completion;
+        ring.completionSeen();
+        dispatchCompletion(seen);
+        dispatched++;
+    }
+
+    timerWheel.advance();
+    runPendingTasks();
+    releaseRetiredRegistrations();
+
+    return dispatched;
+}
+
+/*
+ * Returns the next submission entry, the collected ones are passed to the
+ * kernel early if the submission queue is full
+ */
+struct io_uring_sqe* DoIPEventLoop::nextSubmission() {
+    struct io_uring_sqe* submission = ring.getSubmission();
+    while(submission == nullptr) {
+        ring.submit();
+        submission = ring.getSubmission();
+    }
+    return submission;
+}
+
+/*
+ * Submits the multishot request of a registration
+ */
+void DoIPEventLoop::armRegistration(Registration* registration) {
+    struct io_uring_sqe* submission = nextSubmission();
+    uint64_t userData = (uint64_t)(uintptr_t)registration;
+
+    switch(registration->kind) {
+        case POLLREQUEST:
+            IoUring::prepareMultishotPoll(submission, registration->fd, registration->events, userData);
+            break;
+        case ACCEPTREQUEST:
+            submission->opcode = IORING_OP_ACCEPT;
+            submission->fd = registration->fd;
+            submission->ioprio = IORING_ACCEPT_MULTISHOT;
+            submission->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            submission->user_data = userData;
+            break;
+        case RECEIVEREQUEST:
+            IoUring::prepareMultishotReceive(submission, registration->fd, _UringReceiveBufferGroup, userData);
+            break;
+    }
+    registration->armed = true;
+}
+
+void DoIPEventLoop::armWakeup() {
+    IoUring::prepareMultishotPoll(nextSubmission(), wakeupFd, EPOLLIN, _UringWakeupRequest);
+}
+
+void DoIPEventLoop::dispatchCompletion(const struct io_uring_cqe& completion) {
+    if(completion.user_data == _UringIgnoredRequest) {
+        return;
+    }
+
+    if(completion.user_data == _UringWakeupRequest) {
+        uint64_t counter;
+        while(read(wakeupFd, &counter, sizeof(counter)) > 0) {}
+        if(!(completion.flags & IORING_CQE_F_MORE)) {
+            armWakeup();
+        }
+        return;
+    }
+
+    if(completion.user_data & _UringSendRequestTag) {
+        SendRequest* request = reinterpret_cast<SendRequest*>((uintptr_t)(completion.user_data & ~_UringSendRequestTag));
+        pendingSends.erase(request);
+        request->completion(completion.res);
+        delete request;
+        return;
+    }
+
+    Registration* registration = reinterpret_cast<Registration*>((uintptr_t)completion.user_data);
+    if(!(completion.flags & IORING_CQE_F_MORE)) {
+        registration->armed = false;
+    }
+
+    dispatchRegistration(registration, completion);
+
+    //a removed registration is released when the kernel is done with its request
+    if(!registration->active && !registration->armed && cancelledRegistrations.erase(registration) > 0) {
+        delete registration;
+    }
+}
+
+/*
+ * Calls the handler of a registration and submits its request again if the
+ * kernel ended the multishot request
+ */
+void DoIPEventLoop::dispatchRegistration(Registration* registration, const struct io_uring_cqe& completion) {
+    bool rearm = true;
+
+    switch(registration->kind) {
+        case POLLREQUEST:
+            if(completion.res < 0) {
+                rearm = false;
+            }
+            if(registration->active && completion.res != -ECANCELED) {
+                registration->handler(completion.res > 0 ? (uint32_t)completion.res : (uint32_t)EPOLLERR);
+            }
+            break;
+
+        case ACCEPTREQUEST:
+            if(completion.res >= 0) {
+                if(registration->active) {
+                    registration->acceptHandler(completion.res);
+                } else {
+                    close(completion.res);
+                }
+            } else if(completion.res != -ECANCELED) {
+                DOIP_LOG_WARNING("Accepting a connection failed: %s", strerror(-completion.res));
+            }
+            break;
+
+        case RECEIVEREQUEST:
+            if(completion.res > 0) {
+                uint16_t bufferId = completion.flags >> IORING_CQE_BUFFER_SHIFT;
+                if(registration->active) {
+                    registration->receiveHandler(ring.getBuffer(bufferId), completion.res);
+                }
+                ring.recycleBuffer(bufferId);
+            } else if(completion.res != -ENOBUFS) {
+                //end of stream or error, the connection is not received from anymore
+                rearm = false;
+                if(registration->active && completion.res != -ECANCELED) {
+                    registration->receiveHandler(nullptr, 0);
+                }
+            }
+            break;
+    }
+
+    if(rearm && registration->active && !registration->armed) {
+        armRegistration(registration);
+    }
+}
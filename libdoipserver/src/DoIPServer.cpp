@@ -1,5 +1,27 @@
 #include "DoIPServer.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <chrono>
+#include <thread>
+#include "DoIPLogger.h"
+#include "DoIPMetrics.h"
+#include "DoIPTracer.h"
+
+DoIPServer::~DoIPServer() {
+    if(addressMonitorSocket >= 0) {
+        close(addressMonitorSocket);
+    }
+    //the connections leave their sockets to the server
+    for(auto& connection : connections) {
+        close(connection.first);
+    }
+    delete vehicleIdentificationFrame.load();
+}
+
 /*
  * Set up a tcp socket, so the socket is ready to accept a connection 
  */
@@ -10,6 +32,10 @@ void DoIPServer::setupTcpSocket() {
     serverAddress.sin_family = AF_INET;
     serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
     serverAddress.sin_port = htons(_ServerPort);
+
+    //connections closed by the server leave the port in TIME_WAIT, a restarted server may bind it anyway
+    int reuseAddress = 1;
+    setsockopt(server_socket_tcp, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
     
     //binds the socket to the address and port number
     bind(server_socket_tcp, (struct sockaddr *)&serverAddress, sizeof(serverAddress));     
@@ -25,6 +51,460 @@ std::unique_ptr<DoIPConnection> DoIPServer::waitForTcpConnection() {
     return std::unique_ptr<DoIPConnection>(new DoIPConnection(tcpSocket, LogicalGatewayAddress));
 }
 
+/*
+ * Selects how the event loop drives the tcp connections, it has to be called
+ * before setupEventLoop(). With io_uring connections are accepted, received
+ * and sent by the ring, the udp and netlink sockets are still polled.
+ * @param backend   EPOLLBACKEND or IOURINGBACKEND
+ * @return          false if the backend is not supported, epoll is used then
+ */
+bool DoIPServer::setTransportBackend(EventLoopBackend backend) {
+    return eventLoop.setBackend(backend);
+}
+
+/*
+ * Puts the tcp socket into listening mode and registers it in the event loop.
+ * Afterwards every accepted connection is owned and driven by the event loop.
+ * The event loop also sends the vehicle announcements and repeats them when
+ * a new ip address is assigned. setupTcpSocket() has to be called before.
+ * @return      true if the event loop is ready to run
+ */
+bool DoIPServer::setupEventLoop() {
+    int flags = fcntl(server_socket_tcp, F_GETFL, 0);
+    if(flags < 0 || fcntl(server_socket_tcp, F_SETFL, flags | O_NONBLOCK) < 0) {
+        DOIP_LOG_ERROR("Error setting the tcp socket to non-blocking mode");
+        return false;
+    }
+
+    if(listen(server_socket_tcp, SOMAXCONN) < 0) {
+        DOIP_LOG_ERROR("Error listening on the tcp socket");
+        return false;
+    }
+
+    if(eventLoop.getBackend() == IOURINGBACKEND) {
+        if(!eventLoop.acceptConnections(server_socket_tcp, [this](int tcpSocket) { addConnection(tcpSocket); })) {
+            return false;
+        }
+    } else if(!eventLoop.addDescriptor(server_socket_tcp, EPOLLIN, [this](uint32_t events) {
+        (void)events;
+        acceptTcpConnections();
+    })) {
+        return false;
+    }
+
+    watchAddressChanges();
+    return true;
+}
+
+/*
+ * Drives the event loop on the calling thread until stopEventLoop() is called
+ */
+void DoIPServer::runEventLoop() {
+    eventLoop.run();
+}
+
+/*
+ * Dispatches the currently pending events on the calling thread
+ * @param timeoutMs     maximum time to wait for events, -1 waits forever
+ * @return              number of dispatched events or -1 if error occurred
+ */
+int DoIPServer::pollEvents(int timeoutMs) {
+    return eventLoop.runOnce(timeoutMs);
+}
+
+/*
+ * Stops a running event loop, may be called from any thread
+ */
+void DoIPServer::stopEventLoop() {
+    eventLoop.stop();
+}
+
+/*
+ * Set the callback functions for all connections accepted by the event loop
+ * @dc      Callback which sends the data of a diagnostic message to the application,
+ *          the data is only valid until the callback returns
+ * @dmn     Callback which notifies the application of receiving a diagnostic message
+ * @ccb     Callback which notifies the application that a connection was closed
+ */
+void DoIPServer::setConnectionCallback(ConnectionDiagnosticCallback dc, ConnectionDiagnosticNotification dmn,
+                                        ConnectionClosedCallback ccb) {
+    connection_diag_callback = dc;
+    connection_notify_application = dmn;
+    connection_closed = ccb;
+}
+
+/*
+ * Sets the general inactivity time for all connections accepted by the event loop
+ * @param seconds   time after which alive check timeout occurs, 0 disables it
+ */
+void DoIPServer::setGeneralInactivityTime(const uint16_t seconds) {
+    generalInactivityTime = seconds;
+}
+
+/*
+ * Sets the initial inactivity time for all connections accepted by the event loop
+ * @param milliseconds  time till a routing activation has to succeed, 0 disables it
+ */
+void DoIPServer::setInitialInactivityTime(const uint32_t milliseconds) {
+    initialInactivityTime = milliseconds;
+}
+
+/*
+ * Accepts all pending connections of the listening socket
+ */
+void DoIPServer::acceptTcpConnections() {
+    while(true) {
+        int tcpSocket = accept4(server_socket_tcp, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(tcpSocket >= 0) {
+            addConnection(tcpSocket);
+            continue;
+        }
+
+        if(errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+
+        if(errno != EAGAIN && errno != EWOULDBLOCK) {
+            DOIP_LOG_ERROR("Error accepting a tcp connection: %s", strerror(errno));
+        }
+        return;
+    }
+}
+
+/*
+ * Creates a connection for an accepted socket and registers it in the event loop
+ * @param tcpSocket     non-blocking socket of the accepted connection
+ */
+void DoIPServer::addConnection(int tcpSocket) {
+    if(connections.size() >= maxConnections) {
+        DOIP_LOG_WARNING("Rejected tcp connection, %u connections are open", (unsigned int)maxConnections);
+        close(tcpSocket);
+        return;
+    }
+
+    //the ack and the response of a diagnostic message are separate writes, Nagle would delay the response
+    int noDelay = 1;
+    setsockopt(tcpSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if(DoIPTracer::isEnabled() && DoIPTracer::instance().usesKernelTimestamps()) {
+        DoIPTracer::enableKernelTimestamps(tcpSocket);
+    }
+
+    std::shared_ptr<DoIPConnection> sharedConnection = std::make_shared<DoIPConnection>(tcpSocket, LogicalGatewayAddress);
+    DoIPConnection* connection = sharedConnection.get();
+    //with an executor the message is acknowledged when its task was queued, see submitDiagnosticMessage()
+    bool deferredAck = diagnosticExecutor != nullptr;
+
+    connection->setCallback(
+        [this, connection](unsigned short targetAddress, unsigned char* data, int length) {
+            if(connection_diag_callback) {
+                CallbackLatencyTimer timer(targetAddress);
+                connection_diag_callback(*connection, targetAddress, data, length);
+            }
+        },
+        [this, connection, deferredAck](unsigned short targetAddress) {
+            if(deferredAck) {
+                return true;
+            }
+            return acknowledgeDiagnosticMessage(*connection, targetAddress);
+        },
+        [this, tcpSocket, connection]() {
+            //defer the release, the connection may still be on the call stack
+            eventLoop.post([this, tcpSocket, connection]() {
+                releaseConnection(tcpSocket, connection);
+            });
+        });
+    std::weak_ptr<DoIPConnection> weakConnection = sharedConnection;
+    if(diagnosticExecutor != nullptr) {
+        uint64_t connectionId = nextConnectionId++;
+        connection->setDiagnosticViewCallback([this, weakConnection, connectionId](const DiagnosticMessageView& view) {
+            submitDiagnosticMessage(weakConnection.lock(), connectionId, view);
+        });
+    } else if(routingTable != nullptr) {
+        connection->setDiagnosticViewCallback([this, weakConnection](const DiagnosticMessageView& view) {
+            routeDiagnosticMessage(weakConnection.lock(), view);
+        });
+    } else if(connection_diag_view_callback) {
+        connection->setDiagnosticViewCallback([this, connection](const DiagnosticMessageView& view) {
+            CallbackLatencyTimer timer(view.getTargetAddress());
+            connection_diag_view_callback(*connection, view);
+        });
+    }
+    if(connection_oem_callback) {
+        connection->setOemPayloadCallback([this, connection](uint16_t payloadType, unsigned char* payload, unsigned long length) {
+            connection_oem_callback(*connection, payloadType, payload, length);
+        });
+    }
+    if(connection_backpressure_callback) {
+        connection->setBackpressureCallback([this, connection](bool throttle) {
+            connection_backpressure_callback(*connection, throttle);
+        });
+    }
+    connection->setSendQueueLimits(sendQueueLimits);
+    connection->setTimerWheel(eventLoop.getTimerWheel());
+    connection->setBufferPool(*bufferPool);
+    connection->setGeneralInactivityTime(generalInactivityTime);
+    connection->setInitialInactivityTime(initialInactivityTime);
+    //the socket is closed in releaseConnection(), so the loop never reads a reused socket number
+    connection->setSocketReleasedByOwner();
+
+    connections[tcpSocket] = sharedConnection;
+    connectionCount = connections.size();
+    if(connection_opened) {
+        connection_opened(*connection);
+    }
+
+    if(eventLoop.getBackend() == IOURINGBACKEND) {
+        //the loop thread owns the ring, it submits at the end of the iteration,
+        //so e.g. the ack and the response of a diagnostic message are sent together
+        connection->setSendSubmitCallback([this, weakConnection, tcpSocket]() {
+            LoopTask submit = [this, weakConnection, tcpSocket]() {
+                submitQueuedMessages(weakConnection.lock(), tcpSocket);
+            };
+            if(eventLoop.isInLoopThread()) {
+                eventLoop.defer(submit);
+            } else {
+                eventLoop.post(submit);
+            }
+        });
+        eventLoop.receiveStream(tcpSocket, [connection](unsigned char* data, size_t length) {
+            connection->processReceivedData(data, length);
+        });
+        return;
+    }
+
+    //edge-triggered EPOLLOUT only fires when a full socket buffer has space again
+    eventLoop.addDescriptor(tcpSocket, EPOLLIN | EPOLLRDHUP | EPOLLOUT, [connection](uint32_t events) {
+        if(events & EPOLLOUT) {
+            connection->flushSendQueue();
+        }
+        if(events & ~EPOLLOUT) {
+            connection->receiveAvailableTcpMessages();
+        }
+    });
+
+    //data may have arrived before the socket was registered
+    connection->receiveAvailableTcpMessages();
+}
+
+/*
+ * Passes the queued messages of a connection to the io_uring backend. The
+ * completion submits what was queued meanwhile, so one send per connection
+ * is in flight and the order of the messages is kept.
+ * @param connection    connection whose send submit callback was called
+ * @param tcpSocket     socket of the connection, it stays open until the connection is released
+ */
+void DoIPServer::submitQueuedMessages(const std::shared_ptr<DoIPConnection>& connection, int tcpSocket) {
+    if(!connection) {
+        return;
+    }
+
+    struct iovec vectors[_MaxFlushVectors];
+    int count = connection->collectSendVectors(vectors, _MaxFlushVectors);
+    if(count == 0) {
+        return;
+    }
+
+    //the completion keeps the connection and thereby the queued buffers alive
+    std::shared_ptr<DoIPConnection> sending = connection;
+    eventLoop.sendStream(tcpSocket, vectors, count, [this, sending, tcpSocket](int result) {
+        if(sending->completeSend(result)) {
+            submitQueuedMessages(sending, tcpSocket);
+        }
+    });
+}
+
+/*
+ * Subscribes to the ip address notifications of the kernel, so the vehicle
+ * announcements are repeated after an address change as ISO 13400 requires
+ */
+void DoIPServer::watchAddressChanges() {
+    if(addressMonitorSocket >= 0) {
+        return;
+    }
+
+    addressMonitorSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(addressMonitorSocket < 0) {
+        DOIP_LOG_WARNING("Address changes are not monitored: %s", strerror(errno));
+        return;
+    }
+
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_IPV4_IFADDR;
+
+    if(bind(addressMonitorSocket, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+            !eventLoop.addDescriptor(addressMonitorSocket, EPOLLIN, [this](uint32_t events) {
+                (void)events;
+                receiveAddressChanges();
+            })) {
+        DOIP_LOG_WARNING("Address changes are not monitored: %s", strerror(errno));
+        close(addressMonitorSocket);
+        addressMonitorSocket = -1;
+    }
+}
+
+/*
+ * Reads all pending address notifications and restarts the vehicle
+ * announcements if an address was added
+ */
+void DoIPServer::receiveAddressChanges() {
+    alignas(struct nlmsghdr) char buffer[4096];
+    bool addressAdded = false;
+
+    while(true) {
+        ssize_t length = recv(addressMonitorSocket, buffer, sizeof(buffer), 0);
+        if(length < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == ENOBUFS) {
+                //notifications were lost, one of them may have been a new address
+                addressAdded = true;
+                continue;
+            }
+            break;
+        }
+
+        int remaining = length;
+        for(struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+            if(header->nlmsg_type == RTM_NEWADDR) {
+                addressAdded = true;
+            }
+        }
+    }
+
+    if(addressAdded) {
+        DOIP_LOG_INFO("IP address changed, repeating the vehicle announcements");
+        announcementScheduler.start();
+    }
+}
+
+/*
+ * Copies the user data of a diagnostic message and hands the callback over to
+ * the executor. Messages for the same target address of a connection keep
+ * their order. The message is only acknowledged if the executor has room for
+ * it, otherwise it is rejected with the negative ack code 0x05.
+ */
+void DoIPServer::submitDiagnosticMessage(const std::shared_ptr<DoIPConnection>& connection, uint64_t connectionId,
+                                            const DiagnosticMessageView& view) {
+    struct DeferredMessage {
+        std::shared_ptr<DoIPConnection> connection;
+        unsigned short sourceAddress;
+        unsigned short targetAddress;
+        PooledBuffer data;
+        int length;
+    };
+
+    //the positive ack promises that the message is processed, so the queue place is reserved first
+    if(!diagnosticExecutor->reserve()) {
+        DOIP_LOG_WARNING("Executor queue is full, rejected diagnostic message for 0x%04X", view.getTargetAddress());
+        connection->sendDiagnosticAck(view.getTargetAddress(), false, _OutOfMemoryCode);
+        return;
+    }
+    if(!acknowledgeDiagnosticMessage(*connection, view.getTargetAddress())) {
+        diagnosticExecutor->cancelReservation();
+        return;
+    }
+
+    std::shared_ptr<DeferredMessage> message = std::make_shared<DeferredMessage>();
+    message->connection = connection;
+    message->sourceAddress = view.getSourceAddress();
+    message->targetAddress = view.getTargetAddress();
+    message->data = view.retain();
+    message->length = view.size();
+
+    diagnosticExecutor->submitReserved(DiagnosticExecutor::makeKey(connectionId, message->targetAddress), [this, message]() {
+        DiagnosticMessageView deferredView(message->sourceAddress, message->targetAddress,
+                                            message->data.data(), message->length, *bufferPool);
+        TraceSpan span("deferred DiagnosticCallback", "target", message->targetAddress);
+        if(routingTable != nullptr) {
+            routeDiagnosticMessage(message->connection, deferredView);
+        } else if(connection_diag_view_callback) {
+            CallbackLatencyTimer timer(message->targetAddress);
+            connection_diag_view_callback(*message->connection, deferredView);
+        } else if(connection_diag_callback) {
+            CallbackLatencyTimer timer(message->targetAddress);
+            connection_diag_callback(*message->connection, message->targetAddress, message->data.data(), message->length);
+        }
+    });
+}
+
+/*
+ * Decides if a diagnostic message is accepted: by the routing table if
+ * there is one, otherwise by the notification callback of the application
+ * @return      true if the message will be processed
+ */
+bool DoIPServer::acknowledgeDiagnosticMessage(DoIPConnection& connection, unsigned short targetAddress) {
+    if(routingTable != nullptr) {
+        return acknowledgeRoutedMessage(connection, targetAddress);
+    }
+    if(connection_notify_application) {
+        return connection_notify_application(connection, targetAddress);
+    }
+    return true;
+}
+
+/*
+ * Acknowledges a diagnostic message if the routing table knows its target address,
+ * otherwise it is rejected with the negative ack code 0x03
+ * @return      true if the message will be routed
+ */
+bool DoIPServer::acknowledgeRoutedMessage(DoIPConnection& connection, unsigned short targetAddress) {
+    if(!routingTable->lookup(targetAddress)) {
+        connection.sendDiagnosticAck(targetAddress, false, _UnknownTargetAddressCode);
+        return false;
+    }
+
+    connection.sendDiagnosticAck(targetAddress, true, _ValidDiagnosticMessageCode);
+    return true;
+}
+
+/*
+ * Passes a diagnostic message to the ecu handler of its target address together
+ * with the route back to the tester connection
+ */
+void DoIPServer::routeDiagnosticMessage(const std::shared_ptr<DoIPConnection>& connection, const DiagnosticMessageView& view) {
+    std::shared_ptr<EcuHandler> handler = routingTable->lookup(view.getTargetAddress());
+    if(!handler) {
+        //the route was removed after the message was acknowledged
+        DOIP_LOG_WARNING("No route for diagnostic message to 0x%04X", view.getTargetAddress());
+        return;
+    }
+
+    TesterRoute route(connection, view.getSourceAddress(), view.getTargetAddress());
+    CallbackLatencyTimer timer(view.getTargetAddress());
+    handler->handleDiagnosticMessage(view, route);
+}
+
+/*
+ * Removes a closed connection from the event loop and deletes it
+ * @param tcpSocket     socket number the connection was registered with
+ * @param connection    connection which was closed
+ */
+void DoIPServer::releaseConnection(int tcpSocket, DoIPConnection* connection) {
+    auto it = connections.find(tcpSocket);
+    if(it == connections.end() || it->second.get() != connection) {
+        //the connection was already released
+        return;
+    }
+
+    eventLoop.removeDescriptor(tcpSocket);
+    if(eventLoop.getBackend() == IOURINGBACKEND) {
+        //the requests which still refer to the socket number are completed first
+        eventLoop.flushSubmissions();
+    }
+    //the connection left the socket open, it may have been closed on an executor thread
+    close(tcpSocket);
+
+    if(connection_closed) {
+        connection_closed(*connection);
+    }
+
+    connections.erase(it);
+    connectionCount = connections.size();
+}
+
 void DoIPServer::setupUdpSocket() {
     
     server_socket_udp = socket(AF_INET, SOCK_DGRAM, 0);
@@ -34,13 +514,17 @@ void DoIPServer::setupUdpSocket() {
     serverAddress.sin_port = htons(_ServerPort);
     
     if(server_socket_udp < 0)
-        std::cout << "Error setting up a udp socket" << std::endl;
+        DOIP_LOG_ERROR("Error setting up a udp socket");
     
     //binds the socket to any IP Address and the Port Number 13400
     bind(server_socket_udp, (struct sockaddr *)&serverAddress, sizeof(serverAddress)); 
     
     //setting the IP Address for Multicast
     setMulticastGroup("224.0.0.2");
+
+    //vehicle announcements are sent to the broadcast address
+    if(setsockopt(server_socket_udp, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0)
+        DOIP_LOG_ERROR("Setting the broadcast option failed");
 }
 
 /*
@@ -55,74 +539,207 @@ void DoIPServer::closeUdpSocket() {
 }
 
 /*
- * Receives a udp message and calls reactToReceivedUdpMessage method
- * @return      amount of bytes which were send back to client
+ * Waits for udp messages and answers them. All datagrams which are queued
+ * are received with one recvmmsg() call, the responses are sent with one
+ * sendmmsg() call.
+ * @return      amount of bytes which were send back to the clients
  *              or -1 if error occurred     
  */
 int DoIPServer::receiveUdpMessage(){
     
-    unsigned int length = sizeof(serverAddress);   
-    int readBytes = recvfrom(server_socket_udp, data, _MaxDataSize, 0, (struct sockaddr *) &serverAddress, &length);
-        
-    int sentBytes = reactToReceivedUdpMessage(readBytes);
+    for(int i = 0; i < _UdpBatchSize; i++) {
+        udpBatch.requestVectors[i] = { udpBatch.requests[i], _MaxUdpMessageLength };
+        memset(&udpBatch.requestHeaders[i], 0, sizeof(struct mmsghdr));
+        udpBatch.requestHeaders[i].msg_hdr.msg_name = &udpBatch.senders[i];
+        udpBatch.requestHeaders[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        udpBatch.requestHeaders[i].msg_hdr.msg_iov = &udpBatch.requestVectors[i];
+        udpBatch.requestHeaders[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    //blocks until the first datagram arrives, then takes all which are queued
+    int receivedMessages = recvmmsg(server_socket_udp, udpBatch.requestHeaders, _UdpBatchSize, MSG_WAITFORONE, NULL);
+    if(receivedMessages <= 0) {
+        return -1;
+    }
+
+    udpBatch.responseCount = 0;
+    for(udpBatch.current = 0; udpBatch.current < receivedMessages; udpBatch.current++) {
+        struct msghdr& header = udpBatch.requestHeaders[udpBatch.current].msg_hdr;
+        if(header.msg_flags & MSG_TRUNC) {
+            //no udp message of ISO 13400-2 is that long
+            unsigned char message[_GenericHeaderLength + _NACKLength];
+            sendUdpMessage(message, encodeNegativeAck(message, _MessageTooLargeCode));
+            DoIPMetrics::instance().recordGenericNack(_MessageTooLargeCode);
+            continue;
+        }
+        reactToReceivedUdpMessage(udpBatch.requests[udpBatch.current], udpBatch.requestHeaders[udpBatch.current].msg_len);
+    }
     
-    return sentBytes;
+    return sendUdpResponses();
 }
 
 
 /*
- * Receives a udp message and determine how to process the message
- * @return      amount of bytes which were send back to client
- *              or -1 if error occurred     
+ * Determines how to process a received udp message
+ * @param message       received datagram
+ * @param readedBytes   length of the datagram
+ * @return              amount of bytes which are send back to client
+ *                      or -1 if error occurred     
  */
-int DoIPServer::reactToReceivedUdpMessage(int readedBytes) {
+int DoIPServer::reactToReceivedUdpMessage(unsigned char* message, int readedBytes) {
+
+    //handlers indexed by payload type, types which are not expected from a client have none
+    static constexpr UdpHandlerEntry handlers[] = {
+        { PayloadType::NEGATIVEACK,                 &DoIPServer::handleUdpNegativeAck },
+        { PayloadType::ROUTINGACTIVATIONREQUEST,    nullptr },
+        { PayloadType::ROUTINGACTIVATIONRESPONSE,   nullptr },
+        { PayloadType::VEHICLEIDENTREQUEST,         &DoIPServer::handleVehicleIdentificationRequest },
+        { PayloadType::VEHICLEIDENTRESPONSE,        &DoIPServer::handleVehicleIdentificationResponse },
+        { PayloadType::DIAGNOSTICMESSAGE,           nullptr },
+        { PayloadType::DIAGNOSTICPOSITIVEACK,       nullptr },
+        { PayloadType::DIAGNOSTICNEGATIVEACK,       nullptr },
+        { PayloadType::ALIVECHECKRESPONSE,          nullptr },
+        { PayloadType::ALIVECHECKREQUEST,           nullptr },
+        { PayloadType::VEHICLEIDENTREQUESTEID,      &DoIPServer::handleVehicleIdentificationRequest },
+        { PayloadType::VEHICLEIDENTREQUESTVIN,      &DoIPServer::handleVehicleIdentificationRequest },
+        { PayloadType::ENTITYSTATUSREQUEST,         &DoIPServer::handleEntityStatusRequest },
+        { PayloadType::ENTITYSTATUSRESPONSE,        nullptr },
+        { PayloadType::POWERMODEREQUEST,            &DoIPServer::handlePowerModeRequest },
+        { PayloadType::POWERMODERESPONSE,           nullptr },
+        { PayloadType::GENERICNACK,                 nullptr },
+        { PayloadType::OEMSPECIFIC,                 nullptr },
+    };
+    static_assert(isPayloadTypeTable(handlers), "every payload type needs a handler slot, in the order of the enum");
         
-    GenericHeaderAction action = parseGenericHeader(data, readedBytes);
+    GenericHeaderAction action = parseGenericHeader(message, readedBytes);
+    if(action.type != PayloadType::NEGATIVEACK && (unsigned long)readedBytes < _GenericHeaderLength + action.payloadLength) {
+        //datagram is shorter than the announced payload
+        return -1;
+    }
+    if(action.type != PayloadType::NEGATIVEACK) {
+        DoIPMetrics::instance().recordMessageIn(action.type, readedBytes);
+    }
 
-    int sendedBytes;
-    switch(action.type) {
+    UdpMessageHandler handler = handlers[action.type].handler;
+    if(handler == nullptr) {
+        DOIP_LOG_WARNING("not handled payload type 0x%04X occured in receiveUdpMessage()", action.payloadTypeCode);
+        return -1;
+    }
+    return (this->*handler)(action, message + _GenericHeaderLength);
+}
 
-        case PayloadType::VEHICLEIDENTRESPONSE:{    //server should not send a negative ACK if he receives the sended VehicleIdentificationAnnouncement
-            return -1;
-        }
+int DoIPServer::handleUdpNegativeAck(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)payload;
 
-        case PayloadType::NEGATIVEACK: {
-            //send NACK
-            unsigned char* message = createGenericHeader(action.type, _NACKLength);
-            message[8] = action.value;
-            sendedBytes = sendUdpMessage(message, _GenericHeaderLength + _NACKLength);
+    //send NACK
+    unsigned char message[_GenericHeaderLength + _NACKLength];
+    int messageLength = encodeNegativeAck(message, action.value);
+    int sendedBytes = sendUdpMessage(message, messageLength);
+    DoIPMetrics::instance().recordGenericNack(action.value);
 
-            if(action.value == _IncorrectPatternFormatCode || 
-                    action.value == _InvalidPayloadLengthCode) {
-                return -1;
-            } else {
-                //discard message when value 0x01, 0x02, 0x03
-            }
-            return sendedBytes;
-        }
+    if(action.value == _IncorrectPatternFormatCode || 
+            action.value == _InvalidPayloadLengthCode) {
+        return -1;
+    } else {
+        //discard message when value 0x01, 0x02, 0x03
+    }
+    return sendedBytes;
+}
 
-        case PayloadType::VEHICLEIDENTREQUEST: {
-            unsigned char* message = createVehicleIdentificationResponse(VIN, LogicalGatewayAddress, EID, GID, FurtherActionReq);
-            sendedBytes = sendUdpMessage(message, _GenericHeaderLength + _VIResponseLength);   
+/*
+ * Answers vehicle identification requests, requests with EID or VIN
+ * are only answered if they match the values of this entity
+ */
+int DoIPServer::handleVehicleIdentificationRequest(const GenericHeaderAction& action, unsigned char* payload) {
+    //announce the reader in the current epoch, updateVehicleIdentificationFrame() waits for it
+    std::atomic<long>& counter = frameReaders[frameEpoch.load() & 1];
+    counter++;
 
-            return sendedBytes;
-        }
+    const VehicleIdentificationFrame* frame = vehicleIdentificationFrame.load();
+    const unsigned char* response = frame->message + _GenericHeaderLength;
+    bool otherEntity = action.type == PayloadType::VEHICLEIDENTREQUESTEID && memcmp(payload, response + _VIResponseEIDOffset, 6) != 0;
+    bool otherVehicle = action.type == PayloadType::VEHICLEIDENTREQUESTVIN && memcmp(payload, response + _VIResponseVINOffset, 17) != 0;
+    int sentBytes = otherEntity || otherVehicle ? -1 : sendUdpMessage(frame->message, frame->length);
 
-        default: { 
-            std::cerr << "not handled payload type occured in receiveUdpMessage()" << std::endl;
-            return -1;
-        }
-    }   
+    counter--;
+    return sentBytes;
+}
+
+int DoIPServer::handleVehicleIdentificationResponse(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
+    (void)payload;
+
+    //server should not send a negative ACK if he receives the sended VehicleIdentificationAnnouncement
     return -1;
 }
 
-int DoIPServer::sendUdpMessage(unsigned char* message, int messageLength)  { //sendUdpMessage after receiving a message from the client
-    //if the server receives a message from a client, than the response should be send back to the client address and port
-    clientAddress.sin_port = serverAddress.sin_port;
-    clientAddress.sin_addr.s_addr = serverAddress.sin_addr.s_addr;
-    
-    int result = sendto(server_socket_udp, message, messageLength, 0, (struct sockaddr *)&clientAddress, sizeof(clientAddress));
-    return result;
+int DoIPServer::handleEntityStatusRequest(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
+    (void)payload;
+
+    size_t openConnections = connectionCount;
+    unsigned char openSockets = openConnections < 0xFF ? (unsigned char)openConnections : 0xFF;
+    unsigned char message[_GenericHeaderLength + _EntityStatusResponseLength];
+    int messageLength = encodeEntityStatusResponse(message, _NodeTypeGateway, maxConnections, openSockets, _MaxDataSize);
+    return sendUdpMessage(message, messageLength);
+}
+
+int DoIPServer::handlePowerModeRequest(const GenericHeaderAction& action, unsigned char* payload) {
+    (void)action;
+    (void)payload;
+
+    unsigned char message[_GenericHeaderLength + _PowerModeResponseLength];
+    int messageLength = encodePowerModeResponse(message, diagnosticPowerMode);
+    return sendUdpMessage(message, messageLength);
+}
+
+/*
+ * Queues the response to the udp message which is processed, it is sent
+ * back to the address and port of the client by sendUdpResponses()
+ * @return      length of the queued message or -1 if it does not fit
+ */
+int DoIPServer::sendUdpMessage(const unsigned char* message, int messageLength) {
+    if(messageLength > _MaxUdpMessageLength || udpBatch.responseCount >= _UdpBatchSize) {
+        return -1;
+    }
+
+    DoIPMetrics::instance().recordEncodedMessageOut(message, messageLength);
+    int index = udpBatch.responseCount++;
+    memcpy(udpBatch.responses[index], message, messageLength);
+    udpBatch.responseVectors[index] = { udpBatch.responses[index], (size_t)messageLength };
+    memset(&udpBatch.responseHeaders[index], 0, sizeof(struct mmsghdr));
+    udpBatch.responseHeaders[index].msg_hdr.msg_name = &udpBatch.senders[udpBatch.current];
+    udpBatch.responseHeaders[index].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    udpBatch.responseHeaders[index].msg_hdr.msg_iov = &udpBatch.responseVectors[index];
+    udpBatch.responseHeaders[index].msg_hdr.msg_iovlen = 1;
+    return messageLength;
+}
+
+/*
+ * Sends all queued responses with as few system calls as possible
+ * @return      amount of sent bytes or -1 if there was nothing to send
+ */
+int DoIPServer::sendUdpResponses() {
+    int sentBytes = 0;
+    int sentMessages = 0;
+
+    while(sentMessages < udpBatch.responseCount) {
+        int result = sendmmsg(server_socket_udp, &udpBatch.responseHeaders[sentMessages], udpBatch.responseCount - sentMessages, 0);
+        if(result < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            DOIP_LOG_WARNING("Error sending udp responses: %s", strerror(errno));
+            break;
+        }
+        for(int i = sentMessages; i < sentMessages + result; i++) {
+            sentBytes += udpBatch.responseHeaders[i].msg_len;
+        }
+        sentMessages += result;
+    }
+
+    udpBatch.responseCount = 0;
+    return sentMessages > 0 ? sentBytes : -1;
 }
 
 void DoIPServer::setEIDdefault(){
@@ -147,52 +764,85 @@ void DoIPServer::setEIDdefault(){
     
     //memcpy(mac, (unsigned char *)ifr.ifr_hwaddr.sa_data, 48);
     
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     for(int i = 0; i < 6; i++)
     {
         EID[i] = mac[i];
     }
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setVIN( std::string VINString){
     
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     VIN = VINString;
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setLogicalGatewayAddress(const unsigned short inputLogAdd){
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     LogicalGatewayAddress = inputLogAdd;
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setEID(const uint64_t inputEID){
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     EID[0] = (inputEID >> 40) &0xFF;
     EID[1] = (inputEID >> 32) &0xFF;
     EID[2] = (inputEID >> 24) &0xFF;
     EID[3] = (inputEID >> 16) &0xFF;
     EID[4] = (inputEID >> 8) &0xFF;
     EID[5] = inputEID  & 0xFF;
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setGID(const uint64_t inputGID){
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     GID[0] = (inputGID >> 40) &0xFF;
     GID[1] = (inputGID >> 32) &0xFF;
     GID[2] = (inputGID >> 24) &0xFF;
     GID[3] = (inputGID >> 16) &0xFF;
     GID[4] = (inputGID >> 8) &0xFF;
     GID[5] = inputGID  & 0xFF;
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setFAR(const unsigned int inputFAR){
+    std::lock_guard<std::mutex> lock(vehicleIdentificationMutex);
     FurtherActionReq = inputFAR & 0xFF;
+    updateVehicleIdentificationFrame();
 }
 
 void DoIPServer::setA_DoIP_Announce_Num(int Num){
-    A_DoIP_Announce_Num = Num;
+    announcementScheduler.setAnnounceNum(Num);
 }
 
 void DoIPServer::setA_DoIP_Announce_Interval(int Interval){
-    A_DoIP_Announce_Interval = Interval;
+    announcementScheduler.setAnnounceInterval(Interval);
 }
 
 
+/*
+ * Encodes the vehicle identification response for the current configuration
+ * and publishes it to the udp thread, which answers requests with a copy of
+ * the frame instead of encoding each response. The previous frame is deleted
+ * after the readers of both epochs are done, see DiagnosticRoutingTable::publish().
+ * The caller holds vehicleIdentificationMutex.
+ */
+void DoIPServer::updateVehicleIdentificationFrame() {
+    VehicleIdentificationFrame* frame = new VehicleIdentificationFrame();
+    frame->length = encodeVehicleIdentificationResponse(frame->message, VIN, LogicalGatewayAddress, EID, GID, FurtherActionReq);
+    const VehicleIdentificationFrame* previous = vehicleIdentificationFrame.exchange(frame);
+
+    for(int flip = 0; flip < 2; flip++) {
+        uint64_t drainedEpoch = frameEpoch.fetch_add(1);
+        while(frameReaders[drainedEpoch & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    delete previous;
+}
 
 void DoIPServer::setMulticastGroup(const char* address) {
     
@@ -203,7 +853,7 @@ void DoIPServer::setMulticastGroup(const char* address) {
     
     if(setPort < 0)
     {
-        std::cout << "Setting Port Error" << std::endl;
+        DOIP_LOG_ERROR("Setting Port Error");
     }
     
      
@@ -217,53 +867,65 @@ void DoIPServer::setMulticastGroup(const char* address) {
     
     if(setGroup < 0)
     {
-        std::cout <<"Setting Address Error" << std::endl;
+        DOIP_LOG_ERROR("Setting Address Error");
     }
 }
 
 
+/*
+ * Sends the vehicle announcements on the calling thread and waits
+ * A_DoIP_Announce_Interval between them. Servers which run the event loop
+ * should use scheduleVehicleAnnouncements() instead, which does not block.
+ * @return      amount of bytes of the last announcement or -1 if error occurred
+ */
 int DoIPServer::sendVehicleAnnouncement() {
-    
-    const char* address = "255.255.255.255";
-    
-    //setting the destination port for the Announcement to 13401
-    clientAddress.sin_port=htons(13401);
-    
-    int setAddressError = inet_aton(address,&(clientAddress.sin_addr));
-    
-    
-    if(setAddressError != 0)
-    {
-        std::cout <<"Broadcast Address set succesfully"<<std::endl;
-    }
-    
-    int socketError = setsockopt(server_socket_udp, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast) );
-         
-    if(socketError == 0)
-    {
-        std::cout << "Broadcast Option set successfully" << std::endl;
-    }
-    
-    int sendedmessage;
-    
-    unsigned char* message = createVehicleIdentificationResponse(VIN, LogicalGatewayAddress, EID, GID, FurtherActionReq);
-    
-    for(int i = 0; i < A_DoIP_Announce_Num; i++)
-    {
-        
-        sendedmessage = sendto(server_socket_udp, message, _GenericHeaderLength + _VIResponseLength, 0, (struct sockaddr *)&clientAddress, sizeof(clientAddress));
-        
-        if(sendedmessage > 0)
-        {
-            std::cout<<"Sending Vehicle Announcement"<<std::endl;
+    int announceNum = announcementScheduler.getAnnounceNum();
+    int sentBytes = -1;
+
+    for(int i = 0; i < announceNum; i++) {
+        sentBytes = broadcastVehicleAnnouncement();
+        if(sentBytes > 0) {
+            DOIP_LOG_INFO("Sending Vehicle Announcement");
+        } else {
+            DOIP_LOG_WARNING("Failed Sending Vehicle Announcement");
+        }
+
+        if(i + 1 < announceNum) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(announcementScheduler.getAnnounceInterval()));
         }
-        else
-        {
-            std::cout<<"Failed Sending Vehicle Announcement"<<std::endl;
-        }   
-        usleep(A_DoIP_Announce_Interval*1000);
-        
     }
-    return sendedmessage;
-    
+    return sentBytes;
+}
+
+/*
+ * Schedules the vehicle announcements on the timer wheel of the event loop
+ * and returns immediately. The first announcement is sent after a random
+ * A_DoIP_Announce_Wait, the event loop has to run to send them.
+ * @return      number of scheduled announcements
+ */
+int DoIPServer::scheduleVehicleAnnouncements() {
+    announcementScheduler.start();
+    return announcementScheduler.getRemainingAnnouncements();
+}
+
+/*
+ * Sends one vehicle announcement to the broadcast address
+ * @return      amount of sent bytes or -1 if error occurred
+ */
+int DoIPServer::broadcastVehicleAnnouncement() {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_AnnouncementPort);
+    address.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+    std::atomic<long>& counter = frameReaders[frameEpoch.load() & 1];
+    counter++;
+    const VehicleIdentificationFrame* frame = vehicleIdentificationFrame.load();
+    int sentBytes = sendto(server_socket_udp, frame->message, frame->length, 0, (struct sockaddr*)&address, sizeof(address));
+    counter--;
+    if(sentBytes > 0) {
+        DoIPMetrics::instance().recordMessageOut(PayloadType::VEHICLEIDENTRESPONSE, sentBytes);
+    }
+    return sentBytes;
 }
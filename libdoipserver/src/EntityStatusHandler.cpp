@@ -0,0 +1,37 @@
+#include "EntityStatusHandler.h"
+
+/**
+ * Writes a DoIP entity status response into a caller provided buffer
+ * @param buffer                buffer with space for _GenericHeaderLength + _EntityStatusResponseLength bytes
+ * @param nodeType              _NodeTypeGateway or _NodeTypeNode
+ * @param maxOpenSockets        number of concurrent tcp connections which are supported
+ * @param currentlyOpenSockets  number of currently established tcp connections
+ * @param maxDataSize           largest diagnostic message which can be processed
+ * @return                      number of written bytes
+ */
+int encodeEntityStatusResponse(unsigned char* buffer, unsigned char nodeType, unsigned char maxOpenSockets,
+                                unsigned char currentlyOpenSockets, uint32_t maxDataSize) {
+    encodeGenericHeader(buffer, PayloadType::ENTITYSTATUSRESPONSE, _EntityStatusResponseLength);
+
+    buffer[8] = nodeType;
+    buffer[9] = maxOpenSockets;
+    buffer[10] = currentlyOpenSockets;
+    buffer[11] = (maxDataSize >> 24) & 0xFF;
+    buffer[12] = (maxDataSize >> 16) & 0xFF;
+    buffer[13] = (maxDataSize >> 8) & 0xFF;
+    buffer[14] = maxDataSize & 0xFF;
+
+    return _GenericHeaderLength + _EntityStatusResponseLength;
+}
+
+/**
+ * Writes a diagnostic power mode information response into a caller provided buffer
+ * @param buffer        buffer with space for _GenericHeaderLength + _PowerModeResponseLength bytes
+ * @param powerMode     _PowerModeNotReady, _PowerModeReady or _PowerModeNotSupported
+ * @return              number of written bytes
+ */
+int encodePowerModeResponse(unsigned char* buffer, unsigned char powerMode) {
+    encodeGenericHeader(buffer, PayloadType::POWERMODERESPONSE, _PowerModeResponseLength);
+    buffer[8] = powerMode;
+    return _GenericHeaderLength + _PowerModeResponseLength;
+}
@@ -6,31 +6,37 @@
  * @return      routing activation response code 
  */
 unsigned char parseRoutingActivation(unsigned char *data) {
+    return parseRoutingActivation(data, *getAddressAdmissionPolicy());
+}
+
+/**
+ * Checks if the Routing Activation Request is valid
+ * @param data      contains the request
+ * @param policy    decides which addresses and activation types are admitted
+ * @return          routing activation response code 
+ */
+unsigned char parseRoutingActivation(unsigned char *data, const AddressAdmissionPolicy& policy) {
     
+    uint16_t address = 0;
+    address |= (uint16_t)data[0] << 8;
+    address |= (uint16_t)data[1];
+    unsigned char activationType = data[2];
+
     //Check if source address is known
-    uint32_t address = 0;
-    address |= (uint32_t)data[0] << 8;
-    address |= (uint32_t)data[1];
-    if(!checkSourceAddress(address)) {
+    if(!policy.isKnown(address)) {
         //send routing activation negative response code --> close socket
         return _UnknownSourceAddressCode;
     }
-    
+
     //Check if routing activation type is supported
-    switch(data[2]) {
-        case 0x00: {
-            //Activation Type default
-            break;
-        }
-        case 0x01: {
-            //Activation Type WWH-OBD
-            break;
-        }
-        default: {
-            //unknown activation type
-            //send routing activation negative response code --> close socket
-            return _UnsupportedRoutingTypeCode;
-        }
+    if(!policy.isActivationTypeSupported(activationType)) {
+        //send routing activation negative response code --> close socket
+        return _UnsupportedRoutingTypeCode;
+    }
+
+    //Check if the address may use this activation type
+    if(!policy.isAllowed(address, activationType)) {
+        return _UnknownSourceAddressCode;
     }
     
     //if not exited before, send routing activation positive response
@@ -42,13 +48,29 @@ unsigned char parseRoutingActivation(unsigned char *data) {
  * generic header
  * @param clientAddress     address of the test equipment
  * @param responseCode      routing activation response code
- * @return                  complete routing activation response
+ * @return                  complete routing activation response, release with delete[]
  */
 unsigned char* createRoutingActivationResponse(unsigned short sourceAddress, unsigned char clientAddress[2],
                                                 unsigned char responseCode) {
     
-    unsigned char* message = createGenericHeader(PayloadType::ROUTINGACTIVATIONRESPONSE,
-                                                    _ActivationResponseLength);
+    unsigned char* message = new unsigned char[_GenericHeaderLength + _ActivationResponseLength];
+    encodeRoutingActivationResponse(message, sourceAddress, clientAddress, responseCode);
+    return message;
+}
+
+/**
+ * Writes the complete routing activation response, which also contains the
+ * generic header, into a caller provided buffer
+ * @param buffer            buffer with space for _GenericHeaderLength + _ActivationResponseLength bytes
+ * @param clientAddress     address of the test equipment
+ * @param responseCode      routing activation response code
+ * @return                  number of written bytes
+ */
+int encodeRoutingActivationResponse(unsigned char* buffer, unsigned short sourceAddress,
+                                    unsigned char clientAddress[2], unsigned char responseCode) {
+    
+    unsigned char* message = buffer;
+    encodeGenericHeader(message, PayloadType::ROUTINGACTIVATIONRESPONSE, _ActivationResponseLength);
     
     //Logical address of external test equipment
     message[8] = clientAddress[0];
@@ -67,23 +89,15 @@ unsigned char* createRoutingActivationResponse(unsigned short sourceAddress, uns
     message[15] = 0x00;
     message[16] = 0x00;           
     
-    return message;
+    return _GenericHeaderLength + _ActivationResponseLength;
 }
 
 /**
- * Checks if the submitted address is valid
+ * Checks if the submitted address is valid for the default activation type
  * @param address	the address which will be checked
  * @return			true if address is valid
  */
 bool checkSourceAddress(uint32_t address) {
-    uint32_t minAddress = 3584;  // 0x0E00
-    uint32_t maxAddress = 4095;     // 0x0FFF
-    
-    for(uint32_t i = minAddress; i <= maxAddress; i++) {
-        if(address == i) {
-            return true;
-        }
-    }
-           
-    return false;
-}
\ No newline at end of file
+    return address < (uint32_t)_AddressCount &&
+            getAddressAdmissionPolicy()->isAllowed((uint16_t)address, _DefaultActivationType);
+}
@@ -0,0 +1,58 @@
+#include "VehicleAnnouncementScheduler.h"
+
+#include <random>
+#include "DoIPLogger.h"
+
+/**
+ * @param wheel     timer wheel which drives the announcements, e.g. the one of an event loop
+ * @param sender    sends one announcement and returns the sent bytes or -1
+ */
+VehicleAnnouncementScheduler::VehicleAnnouncementScheduler(TimerWheel& wheel, AnnouncementSender sender):
+    timerWheel(wheel), sender(sender), timerEntry(std::bind(&VehicleAnnouncementScheduler::announce, this)) {
+}
+
+/**
+ * Schedules the announcements after a random A_DoIP_Announce_Wait,
+ * so that entities which start at the same time do not collide
+ */
+void VehicleAnnouncementScheduler::start() {
+    std::random_device random;
+    start(std::uniform_int_distribution<int>(0, _MaxAnnounceWaitMs)(random));
+}
+
+/**
+ * Schedules the announcements, may be called from any thread
+ * @param waitMs    delay until the first announcement
+ */
+void VehicleAnnouncementScheduler::start(int waitMs) {
+    remainingAnnouncements = announceNum.load();
+    if(remainingAnnouncements <= 0) {
+        timerWheel.cancel(timerEntry);
+        return;
+    }
+    timerWheel.arm(timerEntry, waitMs);
+}
+
+/**
+ * Cancels the pending announcements
+ */
+void VehicleAnnouncementScheduler::stop() {
+    remainingAnnouncements = 0;
+    timerWheel.cancel(timerEntry);
+}
+
+void VehicleAnnouncementScheduler::announce() {
+    if(remainingAnnouncements <= 0) {
+        return;
+    }
+
+    if(sender() > 0) {
+        DOIP_LOG_INFO("Sending Vehicle Announcement");
+    } else {
+        DOIP_LOG_WARNING("Failed Sending Vehicle Announcement");
+    }
+
+    if(--remainingAnnouncements > 0) {
+        timerWheel.arm(timerEntry, announceIntervalMs);
+    }
+}
@@ -7,13 +7,27 @@ unsigned char* createVehicleIdentificationResponse(std::string VIN,unsigned shor
                                                     unsigned char* EID, unsigned char* GID,
                                                     unsigned char FurtherActionReq) //also used für the Vehicle Announcement
 {
-    unsigned char* message = createGenericHeader(PayloadType::VEHICLEIDENTRESPONSE, _VIResponseLength);
+    unsigned char* message = new unsigned char[_GenericHeaderLength + _VIResponseLength];
+    encodeVehicleIdentificationResponse(message, VIN, LogicalAddress, EID, GID, FurtherActionReq);
+    return message;
+}
+
+/**
+ * Writes a vehicle identification response or vehicle announcement into a caller provided buffer
+ * @param buffer    buffer with space for _GenericHeaderLength + _VIResponseLength bytes
+ * @return          number of written bytes
+ */
+int encodeVehicleIdentificationResponse(unsigned char* buffer, const std::string& VIN, unsigned short LogicalAddress,
+                                        unsigned char* EID, unsigned char* GID, unsigned char FurtherActionReq)
+{
+    unsigned char* message = buffer;
+    encodeGenericHeader(message, PayloadType::VEHICLEIDENTRESPONSE, _VIResponseLength);
     
-    //VIN Number 
+    //VIN Number, padded with zeros if the configured VIN is shorter than 17 characters
     int j = 0;
     for(int i = 8; i <= 24; i++)
     {      
-        message[i] = (unsigned char)VIN[j];
+        message[i] = j < (int)VIN.size() ? (unsigned char)VIN[j] : 0x00;
         j++;
     }
     
@@ -39,6 +53,5 @@ unsigned char* createVehicleIdentificationResponse(std::string VIN,unsigned shor
     
     message[39] = FurtherActionReq;
     
-    return message;
+    return _GenericHeaderLength + _VIResponseLength;
 }
-
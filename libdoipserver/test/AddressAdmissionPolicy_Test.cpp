@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "AddressAdmissionPolicy.h"
+#include "RoutingActivationHandler.h"
+
+/*
+* Checks if the default policy admits exactly the tester range for the default activation types
+*/
+TEST(AddressAdmissionPolicyTest, DefaultPolicy) {
+	std::shared_ptr<const AddressAdmissionPolicy> policy = AddressAdmissionPolicy::createDefault();
+
+	ASSERT_TRUE(policy->isAllowed(0x0E00, _DefaultActivationType));
+	ASSERT_TRUE(policy->isAllowed(0x0FFF, _WwhObdActivationType));
+	ASSERT_FALSE(policy->isAllowed(0x0DFF, _DefaultActivationType));
+	ASSERT_FALSE(policy->isAllowed(0x1000, _DefaultActivationType));
+	ASSERT_FALSE(policy->isActivationTypeSupported(_CentralSecurityActivationType));
+}
+
+/*
+* Checks if several ranges, blocked addresses and rules per activation type are combined
+*/
+TEST(AddressAdmissionPolicyTest, RangesAndBlockedAddresses) {
+	AddressAdmissionPolicy policy;
+	policy.supportActivationType(_DefaultActivationType);
+	policy.allowRange(0x0E00, 0x0E7F);
+	policy.allowRange(0x0F00, 0x0F0F);
+	policy.block(0x0E10);
+	policy.allowRange(0x0E80, 0x0E8F, _CentralSecurityActivationType);
+	policy.block(0x0F00, _CentralSecurityActivationType);
+
+	ASSERT_TRUE(policy.isAllowed(0x0E0F, _DefaultActivationType));
+	ASSERT_FALSE(policy.isAllowed(0x0E10, _DefaultActivationType));
+	ASSERT_TRUE(policy.isAllowed(0x0F05, _DefaultActivationType));
+	ASSERT_FALSE(policy.isAllowed(0x0E80, _DefaultActivationType));
+
+	ASSERT_TRUE(policy.isActivationTypeSupported(_CentralSecurityActivationType));
+	ASSERT_TRUE(policy.isAllowed(0x0E80, _CentralSecurityActivationType));
+	ASSERT_TRUE(policy.isAllowed(0x0E00, _CentralSecurityActivationType)) << "common rules were not copied";
+	ASSERT_FALSE(policy.isAllowed(0x0F00, _CentralSecurityActivationType));
+	ASSERT_TRUE(policy.isAllowed(0x0F00, _DefaultActivationType));
+}
+
+/*
+* Checks if a swapped in policy is used for following routing activation requests
+*/
+TEST(AddressAdmissionPolicyTest, SwapPolicy) {
+	unsigned char request[] = {0x0E, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00};
+	ASSERT_EQ(parseRoutingActivation(request), _SuccessfullyRoutedCode);
+
+	std::shared_ptr<AddressAdmissionPolicy> policy = std::make_shared<AddressAdmissionPolicy>();
+	policy->supportActivationType(_DefaultActivationType);
+	policy->allowRange(0x0E00, 0x0FFF);
+	policy->block(0x0E10);
+	setAddressAdmissionPolicy(policy);
+
+	ASSERT_EQ(parseRoutingActivation(request), _UnknownSourceAddressCode);
+	request[2] = _WwhObdActivationType;
+	ASSERT_EQ(parseRoutingActivation(request), _UnknownSourceAddressCode) << "address is checked first";
+	request[1] = 0x11;
+	ASSERT_EQ(parseRoutingActivation(request), _UnsupportedRoutingTypeCode);
+
+	setAddressAdmissionPolicy(nullptr);
+	request[1] = 0x10;
+	request[2] = _DefaultActivationType;
+	ASSERT_EQ(parseRoutingActivation(request), _SuccessfullyRoutedCode);
+}
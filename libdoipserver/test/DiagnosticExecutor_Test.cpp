@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "DiagnosticExecutor.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <vector>
+
+/*
+* Checks if tasks with the same key run in submission order on several workers
+*/
+TEST(DiagnosticExecutorTest, KeepsOrderPerKey) {
+	DiagnosticExecutor executor(4, 8000);
+	std::mutex resultMutex;
+	std::vector<std::vector<int>> results(8);
+
+	for(int i = 0; i < 1000; i++) {
+		for(unsigned short target = 0; target < results.size(); target++) {
+			ASSERT_TRUE(executor.submit(DiagnosticExecutor::makeKey(1, target), [&resultMutex, &results, target, i]() {
+				std::lock_guard<std::mutex> lock(resultMutex);
+				results[target].push_back(i);
+			}));
+		}
+	}
+	executor.drain();
+
+	for(const std::vector<int>& result : results) {
+		ASSERT_EQ(result.size(), 1000u);
+		for(int i = 0; i < 1000; i++) {
+			ASSERT_EQ(result[i], i) << "tasks of one key were reordered";
+		}
+	}
+	ASSERT_EQ(executor.getPendingTasks(), 0u);
+}
+
+/*
+* Checks if a blocked key does not delay the tasks of other keys,
+* idle workers steal them from the blocked worker
+*/
+TEST(DiagnosticExecutorTest, BlockedKeyDoesNotStallOthers) {
+	DiagnosticExecutor executor(2);
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	std::atomic<int> finished(0);
+
+	executor.submit(DiagnosticExecutor::makeKey(1, 0x10), [released]() { released.wait(); });
+	executor.submit(DiagnosticExecutor::makeKey(1, 0x10), [&finished]() { finished++; });
+	for(unsigned short target = 0; target < 64; target++) {
+		executor.submit(DiagnosticExecutor::makeKey(2, target), [&finished]() { finished++; });
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while(finished < 64 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	ASSERT_EQ(finished, 64) << "the blocked key or its successor delayed other keys";
+	ASSERT_GT(executor.getStolenStrands(), 0u);
+
+	release.set_value();
+	executor.drain();
+	ASSERT_EQ(finished, 65);
+}
+
+/*
+* Checks if tasks beyond the queue depth are rejected
+*/
+TEST(DiagnosticExecutorTest, RejectsTasksBeyondQueueDepth) {
+	DiagnosticExecutor executor(1, 4);
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+
+	for(int i = 0; i < 4; i++) {
+		ASSERT_TRUE(executor.submit(1, [released]() { released.wait(); }));
+	}
+	ASSERT_FALSE(executor.submit(1, []() { }));
+	ASSERT_EQ(executor.getRejectedTasks(), 1u);
+
+	release.set_value();
+	executor.drain();
+	ASSERT_TRUE(executor.submit(1, []() { }));
+}
+
+/*
+* Checks if a reserved place is not taken by other tasks and is returned when it is cancelled
+*/
+TEST(DiagnosticExecutorTest, ReservedPlaceIsKept) {
+	DiagnosticExecutor executor(1, 1);
+	ASSERT_TRUE(executor.reserve());
+	ASSERT_FALSE(executor.submit(1, []() { }));
+	ASSERT_FALSE(executor.reserve());
+
+	executor.cancelReservation();
+	ASSERT_TRUE(executor.reserve());
+	std::atomic<bool> ran(false);
+	executor.submitReserved(1, [&ran]() { ran = true; });
+	executor.drain();
+	ASSERT_TRUE(ran);
+}
+
+/*
+* Checks if the destructor runs the tasks which are still queued
+*/
+TEST(DiagnosticExecutorTest, DestructorRunsQueuedTasks) {
+	std::atomic<int> finished(0);
+	{
+		DiagnosticExecutor executor(2);
+		for(int i = 0; i < 100; i++) {
+			executor.submit(i % 3, [&finished]() {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				finished++;
+			});
+		}
+	}
+	ASSERT_EQ(finished, 100);
+}
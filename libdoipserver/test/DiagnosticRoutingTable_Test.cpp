@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include "DiagnosticRoutingTable.h"
+#include "DoIPConnection.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class TestEcu : public EcuHandler {
+	public:
+		explicit TestEcu(int id): id(id) { }
+
+		void handleDiagnosticMessage(const DiagnosticMessageView& message, const TesterRoute& route) override {
+			(void)message;
+			(void)route;
+		}
+
+		int id;
+};
+
+class DiagnosticRoutingTableTest : public ::testing::Test {
+	public:
+		DiagnosticRoutingTable table;
+
+	protected:
+		int lookupId(unsigned short address) {
+			std::shared_ptr<EcuHandler> handler = table.lookup(address);
+			return handler ? static_cast<TestEcu*>(handler.get())->id : -1;
+		}
+};
+
+/*
+* Checks if physical addresses are routed to their handler and others are unknown
+*/
+TEST_F(DiagnosticRoutingTableTest, RoutesPhysicalAddresses) {
+	table.addEcu(0x0030, std::make_shared<TestEcu>(3));
+	table.addEcu(0x0010, std::make_shared<TestEcu>(1));
+	table.addEcu(0x0020, std::make_shared<TestEcu>(2));
+
+	ASSERT_EQ(lookupId(0x0010), 1);
+	ASSERT_EQ(lookupId(0x0020), 2);
+	ASSERT_EQ(lookupId(0x0030), 3);
+	ASSERT_EQ(lookupId(0x0011), -1);
+	ASSERT_EQ(lookupId(0xE400), -1);
+}
+
+/*
+* Checks if functional ranges apply to addresses without physical route
+*/
+TEST_F(DiagnosticRoutingTableTest, FunctionalRangeAfterPhysicalRoute) {
+	table.addFunctionalRange(0xE400, 0xE4FF, std::make_shared<TestEcu>(1));
+	table.addFunctionalRange(0xE400, 0xEFFF, std::make_shared<TestEcu>(2));
+	table.addEcu(0xE410, std::make_shared<TestEcu>(3));
+
+	ASSERT_EQ(lookupId(0xE400), 1);
+	ASSERT_EQ(lookupId(0xE4FF), 1);
+	ASSERT_EQ(lookupId(0xE500), 2) << "overlapping range was not used";
+	ASSERT_EQ(lookupId(0xE410), 3) << "physical route has priority";
+	ASSERT_EQ(lookupId(0xF000), -1);
+}
+
+/*
+* Checks if routes can be replaced and removed
+*/
+TEST_F(DiagnosticRoutingTableTest, ReplacesAndRemovesRoutes) {
+	table.addEcu(0x0010, std::make_shared<TestEcu>(1));
+	table.addEcu(0x0010, std::make_shared<TestEcu>(2));
+	ASSERT_EQ(lookupId(0x0010), 2);
+
+	ASSERT_TRUE(table.removeEcu(0x0010));
+	ASSERT_FALSE(table.removeEcu(0x0010));
+	ASSERT_EQ(lookupId(0x0010), -1);
+
+	table.addEcu(0x0010, std::make_shared<TestEcu>(1));
+	table.addFunctionalRange(0xE400, 0xE4FF, std::make_shared<TestEcu>(2));
+	table.clear();
+	ASSERT_EQ(lookupId(0x0010), -1);
+	ASSERT_EQ(lookupId(0xE400), -1);
+}
+
+/*
+* Checks if lookups return consistent results while routes are changed
+*/
+TEST_F(DiagnosticRoutingTableTest, LookupsDuringChanges) {
+	table.addEcu(0x0001, std::make_shared<TestEcu>(1));
+	std::atomic<bool> running(true);
+	std::atomic<int> failures(0);
+
+	std::vector<std::thread> readers;
+	for(int i = 0; i < 3; i++) {
+		readers.push_back(std::thread([this, &running, &failures]() {
+			while(running) {
+				if(lookupId(0x0001) != 1) {
+					failures++;
+				}
+				int changing = lookupId(0x0002);
+				if(changing != -1 && changing != 2) {
+					failures++;
+				}
+			}
+		}));
+	}
+
+	for(int i = 0; i < 500; i++) {
+		table.addEcu(0x0002, std::make_shared<TestEcu>(2));
+		table.removeEcu(0x0002);
+	}
+	running = false;
+	for(std::thread& reader : readers) {
+		reader.join();
+	}
+
+	ASSERT_EQ(failures, 0);
+}
+
+/*
+* Checks if a route to a closed tester connection does not send
+*/
+TEST(TesterRouteTest, DisconnectedTester) {
+	std::weak_ptr<DoIPConnection> closed;
+	TesterRoute route(closed, 0x0E00, 0x0028);
+	unsigned char response[] = {0x62, 0xF1, 0x90};
+
+	ASSERT_FALSE(route.isConnected());
+	ASSERT_EQ(route.sendResponse(0x0028, response, sizeof(response)), -1);
+	ASSERT_EQ(route.getTesterAddress(), 0x0E00);
+	ASSERT_EQ(route.getEcuAddress(), 0x0028);
+}
+
+/*
+* Checks if the ECUs which answer a functional request send their responses
+* with their own address and not with the functional target address
+*/
+TEST(TesterRouteTest, FunctionalRequestIsAnsweredByEcuAddresses) {
+	int sockets[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+	std::shared_ptr<DoIPConnection> connection = std::make_shared<DoIPConnection>(sockets[0], 0x0010);
+
+	class FunctionalEcus : public EcuHandler {
+		public:
+			void handleDiagnosticMessage(const DiagnosticMessageView& message, const TesterRoute& route) override {
+				(void)message;
+				unsigned char response[] = {0x50, 0x01};
+				route.sendResponse(0x0028, response, sizeof(response));
+				route.sendResponse(0x0029, response, sizeof(response));
+			}
+	};
+	DiagnosticRoutingTable table;
+	table.addFunctionalRange(0xE400, 0xE4FF, std::make_shared<FunctionalEcus>());
+
+	unsigned char request[] = {0x10, 0x01};
+	DiagnosticMessageView view(0x0E00, 0xE400, request, sizeof(request), BufferPool::defaultPool());
+	TesterRoute route(connection, view.getSourceAddress(), view.getTargetAddress());
+	table.lookup(view.getTargetAddress())->handleDiagnosticMessage(view, route);
+
+	const int responseLength = _GenericHeaderLength + _DiagnosticMessageMinimumLength + 2;
+	unsigned char received[2 * responseLength];
+	ASSERT_EQ(recv(sockets[1], received, sizeof(received), MSG_WAITALL), (ssize_t)sizeof(received));
+	ASSERT_EQ(received[8], 0x00);
+	ASSERT_EQ(received[9], 0x28);
+	ASSERT_EQ(received[responseLength + 8], 0x00);
+	ASSERT_EQ(received[responseLength + 9], 0x29);
+
+	connection.reset();
+	close(sockets[0]);
+	close(sockets[1]);
+}
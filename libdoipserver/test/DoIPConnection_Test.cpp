@@ -0,0 +1,388 @@
+#include <gtest/gtest.h>
+#include "DoIPConnection.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+class DoIPConnectionSendQueueTest : public ::testing::Test {
+	public:
+		int sockets[2];
+		DoIPConnection* connection = nullptr;
+		std::vector<unsigned char> payload;
+		std::vector<bool> throttleEvents;
+		bool closed = false;
+
+	protected:
+		void SetUp() override {
+			ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+			int bufferSize = 4096;
+			setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+			fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+
+			connection = new DoIPConnection(sockets[0], 0x0028);
+			connection->setCallback(nullptr, nullptr, [this]() { closed = true; });
+			connection->setBackpressureCallback([this](bool throttle) { throttleEvents.push_back(throttle); });
+
+			payload.resize(10000);
+			for(size_t i = 0; i < payload.size(); i++) {
+				payload[i] = (unsigned char)(i * 13);
+			}
+		}
+
+		void TearDown() override {
+			delete connection;
+			if(!closed) {
+				close(sockets[0]);
+			}
+			close(sockets[1]);
+		}
+
+		void setLimits(size_t highWaterMark, size_t lowWaterMark, size_t limit, SendOverflowPolicy policy) {
+			SendQueueLimits limits;
+			limits.highWaterMark = highWaterMark;
+			limits.lowWaterMark = lowWaterMark;
+			limits.limit = limit;
+			limits.overflowPolicy = policy;
+			connection->setSendQueueLimits(limits);
+		}
+
+		//reads everything the peer can read right now
+		size_t readAvailable(std::vector<unsigned char>& received) {
+			unsigned char buffer[65536];
+			size_t total = 0;
+			ssize_t result;
+			while((result = recv(sockets[1], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+				received.insert(received.end(), buffer, buffer + result);
+				total += result;
+			}
+			return total;
+		}
+
+		//checks if the received bytes are complete diagnostic messages with the test payload
+		void expectMessages(const std::vector<unsigned char>& received, size_t count) {
+			size_t messageLength = _GenericHeaderLength + _DiagnosticMessageMinimumLength + payload.size();
+			ASSERT_EQ(received.size(), count * messageLength);
+			for(size_t i = 0; i < count; i++) {
+				const unsigned char* message = received.data() + i * messageLength;
+				ASSERT_EQ(message[2], 0x80);
+				ASSERT_EQ(message[3], 0x01);
+				ASSERT_TRUE(std::equal(payload.begin(), payload.end(), message + _GenericHeaderLength + _DiagnosticMessageMinimumLength))
+					<< "message " << i << " is corrupted";
+			}
+		}
+
+		int sendPayload() {
+			struct iovec vector = { payload.data(), payload.size() };
+			return connection->sendDiagnosticPayload(0x0028, &vector, 1);
+		}
+};
+
+/*
+* Checks if messages which do not fit into the socket buffer are queued
+* and sent in order when the socket is writable again
+*/
+TEST_F(DoIPConnectionSendQueueTest, QueuesAndFlushesInOrder) {
+	for(int i = 0; i < 20; i++) {
+		ASSERT_GT(sendPayload(), 0) << "send blocked or failed";
+	}
+	ASSERT_GT(connection->getQueuedBytes(), 0u);
+
+	std::vector<unsigned char> received;
+	while(connection->getQueuedBytes() > 0) {
+		readAvailable(received);
+		ASSERT_GE(connection->flushSendQueue(), 0);
+	}
+	readAvailable(received);
+
+	expectMessages(received, 20);
+}
+
+/*
+* Checks if the application is told to throttle above the high water mark
+* and to resume below the low water mark
+*/
+TEST_F(DoIPConnectionSendQueueTest, NotifiesWaterMarks) {
+	setLimits(50000, 20000, 1000000, OVERFLOWDROP);
+
+	int sent = 0;
+	while(throttleEvents.empty() && sent < 100) {
+		ASSERT_GT(sendPayload(), 0);
+		sent++;
+	}
+	ASSERT_EQ(throttleEvents, std::vector<bool>({true}));
+	ASSERT_GE(connection->getQueuedBytes(), 50000u);
+
+	std::vector<unsigned char> received;
+	while(connection->getQueuedBytes() > 0) {
+		readAvailable(received);
+		connection->flushSendQueue();
+	}
+	readAvailable(received);
+
+	ASSERT_EQ(throttleEvents, std::vector<bool>({true, false}));
+	expectMessages(received, sent);
+}
+
+/*
+* Checks if messages are dropped completely when the queue is full
+*/
+TEST_F(DoIPConnectionSendQueueTest, DropsMessagesWhenFull) {
+	setLimits(1000000, 0, 30000, OVERFLOWDROP);
+
+	int accepted = 0;
+	for(int i = 0; i < 20; i++) {
+		if(sendPayload() > 0) {
+			accepted++;
+		}
+	}
+	ASSERT_LT(accepted, 20);
+	ASSERT_EQ(connection->getDroppedMessages(), (uint64_t)(20 - accepted));
+	ASSERT_LE(connection->getQueuedBytes(), 30000u);
+
+	std::vector<unsigned char> received;
+	while(connection->getQueuedBytes() > 0) {
+		readAvailable(received);
+		connection->flushSendQueue();
+	}
+	readAvailable(received);
+	expectMessages(received, accepted);
+}
+
+/*
+* Checks if the connection is closed when the queue is full
+*/
+TEST_F(DoIPConnectionSendQueueTest, DisconnectsWhenFull) {
+	setLimits(1000000, 0, 30000, OVERFLOWDISCONNECT);
+
+	for(int i = 0; i < 20 && !closed; i++) {
+		sendPayload();
+	}
+	ASSERT_TRUE(closed);
+	ASSERT_EQ(connection->getQueuedBytes(), 0u);
+	ASSERT_EQ(sendPayload(), -1);
+}
+
+/*
+* Checks if a connection whose socket is released by its owner only shuts the
+* socket down when an executor thread closes it, so the socket number is not reused
+*/
+TEST_F(DoIPConnectionSendQueueTest, LeavesSocketToOwner) {
+	setLimits(1000000, 0, 30000, OVERFLOWDISCONNECT);
+	connection->setSocketReleasedByOwner();
+
+	std::thread executor([this]() {
+		for(int i = 0; i < 20 && !closed; i++) {
+			sendPayload();
+		}
+	});
+	executor.join();
+	ASSERT_TRUE(closed);
+	ASSERT_FALSE(connection->isSocketActive());
+	ASSERT_NE(fcntl(sockets[0], F_GETFD), -1) << "the socket was closed before the owner released it";
+
+	std::vector<unsigned char> received;
+	readAvailable(received);
+	unsigned char byte;
+	ASSERT_EQ(recv(sockets[1], &byte, 1, MSG_DONTWAIT), 0) << "the tester was not disconnected";
+	close(sockets[0]);
+}
+
+/*
+* Checks if the sender waits for the tester when the queue is full
+*/
+TEST_F(DoIPConnectionSendQueueTest, BlocksWhenFull) {
+	setLimits(1000000, 0, 30000, OVERFLOWBLOCK);
+
+	std::atomic<bool> sending(true);
+	std::vector<unsigned char> received;
+	std::thread reader([this, &sending, &received]() {
+		while(sending) {
+			readAvailable(received);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
+	for(int i = 0; i < 50; i++) {
+		EXPECT_GT(sendPayload(), 0) << "message was not accepted after waiting";
+		EXPECT_LE(connection->getQueuedBytes(), 30000u + payload.size() + 12);
+	}
+	while(connection->getQueuedBytes() > 0) {
+		connection->flushSendQueue();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	sending = false;
+	reader.join();
+	readAvailable(received);
+
+	ASSERT_EQ(connection->getDroppedMessages(), 0u);
+	expectMessages(received, 50);
+}
+
+/*
+* Checks if a transport which sends itself is told once about queued
+* messages and gets them in order until all were sent
+*/
+TEST_F(DoIPConnectionSendQueueTest, SubmitsQueueToTransport) {
+	int submits = 0;
+	connection->setSendSubmitCallback([&submits]() { submits++; });
+	for(int i = 0; i < 3; i++) {
+		ASSERT_GT(sendPayload(), 0);
+	}
+	ASSERT_EQ(submits, 1) << "a submitted send is still in flight";
+
+	std::vector<unsigned char> received;
+	struct iovec vectors[_MaxFlushVectors];
+	int count;
+	while((count = connection->collectSendVectors(vectors, _MaxFlushVectors)) > 0) {
+		//sends at most one message per round, like a short write of the transport
+		ssize_t sent = writev(sockets[0], vectors, 1);
+		ASSERT_GT(sent, 0);
+		bool more = connection->completeSend(sent);
+		readAvailable(received);
+		if(!more) {
+			break;
+		}
+	}
+	readAvailable(received);
+
+	expectMessages(received, 3);
+	ASSERT_EQ(connection->getQueuedBytes(), 0u);
+
+	ASSERT_GT(sendPayload(), 0);
+	ASSERT_EQ(submits, 2) << "the next message has to be submitted again";
+}
+
+/*
+* Checks if the connection of a tester is closed after T_TCP_General_Inactivity
+* without a message, and a message of the tester restarts the timer
+*/
+TEST(DoIPConnectionInactivityTest, ClosesInactiveTester) {
+	int sockets[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+	uint64_t currentTime = 0;
+	TimerWheel wheel(10, 64, [&currentTime]() { return currentTime; });
+	auto advanceFor = [&currentTime, &wheel](int milliseconds) {
+		currentTime += milliseconds;
+		wheel.advance();
+	};
+
+	bool closed = false;
+	DoIPConnection connection(sockets[0], 0x0028);
+	connection.setTimerWheel(wheel);
+	connection.setCallback(nullptr, nullptr, [&closed]() { closed = true; });
+	connection.setGeneralInactivityTime(2);
+
+	unsigned char routingActivationRequest[] = {0x02, 0xFD, 0x00, 0x05, 0x00, 0x00, 0x00, 0x07,
+		0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	connection.processReceivedData(routingActivationRequest, sizeof(routingActivationRequest));
+	unsigned char received[64];
+	ASSERT_GT(recv(sockets[1], received, sizeof(received), MSG_DONTWAIT), 0);
+
+	//any message of the tester restarts the inactivity timer
+	advanceFor(1500);
+	unsigned char aliveCheckResponse[] = {0x02, 0xFD, 0x00, 0x08, 0x00, 0x00, 0x00, 0x02, 0x0E, 0x00};
+	connection.processReceivedData(aliveCheckResponse, sizeof(aliveCheckResponse));
+	advanceFor(1500);
+	ASSERT_FALSE(closed);
+
+	advanceFor(490);
+	ASSERT_FALSE(closed);
+	advanceFor(20);
+	ASSERT_TRUE(closed);
+	ASSERT_EQ(recv(sockets[1], received, sizeof(received), MSG_DONTWAIT), 0) << "the server sent a message instead of closing";
+
+	close(sockets[1]);
+}
+
+/*
+* Checks if one flush writes a queue of more messages than one write takes
+* and resumes the application, because an edge triggered socket is not
+* reported writable again while it still has space
+*/
+TEST(DoIPConnectionTcpSendQueueTest, FlushesLongQueueAtOnce) {
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT_GE(listener, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	ASSERT_EQ(bind(listener, (struct sockaddr*)&address, sizeof(address)), 0);
+	ASSERT_EQ(listen(listener, 1), 0);
+	ASSERT_EQ(getsockname(listener, (struct sockaddr*)&address, &addressLength), 0);
+
+	int tester = socket(AF_INET, SOCK_STREAM, 0);
+	int bufferSize = 4096;
+	setsockopt(tester, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+	ASSERT_EQ(connect(tester, (struct sockaddr*)&address, sizeof(address)), 0);
+	int server = accept(listener, nullptr, nullptr);
+	ASSERT_GE(server, 0);
+	close(listener);
+	setsockopt(server, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+
+	std::vector<bool> throttleEvents;
+	DoIPConnection connection(server, 0x0028);
+	connection.setBackpressureCallback([&throttleEvents](bool throttle) { throttleEvents.push_back(throttle); });
+	SendQueueLimits limits;
+	limits.highWaterMark = 1000;
+	limits.lowWaterMark = 100;
+	limits.limit = 1000000;
+	limits.overflowPolicy = OVERFLOWDROP;
+	connection.setSendQueueLimits(limits);
+
+	//fill the socket, so the messages have to be queued
+	unsigned char filler[1024] = {};
+	size_t fillerBytes = 0;
+	ssize_t result;
+	while((result = send(server, filler, sizeof(filler), MSG_DONTWAIT)) > 0) {
+		fillerBytes += result;
+	}
+
+	const int messageCount = 3 * _MaxFlushVectors;
+	unsigned char payload[8] = {0x62, 0xF1, 0x90, 0x01, 0x02, 0x03, 0x04, 0x05};
+	for(int i = 0; i < messageCount; i++) {
+		payload[7] = (unsigned char)i;
+		struct iovec vector = { payload, sizeof(payload) };
+		ASSERT_GT(connection.sendDiagnosticPayload(0x0028, &vector, 1), 0);
+	}
+	size_t messageLength = _GenericHeaderLength + _DiagnosticMessageMinimumLength + sizeof(payload);
+	ASSERT_EQ(connection.getQueuedBytes(), messageCount * messageLength);
+	ASSERT_EQ(throttleEvents, std::vector<bool>({true}));
+
+	std::vector<unsigned char> received(fillerBytes + messageCount * messageLength);
+	size_t receivedBytes = 0;
+	while(receivedBytes < fillerBytes) {
+		result = recv(tester, received.data() + receivedBytes, fillerBytes - receivedBytes, 0);
+		ASSERT_GT(result, 0);
+		receivedBytes += result;
+	}
+	struct pollfd writable = { server, POLLOUT, 0 };
+	ASSERT_EQ(poll(&writable, 1, 1000), 1);
+
+	ASSERT_EQ(connection.flushSendQueue(), (int)(messageCount * messageLength));
+	ASSERT_EQ(connection.getQueuedBytes(), 0u) << "the flush stopped before the socket was full";
+	ASSERT_EQ(throttleEvents, std::vector<bool>({true, false}));
+
+	while(receivedBytes < received.size()) {
+		result = recv(tester, received.data() + receivedBytes, received.size() - receivedBytes, 0);
+		ASSERT_GT(result, 0);
+		receivedBytes += result;
+	}
+	for(int i = 0; i < messageCount; i++) {
+		const unsigned char* message = received.data() + fillerBytes + i * messageLength;
+		ASSERT_EQ(message[3], 0x01);
+		ASSERT_EQ(message[messageLength - 1], (unsigned char)i) << "message " << i << " is missing";
+	}
+
+	close(server);
+	close(tester);
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include "DoIPEventLoop.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+
+class DoIPEventLoopUringTest : public ::testing::Test {
+	public:
+		DoIPEventLoop loop;
+		int listener = -1;
+		struct sockaddr_in address = {};
+
+	protected:
+		void SetUp() override {
+			listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t addressLength = sizeof(address);
+			ASSERT_EQ(bind(listener, (struct sockaddr*)&address, sizeof(address)), 0);
+			getsockname(listener, (struct sockaddr*)&address, &addressLength);
+			ASSERT_EQ(listen(listener, 8), 0);
+		}
+
+		void TearDown() override {
+			close(listener);
+		}
+
+		int connectTester() {
+			int tester = socket(AF_INET, SOCK_STREAM, 0);
+			connect(tester, (struct sockaddr*)&address, sizeof(address));
+			return tester;
+		}
+};
+
+/*
+* Checks if connections are accepted, received and answered by the ring and
+* the end of the stream is reported
+*/
+TEST_F(DoIPEventLoopUringTest, AcceptsReceivesAndSends) {
+	if(!IoUring::isSupported()) {
+		return;
+	}
+	ASSERT_TRUE(loop.setBackend(IOURINGBACKEND));
+
+	int accepted = -1;
+	std::string received;
+	bool closed = false;
+	int sendResult = 0;
+	ASSERT_TRUE(loop.acceptConnections(listener, [&](int fd) {
+		accepted = fd;
+		loop.receiveStream(fd, [&, fd](unsigned char* data, size_t length) {
+			if(length == 0) {
+				closed = true;
+				return;
+			}
+			received.append(reinterpret_cast<char*>(data), length);
+			struct iovec vectors[2] = { { (void*)"echo:", 5 }, { data, length } };
+			loop.sendStream(fd, vectors, 2, [&](int result) { sendResult = result; });
+		});
+	}));
+
+	int tester = connectTester();
+	for(int i = 0; i < 100 && accepted < 0; i++) {
+		loop.runOnce(10);
+	}
+	ASSERT_GE(accepted, 0);
+
+	ASSERT_EQ(write(tester, "ping", 4), 4);
+	for(int i = 0; i < 100 && sendResult == 0; i++) {
+		loop.runOnce(10);
+	}
+	ASSERT_EQ(received, "ping");
+	ASSERT_EQ(sendResult, 9);
+
+	char answer[16] = {};
+	ASSERT_EQ(recv(tester, answer, sizeof(answer), 0), 9);
+	ASSERT_EQ(std::string(answer), "echo:ping");
+
+	close(tester);
+	for(int i = 0; i < 100 && !closed; i++) {
+		loop.runOnce(10);
+	}
+	ASSERT_TRUE(closed);
+	loop.removeDescriptor(accepted);
+	loop.runOnce(0);
+	close(accepted);
+}
+
+/*
+* Checks if tasks posted from another thread wake up the ring and deferred
+* tasks run in the same iteration
+*/
+TEST_F(DoIPEventLoopUringTest, RunsPostedAndDeferredTasks) {
+	if(!IoUring::isSupported()) {
+		return;
+	}
+	ASSERT_TRUE(loop.setBackend(IOURINGBACKEND));
+
+	bool posted = false;
+	bool deferred = false;
+	std::thread poster([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		loop.post([&]() {
+			posted = true;
+			loop.defer([&]() { deferred = true; });
+		});
+	});
+
+	ASSERT_GE(loop.runOnce(5000), 0);
+	for(int i = 0; i < 10 && !posted; i++) {
+		loop.runOnce(100);
+	}
+	poster.join();
+	ASSERT_TRUE(posted);
+	ASSERT_TRUE(deferred);
+}
+
+/*
+* Checks if the epoll loop reports a readable descriptor once per new data,
+* stops dispatching a removed descriptor and runs posted tasks
+*/
+TEST(DoIPEventLoopTest, DispatchesEdgeTriggeredEvents) {
+	DoIPEventLoop loop;
+	int sockets[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets), 0);
+
+	int dispatched = 0;
+	std::string received;
+	ASSERT_TRUE(loop.addDescriptor(sockets[0], EPOLLIN, [&](uint32_t events) {
+		ASSERT_TRUE(events & EPOLLIN);
+		dispatched++;
+		char buffer[16];
+		ssize_t length;
+		while((length = read(sockets[0], buffer, sizeof(buffer))) > 0) {
+			received.append(buffer, length);
+		}
+	}));
+
+	ASSERT_EQ(write(sockets[1], "ping", 4), 4);
+	ASSERT_EQ(loop.runOnce(1000), 1);
+	ASSERT_EQ(received, "ping");
+	ASSERT_EQ(loop.runOnce(0), 0) << "the drained descriptor is not reported again";
+	ASSERT_EQ(dispatched, 1);
+
+	loop.removeDescriptor(sockets[0]);
+	ASSERT_EQ(write(sockets[1], "pong", 4), 4);
+	loop.runOnce(0);
+	ASSERT_EQ(dispatched, 1);
+
+	bool posted = false;
+	std::thread poster([&]() { loop.post([&]() { posted = true; }); });
+	for(int i = 0; i < 10 && !posted; i++) {
+		loop.runOnce(100);
+	}
+	poster.join();
+	ASSERT_TRUE(posted);
+
+	close(sockets[0]);
+	close(sockets[1]);
+}
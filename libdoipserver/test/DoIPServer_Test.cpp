@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+#include "DoIPServer.h"
+#include "DiagnosticExecutor.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+//limits the datagrams per sendmmsg() call of the server, like the kernel does when its send buffer fills
+static std::atomic<unsigned int> sendBatchLimit(0);
+static std::atomic<int> sendBatchCalls(0);
+
+extern "C" int sendmmsg(int socket, struct mmsghdr* messages, unsigned int count, int flags) __THROW {
+	sendBatchCalls++;
+	if(sendBatchLimit > 0 && count > sendBatchLimit) {
+		count = sendBatchLimit;
+	}
+	return syscall(SYS_sendmmsg, socket, messages, count, flags);
+}
+
+class DoIPServerTest : public ::testing::Test {
+	public:
+		DoIPServer server;
+		int closedConnections = 0;
+
+		int connectTester() {
+			struct sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(_ServerPort);
+			int tester = socket(AF_INET, SOCK_STREAM, 0);
+			connect(tester, (struct sockaddr*)&address, sizeof(address));
+			return tester;
+		}
+
+		template<typename Condition>
+		void pollUntil(Condition condition) {
+			for(int i = 0; i < 100 && !condition(); i++) {
+				server.pollEvents(10);
+			}
+		}
+
+	protected:
+		void SetUp() override {
+			server.setConnectionCallback(nullptr, nullptr, [this](DoIPConnection&) { closedConnections++; });
+			server.setupTcpSocket();
+			ASSERT_TRUE(server.setupEventLoop());
+		}
+
+		void TearDown() override {
+			server.closeTcpSocket();
+		}
+};
+
+/*
+* Checks if a connection which the tester closed is reported as closed,
+* although accept() reuses its socket number before its posted release ran
+*/
+TEST_F(DoIPServerTest, ReleasesConnectionWhoseSocketIsReused) {
+	int first = connectTester();
+	pollUntil([this]() { return server.getConnectionCount() == 1; });
+	ASSERT_EQ(server.getConnectionCount(), 1u);
+
+	//the end of the first and the second connection are dispatched in the same round
+	close(first);
+	int second = connectTester();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	server.pollEvents(100);
+	pollUntil([this]() { return closedConnections == 1; });
+	ASSERT_EQ(closedConnections, 1);
+	ASSERT_EQ(server.getConnectionCount(), 1u);
+
+	//the tester closes first, so the server port is not left in TIME_WAIT
+	close(second);
+	pollUntil([this]() { return closedConnections == 2; });
+	ASSERT_EQ(closedConnections, 2);
+	ASSERT_EQ(server.getConnectionCount(), 0u);
+}
+
+/*
+* Checks if a connection above the configured limit is closed right away
+*/
+TEST_F(DoIPServerTest, ClosesConnectionsAboveLimit) {
+	server.setMaxConnections(1);
+	int first = connectTester();
+	pollUntil([this]() { return server.getConnectionCount() == 1; });
+	ASSERT_EQ(server.getConnectionCount(), 1u);
+
+	int second = connectTester();
+	unsigned char buffer[8];
+	ssize_t length = -1;
+	pollUntil([second, &buffer, &length]() {
+		length = recv(second, buffer, sizeof(buffer), MSG_DONTWAIT);
+		return length == 0;
+	});
+	ASSERT_EQ(length, 0) << "the second connection was not closed";
+	ASSERT_EQ(server.getConnectionCount(), 1u);
+	ASSERT_EQ(closedConnections, 0);
+
+	close(second);
+	close(first);
+	pollUntil([this]() { return closedConnections == 1; });
+	ASSERT_EQ(server.getConnectionCount(), 0u);
+}
+
+/*
+* Checks if a diagnostic message which does not fit into the executor queue
+* gets the negative ack code 0x05 instead of a positive ack
+*/
+TEST_F(DoIPServerTest, RejectsDiagnosticMessageWhenExecutorIsFull) {
+	DiagnosticExecutor executor(1, 1);
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	server.setDiagnosticExecutor(&executor);
+	server.setConnectionCallback(
+		[released](DoIPConnection&, unsigned short, unsigned char*, int) { released.wait(); },
+		[](DoIPConnection& connection, unsigned short targetAddress) {
+			connection.sendDiagnosticAck(targetAddress, true, _ValidDiagnosticMessageCode);
+			return true;
+		},
+		[this](DoIPConnection&) { closedConnections++; });
+
+	//routing activation and two diagnostic messages, the first one blocks the only worker
+	unsigned char requests[] = {
+		0x02, 0xFD, 0x00, 0x05, 0x00, 0x00, 0x00, 0x07, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x06, 0x0E, 0x00, 0x00, 0x28, 0x3E, 0x00,
+		0x02, 0xFD, 0x80, 0x01, 0x00, 0x00, 0x00, 0x06, 0x0E, 0x00, 0x00, 0x28, 0x3E, 0x00};
+	int tester = connectTester();
+	ASSERT_EQ(send(tester, requests, sizeof(requests), 0), (ssize_t)sizeof(requests));
+
+	const size_t activationLength = _GenericHeaderLength + 9;
+	const size_t ackLength = _GenericHeaderLength + _DiagnosticPositiveACKLength;
+	std::vector<unsigned char> received;
+	pollUntil([this, tester, &received, activationLength, ackLength]() {
+		unsigned char buffer[256];
+		ssize_t length = recv(tester, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if(length > 0) {
+			received.insert(received.end(), buffer, buffer + length);
+		}
+		return received.size() >= activationLength + 2 * ackLength;
+	});
+	ASSERT_EQ(received.size(), activationLength + 2 * ackLength);
+
+	const unsigned char* positiveAck = received.data() + activationLength;
+	ASSERT_EQ(positiveAck[2], 0x80);
+	ASSERT_EQ(positiveAck[3], 0x02);
+	const unsigned char* negativeAck = positiveAck + ackLength;
+	ASSERT_EQ(negativeAck[2], 0x80);
+	ASSERT_EQ(negativeAck[3], 0x03);
+	ASSERT_EQ(negativeAck[12], _OutOfMemoryCode);
+	ASSERT_EQ(executor.getRejectedTasks(), 1u);
+
+	release.set_value();
+	executor.drain();
+	close(tester);
+	pollUntil([this]() { return closedConnections == 1; });
+	ASSERT_EQ(closedConnections, 1);
+	server.setDiagnosticExecutor(nullptr);
+}
+
+class DoIPServerUdpTest : public ::testing::Test {
+	public:
+		DoIPServer server;
+		int testers[4];
+		std::vector<unsigned char> firstResponse;
+
+		//sends vehicle identification requests from the testers in turn
+		void sendRequests(int count) {
+			unsigned char request[] = {0x02, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+			struct sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(_ServerPort);
+			for(int i = 0; i < count; i++) {
+				ASSERT_EQ(sendto(testers[i % 4], request, sizeof(request), 0, (struct sockaddr*)&address, sizeof(address)),
+					(ssize_t)sizeof(request));
+			}
+		}
+
+		int receiveResponses(int tester) {
+			unsigned char response[_MaxUdpMessageLength];
+			ssize_t length;
+			int count = 0;
+			while((length = recv(tester, response, sizeof(response), MSG_DONTWAIT)) > 0) {
+				EXPECT_EQ(response[2], 0x00);
+				EXPECT_EQ(response[3], 0x04) << "response is no vehicle identification response";
+				firstResponse.assign(response, response + length);
+				count++;
+			}
+			return count;
+		}
+
+	protected:
+		void SetUp() override {
+			sendBatchLimit = 0;
+			sendBatchCalls = 0;
+			server.setupUdpSocket();
+			for(int& tester : testers) {
+				tester = socket(AF_INET, SOCK_DGRAM, 0);
+				struct sockaddr_in address = {};
+				address.sin_family = AF_INET;
+				address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+				ASSERT_EQ(bind(tester, (struct sockaddr*)&address, sizeof(address)), 0);
+			}
+		}
+
+		void TearDown() override {
+			sendBatchLimit = 0;
+			for(int tester : testers) {
+				close(tester);
+			}
+			server.closeUdpSocket();
+		}
+};
+
+/*
+* Checks if every request of a burst is answered exactly once, to its sender,
+* with one recvmmsg() and one sendmmsg() call
+*/
+TEST_F(DoIPServerUdpTest, AnswersEveryRequestOfBurst) {
+	sendRequests(12);
+	ASSERT_GT(server.receiveUdpMessage(), 0);
+	ASSERT_EQ(sendBatchCalls, 1);
+
+	for(int tester : testers) {
+		ASSERT_EQ(receiveResponses(tester), 3);
+	}
+}
+
+/*
+* Checks if the responses which sendmmsg() did not send are sent with further calls
+*/
+TEST_F(DoIPServerUdpTest, SendsRestOfPartialBatch) {
+	sendBatchLimit = 5;
+	sendRequests(12);
+	int sentBytes = server.receiveUdpMessage();
+	ASSERT_EQ(sendBatchCalls, 3);
+
+	for(int tester : testers) {
+		ASSERT_EQ(receiveResponses(tester), 3);
+	}
+	ASSERT_EQ(sentBytes, (int)(12 * firstResponse.size()));
+}
+
+/*
+* Checks if requests are answered with the values which were set last,
+* although the previous frames were released
+*/
+TEST_F(DoIPServerUdpTest, AnswersWithCurrentVehicleIdentification) {
+	server.setVIN("WAUZZZ00000000001");
+	server.setVIN("WAUZZZ00000000002");
+	sendRequests(1);
+	ASSERT_GT(server.receiveUdpMessage(), 0);
+	ASSERT_EQ(receiveResponses(testers[0]), 1);
+
+	std::string vin(firstResponse.begin() + _GenericHeaderLength + _VIResponseVINOffset,
+		firstResponse.begin() + _GenericHeaderLength + _VIResponseVINOffset + 17);
+	ASSERT_EQ(vin, "WAUZZZ00000000002");
+}
+
+/*
+* Checks if requests which are answered while another thread replaces the
+* frame get one of the complete frames
+*/
+TEST_F(DoIPServerUdpTest, AnswersWhileVehicleIdentificationChanges) {
+	server.setVIN("WAUZZZ00000000001");
+	std::atomic<bool> running{true};
+	std::thread writer([this, &running]() {
+		for(int i = 0; running; i++) {
+			server.setVIN(i % 2 == 0 ? "WAUZZZ00000000001" : "WAUZZZ00000000002");
+		}
+	});
+
+	//the writer is joined before the test fails
+	for(int round = 0; round < 200 && !HasFailure(); round++) {
+		sendRequests(4);
+		EXPECT_GT(server.receiveUdpMessage(), 0);
+		for(int tester : testers) {
+			EXPECT_EQ(receiveResponses(tester), 1);
+			std::string vin(firstResponse.begin() + _GenericHeaderLength + _VIResponseVINOffset,
+				firstResponse.begin() + _GenericHeaderLength + _VIResponseVINOffset + 17);
+			EXPECT_TRUE(vin == "WAUZZZ00000000001" || vin == "WAUZZZ00000000002") << vin;
+		}
+	}
+
+	running = false;
+	writer.join();
+}
+
+/*
+* Checks if the entity status reports the configured connection limit
+*/
+TEST_F(DoIPServerUdpTest, ReportsConnectionLimitInEntityStatus) {
+	server.setMaxConnections(3);
+	unsigned char request[] = {0x02, 0xFD, 0x40, 0x01, 0x00, 0x00, 0x00, 0x00};
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(_ServerPort);
+	ASSERT_EQ(sendto(testers[0], request, sizeof(request), 0, (struct sockaddr*)&address, sizeof(address)), (ssize_t)sizeof(request));
+	ASSERT_GT(server.receiveUdpMessage(), 0);
+
+	unsigned char response[_MaxUdpMessageLength];
+	ASSERT_EQ(recv(testers[0], response, sizeof(response), MSG_DONTWAIT), _GenericHeaderLength + _EntityStatusResponseLength);
+	ASSERT_EQ(response[3], 0x02);
+	ASSERT_EQ(response[_GenericHeaderLength + 1], 3) << "maximum number of concurrent sockets";
+	ASSERT_EQ(response[_GenericHeaderLength + 2], 0) << "currently open sockets";
+}
+
+/*
+* Checks if the vehicle announcements are sent on the calling thread when
+* the server does not run the event loop
+*/
+TEST_F(DoIPServerUdpTest, SendsAnnouncementsWithoutEventLoop) {
+	int listener = socket(AF_INET, SOCK_DGRAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(_AnnouncementPort);
+	ASSERT_EQ(bind(listener, (struct sockaddr*)&address, sizeof(address)), 0);
+
+	server.setA_DoIP_Announce_Num(2);
+	server.setA_DoIP_Announce_Interval(10);
+	int sentBytes = server.sendVehicleAnnouncement();
+
+	int received = receiveResponses(listener);
+	close(listener);
+	ASSERT_EQ(sentBytes, (int)(_GenericHeaderLength + _VIResponseLength));
+	ASSERT_EQ(received, 2);
+}
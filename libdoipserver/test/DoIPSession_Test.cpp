@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "DoIPSession.h"
+#include "DoIPAsyncClient.h"
+#include <future>
+#include <thread>
+#include <vector>
+
+static DoIPTask<int> addLater(int first, int second) {
+	co_return first + second;
+}
+
+static DoIPTask<int> sumOfSums() {
+	int sum = co_await addLater(1, 2);
+	sum += co_await addLater(3, 4);
+	co_return sum;
+}
+
+/*
+* Checks if awaited tasks return their results and a detached task releases
+* its frame, which the next task of the same size reuses
+*/
+TEST(DoIPTaskTest, AwaitsResultsAndRecyclesFrames) {
+	int result = 0;
+	auto run = [&result]() -> DoIPTask<> {
+		result = co_await sumOfSums();
+	};
+	run().detach();
+	ASSERT_EQ(result, 10);
+
+	void* frame = CoroutineFrameAllocator::allocate(180);
+	CoroutineFrameAllocator::deallocate(frame, 180);
+	ASSERT_EQ(CoroutineFrameAllocator::allocate(190), frame) << "frames of the same size class are reused";
+	CoroutineFrameAllocator::deallocate(frame, 190);
+}
+
+/*
+* Checks if session coroutines on the event loop answer the requests which
+* a client coroutine awaits, and see the end of the session when the tester
+* closes the connection
+*/
+TEST(DoIPSessionTest, ServesClientCoroutine) {
+	DoIPServer server;
+	server.setLogicalGatewayAddress(0x0028);
+	std::atomic<int> closedSessions{0};
+	DoIPSessionServer sessions(server, [&closedSessions](std::shared_ptr<DoIPSession> session) -> DoIPTask<> {
+		while(std::optional<SessionRequest> request = co_await session->nextDiagnostic()) {
+			std::vector<unsigned char> response(request->data.data(), request->data.data() + request->data.size());
+			response[0] += 0x40;
+			int sent = co_await session->send(request->targetAddress, response.data(), response.size());
+			EXPECT_GT(sent, 0);
+		}
+		closedSessions++;
+	});
+	server.setupTcpSocket();
+	ASSERT_TRUE(server.setupEventLoop());
+	std::thread loop([&server]() { server.runEventLoop(); });
+
+	DoIPAsyncClient client;
+	ASSERT_TRUE(client.connect("127.0.0.1", 0x0E00));
+
+	std::promise<std::vector<unsigned char>> finished;
+	auto requests = [&client, &finished]() -> DoIPTask<> {
+		std::vector<unsigned char> services;
+		for(unsigned char service = 0x10; service < 0x13; service++) {
+			unsigned char data[] = { service, 0x01 };
+			DiagnosticResponse response = co_await client.request(0x0028, data, sizeof(data));
+			if(response.status == RESPONSERECEIVED) {
+				services.push_back(response.data[0]);
+			}
+		}
+		finished.set_value(services);
+	};
+	requests().detach();
+
+	std::future<std::vector<unsigned char>> result = finished.get_future();
+	ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+	ASSERT_EQ(result.get(), (std::vector<unsigned char>{0x50, 0x51, 0x52}));
+
+	client.close();
+	for(int i = 0; i < 100 && closedSessions == 0; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	server.stopEventLoop();
+	loop.join();
+	server.closeTcpSocket();
+	ASSERT_EQ(closedSessions, 1);
+	ASSERT_EQ(sessions.getSessionCount(), 0u);
+}
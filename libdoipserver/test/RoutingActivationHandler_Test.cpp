@@ -48,7 +48,7 @@ TEST_F(RoutingActivationTest, WrongAddressParsing) {
 	//Set wrong address in received message
 	request[8] = 0x0D;
 	request[9] = 0x00;
-	unsigned char result = parseRoutingActivation(request);
+	unsigned char result = parseRoutingActivation(&request[_GenericHeaderLength]);
 	ASSERT_EQ(result, 0x00) <<"Wrong address doesn't return correct response code";
 }
 
@@ -58,14 +58,26 @@ TEST_F(RoutingActivationTest, WrongAddressParsing) {
 TEST_F(RoutingActivationTest, UnknownActivationType) {
 	//Set wrong activation type
 	request[10] = 0xFF;
-	unsigned char result = parseRoutingActivation(request);
+	unsigned char result = parseRoutingActivation(&request[_GenericHeaderLength]);
 	ASSERT_EQ(result, 0x06);
 }
 
+/*
+* Checks if the source address is checked before the activation type, so an
+* unknown address with an unknown activation type leads to the code 0x00
+*/
+TEST_F(RoutingActivationTest, UnknownAddressBeforeActivationType) {
+	request[8] = 0x0D;
+	request[9] = 0x00;
+	request[10] = 0xFF;
+	unsigned char result = parseRoutingActivation(&request[_GenericHeaderLength]);
+	ASSERT_EQ(result, 0x00);
+}
+
 /*
 * Checks if a valid routing activation request leads to the correct routing activation code (0x10);
 */
 TEST_F(RoutingActivationTest, ValidRequest) {
-	unsigned char result = parseRoutingActivation(request);
+	unsigned char result = parseRoutingActivation(&request[_GenericHeaderLength]);
 	ASSERT_EQ(result, 0x10);
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "VehicleAnnouncementScheduler.h"
+#include <thread>
+
+class VehicleAnnouncementSchedulerTest : public ::testing::Test {
+	public:
+		TimerWheel wheel{1, 64};
+		int sent = 0;
+		VehicleAnnouncementScheduler scheduler{wheel, [this]() { sent++; return 40; }};
+
+	protected:
+		void SetUp() override {
+			scheduler.setAnnounceNum(3);
+			scheduler.setAnnounceInterval(20);
+		}
+
+		void advanceFor(int milliseconds) {
+			auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+			while(std::chrono::steady_clock::now() < end) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				wheel.advance();
+			}
+		}
+};
+
+/*
+* Checks if the configured number of announcements is sent and nothing more
+*/
+TEST_F(VehicleAnnouncementSchedulerTest, SendsConfiguredNumber) {
+	scheduler.start(0);
+	ASSERT_EQ(sent, 0) << "start() must not send on the calling thread";
+
+	advanceFor(150);
+	ASSERT_EQ(sent, 3);
+	ASSERT_EQ(scheduler.getRemainingAnnouncements(), 0);
+	ASSERT_EQ(wheel.getArmedCount(), 0u);
+}
+
+/*
+* Checks if the announcements keep the configured interval
+*/
+TEST_F(VehicleAnnouncementSchedulerTest, KeepsInterval) {
+	scheduler.setAnnounceInterval(200);
+	scheduler.start(0);
+
+	advanceFor(50);
+	ASSERT_EQ(sent, 1);
+	ASSERT_EQ(scheduler.getRemainingAnnouncements(), 2);
+}
+
+/*
+* Checks if the first announcement waits for A_DoIP_Announce_Wait,
+* which is chosen randomly up to 500 ms
+*/
+TEST_F(VehicleAnnouncementSchedulerTest, WaitsBeforeFirstAnnouncement) {
+	scheduler.start(200);
+	advanceFor(50);
+	ASSERT_EQ(sent, 0);
+
+	scheduler.start();
+	int wait = wheel.millisecondsUntilNextExpiry();
+	ASSERT_GE(wait, 0);
+	ASSERT_LE(wait, _MaxAnnounceWaitMs + 1);
+}
+
+/*
+* Checks if starting again, e.g. after an address change, restarts the sequence
+*/
+TEST_F(VehicleAnnouncementSchedulerTest, RestartRepeatsAnnouncements) {
+	scheduler.start(0);
+	advanceFor(150);
+	ASSERT_EQ(sent, 3);
+
+	scheduler.start(0);
+	advanceFor(150);
+	ASSERT_EQ(sent, 6);
+}
+
+/*
+* Checks if stopped announcements are not sent
+*/
+TEST_F(VehicleAnnouncementSchedulerTest, StopCancelsAnnouncements) {
+	scheduler.start(20);
+	scheduler.stop();
+	advanceFor(100);
+	ASSERT_EQ(sent, 0);
+	ASSERT_EQ(wheel.getArmedCount(), 0u);
+}
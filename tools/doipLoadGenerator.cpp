@@ -0,0 +1,418 @@
+#include "DoIPClient_h.h"
+#include "DoIPLogger.h"
+
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+const double _DrainTimeSeconds = 2.0;
+const int _ActivationTimeoutSeconds = 5;
+const long _MaxPollIntervalNs = 100 * 1000 * 1000;
+
+/*
+ * Size of the user data of a diagnostic request and how often it is sent relative to the other sizes
+ */
+struct RequestSize {
+    int length;
+    int weight;
+};
+
+struct LoadConfiguration {
+    std::string address = "127.0.0.1";
+    int port = _serverPortNr;
+    int testers = 1;
+    int threads = 0;
+    double durationSeconds = 10.0;
+    std::vector<RequestSize> requestSizes = { {3, 1} };
+    double rate = 0.0;                      //requests per second of every tester, 0 runs a closed loop
+    int thinkTimeMs = 0;                    //pause between response and next request in a closed loop
+    unsigned short targetAddress = 0x0028;
+    unsigned short firstSourceAddress = 0x0E00;
+};
+
+/*
+ * One tester connection with the send times of its unanswered requests.
+ * The server answers the requests of a connection in order.
+ */
+struct Tester {
+    DoIPClient client;
+    unsigned short sourceAddress = 0;
+    bool active = false;
+    std::deque<Clock::time_point> outstanding;
+    Clock::time_point nextSend;
+};
+
+struct WorkerResult {
+    std::vector<uint64_t> latenciesNs;
+    uint64_t sentRequests = 0;
+    uint64_t sentBytes = 0;
+    uint64_t responses = 0;
+    uint64_t negativeAcks = 0;
+    uint64_t sendErrors = 0;
+    int activatedTesters = 0;
+    int failedTesters = 0;
+    int closedTesters = 0;
+};
+
+/*
+ * Connects and activates the testers of one worker, then waits for the common
+ * start time and drives the requests of all its testers with one poll loop
+ */
+static void runWorker(const LoadConfiguration& config, int firstTester, int testerCount,
+                      std::shared_future<Clock::time_point> startSignal, std::promise<void> ready, WorkerResult& result) {
+
+    std::vector<std::unique_ptr<Tester>> testers;
+    for(int i = 0; i < testerCount; i++) {
+        std::unique_ptr<Tester> tester(new Tester);
+        tester->sourceAddress = (unsigned short)(config.firstSourceAddress + firstTester + i);
+        unsigned char address[2] = { (unsigned char)(tester->sourceAddress >> 8), (unsigned char)(tester->sourceAddress & 0xFF) };
+        tester->client.setSourceAddress(address);
+        tester->client.startTcpConnection(config.address.c_str(), config.port);
+
+        struct timeval timeout = { _ActivationTimeoutSeconds, 0 };
+        setsockopt(tester->client.getSockFd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        tester->client.sendRoutingActivationRequest();
+        int responseCode = tester->client.receiveRoutingActivationResponse();
+        if(responseCode == _RoutingActivationSuccessCode) {
+            tester->active = true;
+            result.activatedTesters++;
+        } else {
+            fprintf(stderr, "tester 0x%04X: routing activation failed with code %d\n", tester->sourceAddress, responseCode);
+            tester->client.closeTcpConnection();
+            result.failedTesters++;
+        }
+        testers.push_back(std::move(tester));
+    }
+
+    ready.set_value();
+    Clock::time_point start = startSignal.get();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.durationSeconds));
+    Clock::time_point drainEnd = end + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(_DrainTimeSeconds));
+
+    bool openLoop = config.rate > 0.0;
+    Clock::duration interval = openLoop ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / config.rate))
+                                        : Clock::duration::zero();
+    Clock::duration thinkTime = std::chrono::milliseconds(config.thinkTimeMs);
+
+    std::mt19937 random(firstTester + 1);
+    std::vector<int> weights;
+    std::vector<std::vector<unsigned char>> requests;
+    for(const RequestSize& size : config.requestSizes) {
+        weights.push_back(size.weight);
+        //ReadDataByIdentifier 0xF190, the example server answers it with a positive response
+        std::vector<unsigned char> request(size.length, 0x00);
+        unsigned char service[] = { 0x22, 0xF1, 0x90 };
+        std::copy(service, service + std::min<size_t>(sizeof(service), request.size()), request.begin());
+        requests.push_back(request);
+    }
+    std::discrete_distribution<int> requestChoice(weights.begin(), weights.end());
+    unsigned char targetAddress[2] = { (unsigned char)(config.targetAddress >> 8), (unsigned char)(config.targetAddress & 0xFF) };
+
+    std::vector<struct pollfd> pollList(testers.size());
+    for(size_t i = 0; i < testers.size(); i++) {
+        Tester* tester = testers[i].get();
+        pollList[i].fd = tester->active ? tester->client.getSockFd() : -1;
+        pollList[i].events = POLLIN;
+
+        //spread the first requests of an open loop over one interval
+        tester->nextSend = start;
+        if(openLoop) {
+            tester->nextSend += std::chrono::duration_cast<Clock::duration>(interval * std::uniform_real_distribution<double>(0.0, 1.0)(random));
+        }
+
+        tester->client.setDiagnosticMessageCallback([tester, &result, end, thinkTime, openLoop](unsigned short, unsigned char*, int) {
+            if(tester->outstanding.empty()) {
+                return;
+            }
+            Clock::time_point now = Clock::now();
+            Clock::time_point sent = tester->outstanding.front();
+            tester->outstanding.pop_front();
+            if(sent < end) {
+                result.latenciesNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent).count());
+                result.responses++;
+            }
+            if(!openLoop) {
+                tester->nextSend = now + thinkTime;
+            }
+        });
+        tester->client.setDiagnosticAckCallback([tester, &result, end, thinkTime, openLoop](unsigned short, bool ackType, unsigned char) {
+            //a rejected request is not answered with a diagnostic message
+            if(ackType || tester->outstanding.empty()) {
+                return;
+            }
+            Clock::time_point sent = tester->outstanding.front();
+            tester->outstanding.pop_front();
+            if(sent < end) {
+                result.negativeAcks++;
+            }
+            if(!openLoop) {
+                tester->nextSend = Clock::now() + thinkTime;
+            }
+        });
+    }
+
+    while(true) {
+        Clock::time_point now = Clock::now();
+        bool sending = now < end;
+        bool pending = false;
+        Clock::time_point wakeup = sending ? end : drainEnd;
+
+        for(size_t i = 0; i < testers.size(); i++) {
+            Tester* tester = testers[i].get();
+            if(!tester->active) {
+                continue;
+            }
+
+            //a closed loop waits for the response before the next request is sent
+            while(sending && tester->nextSend <= now && (openLoop || tester->outstanding.empty())) {
+                std::vector<unsigned char>& request = requests[requestChoice(random)];
+                struct iovec userData = { request.data(), request.size() };
+                if(tester->client.sendDiagnosticMessage(targetAddress, &userData, 1) < 0) {
+                    result.sendErrors++;
+                    tester->active = false;
+                    pollList[i].fd = -1;
+                    break;
+                }
+                tester->outstanding.push_back(openLoop ? tester->nextSend : now);
+                result.sentRequests++;
+                result.sentBytes += request.size();
+                tester->nextSend = openLoop ? tester->nextSend + interval : Clock::time_point::max();
+            }
+
+            pending = pending || !tester->outstanding.empty();
+            if(sending && tester->nextSend < wakeup) {
+                wakeup = tester->nextSend;
+            }
+        }
+
+        if((!sending && !pending) || now >= drainEnd) {
+            break;
+        }
+
+        long waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeup - now).count();
+        waitNs = std::max(0L, std::min(waitNs, _MaxPollIntervalNs));
+        struct timespec timeout = { 0, waitNs };
+        if(ppoll(pollList.data(), pollList.size(), &timeout, nullptr) <= 0) {
+            continue;
+        }
+
+        for(size_t i = 0; i < testers.size(); i++) {
+            if(pollList[i].fd < 0 || pollList[i].revents == 0) {
+                continue;
+            }
+            if(testers[i]->client.receiveMessage() <= 0) {
+                //the server closed the connection, unanswered requests are reported as lost
+                testers[i]->active = false;
+                testers[i]->outstanding.clear();
+                pollList[i].fd = -1;
+                result.closedTesters++;
+            }
+        }
+    }
+
+    for(std::unique_ptr<Tester>& tester : testers) {
+        if(tester->active) {
+            tester->client.closeTcpConnection();
+        }
+    }
+}
+
+/*
+ * Parses a request mix like "3:70,64:20,4000:10", the weight defaults to 1
+ */
+static bool parseRequestSizes(const char* text, std::vector<RequestSize>& sizes) {
+    sizes.clear();
+    std::string list(text);
+    size_t position = 0;
+    while(position <= list.size()) {
+        size_t next = list.find(',', position);
+        std::string entry = list.substr(position, next == std::string::npos ? std::string::npos : next - position);
+        RequestSize size = { 0, 1 };
+        if(sscanf(entry.c_str(), "%d:%d", &size.length, &size.weight) < 1 || size.length < 1 || size.weight < 1) {
+            return false;
+        }
+        sizes.push_back(size);
+        if(next == std::string::npos) {
+            break;
+        }
+        position = next + 1;
+    }
+    return !sizes.empty();
+}
+
+/*
+ * Checks that the server accepts connections, DoIPClient retries forever otherwise
+ */
+static bool isServerReachable(const LoadConfiguration& config) {
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(config.port);
+    bool reachable = inet_aton(config.address.c_str(), &serverAddress.sin_addr) != 0 &&
+                     connect(probe, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) == 0;
+    close(probe);
+    return reachable;
+}
+
+static double percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    if(sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = (size_t)(fraction * sorted.size());
+    return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "Opens several tester connections to a DoIP server and measures diagnostic round trips.\n\n"
+           "  -a, --address ADDRESS        IPv4 address of the server (127.0.0.1)\n"
+           "  -p, --port PORT              TCP port of the server (13400)\n"
+           "  -n, --testers COUNT          number of concurrent tester connections (1)\n"
+           "  -j, --threads COUNT          worker threads which drive the testers (one per core)\n"
+           "  -d, --duration SECONDS       length of the measurement (10)\n"
+           "  -s, --sizes LENGTH:WEIGHT,.. user data lengths of the requests and their weights (3)\n"
+           "  -r, --rate REQUESTS          open loop: requests per second of every tester\n"
+           "  -t, --think-time MS          closed loop: pause between a response and the next request (0)\n"
+           "  -T, --target-address ADDR    logical address of the ECU (0x0028)\n"
+           "  -S, --source-address ADDR    address of the first tester, the others count up (0x0E00)\n"
+           "  -h, --help                   show this help\n\n"
+           "Without --rate every tester sends its next request when the previous one was answered.\n"
+           "With --rate the requests are sent on schedule and the latency counts from the scheduled time.\n"
+           "The default address admission policy of the server admits 512 testers from 0x0E00.\n", program);
+}
+
+int main(int argc, char** argv) {
+    LoadConfiguration config;
+
+    const struct option options[] = {
+        { "address",        required_argument, nullptr, 'a' },
+        { "port",           required_argument, nullptr, 'p' },
+        { "testers",        required_argument, nullptr, 'n' },
+        { "threads",        required_argument, nullptr, 'j' },
+        { "duration",       required_argument, nullptr, 'd' },
+        { "sizes",          required_argument, nullptr, 's' },
+        { "rate",           required_argument, nullptr, 'r' },
+        { "think-time",     required_argument, nullptr, 't' },
+        { "target-address", required_argument, nullptr, 'T' },
+        { "source-address", required_argument, nullptr, 'S' },
+        { "help",           no_argument,       nullptr, 'h' },
+        { nullptr,          0,                 nullptr, 0 }
+    };
+
+    int option;
+    while((option = getopt_long(argc, argv, "a:p:n:j:d:s:r:t:T:S:h", options, nullptr)) != -1) {
+        switch(option) {
+            case 'a': config.address = optarg; break;
+            case 'p': config.port = atoi(optarg); break;
+            case 'n': config.testers = atoi(optarg); break;
+            case 'j': config.threads = atoi(optarg); break;
+            case 'd': config.durationSeconds = atof(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 't': config.thinkTimeMs = atoi(optarg); break;
+            case 'T': config.targetAddress = (unsigned short)strtoul(optarg, nullptr, 0); break;
+            case 'S': config.firstSourceAddress = (unsigned short)strtoul(optarg, nullptr, 0); break;
+            case 's':
+                if(!parseRequestSizes(optarg, config.requestSizes)) {
+                    fprintf(stderr, "invalid request sizes: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(config.testers < 1 || config.durationSeconds <= 0.0 || config.rate < 0.0 || config.thinkTimeMs < 0 ||
+       config.firstSourceAddress + config.testers - 1 > 0xFFFF) {
+        fprintf(stderr, "invalid arguments\n");
+        printUsage(argv[0]);
+        return 1;
+    }
+    if(config.threads < 1) {
+        config.threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    config.threads = std::min(config.threads, config.testers);
+
+    if(!isServerReachable(config)) {
+        fprintf(stderr, "no DoIP server is listening on %s:%d\n", config.address.c_str(), config.port);
+        return 1;
+    }
+
+    //the per message output of the library would slow down the testers
+    DoIPLogger::instance().setLevel(LogLevel::WARNING);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::promise<Clock::time_point> startPromise;
+    std::shared_future<Clock::time_point> startSignal = startPromise.get_future().share();
+    std::vector<WorkerResult> results(config.threads);
+    std::vector<std::future<void>> readySignals;
+    std::vector<std::thread> workers;
+
+    int firstTester = 0;
+    for(int i = 0; i < config.threads; i++) {
+        int testerCount = config.testers / config.threads + (i < config.testers % config.threads ? 1 : 0);
+        std::promise<void> ready;
+        readySignals.push_back(ready.get_future());
+        workers.push_back(std::thread(runWorker, std::cref(config), firstTester, testerCount, startSignal,
+                                      std::move(ready), std::ref(results[i])));
+        firstTester += testerCount;
+    }
+
+    for(std::future<void>& ready : readySignals) {
+        ready.wait();
+    }
+    startPromise.set_value(Clock::now());
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+
+    WorkerResult total;
+    for(WorkerResult& result : results) {
+        total.latenciesNs.insert(total.latenciesNs.end(), result.latenciesNs.begin(), result.latenciesNs.end());
+        total.sentRequests += result.sentRequests;
+        total.sentBytes += result.sentBytes;
+        total.responses += result.responses;
+        total.negativeAcks += result.negativeAcks;
+        total.sendErrors += result.sendErrors;
+        total.activatedTesters += result.activatedTesters;
+        total.failedTesters += result.failedTesters;
+        total.closedTesters += result.closedTesters;
+    }
+    std::sort(total.latenciesNs.begin(), total.latenciesNs.end());
+    uint64_t answered = total.responses + total.negativeAcks;
+
+    printf("testers:     %d activated, %d failed, %d closed by the server\n",
+           total.activatedTesters, total.failedTesters, total.closedTesters);
+    if(config.rate > 0.0) {
+        printf("load:        open loop, %.1f requests/s per tester, %d threads\n", config.rate, config.threads);
+    } else {
+        printf("load:        closed loop, %d ms think time, %d threads\n", config.thinkTimeMs, config.threads);
+    }
+    printf("requests:    %lu sent, %lu answered, %lu negative acks, %lu unanswered, %lu send errors\n",
+           (unsigned long)total.sentRequests, (unsigned long)total.responses, (unsigned long)total.negativeAcks,
+           (unsigned long)(total.sentRequests - std::min(answered, total.sentRequests)), (unsigned long)total.sendErrors);
+    printf("throughput:  %.1f requests/s, %.2f MB/s user data\n",
+           total.responses / config.durationSeconds, total.sentBytes / config.durationSeconds / 1e6);
+    printf("latency us:  min %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentile(total.latenciesNs, 0.0), percentile(total.latenciesNs, 0.5), percentile(total.latenciesNs, 0.99),
+           percentile(total.latenciesNs, 0.999), percentile(total.latenciesNs, 1.0));
+
+    return total.activatedTesters > 0 ? 0 : 1;
+}
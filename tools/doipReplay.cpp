@@ -0,0 +1,378 @@
+#include "DoIPCapture.h"
+#include "DoIPConnection.h"
+#include "DoIPFrameDecoder.h"
+#include "DoIPLogger.h"
+#include "DoIPMetrics.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+
+enum ReplayMode {
+    REPLAYPARSE,        //the frames are decoded with parseGenericHeader only
+    REPLAYSERVER        //the tester data is processed by server connections
+};
+
+struct ReplayConfiguration {
+    std::string capture;
+    ReplayMode mode = REPLAYPARSE;
+    bool originalTiming = false;
+    double speed = 1.0;                     //with the original timing, 2 replays twice as fast
+    int loops = 1;
+    uint16_t port = _CaptureDoIPPort;
+    unsigned short gatewayAddress = 0x0028;
+};
+
+/*
+ * Decoder of one direction of a connection. Processing time of chunks
+ * which end inside a message is carried over to the message.
+ */
+struct ReplayStream {
+    DoIPFrameDecoder decoder;
+    uint64_t carriedNs = 0;
+};
+
+/*
+ * Server connection which gets the tester data of a captured connection.
+ * The tester end of the socket pair reads the responses.
+ */
+struct ReplayConnection {
+    std::unique_ptr<DoIPConnection> connection;
+    int testerSocket = -1;
+    bool closedByServer = false;
+    uint64_t carriedNs = 0;
+};
+
+struct ReplayResult {
+    uint64_t messages[_PayloadTypeCount] = {};
+    uint64_t messageCount = 0;
+    uint64_t messageBytes = 0;
+    uint64_t udpDatagrams = 0;
+    uint64_t gaps = 0;
+    uint64_t decodeErrors = 0;
+    uint64_t recordedResponseBytes = 0;     //sent by the server in the capture, not replayed in server mode
+    uint64_t responseBytes = 0;             //sent by the replaying server connections
+    uint64_t closedByServer = 0;
+    uint64_t processingNs = 0;
+    LatencyHistogram cost;                  //processing time per message
+};
+
+static uint64_t elapsedNs(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/*
+ * Spreads the processing time of a chunk over the messages it completed
+ */
+static void recordCost(ReplayResult& result, uint64_t& carriedNs, uint64_t chunkNs, uint64_t messages) {
+    result.processingNs += chunkNs;
+    carriedNs += chunkNs;
+    if(messages == 0) {
+        return;
+    }
+    for(uint64_t i = 0; i < messages; i++) {
+        result.cost.record(carriedNs / messages);
+    }
+    carriedNs = 0;
+}
+
+/*
+ * Decodes a chunk into frames, counting them by payload type
+ */
+static void decodeChunk(ReplayStream& stream, const CaptureChunk& chunk, ReplayResult& result) {
+    if(chunk.gap) {
+        result.gaps++;
+        stream.decoder.reset();
+    }
+    uint64_t messages = 0;
+    Clock::time_point start = Clock::now();
+    stream.decoder.feed(chunk.data, chunk.length, [&messages, &result](const DoIPFrame& frame) {
+        messages++;
+        result.messages[frame.action.type]++;
+        result.messageBytes += _GenericHeaderLength + frame.action.payloadLength;
+        return true;
+    });
+    recordCost(result, stream.carriedNs, elapsedNs(start), messages);
+    result.messageCount += messages;
+
+    //a broken stream is decoded again from the next chunk
+    if(stream.decoder.isFailed()) {
+        result.decodeErrors++;
+        stream.decoder.reset();
+    }
+}
+
+/*
+ * Reads what the server connection sent to the tester, so its socket never fills up
+ */
+static void drainResponses(ReplayConnection& replay, ReplayResult& result) {
+    unsigned char buffer[_ReceiveChunkSize];
+    while(true) {
+        ssize_t readBytes = recv(replay.testerSocket, buffer, sizeof(buffer), 0);
+        if(readBytes <= 0) {
+            break;
+        }
+        result.responseBytes += readBytes;
+    }
+    if(!replay.closedByServer && replay.connection->getQueuedBytes() > 0) {
+        replay.connection->flushSendQueue();
+    }
+}
+
+static ReplayConnection* openConnection(std::unordered_map<uint64_t, ReplayConnection>& connections, uint64_t connectionId,
+                                        const ReplayConfiguration& config) {
+    int sockets[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) < 0) {
+        perror("socketpair");
+        return nullptr;
+    }
+    ReplayConnection& replay = connections[connectionId];
+    replay.testerSocket = sockets[1];
+    replay.connection.reset(new DoIPConnection(sockets[0], config.gatewayAddress));
+    ReplayConnection* replayPointer = &replay;
+    //every target is acknowledged, like a routing table which knows all of them
+    replay.connection->setCallback(
+        [](unsigned short, unsigned char*, int) { },
+        [replayPointer](unsigned short targetAddress) {
+            replayPointer->connection->sendDiagnosticAck(targetAddress, true, _ValidDiagnosticMessageCode);
+            return true;
+        },
+        [replayPointer]() { replayPointer->closedByServer = true; });
+    replay.connection->setGeneralInactivityTime(0);
+    return &replay;
+}
+
+static void closeConnection(std::unordered_map<uint64_t, ReplayConnection>& connections, uint64_t connectionId, ReplayResult& result) {
+    auto it = connections.find(connectionId);
+    if(it == connections.end()) {
+        return;
+    }
+    ReplayConnection& replay = it->second;
+    if(replay.closedByServer) {
+        result.closedByServer++;
+    } else {
+        replay.connection->processReceivedData(nullptr, 0);
+    }
+    drainResponses(replay, result);
+    close(replay.testerSocket);
+    connections.erase(it);
+}
+
+/*
+ * Passes the data of the tester to its server connection like the event loop does after a read
+ */
+static void processChunk(ReplayConnection& replay, const CaptureChunk& chunk, ReplayResult& result) {
+    if(chunk.gap) {
+        result.gaps++;
+    }
+    if(replay.closedByServer) {
+        return;
+    }
+    Clock::time_point start = Clock::now();
+    int messages = replay.connection->processReceivedData(chunk.data, chunk.length);
+    recordCost(result, replay.carriedNs, elapsedNs(start), messages > 0 ? messages : 0);
+    if(messages > 0) {
+        result.messageCount += messages;
+    }
+    drainResponses(replay, result);
+}
+
+/*
+ * Replays the capture once
+ */
+static void replayCapture(CaptureReader& reader, const ReplayConfiguration& config, ReplayResult& result,
+                          uint64_t& tcpConnections, uint64_t& retransmittedBytes, uint64_t& missingBytes) {
+    CaptureReassembler reassembler(config.port);
+    std::unordered_map<uint64_t, ReplayStream> streams;
+    std::unordered_map<uint64_t, ReplayConnection> connections;
+    ReplayStream datagrams;
+
+    Clock::time_point replayStart = Clock::now();
+    uint64_t firstTimestamp = 0;
+
+    CaptureChunkCallback onChunk = [&](const CaptureChunk& chunk) {
+        if(config.originalTiming && chunk.timestamp > 0) {
+            if(firstTimestamp == 0) {
+                firstTimestamp = chunk.timestamp;
+            }
+            uint64_t offsetNs = (uint64_t)((chunk.timestamp - std::min(firstTimestamp, chunk.timestamp)) / config.speed);
+            std::this_thread::sleep_until(replayStart + std::chrono::nanoseconds(offsetNs));
+        }
+
+        if(chunk.protocol == CAPTUREUDP) {
+            //every datagram carries complete messages
+            result.udpDatagrams++;
+            datagrams.decoder.reset();
+            decodeChunk(datagrams, chunk, result);
+            return;
+        }
+
+        if(chunk.closed) {
+            streams.erase(chunk.connectionId * 2);
+            streams.erase(chunk.connectionId * 2 + 1);
+            closeConnection(connections, chunk.connectionId, result);
+            return;
+        }
+
+        if(config.mode == REPLAYPARSE) {
+            decodeChunk(streams[chunk.connectionId * 2 + (chunk.toServer ? 1 : 0)], chunk, result);
+            return;
+        }
+
+        if(!chunk.toServer) {
+            result.recordedResponseBytes += chunk.length;
+            return;
+        }
+        auto it = connections.find(chunk.connectionId);
+        ReplayConnection* replay = it != connections.end() ? &it->second : openConnection(connections, chunk.connectionId, config);
+        if(replay != nullptr) {
+            processChunk(*replay, chunk, result);
+        }
+    };
+
+    CapturedPacket packet;
+    while(reader.next(packet)) {
+        reassembler.add(packet, onChunk);
+    }
+    reassembler.finish(onChunk);
+
+    tcpConnections += reassembler.getConnectionCount();
+    retransmittedBytes += reassembler.getRetransmittedBytes();
+    missingBytes += reassembler.getMissingBytes();
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options] CAPTURE\n"
+           "Replays the DoIP traffic of a pcap or pcapng file offline and measures the processing cost per message.\n\n"
+           "  -m, --mode parse|server      decode the frames only, or process the tester data with server connections (parse)\n"
+           "  -t, --timing fast|original   replay as fast as possible or with the gaps of the capture (fast)\n"
+           "  -x, --speed FACTOR           speed up the original timing, 2 replays twice as fast (1)\n"
+           "  -l, --loops COUNT            replay the capture several times (1)\n"
+           "  -p, --port PORT              TCP and UDP port of the DoIP server in the capture (13400)\n"
+           "  -g, --gateway-address ADDR   logical address of the replaying server (0x0028)\n"
+           "  -h, --help                   show this help\n\n"
+           "TCP streams are reassembled, retransmissions are dropped and lost data is reported as gap.\n"
+           "In server mode every captured connection is replayed into a DoIPConnection over a socket pair,\n"
+           "the responses of the capture are counted but not compared. UDP datagrams are always decoded only.\n", program);
+}
+
+int main(int argc, char** argv) {
+    ReplayConfiguration config;
+
+    const struct option options[] = {
+        { "mode",            required_argument, nullptr, 'm' },
+        { "timing",          required_argument, nullptr, 't' },
+        { "speed",           required_argument, nullptr, 'x' },
+        { "loops",           required_argument, nullptr, 'l' },
+        { "port",            required_argument, nullptr, 'p' },
+        { "gateway-address", required_argument, nullptr, 'g' },
+        { "help",            no_argument,       nullptr, 'h' },
+        { nullptr,           0,                 nullptr, 0 }
+    };
+
+    int option;
+    while((option = getopt_long(argc, argv, "m:t:x:l:p:g:h", options, nullptr)) != -1) {
+        switch(option) {
+            case 'm':
+                if(strcmp(optarg, "parse") == 0) {
+                    config.mode = REPLAYPARSE;
+                } else if(strcmp(optarg, "server") == 0) {
+                    config.mode = REPLAYSERVER;
+                } else {
+                    fprintf(stderr, "invalid mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                if(strcmp(optarg, "fast") != 0 && strcmp(optarg, "original") != 0) {
+                    fprintf(stderr, "invalid timing: %s\n", optarg);
+                    return 1;
+                }
+                config.originalTiming = strcmp(optarg, "original") == 0;
+                break;
+            case 'x': config.speed = atof(optarg); break;
+            case 'l': config.loops = atoi(optarg); break;
+            case 'p': config.port = (uint16_t)atoi(optarg); break;
+            case 'g': config.gatewayAddress = (unsigned short)strtoul(optarg, nullptr, 0); break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(optind != argc - 1 || config.speed <= 0.0 || config.loops < 1 || config.port == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        printUsage(argv[0]);
+        return 1;
+    }
+    config.capture = argv[optind];
+
+    //the per message output of the library would dominate the measured cost
+    DoIPLogger::instance().setLevel(LogLevel::WARNING);
+    signal(SIGPIPE, SIG_IGN);
+
+    CaptureReader reader;
+    if(!reader.open(config.capture, config.port)) {
+        fprintf(stderr, "could not read capture %s\n", config.capture.c_str());
+        return 1;
+    }
+
+    ReplayResult result;
+    uint64_t tcpConnections = 0;
+    uint64_t retransmittedBytes = 0;
+    uint64_t missingBytes = 0;
+    Clock::time_point start = Clock::now();
+    for(int loop = 0; loop < config.loops; loop++) {
+        reader.rewind();
+        replayCapture(reader, config, result, tcpConnections, retransmittedBytes, missingBytes);
+    }
+    double wallSeconds = elapsedNs(start) / 1e9;
+    double processingSeconds = result.processingNs / 1e9;
+
+    //the server connections count their messages by payload type in the metrics of the library
+    if(config.mode == REPLAYSERVER) {
+        MetricsSnapshot metrics = DoIPMetrics::instance().snapshot();
+        for(int type = 0; type < _PayloadTypeCount; type++) {
+            result.messages[type] += metrics.messagesIn[type];
+            result.messageBytes += metrics.bytesIn[type];
+        }
+    }
+    LatencySnapshot cost;
+    cost.merge(result.cost);
+
+    printf("capture:     %lu packets, %lu DoIP packets, %lu tcp connections, %lu udp datagrams\n",
+           (unsigned long)reader.getPacketCount(), (unsigned long)(reader.getPacketCount() - reader.getSkippedPackets()),
+           (unsigned long)tcpConnections, (unsigned long)result.udpDatagrams);
+    printf("reassembly:  %lu bytes retransmitted, %lu bytes missing, %lu gaps, %lu decode errors\n",
+           (unsigned long)retransmittedBytes, (unsigned long)missingBytes, (unsigned long)result.gaps, (unsigned long)result.decodeErrors);
+    printf("messages:    %lu", (unsigned long)result.messageCount);
+    for(int type = 0; type < _PayloadTypeCount; type++) {
+        if(result.messages[type] > 0) {
+            printf(", 0x%04X: %lu", getPayloadTypeCode(static_cast<PayloadType>(type)), (unsigned long)result.messages[type]);
+        }
+    }
+    printf("\n");
+    if(config.mode == REPLAYSERVER) {
+        printf("server:      %lu bytes sent, %lu bytes in the capture, %lu connections closed by the server\n",
+               (unsigned long)result.responseBytes, (unsigned long)result.recordedResponseBytes, (unsigned long)result.closedByServer);
+    }
+    printf("throughput:  %.1f messages/s, %.2f MB/s while processing, %.3f s processing, %.3f s replay\n",
+           processingSeconds > 0.0 ? result.messageCount / processingSeconds : 0.0,
+           processingSeconds > 0.0 ? result.messageBytes / processingSeconds / 1e6 : 0.0, processingSeconds, wallSeconds);
+    printf("cost ns:     mean %.0f  p50 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+           cost.mean(), (unsigned long)cost.percentile(50.0), (unsigned long)cost.percentile(99.0),
+           (unsigned long)cost.percentile(99.9), (unsigned long)cost.maximum);
+
+    return result.messageCount > 0 ? 0 : 1;
+}